@@ -10,6 +10,12 @@ Rectangle {
     property string imagePath: ""
     property real minValue: 0
     property real maxValue: 255
+    // Intervallo dello stretch adattivo della viewport, se attivo
+    property bool stretchActive: false
+    property real stretchMin: 0
+    property real stretchMax: 0
+    readonly property real shownMin: stretchActive ? stretchMin : minValue
+    readonly property real shownMax: stretchActive ? stretchMax : maxValue
     property var processor: null
     
     color: "#252525"
@@ -18,6 +24,9 @@ Rectangle {
     onImagePathChanged: {
         if (imagePath !== "" && processor !== null) {
             updateStatistics()
+        } else if (processor !== null) {
+            processor.cancelStatistics(statisticsChannel)
+            pendingStatistics = 0
         }
     }
     
@@ -27,18 +36,35 @@ Rectangle {
         }
     }
     
+    // Handle della richiesta in corso e canale di questa legenda: una nuova
+    // richiesta sul canale annulla quella precedente nel processor
+    property int pendingStatistics: 0
+    readonly property string statisticsChannel: "legend-" + Math.random().toString(36).substring(2)
+    
+    Component.onDestruction: {
+        if (processor !== null) {
+            processor.cancelStatistics(statisticsChannel)
+        }
+    }
+    
     function updateStatistics() {
         if (processor === null || imagePath === "") return
         
-        try {
-            var stats = processor.getImageStatistics(imagePath)
-            if (stats.valid) {
-                minValue = stats.min
-                maxValue = stats.max
-                console.log("ColorLegend updated stats - Min:", minValue, "Max:", maxValue)
+        // Asincrona: il calcolo gira nel pool del processor, il risultato
+        // arriva con statisticsReady (dalla cache se già calcolato)
+        pendingStatistics = processor.requestStatistics(imagePath, statisticsChannel)
+    }
+    
+    Connections {
+        target: root.processor
+        function onStatisticsReady(handle, path, valid, min, max, mean, stdDev) {
+            if (handle !== root.pendingStatistics) return
+            root.pendingStatistics = 0
+            if (valid) {
+                root.minValue = min
+                root.maxValue = max
+                console.log("ColorLegend updated stats - Min:", min, "Max:", max)
             }
-        } catch (e) {
-            console.error("Error getting statistics:", e)
         }
     }
     
@@ -72,7 +98,7 @@ Rectangle {
         
         // Max value
         Label {
-            text: formatValue(maxValue)
+            text: formatValue(shownMax)
             font.pixelSize: 8
             color: "#aaaaaa"
             Layout.alignment: Qt.AlignHCenter
@@ -114,7 +140,7 @@ Rectangle {
                             anchors.bottom: parent.bottom
                             anchors.right: parent.right
                             anchors.rightMargin: -25
-                            text: formatValue(maxValue - (maxValue - minValue) * (index + 1) / 4)
+                            text: formatValue(shownMax - (shownMax - shownMin) * (index + 1) / 4)
                             font.pixelSize: 7
                             color: "#888888"
                         }
@@ -125,7 +151,7 @@ Rectangle {
         
         // Min value
         Label {
-            text: formatValue(minValue)
+            text: formatValue(shownMin)
             font.pixelSize: 8
             color: "#aaaaaa"
             Layout.alignment: Qt.AlignHCenter
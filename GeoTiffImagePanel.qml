@@ -3,6 +3,7 @@ import QtQuick.Controls
 import QtQuick.Layouts
 import QtQuick.Dialogs
 import QtQuick.Window
+import GeoTiffProcessor
 
 Item {
     id: root
@@ -12,7 +13,27 @@ Item {
     property string imagePath: ""
     property int currentColorMap: 0
     property var processor: null
-    property var histogramData: []
+    property bool histogramLogScale: false
+    property bool adaptiveStretch: false
+    // ROI per le statistiche: "" (off), "rect", "polygon"
+    property string roiMode: ""
+    // Resa del DSM: "" (colormap), "hillshade", "slope", "aspect"
+    property string renderMode: ""
+    property real lightAzimuth: 315
+    property real lightAltitude: 45
+    // Denoise in anteprima: "" (off), "median", "gaussian", "opening"; raggio 1..3
+    property string denoiseFilter: ""
+    property int denoiseRadius: 1
+    // Curve di livello: DSM di origine ("" = l'immagine del pannello), intervallo (0 = auto)
+    property bool contoursVisible: false
+    property string contourSource: ""
+    property real contourInterval: 0
+    // Shapefile di analisi (zip) disegnato sopra l'immagine
+    property string boundarySource: ""
+    property bool boundariesVisible: true
+    // Export a piena risoluzione in corso da questo pannello
+    property bool exporting: false
+    property real exportProgress: 0
     property var themeColors: ({
         panelColor: "#2a2a2a",
         borderColor: "#404040",
@@ -25,6 +46,17 @@ Item {
     
     signal imageChanged(string imagePath)
     
+    // Metadati dall'header del raster (DatasetCatalog), senza riaprire il dataset
+    RasterMetadata {
+        id: metadata
+        source: root.imagePath
+    }
+    
+    // Conteggi dell'istogramma, riempiti in streaming da processor.streamHistogram
+    HistogramBuffer {
+        id: histogramBuffer
+    }
+    
     // Detached window for image
     Window {
         id: detachedWindow
@@ -146,6 +178,19 @@ Item {
                     colorMapIndex: root.currentColorMap
                     showLegend: false
                     hideInstructionsDelay: 5000
+                    adaptiveStretch: root.adaptiveStretch
+                    roiMode: root.roiMode
+                    renderMode: root.renderMode
+                    lightAzimuth: root.lightAzimuth
+                    lightAltitude: root.lightAltitude
+                    denoiseFilter: root.denoiseFilter
+                    denoiseRadius: root.denoiseRadius
+                    contoursVisible: root.contoursVisible
+                    contourSource: root.contourSource
+                    contourInterval: root.contourInterval
+                    boundarySource: root.boundarySource
+                    boundariesVisible: root.boundariesVisible
+                    processor: root.processor
                 }
                 
                 ColorLegend {
@@ -156,11 +201,24 @@ Item {
                     colorMaps: root.colorMaps
                     imagePath: root.imagePath
                     processor: root.processor
+                    stretchActive: detachedImageViewer.stretchValid
+                    stretchMin: detachedImageViewer.stretchMin
+                    stretchMax: detachedImageViewer.stretchMax
                 }
             }
         }
     }
     
+    // Cambio immagine: lo stream dell'istogramma in corso è annullato
+    // (o riavviato sul nuovo raster se la finestra è aperta)
+    onImagePathChanged: {
+        if (histogramWindow.visible && root.imagePath !== "") {
+            updateHistogram()
+        } else {
+            histogramBuffer.clear()
+        }
+    }
+    
     // Detached window for histogram
     Window {
         id: histogramWindow
@@ -195,6 +253,19 @@ Item {
                         Layout.fillWidth: true
                     }
                     
+                    CheckBox {
+                        id: logScaleCheck
+                        checked: root.histogramLogScale
+                        onToggled: root.histogramLogScale = checked
+                        contentItem: Text {
+                            text: "Log"
+                            leftPadding: logScaleCheck.indicator.width + 4
+                            color: root.themeColors.textColor
+                            font.pixelSize: 12
+                            verticalAlignment: Text.AlignVCenter
+                        }
+                    }
+                    
                     ToolButton {
                         implicitWidth: 32
                         implicitHeight: 32
@@ -221,7 +292,8 @@ Item {
             Histogram {
                 Layout.fillWidth: true
                 Layout.fillHeight: true
-                histogramData: root.histogramData
+                buffer: histogramBuffer
+                logScale: root.histogramLogScale
                 themeColors: root.themeColors
             }
         }
@@ -234,7 +306,7 @@ Item {
         }
         
         console.log("Updating histogram for:", root.imagePath)
-        root.histogramData = root.processor.getHistogramData(root.imagePath, 256)
+        root.processor.streamHistogram(root.imagePath, histogramBuffer, 256)
     }
     
     ColumnLayout {
@@ -261,7 +333,35 @@ Item {
                     color: root.themeColors.textColor
                 }
                 
-                Item { Layout.fillWidth: true }
+                // Dimensioni, bande, CRS e compressione dall'header, appena scelto il file
+                Label {
+                    Layout.fillWidth: true
+                    visible: root.imagePath !== ""
+                    text: metadata.summary
+                    elide: Text.ElideRight
+                    font.pixelSize: 11
+                    color: metadata.valid ? root.themeColors.textSecondaryColor : "#ff6666"
+                    
+                    MouseArea {
+                        id: metadataHover
+                        anchors.fill: parent
+                        hoverEnabled: true
+                    }
+                    ToolTip.visible: metadataHover.containsMouse && metadata.valid
+                    ToolTip.delay: 500
+                    ToolTip.text: metadata.driver + " " + metadata.width + " × " + metadata.height
+                                  + "\nBands: " + metadata.bandCount + " " + metadata.dataType
+                                  + (metadata.hasNoData ? "  (nodata " + metadata.noData + ")" : "")
+                                  + "\nCRS: " + (metadata.crsName !== "" ? metadata.crsName : "none")
+                                  + (metadata.pixelSizeX > 0 ? "\nPixel: " + metadata.pixelSizeX.toPrecision(4)
+                                                               + " × " + metadata.pixelSizeY.toPrecision(4) : "")
+                                  + "\nBlocks: " + metadata.blockWidth + " × " + metadata.blockHeight
+                                  + (metadata.tiled ? " (tiled)" : " (strips)")
+                                  + "\nOverviews: " + metadata.overviewCount
+                                  + "\nCompression: " + (metadata.compression !== "" ? metadata.compression : "none")
+                }
+                
+                Item { Layout.fillWidth: true; visible: root.imagePath === "" }
                 
                 ToolButton {
                     implicitWidth: 32
@@ -331,6 +431,54 @@ Item {
                     ToolTip.delay: 500
                 }
                 
+                ToolButton {
+                    implicitWidth: 32
+                    implicitHeight: 32
+                    enabled: root.imagePath !== ""
+                    checkable: true
+                    checked: root.adaptiveStretch
+                    onToggled: root.adaptiveStretch = checked
+                    contentItem: Text {
+                        text: "◐"
+                        font.pixelSize: 16
+                        color: parent.enabled ? root.themeColors.textColor : "#666666"
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    background: Rectangle {
+                        color: parent.pressed || parent.checked ? root.themeColors.buttonPressedColor : 
+                               (parent.hovered ? root.themeColors.buttonHoverColor : root.themeColors.buttonColor)
+                        radius: 3
+                    }
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Adaptive Stretch (2–98% of visible area)"
+                    ToolTip.delay: 500
+                }
+                
+                ToolButton {
+                    implicitWidth: 32
+                    implicitHeight: 32
+                    enabled: root.imagePath !== ""
+                    // off -> rettangolo -> poligono -> off
+                    onClicked: root.roiMode = root.roiMode === "" ? "rect" : (root.roiMode === "rect" ? "polygon" : "")
+                    contentItem: Text {
+                        text: root.roiMode === "polygon" ? "⬠" : "▭"
+                        font.pixelSize: 16
+                        color: parent.enabled ? root.themeColors.textColor : "#666666"
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    background: Rectangle {
+                        color: parent.pressed || root.roiMode !== "" ? root.themeColors.buttonPressedColor : 
+                               (parent.hovered ? root.themeColors.buttonHoverColor : root.themeColors.buttonColor)
+                        radius: 3
+                    }
+                    ToolTip.visible: hovered
+                    ToolTip.text: root.roiMode === "" ? "ROI Statistics: rectangle"
+                                  : (root.roiMode === "rect" ? "ROI Statistics: polygon" : "ROI Statistics: off")
+                    ToolTip.delay: 500
+                }
+                
                 Rectangle {
                     width: 1
                     height: 30
@@ -384,6 +532,58 @@ Item {
                     ToolTip.delay: 500
                 }
                 
+                ToolButton {
+                    implicitWidth: 32
+                    implicitHeight: 32
+                    enabled: root.imagePath !== "" && root.processor !== null && !root.processor.derivationRunning
+                    contentItem: Text {
+                        text: "💾"
+                        font.pixelSize: 16
+                        color: parent.enabled ? root.themeColors.textColor : "#666666"
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    background: Rectangle {
+                        color: parent.pressed ? root.themeColors.buttonPressedColor : 
+                               (parent.hovered ? root.themeColors.buttonHoverColor : root.themeColors.buttonColor)
+                        radius: 3
+                    }
+                    onClicked: imageExportDialog.open()
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Export colorized image at full resolution"
+                    ToolTip.delay: 500
+                }
+                
+                ProgressBar {
+                    Layout.preferredWidth: 60
+                    visible: root.exporting
+                    from: 0
+                    to: 1
+                    value: root.exportProgress
+                }
+                
+                ToolButton {
+                    implicitWidth: 32
+                    implicitHeight: 32
+                    visible: root.exporting
+                    contentItem: Text {
+                        text: "✕"
+                        font.pixelSize: 14
+                        color: root.themeColors.textColor
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    background: Rectangle {
+                        color: parent.pressed ? root.themeColors.buttonPressedColor : 
+                               (parent.hovered ? root.themeColors.buttonHoverColor : root.themeColors.buttonColor)
+                        radius: 3
+                    }
+                    onClicked: root.processor.cancelDerivation()
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Cancel export"
+                    ToolTip.delay: 500
+                }
+                
                 Rectangle {
                     width: 1
                     height: 30
@@ -429,6 +629,19 @@ Item {
                     colorMapIndex: root.currentColorMap
                     showLegend: false
                     hideInstructionsDelay: 5000
+                    adaptiveStretch: root.adaptiveStretch
+                    roiMode: root.roiMode
+                    renderMode: root.renderMode
+                    lightAzimuth: root.lightAzimuth
+                    lightAltitude: root.lightAltitude
+                    denoiseFilter: root.denoiseFilter
+                    denoiseRadius: root.denoiseRadius
+                    contoursVisible: root.contoursVisible
+                    contourSource: root.contourSource
+                    contourInterval: root.contourInterval
+                    boundarySource: root.boundarySource
+                    boundariesVisible: root.boundariesVisible
+                    processor: root.processor
                 }
                 
                 ColorLegend {
@@ -439,6 +652,9 @@ Item {
                     colorMaps: root.colorMaps
                     imagePath: root.imagePath
                     processor: root.processor
+                    stretchActive: imageViewer.stretchValid
+                    stretchMin: imageViewer.stretchMin
+                    stretchMax: imageViewer.stretchMax
                 }
             }
         }
@@ -572,6 +788,218 @@ Item {
                     radius: 3
                 }
             }
+            
+            Label {
+                text: "Render:"
+                font.pixelSize: 11
+                color: root.themeColors.textSecondaryColor
+            }
+            
+            ComboBox {
+                id: renderModeCombo
+                Layout.preferredWidth: 110
+                font.pixelSize: 11
+                model: [
+                    { text: "Color", value: "" },
+                    { text: "Hillshade", value: "hillshade" },
+                    { text: "Slope", value: "slope" },
+                    { text: "Aspect", value: "aspect" }
+                ]
+                textRole: "text"
+                valueRole: "value"
+                onActivated: root.renderMode = currentValue
+                Component.onCompleted: currentIndex = indexOfValue(root.renderMode)
+            }
+            
+            // Luce dell'hillshade: azimut (gradi da nord) e altezza
+            Label {
+                text: "Az " + Math.round(root.lightAzimuth) + "°"
+                font.pixelSize: 11
+                color: root.themeColors.textSecondaryColor
+                visible: root.renderMode === "hillshade"
+            }
+            
+            Slider {
+                Layout.preferredWidth: 90
+                from: 0
+                to: 360
+                stepSize: 5
+                value: root.lightAzimuth
+                visible: root.renderMode === "hillshade"
+                onMoved: root.lightAzimuth = value
+            }
+            
+            Label {
+                text: "Alt " + Math.round(root.lightAltitude) + "°"
+                font.pixelSize: 11
+                color: root.themeColors.textSecondaryColor
+                visible: root.renderMode === "hillshade"
+            }
+            
+            Slider {
+                Layout.preferredWidth: 70
+                from: 5
+                to: 90
+                stepSize: 5
+                value: root.lightAltitude
+                visible: root.renderMode === "hillshade"
+                onMoved: root.lightAltitude = value
+            }
+            
+            Label {
+                text: "Filter:"
+                font.pixelSize: 11
+                color: root.themeColors.textSecondaryColor
+            }
+            
+            ComboBox {
+                id: denoiseCombo
+                Layout.preferredWidth: 120
+                font.pixelSize: 11
+                model: [
+                    { text: "None", value: "" },
+                    { text: "Median 3×3", value: "median:1" },
+                    { text: "Median 5×5", value: "median:2" },
+                    { text: "Gaussian 5×5", value: "gaussian:2" },
+                    { text: "Opening 3×3", value: "opening:1" },
+                    { text: "Opening 5×5", value: "opening:2" }
+                ]
+                textRole: "text"
+                valueRole: "value"
+                onActivated: {
+                    var parts = currentValue.split(":")
+                    root.denoiseRadius = parts.length > 1 ? parseInt(parts[1]) : 1
+                    root.denoiseFilter = parts[0]
+                }
+                Component.onCompleted: currentIndex = indexOfValue(root.denoiseFilter === "" ? ""
+                                                                   : root.denoiseFilter + ":" + root.denoiseRadius)
+                
+                Connections {
+                    target: root
+                    function onDenoiseFilterChanged() {
+                        denoiseCombo.currentIndex = denoiseCombo.indexOfValue(root.denoiseFilter === "" ? ""
+                                                                              : root.denoiseFilter + ":" + root.denoiseRadius)
+                    }
+                }
+                
+                ToolTip.visible: hovered
+                ToolTip.text: "Native denoise preview (Derive Inputs applies it to the whole raster)"
+            }
+            
+            CheckBox {
+                id: contoursCheck
+                checked: root.contoursVisible
+                enabled: root.imagePath !== "" || root.contourSource !== ""
+                onToggled: root.contoursVisible = checked
+                contentItem: Text {
+                    text: "Contours"
+                    leftPadding: contoursCheck.indicator.width + 4
+                    color: root.themeColors.textColor
+                    font.pixelSize: 11
+                    verticalAlignment: Text.AlignVCenter
+                }
+                ToolTip.visible: hovered
+                ToolTip.text: root.contourSource !== "" && root.contourSource !== root.imagePath
+                              ? "Contour lines from " + root.contourSource : "Contour lines of this surface model"
+            }
+            
+            // Intervallo in decimi di unità di quota; 0 = automatico
+            SpinBox {
+                id: contourIntervalSpin
+                Layout.preferredWidth: 100
+                font.pixelSize: 11
+                visible: root.contoursVisible
+                from: 0
+                to: 10000
+                stepSize: 5
+                editable: true
+                value: Math.round(root.contourInterval * 10)
+                textFromValue: function(value, locale) {
+                    return value === 0 ? "auto" : Number(value / 10).toLocaleString(locale, 'f', 1)
+                }
+                valueFromText: function(text, locale) {
+                    if (text === "auto") return 0
+                    return Math.round(Number.fromLocaleString(locale, text) * 10)
+                }
+                onValueModified: root.contourInterval = value / 10
+                ToolTip.visible: hovered
+                ToolTip.text: "Contour interval" + (imageViewer.contourEffectiveInterval > 0
+                                                    ? " (now " + imageViewer.contourEffectiveInterval + ")" : "")
+            }
+            
+            Label {
+                visible: root.contoursVisible
+                text: imageViewer.contourRunning ? "…" : imageViewer.contourLineCount + " lines"
+                font.pixelSize: 11
+                color: root.themeColors.textSecondaryColor
+            }
+            
+            Button {
+                text: "Export…"
+                visible: root.contoursVisible
+                enabled: !imageViewer.contourRunning && imageViewer.contourLineCount > 0
+                font.pixelSize: 11
+                onClicked: contourExportDialog.open()
+            }
+            
+            CheckBox {
+                id: boundariesCheck
+                visible: root.boundarySource !== ""
+                checked: root.boundariesVisible
+                onToggled: root.boundariesVisible = checked
+                contentItem: Text {
+                    text: "Boundaries" + (imageViewer.boundaryFeatureCount > 0 ? " (" + imageViewer.boundaryFeatureCount + ")" : "")
+                    leftPadding: boundariesCheck.indicator.width + 4
+                    color: root.themeColors.textColor
+                    font.pixelSize: 11
+                    verticalAlignment: Text.AlignVCenter
+                }
+                ToolTip.visible: hovered
+                ToolTip.text: "Analysis shapefile outlines"
+            }
+        }
+    }
+    
+    // Colormap come nel viewer, stretch sulle statistiche della banda
+    FileDialog {
+        id: imageExportDialog
+        title: "Export Image"
+        fileMode: FileDialog.SaveFile
+        defaultSuffix: "tif"
+        nameFilters: ["GeoTIFF (*.tif)", "Cloud Optimized GeoTIFF (*.tif)", "PNG (*.png)"]
+        onAccepted: {
+            var path = selectedFile.toString()
+            if (path.startsWith("file:///")) path = path.substring(8)
+            else if (path.startsWith("file://")) path = path.substring(7)
+            var format = ["gtiff", "cog", "png"][Math.max(0, selectedNameFilter.index)]
+            root.exportProgress = 0
+            root.exporting = true
+            root.processor.exportRendered(root.imagePath, root.currentColorMap, "", "", 0, format, path)
+        }
+    }
+    
+    Connections {
+        target: root.processor
+        enabled: root.exporting
+        function onDerivationProgress(fraction) { root.exportProgress = fraction }
+        function onDerivationRunningChanged() {
+            if (!root.processor.derivationRunning) root.exporting = false
+        }
+    }
+    
+    FileDialog {
+        id: contourExportDialog
+        title: "Export Contour Lines"
+        fileMode: FileDialog.SaveFile
+        defaultSuffix: "geojson"
+        nameFilters: ["GeoJSON (*.geojson)", "Shapefile (*.shp)"]
+        onAccepted: {
+            var result = imageViewer.exportContours(selectedFile.toString())
+            if (result.ok) {
+                console.log("Contours exported:", result.lines, "lines to", result.path)
+            } else {
+                console.error("Contour export failed:", result.error)
+            }
         }
     }
     
@@ -1,11 +1,14 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
+import GeoTiffProcessor
 
 Item {
     id: root
-    
-    property var histogramData: []
+
+    // Conteggi impacchettati (HistogramBuffer) riempiti da processor.streamHistogram
+    property HistogramBuffer buffer: null
+    property bool logScale: false
     property var themeColors: ({
         panelColor: "#2a2a2a",
         borderColor: "#404040",
@@ -15,139 +18,139 @@ Item {
         buttonHoverColor: "#004499",
         buttonPressedColor: "#0066cc"
     })
-    
+
+    // Conteggi troncati da una lettura fallita non si disegnano come definitivi
+    readonly property bool hasData: root.buffer !== null && root.buffer.bins > 0 && root.buffer.totalCount > 0
+                                    && !root.buffer.failed
+
     Rectangle {
         anchors.fill: parent
         color: root.themeColors.panelColor
         border.color: root.themeColors.borderColor
         border.width: 1
-        
-        Canvas {
-            id: histogramCanvas
+
+        Item {
+            id: chartArea
             anchors.fill: parent
             anchors.margins: 10
-            
-            onPaint: {
-                let ctx = getContext("2d")
-                ctx.fillStyle = root.themeColors.panelColor
-                ctx.fillRect(0, 0, width, height)
-                
-                if (root.histogramData.length === 0) {
-                    ctx.fillStyle = root.themeColors.textSecondaryColor
-                    ctx.font = "12px Arial"
-                    ctx.textAlign = "center"
-                    ctx.fillText("No histogram data", width / 2, height / 2)
-                    return
-                }
-                
-                let barWidth = width / root.histogramData.length
-                let maxHeight = height - 60  // More space for X-axis labels
-                let chartLeft = 40  // Space for Y-axis labels
-                let chartWidth = width - chartLeft - 10
-                let chartHeight = maxHeight
-                
-                // Draw histogram bars
-                ctx.fillStyle = "#4a90e2"
-                ctx.strokeStyle = root.themeColors.borderColor
-                
-                for (let i = 0; i < root.histogramData.length; ++i) {
-                    let bin = root.histogramData[i]
-                    let barHeight = bin.normalized * chartHeight
-                    let x = chartLeft + (i / root.histogramData.length) * chartWidth
-                    let barActualWidth = (chartWidth / root.histogramData.length)
-                    let y = height - 60 - barHeight
-                    
-                    ctx.fillRect(x, y, barActualWidth - 1, barHeight)
-                    ctx.strokeRect(x, y, barActualWidth - 1, barHeight)
-                }
-                
-                // Draw axes
-                ctx.strokeStyle = root.themeColors.borderColor
-                ctx.lineWidth = 1
-                
-                // X-axis
-                ctx.beginPath()
-                ctx.moveTo(chartLeft, height - 40)
-                ctx.lineTo(width, height - 40)
-                ctx.stroke()
-                
-                // Y-axis
-                ctx.beginPath()
-                ctx.moveTo(chartLeft, 0)
-                ctx.lineTo(chartLeft, height - 40)
-                ctx.stroke()
-                
-                // Draw X-axis tick marks and labels
-                ctx.fillStyle = root.themeColors.textSecondaryColor
-                ctx.font = "9px Arial"
-                ctx.textAlign = "center"
-                
-                if (root.histogramData.length > 0) {
-                    let minValue = root.histogramData[0].value
-                    let maxValue = root.histogramData[root.histogramData.length - 1].value
-                    
-                    // Draw multiple reference points on X-axis
-                    let numTicks = 5
-                    for (let i = 0; i < numTicks; ++i) {
-                        let fraction = i / (numTicks - 1)
-                        let xPos = chartLeft + fraction * chartWidth
-                        let value = minValue + fraction * (maxValue - minValue)
-                        
-                        // Draw tick mark
-                        ctx.beginPath()
-                        ctx.moveTo(xPos, height - 40)
-                        ctx.lineTo(xPos, height - 35)
-                        ctx.stroke()
-                        
-                        // Draw label
-                        ctx.fillText(value.toFixed(2), xPos, height - 20)
+
+            readonly property real chartLeft: 40   // Space for Y-axis labels
+            readonly property real chartBottom: 40 // Space for X-axis labels
+
+            Text {
+                anchors.centerIn: parent
+                visible: !root.hasData
+                text: root.buffer !== null && root.buffer.failed ? "Histogram read failed"
+                      : root.buffer !== null && root.buffer.bins > 0 && !root.buffer.complete
+                      ? "Computing histogram..." : "No histogram data"
+                color: root.themeColors.textSecondaryColor
+                font.pixelSize: 12
+            }
+
+            // Barre: geometria del scene graph, nessun repaint JS
+            HistogramItem {
+                id: bars
+                x: chartArea.chartLeft
+                y: 0
+                width: chartArea.width - chartArea.chartLeft - 10
+                height: chartArea.height - 60
+                buffer: root.buffer
+                logScale: root.logScale
+                color: "#4a90e2"
+                visible: root.hasData
+            }
+
+            // X-axis
+            Rectangle {
+                x: chartArea.chartLeft
+                y: chartArea.height - chartArea.chartBottom
+                width: chartArea.width - chartArea.chartLeft
+                height: 1
+                color: root.themeColors.borderColor
+            }
+
+            // Y-axis
+            Rectangle {
+                x: chartArea.chartLeft
+                y: 0
+                width: 1
+                height: chartArea.height - chartArea.chartBottom
+                color: root.themeColors.borderColor
+            }
+
+            // X-axis tick marks and labels
+            Repeater {
+                model: root.hasData ? 5 : 0
+
+                Item {
+                    readonly property real fraction: index / 4
+                    x: chartArea.chartLeft + fraction * bars.width
+                    y: chartArea.height - chartArea.chartBottom
+
+                    Rectangle {
+                        width: 1
+                        height: 5
+                        color: root.themeColors.borderColor
                     }
-                }
-                
-                // Draw Y-axis tick marks and labels
-                ctx.textAlign = "right"
-                let numYTicks = 5
-                for (let i = 0; i < numYTicks; ++i) {
-                    let fraction = i / (numYTicks - 1)
-                    let yPos = height - 40 - fraction * chartHeight
-                    
-                    // Draw tick mark
-                    ctx.beginPath()
-                    ctx.moveTo(chartLeft - 5, yPos)
-                    ctx.lineTo(chartLeft, yPos)
-                    ctx.stroke()
-                    
-                    // Find max count for Y-axis scaling
-                    let maxCount = 0
-                    for (let j = 0; j < root.histogramData.length; ++j) {
-                        if (root.histogramData[j].count > maxCount) {
-                            maxCount = root.histogramData[j].count
-                        }
+
+                    Text {
+                        anchors.horizontalCenter: parent.left
+                        y: 12
+                        text: (root.buffer.minValue + parent.fraction * (root.buffer.maxValue - root.buffer.minValue)).toFixed(2)
+                        color: root.themeColors.textSecondaryColor
+                        font.pixelSize: 9
                     }
-                    
-                    let yValue = Math.round(fraction * maxCount)
-                    ctx.fillText(yValue, chartLeft - 10, yPos + 3)
                 }
-                
-                // Draw axis labels
-                ctx.font = "bold 10px Arial"
-                ctx.textAlign = "center"
-                ctx.fillStyle = root.themeColors.textColor
-                ctx.fillText("Value", width / 2, height - 2)
-                
-                ctx.save()
-                ctx.translate(10, height / 2)
-                ctx.rotate(-Math.PI / 2)
-                ctx.fillText("Count", 0, 0)
-                ctx.restore()
             }
-            
-            Connections {
-                target: root
-                function onHistogramDataChanged() {
-                    histogramCanvas.requestPaint()
+
+            // Y-axis tick marks and labels (lineari o logaritmici come le barre)
+            Repeater {
+                model: root.hasData ? 5 : 0
+
+                Item {
+                    readonly property real fraction: index / 4
+                    x: chartArea.chartLeft
+                    y: chartArea.height - chartArea.chartBottom - fraction * bars.height
+
+                    Rectangle {
+                        x: -5
+                        width: 5
+                        height: 1
+                        color: root.themeColors.borderColor
+                    }
+
+                    Text {
+                        anchors.right: parent.left
+                        anchors.rightMargin: 10
+                        anchors.verticalCenter: parent.top
+                        text: root.logScale
+                              ? Math.round(Math.expm1(parent.fraction * Math.log1p(root.buffer.maxCount)))
+                              : Math.round(parent.fraction * root.buffer.maxCount)
+                        color: root.themeColors.textSecondaryColor
+                        font.pixelSize: 9
+                    }
                 }
             }
+
+            // Axis labels
+            Text {
+                anchors.horizontalCenter: parent.horizontalCenter
+                anchors.bottom: parent.bottom
+                text: "Value"
+                color: root.themeColors.textColor
+                font.pixelSize: 10
+                font.bold: true
+            }
+
+            Text {
+                x: -width / 2
+                anchors.verticalCenter: parent.verticalCenter
+                rotation: -90
+                text: root.logScale ? "Count (log)" : "Count"
+                color: root.themeColors.textColor
+                font.pixelSize: 10
+                font.bold: true
+            }
         }
     }
 }
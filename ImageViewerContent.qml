@@ -1,5 +1,7 @@
 import QtQuick
 import QtQuick.Controls
+import QtQuick.Shapes
+import GeoTiffProcessor
 
 Item {
     id: root
@@ -9,6 +11,60 @@ Item {
     property bool showLegend: false
     property alias imageStatus: imageView.status
     property int hideInstructionsDelay: 5000
+    // Ricampionamento della lettura ridotta ("" = default del processor)
+    property string resampling: ""
+    // Stretch adattivo: colormap sui percentili della porzione visibile
+    // (piramide di riepilogo nel provider); processor serve per leggere l'intervallo
+    property bool adaptiveStretch: false
+    property real stretchLowPercent: 2
+    property real stretchHighPercent: 98
+    property var processor: null
+    property bool stretchValid: false
+    property real stretchMin: 0
+    property real stretchMax: 0
+    property int frontStretchLayer: 0
+    // Resa derivata per DSM ("" = colormap, "hillshade", "slope", "aspect"):
+    // cambiare la luce ricolora dai tile in cache, senza svuotare l'immagine
+    property string renderMode: ""
+    property real lightAzimuth: 315
+    property real lightAltitude: 45
+    // Denoise in anteprima ("" = off, "median", "gaussian", "opening"; raggio 1..3):
+    // l'immagine intera è filtrata sulla griglia in cache; da zoomati la porzione
+    // visibile è riletta fino alla risoluzione nativa e filtrata con il suo bordo
+    property string denoiseFilter: ""
+    property int denoiseRadius: 1
+    // Colormap nello shader: l'immagine completa arriva a un canale (channel=1)
+    // e la colora colormap.frag con la striscia della colormap, per cui cambiare
+    // colormap non rilegge il raster. Non con il backend software (nessuno shader)
+    readonly property bool shaderColormap: imageView.GraphicsInfo.api !== GraphicsInfo.Software
+                                           && renderMode === "" && colorMapIndex >= 0
+    onShaderColormapChanged: if (imagePath !== "") Qt.callLater(imageContainer.reloadImage)
+    // Curve di livello sopra l'immagine: dal DSM contourSource ("" = l'immagine
+    // stessa), intervallo in unità di quota (0 = automatico)
+    property bool contoursVisible: false
+    property string contourSource: ""
+    property real contourInterval: 0
+    property alias contourLineCount: contourOverlay.lineCount
+    property alias contourRunning: contourOverlay.running
+    property alias contourEffectiveInterval: contourOverlay.effectiveInterval
+    // Contorni del shapefile di analisi (archivio zip), riproiettati sull'immagine
+    property bool boundariesVisible: true
+    property string boundarySource: ""
+    property alias boundaryFeatureCount: boundaryOverlay.featureCount
+    // ROI: "rect" (trascina) o "polygon" (click sui vertici, doppio click chiude);
+    // statistiche dalle tabelle a somme cumulate, aggiornate durante il disegno
+    property string roiMode: ""
+    property var roiPoints: []          // vertici normalizzati {x, y}
+    property var roiCursor: null        // vertice provvisorio sotto il mouse
+    property bool roiDrawing: false
+    property var roiResult: ({})
+    // Caricamento progressivo: anteprime dalle overview a lato crescente,
+    // sostituite sul posto, poi l'immagine completa. Una ricarica (immagine,
+    // colormap, ...) scarta le anteprime ancora in corso
+    // Senza overview l'anteprima ridotta scansionerebbe comunque tutto il raster
+    property bool progressive: !rasterMetadata.valid || rasterMetadata.overviewCount > 0
+    readonly property var progressiveLevels: [256, 1024]
+    property int progressiveSerial: 0
     
     property real zoomLevel: 1.0
     property real minZoom: 0.1
@@ -30,6 +86,209 @@ Item {
         offset = Qt.point(0, 0)
     }
     
+    // Porzione visibile dell'immagine in coordinate normalizzate [x0, y0, x1, y1]
+    function viewportRect() {
+        var w = imageView.width * root.zoomLevel
+        var h = imageView.height * root.zoomLevel
+        if (w <= 0 || h <= 0) return [0, 0, 1, 1]
+        var left = (imageContainer.width - w) / 2
+        var top = (imageContainer.height - h) / 2
+        var clamp = function(v) { return Math.max(0, Math.min(1, v)) }
+        return [clamp((flickable.contentX - left) / w), clamp((flickable.contentY - top) / h),
+                clamp((flickable.contentX + flickable.width - left) / w),
+                clamp((flickable.contentY + flickable.height - top) / h)]
+    }
+    
+    // Ricolora sul layer nascosto e lo porta davanti solo quando è pronto
+    function requestStretch() {
+        if (!root.adaptiveStretch || root.imagePath === "") return
+        var view = viewportRect()
+        var back = root.frontStretchLayer === 0 ? stretchLayerB : stretchLayerA
+        back.view = view
+        back.source = imageContainer.sourceUrl("&stretch=" + root.stretchLowPercent + "," + root.stretchHighPercent
+                                               + "&view=" + view.map(function(v) { return v.toFixed(4) }).join(","))
+    }
+    
+    function stretchLayerReady(index, layer) {
+        root.frontStretchLayer = index
+        if (root.processor === null) return
+        var range = root.processor.viewportStretch(cleanImagePath(), layer.view[0], layer.view[1], layer.view[2], layer.view[3],
+                                                   root.stretchLowPercent, root.stretchHighPercent)
+        root.stretchValid = range.valid
+        if (range.valid) {
+            root.stretchMin = range.min
+            root.stretchMax = range.max
+        }
+    }
+    
+    function clearStretch() {
+        stretchLayerA.source = ""
+        stretchLayerB.source = ""
+        root.stretchValid = false
+    }
+    
+    // Curve correnti in GeoJSON o shapefile: { ok, path, lines } o { ok: false, error }
+    function exportContours(path) {
+        return contourOverlay.exportTo(path)
+    }
+    
+    function cleanImagePath() {
+        var cleanPath = root.imagePath
+        if (cleanPath.startsWith("file:///")) cleanPath = cleanPath.substring(8)
+        else if (cleanPath.startsWith("file://")) cleanPath = cleanPath.substring(7)
+        return cleanPath
+    }
+    
+    // Punto del mouse in coordinate normalizzate dell'immagine
+    function roiPointAt(item, x, y) {
+        var p = imageView.mapFromItem(item, x, y)
+        var clamp = function(v) { return Math.max(0, Math.min(1, v)) }
+        return { x: clamp(p.x / imageView.width), y: clamp(p.y / imageView.height) }
+    }
+    
+    function roiQueryPoints() {
+        var points = root.roiPoints.slice()
+        if (root.roiDrawing && root.roiCursor !== null) {
+            if (root.roiMode === "rect") points = [points[0], root.roiCursor]
+            else points.push(root.roiCursor)
+        }
+        return points
+    }
+    
+    function updateRoiStatistics() {
+        var points = roiQueryPoints()
+        if (root.processor === null || root.imagePath === "" || points.length < 2) {
+            root.roiResult = ({})
+            return
+        }
+        root.roiResult = root.processor.roiStatistics(cleanImagePath(), points)
+    }
+    
+    function clearRoi() {
+        root.roiPoints = []
+        root.roiCursor = null
+        root.roiDrawing = false
+        root.roiResult = ({})
+    }
+    
+    onRoiModeChanged: clearRoi()
+    onImagePathChanged: clearRoi()
+    
+    // Tabella del livello costruita in background: ripeti la query
+    Connections {
+        target: root.processor
+        enabled: root.roiPoints.length > 0
+        function onRoiTablesReady(imagePath) {
+            if (imagePath === root.cleanImagePath()) root.updateRoiStatistics()
+        }
+    }
+    
+    onAdaptiveStretchChanged: {
+        if (adaptiveStretch) requestStretch()
+        else clearStretch()
+    }
+    
+    // Pan/zoom: nuova richiesta dopo una breve pausa del movimento
+    Timer {
+        id: stretchTimer
+        interval: 150
+        onTriggered: root.requestStretch()
+    }
+    
+    onZoomLevelChanged: {
+        if (adaptiveStretch) stretchTimer.restart()
+        if (denoiseFilter !== "") denoiseTimer.restart()
+    }
+    
+    Connections {
+        target: flickable
+        enabled: root.adaptiveStretch
+        function onContentXChanged() { stretchTimer.restart() }
+        function onContentYChanged() { stretchTimer.restart() }
+        function onWidthChanged() { stretchTimer.restart() }
+        function onHeightChanged() { stretchTimer.restart() }
+    }
+    
+    // Porzione visibile filtrata a piena risoluzione (la vista intera usa la griglia)
+    function requestDenoiseRegion() {
+        if (root.denoiseFilter === "" || root.imagePath === "" || root.renderMode !== "" || root.colorMapIndex < 0) {
+            denoiseLayer.source = ""
+            return
+        }
+        var view = viewportRect()
+        if (view[2] - view[0] > 0.98 && view[3] - view[1] > 0.98) {
+            denoiseLayer.source = ""
+            return
+        }
+        var region = view.map(function(v) { return v.toFixed(4) }).join(",")
+        var extra = "&region=" + region
+        if (root.adaptiveStretch) {
+            extra += "&stretch=" + root.stretchLowPercent + "," + root.stretchHighPercent + "&view=" + region
+        }
+        var w = Math.ceil(flickable.width)
+        var h = Math.ceil(flickable.height)
+        if (denoiseLayer.sourceSize.width !== w || denoiseLayer.sourceSize.height !== h) {
+            denoiseLayer.sourceSize = Qt.size(w, h)
+        }
+        denoiseLayer.pendingView = view
+        denoiseLayer.source = imageContainer.sourceUrl(extra)
+    }
+    
+    Timer {
+        id: denoiseTimer
+        interval: 150
+        onTriggered: root.requestDenoiseRegion()
+    }
+    
+    Connections {
+        target: flickable
+        enabled: root.denoiseFilter !== ""
+        function onContentXChanged() { denoiseTimer.restart() }
+        function onContentYChanged() { denoiseTimer.restart() }
+        function onWidthChanged() { denoiseTimer.restart() }
+        function onHeightChanged() { denoiseTimer.restart() }
+    }
+    
+    // Metadati dall'header (catalogo condiviso): scelgono la strategia di lettura
+    RasterMetadata {
+        id: rasterMetadata
+        source: root.imagePath
+    }
+    
+    // Prefetch dei blocchi che la porzione filtrata leggerà: segue pan e zoom
+    // e anticipa la viewport prevista. Le regioni si richiedono solo con un
+    // filtro attivo: senza, lo scheduler (thread e dataset) non viene creato
+    readonly property bool prefetchActive: root.denoiseFilter !== "" && root.renderMode === ""
+                                           && root.colorMapIndex >= 0 && root.imagePath !== ""
+    Loader {
+        id: prefetchLoader
+        active: root.prefetchActive
+        sourceComponent: PrefetchScheduler {
+            source: root.imagePath
+            viewportSize: Qt.size(flickable.width, flickable.height)
+            visibleRect: {
+                var view = root.viewportRect()
+                return Qt.rect(view[0], view[1], view[2] - view[0], view[3] - view[1])
+            }
+        }
+    }
+    readonly property var prefetcher: prefetchLoader.item
+    
+    // Luce: nuova resa dopo una breve pausa del cursore, l'immagine corrente
+    // resta visibile finché la nuova non è pronta
+    Timer {
+        id: lightTimer
+        interval: 80
+        onTriggered: {
+            if (root.imagePath === "" || root.renderMode !== "hillshade") return
+            imageView.source = imageContainer.sourceUrl("")
+            root.requestStretch()
+        }
+    }
+    
+    onLightAzimuthChanged: lightTimer.restart()
+    onLightAltitudeChanged: lightTimer.restart()
+    
     // Timer to hide instructions
     Timer {
         id: hideInstructionsTimer
@@ -58,22 +317,77 @@ Item {
                 width: Math.max(flickable.width, imageView.width * imageView.scale)
                 height: Math.max(flickable.height, imageView.height * imageView.scale)
                 
+                function sourceUrl(extraParams) {
+                    var encodedPath = encodeURIComponent(root.cleanImagePath())
+                    var newSource = "image://geotifftex/" + encodedPath + "?colormap=" + root.colorMapIndex
+                    if (root.resampling !== "") newSource += "&resample=" + root.resampling
+                    if (root.renderMode !== "") {
+                        newSource += "&mode=" + root.renderMode + "&az=" + root.lightAzimuth.toFixed(0)
+                                     + "&alt=" + root.lightAltitude.toFixed(0)
+                    }
+                    if (root.denoiseFilter !== "") {
+                        newSource += "&filter=" + root.denoiseFilter + "&radius=" + root.denoiseRadius
+                    }
+                    return newSource + extraParams + "&t=" + Date.now()
+                }
+                
                 function reloadImage() {
                     imageView.source = ""
+                    previewLow.source = ""
+                    previewHigh.source = ""
+                    denoiseLayer.source = ""
+                    root.progressiveSerial++
+                    root.clearStretch()
                     if (root.imagePath !== "") {
-                        var cleanPath = root.imagePath
-                        if (cleanPath.startsWith("file:///")) cleanPath = cleanPath.substring(8)
-                        else if (cleanPath.startsWith("file://")) cleanPath = cleanPath.substring(7)
-                        var encodedPath = encodeURIComponent(cleanPath)
-                        var newSource = "image://geotiff/" + encodedPath + "?colormap=" + root.colorMapIndex + "&t=" + Date.now()
-                        console.log("Loading image source:", newSource)
-                        imageView.source = newSource
+                        if (root.progressive) requestPreview(0)
+                        else loadFullImage()
+                        root.requestStretch()
+                        root.requestDenoiseRegion()
+                    }
+                }
+                
+                function loadFullImage() {
+                    var newSource = sourceUrl(root.shaderColormap ? "&channel=1" : "")
+                    console.log("Loading image source:", newSource)
+                    imageView.source = newSource
+                }
+                
+                // Un livello alla volta: il successivo (o l'immagine completa) parte
+                // quando il precedente è pronto, così non si contendono il lettore
+                function requestPreview(level) {
+                    var layer = level === 0 ? previewLow : previewHigh
+                    var side = root.progressiveLevels[level]
+                    layer.serial = root.progressiveSerial
+                    layer.sourceSize = Qt.size(side, side)
+                    layer.source = sourceUrl("&preview=1")
+                }
+                
+                function previewFinished(level, layer) {
+                    if (layer.serial !== root.progressiveSerial || imageView.source.toString() !== "") return
+                    if (layer.status === Image.Ready) {
+                        updateImageSize()
+                        // Anteprima già alla risoluzione nativa: resta solo la resa completa
+                        var side = root.progressiveLevels[level]
+                        var native = layer.implicitWidth < side && layer.implicitHeight < side
+                        if (!native && level + 1 < root.progressiveLevels.length) {
+                            requestPreview(level + 1)
+                            return
+                        }
                     }
+                    loadFullImage()
                 }
                 
                 function updateImageSize() {
-                    if (imageView.sourceSize.width > 0 && imageView.sourceSize.height > 0) {
-                        var aspectRatio = imageView.sourceSize.width / imageView.sourceSize.height
+                    var w = imageView.sourceSize.width
+                    var h = imageView.sourceSize.height
+                    if (imageView.status !== Image.Ready) {
+                        // Ancora in caricamento: proporzioni dall'anteprima mostrata
+                        var preview = previewHigh.status === Image.Ready ? previewHigh : previewLow
+                        w = preview.status === Image.Ready ? preview.implicitWidth : 0
+                        h = preview.status === Image.Ready ? preview.implicitHeight : 0
+                    }
+                    if (w > 0 && h > 0) {
+                        var aspectRatio = w / h
                         if (flickable.width / flickable.height > aspectRatio) {
                             imageView.width = flickable.height * aspectRatio
                             imageView.height = flickable.height
@@ -108,16 +422,40 @@ Item {
                         }
                         function onColorMapIndexChanged() {
                             console.log("ImageViewerContent: colorMapIndex changed to:", root.colorMapIndex)
+                            // Già a un canale: cambia solo la striscia dello shader
+                            if (root.shaderColormap && imageView.source.toString().indexOf("&channel=1") >= 0) {
+                                if (root.adaptiveStretch) root.requestStretch()
+                                return
+                            }
                             if (root.imagePath !== "") {
                                 imageContainer.reloadImage()
                             }
                         }
+                        function onResamplingChanged() {
+                            if (root.imagePath !== "") {
+                                imageContainer.reloadImage()
+                            }
+                        }
+                        function onRenderModeChanged() {
+                            if (root.imagePath !== "") {
+                                imageContainer.reloadImage()
+                            }
+                        }
+                        // Filtro e raggio cambiano insieme dal pannello: una sola ricarica
+                        function onDenoiseFilterChanged() {
+                            if (root.imagePath !== "") Qt.callLater(imageContainer.reloadImage)
+                        }
+                        function onDenoiseRadiusChanged() {
+                            if (root.imagePath !== "" && root.denoiseFilter !== "") Qt.callLater(imageContainer.reloadImage)
+                        }
                     }
                     
                     onStatusChanged: {
                         if (status === Image.Ready) {
                             hideInstructionsTimer.restart()
                             imageContainer.updateImageSize()
+                            previewLow.source = ""
+                            previewHigh.source = ""
                         } else if (status === Image.Error) {
                             console.error("Failed to load image:", source)
                         }
@@ -126,23 +464,185 @@ Item {
                     // Update size when flickable size changes
                     Connections {
                         target: flickable
-                        function onWidthChanged() { if (imageView.status === Image.Ready) imageContainer.updateImageSize() }
-                        function onHeightChanged() { if (imageView.status === Image.Ready) imageContainer.updateImageSize() }
+                        function onWidthChanged() { imageContainer.updateImageSize() }
+                        function onHeightChanged() { imageContainer.updateImageSize() }
                     }
                     
                     Behavior on scale {
                         NumberAnimation { duration: 200; easing.type: Easing.OutQuad }
                     }
+                    
+                    // Codici a 8 bit dell'immagine completa colorati con la striscia
+                    // 256x1 (nearest); copre l'immagine sotto, gli altri layer restano sopra
+                    ShaderEffect {
+                        anchors.fill: parent
+                        visible: root.shaderColormap && imageView.status === Image.Ready
+                                 && imageView.source.toString().indexOf("&channel=1") >= 0
+                        property variant source: imageView
+                        property variant colormap: colormapStrip
+                        fragmentShader: "qrc:/colormap.frag.qsb"
+                        
+                        Image {
+                            id: colormapStrip
+                            source: root.shaderColormap ? "image://geotifftex/lut?colormap=" + root.colorMapIndex : ""
+                            smooth: false
+                            visible: false
+                        }
+                    }
+                    
+                    // Anteprime progressive sotto tutti gli altri layer: la più fine
+                    // pronta copre l'altra, l'immagine completa le sostituisce
+                    Image {
+                        id: previewLow
+                        property int serial: 0
+                        anchors.fill: parent
+                        fillMode: Image.PreserveAspectFit
+                        cache: false
+                        asynchronous: true
+                        smooth: true
+                        visible: imageView.status !== Image.Ready && status === Image.Ready
+                        onStatusChanged: if (status === Image.Ready || status === Image.Error) imageContainer.previewFinished(0, previewLow)
+                    }
+                    
+                    Image {
+                        id: previewHigh
+                        property int serial: 0
+                        anchors.fill: parent
+                        fillMode: Image.PreserveAspectFit
+                        cache: false
+                        asynchronous: true
+                        smooth: true
+                        visible: imageView.status !== Image.Ready && status === Image.Ready
+                        onStatusChanged: if (status === Image.Ready || status === Image.Error) imageContainer.previewFinished(1, previewHigh)
+                    }
+                    
+                    // Layer ricolorati con lo stretch della viewport (doppio buffer:
+                    // il nuovo sostituisce il precedente solo quando è pronto)
+                    Image {
+                        id: stretchLayerA
+                        property var view: [0, 0, 1, 1]
+                        anchors.fill: parent
+                        fillMode: Image.PreserveAspectFit
+                        cache: false
+                        asynchronous: true
+                        smooth: false
+                        visible: root.adaptiveStretch && root.frontStretchLayer === 0 && status === Image.Ready
+                        onStatusChanged: if (status === Image.Ready) root.stretchLayerReady(0, stretchLayerA)
+                    }
+                    
+                    Image {
+                        id: stretchLayerB
+                        property var view: [0, 0, 1, 1]
+                        anchors.fill: parent
+                        fillMode: Image.PreserveAspectFit
+                        cache: false
+                        asynchronous: true
+                        smooth: false
+                        visible: root.adaptiveStretch && root.frontStretchLayer === 1 && status === Image.Ready
+                        onStatusChanged: if (status === Image.Ready) root.stretchLayerReady(1, stretchLayerB)
+                    }
+                    
+                    // Porzione visibile filtrata, sopra la griglia filtrata: mentre carica
+                    // resta visibile l'anteprima ridotta, già filtrata
+                    Image {
+                        id: denoiseLayer
+                        property var pendingView: [0, 0, 1, 1]
+                        property var view: [0, 0, 1, 1]
+                        x: view[0] * parent.width
+                        y: view[1] * parent.height
+                        width: (view[2] - view[0]) * parent.width
+                        height: (view[3] - view[1]) * parent.height
+                        fillMode: Image.Stretch
+                        cache: false
+                        asynchronous: true
+                        smooth: false
+                        visible: root.denoiseFilter !== "" && status === Image.Ready
+                        onStatusChanged: if (status === Image.Ready) view = pendingView
+                    }
+                    
+                    // Curve di livello: solo quelle nella porzione visibile, a tratto costante
+                    ContourOverlay {
+                        id: contourOverlay
+                        anchors.fill: parent
+                        visible: root.contoursVisible
+                        source: root.contoursVisible ? (root.contourSource !== "" ? root.contourSource : root.imagePath) : ""
+                        reference: root.imagePath
+                        interval: root.contourInterval
+                        zoom: root.zoomLevel
+                        visibleRect: {
+                            var view = root.viewportRect()
+                            return Qt.rect(view[0], view[1], view[2] - view[0], view[3] - view[1])
+                        }
+                        onErrorOccurred: (message) => console.error("Contours:", message)
+                    }
+                    
+                    // Contorni del shapefile: solo le feature nella viewport (R-tree)
+                    BoundaryOverlay {
+                        id: boundaryOverlay
+                        anchors.fill: parent
+                        visible: root.boundariesVisible
+                        source: root.boundariesVisible ? root.boundarySource : ""
+                        reference: root.imagePath
+                        zoom: root.zoomLevel
+                        visibleRect: {
+                            var view = root.viewportRect()
+                            return Qt.rect(view[0], view[1], view[2] - view[0], view[3] - view[1])
+                        }
+                        onErrorOccurred: (message) => console.error("Boundaries:", message)
+                    }
+                    
+                    // Contorno della ROI (coordinate locali dell'immagine, tratto costante a schermo)
+                    Shape {
+                        anchors.fill: parent
+                        visible: root.roiPoints.length > 0
+                        
+                        ShapePath {
+                            strokeColor: "#ffd54f"
+                            strokeWidth: 2 / root.zoomLevel
+                            fillColor: Qt.rgba(1, 0.84, 0.31, 0.15)
+                            PathPolyline {
+                                path: {
+                                    var points = root.roiQueryPoints()
+                                    var w = imageView.width
+                                    var h = imageView.height
+                                    if (root.roiMode === "rect" && points.length === 2) {
+                                        var a = points[0], b = points[1]
+                                        points = [a, { x: b.x, y: a.y }, b, { x: a.x, y: b.y }]
+                                    }
+                                    var result = points.map(function(p) { return Qt.point(p.x * w, p.y * h) })
+                                    if (result.length > 2) result.push(result[0])
+                                    return result
+                                }
+                            }
+                        }
+                    }
                 }
             }
             
             MouseArea {
+                id: mouseArea
                 anchors.fill: parent
-                acceptedButtons: Qt.MiddleButton | Qt.LeftButton
+                acceptedButtons: Qt.MiddleButton | Qt.LeftButton | Qt.RightButton
+                hoverEnabled: root.roiMode === "polygon"
                 property point lastPos: Qt.point(0, 0)
                 property bool isPanning: false
                 
                 onPressed: (mouse) => {
+                    if (mouse.button === Qt.RightButton) {
+                        root.clearRoi()
+                        return
+                    }
+                    if (root.roiMode !== "" && mouse.button === Qt.LeftButton) {
+                        var point = root.roiPointAt(mouseArea, mouse.x, mouse.y)
+                        if (root.roiMode === "rect" || !root.roiDrawing) {
+                            root.roiPoints = [point]
+                        } else {
+                            root.roiPoints = root.roiPoints.concat([point])
+                        }
+                        root.roiCursor = point
+                        root.roiDrawing = true
+                        return
+                    }
                     if (mouse.button === Qt.MiddleButton || (mouse.button === Qt.LeftButton && root.zoomLevel > 1.0)) {
                         isPanning = true
                         lastPos = Qt.point(mouse.x, mouse.y)
@@ -150,13 +650,31 @@ Item {
                     }
                 }
                 
-                onReleased: {
+                onReleased: (mouse) => {
                     isPanning = false
                     cursorShape = Qt.ArrowCursor
+                    if (root.roiMode === "rect" && root.roiDrawing && mouse.button === Qt.LeftButton) {
+                        root.roiPoints = [root.roiPoints[0], root.roiPointAt(mouseArea, mouse.x, mouse.y)]
+                        root.roiDrawing = false
+                        root.updateRoiStatistics()
+                    }
+                }
+                
+                // Chiude il poligono (il secondo click ha già aggiunto un vertice doppio)
+                onDoubleClicked: (mouse) => {
+                    if (root.roiMode === "polygon" && root.roiDrawing) {
+                        var points = root.roiPoints.slice(0, -1)
+                        root.roiDrawing = false
+                        root.roiPoints = points.length >= 3 ? points : []
+                        root.updateRoiStatistics()
+                    }
                 }
                 
                 onPositionChanged: (mouse) => {
-                    if (isPanning) {
+                    if (root.roiDrawing) {
+                        root.roiCursor = root.roiPointAt(mouseArea, mouse.x, mouse.y)
+                        root.updateRoiStatistics()
+                    } else if (isPanning) {
                         var dx = mouse.x - lastPos.x
                         var dy = mouse.y - lastPos.y
                         flickable.contentX = Math.max(0, Math.min(flickable.contentWidth - flickable.width, flickable.contentX - dx))
@@ -173,9 +691,37 @@ Item {
             }
         }
         
+        // Statistiche della ROI
+        Rectangle {
+            anchors.top: parent.top
+            anchors.left: parent.left
+            anchors.margins: 10
+            width: roiText.width + 20
+            height: roiText.height + 10
+            color: Qt.rgba(0, 0, 0, 0.7)
+            radius: 3
+            visible: root.roiPoints.length > 0
+            
+            Label {
+                id: roiText
+                anchors.centerIn: parent
+                color: "#ffd54f"
+                font.pixelSize: 11
+                text: {
+                    var r = root.roiResult
+                    if (r.pending) return "ROI: building tables..."
+                    if (!r.valid) return "ROI: no valid pixels"
+                    return "ROI mean: " + r.mean.toFixed(3) + "  σ: " + r.stdDev.toFixed(3)
+                           + "\nPixels: " + Math.round(r.area).toLocaleString(Qt.locale(), 'f', 0)
+                           + (r.exact ? "" : "  (level " + r.level + ")")
+                }
+            }
+        }
+        
         BusyIndicator {
             anchors.centerIn: parent
-            running: imageView.status === Image.Loading
+            running: imageView.status === Image.Loading || previewLow.status === Image.Loading
+                     || previewHigh.status === Image.Loading
             visible: running
         }
         
@@ -210,6 +756,8 @@ Item {
                 id: zoomText
                 anchors.centerIn: parent
                 text: Math.round(root.zoomLevel * 100) + "%"
+                      + (root.prefetcher && root.prefetcher.hits + root.prefetcher.misses > 0
+                         ? "  ·  prefetch " + Math.round(root.prefetcher.hitRate * 100) + "%" : "")
                 color: "#ffffff"
                 font.pixelSize: 11
             }
@@ -237,9 +785,16 @@ Item {
                     font.pixelSize: 9
                 }
                 Label {
-                    text: "• Drag: Pan"
+                    text: root.roiMode === "rect" ? "• Drag: ROI rectangle"
+                          : (root.roiMode === "polygon" ? "• Click: ROI vertex, double click: close" : "• Drag: Pan")
+                    color: "#cccccc"
+                    font.pixelSize: 9
+                }
+                Label {
+                    text: "• Right click: clear ROI"
                     color: "#cccccc"
                     font.pixelSize: 9
+                    visible: root.roiMode !== ""
                 }
             }
         }
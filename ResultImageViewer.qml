@@ -1,7 +1,8 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
-import Qt5Compat.GraphicalEffects
+import QtQuick.Dialogs
+import GeoTiffProcessor
 
 Item {
     id: root
@@ -18,78 +19,93 @@ Item {
     property real overlayOpacity: 0.8
     property int colormapMode: 0  // 0=Jet, 1=Viridis, 2=Turbo
     
-    onOverlayColorChanged: {
-        console.log("Overlay color changed to:", overlayColor)
+    // Export a piena risoluzione del composito visibile (processor.exportRendered)
+    property var processor: null
+    property bool exporting: false
+    property real exportProgress: 0
+    
+    function cleanPath(path) {
+        if (path.startsWith("file:///")) return path.substring(8)
+        if (path.startsWith("file://")) return path.substring(7)
+        return path
     }
     
-    onOverlayOpacityChanged: {
-        console.log("Overlay opacity changed to:", overlayOpacity)
+    // Layer visibili come un'unica immagine del provider (composite=1): base RGB e
+    // maschera fuse in C++ a tile, una decodifica e una texture invece di tre Image
+    function compositeUrl() {
+        var showBase = showRgbLayer && displayPath !== ""
+        var showMask = showResultLayer && resultPath !== ""
+        if (!showBase && !showMask) return ""
+        var base = displayPath !== "" ? cleanPath(displayPath.replace(/\\/g, '/')) : ""
+        var url = "image://geotifftex/" + encodeURIComponent(base) + "?composite=1"
+        if (!showBase) url += "&base=0"
+        if (showMask) {
+            url += "&overlay=" + encodeURIComponent(cleanPath(resultPath.replace(/\\/g, '/')))
+            if (colorModeCheck.checked) {
+                url += "&overlayColor=" + encodeURIComponent(overlayColor.toString())
+                       + "&opacity=" + overlayOpacity.toFixed(2)
+            }
+        }
+        return url + "&t=" + Date.now()
     }
     
-    function updateImage(path) {
-        console.log("updateImage called with:", path)
-        resultPath = path
-        loadResultImage()
+    // Le modifiche ravvicinate (slider dell'opacità, toggle) producono un solo composito
+    function scheduleComposite() {
+        compositeTimer.restart()
     }
     
-    function loadRgbImage() {
-        if (displayPath === "") {
-            rgbImage.source = ""
+    // Il nuovo composito si carica nel layer nascosto; si scambia quando è pronto
+    function loadComposite() {
+        var url = compositeUrl()
+        if (url === "") {
+            compositeA.source = ""
+            compositeB.source = ""
             return
         }
-        
-        var normalizedPath = displayPath.replace(/\\/g, '/')
-        
-        if (normalizedPath.endsWith('.tif') || normalizedPath.endsWith('.tiff')) {
-            var cleanPath = normalizedPath
-            if (cleanPath.startsWith("file:///")) cleanPath = cleanPath.substring(8)
-            else if (cleanPath.startsWith("file://")) cleanPath = cleanPath.substring(7)
-            var encodedPath = encodeURIComponent(cleanPath)
-            var imageUrl = "image://geotiff/" + encodedPath + "?colormap=-1&t=" + Date.now()
-            rgbImage.source = ""
-            rgbImage.source = imageUrl
-        } else {
-            var fileUrl = normalizedPath.startsWith("file://") ? normalizedPath : "file:///" + normalizedPath
-            rgbImage.source = ""
-            rgbImage.source = fileUrl
-        }
+        var back = frontLayer === 0 ? compositeB : compositeA
+        back.source = url
     }
     
-    function loadResultImage() {
-        if (resultPath === "") {
-            resultImage.source = ""
-            return
-        }
-        var normalizedPath = resultPath.replace(/\\/g, '/')
-        var rgbPath = displayPath.replace(/\\/g, '/')
-        // Rimuovi prefisso file:/// se presente
-        var cleanPath = normalizedPath
-        if (cleanPath.startsWith("file:///")) cleanPath = cleanPath.substring(8)
-        else if (cleanPath.startsWith("file://")) cleanPath = cleanPath.substring(7)
-        var cleanRgbPath = rgbPath
-        if (cleanRgbPath.startsWith("file:///")) cleanRgbPath = cleanRgbPath.substring(8)
-        else if (cleanRgbPath.startsWith("file://")) cleanRgbPath = cleanRgbPath.substring(7)
-        
-        var imageUrl = "image://geotiff/" + encodeURIComponent(cleanPath)
-        if (displayPath !== "") {
-            imageUrl += "?alignTo=" + encodeURIComponent(cleanRgbPath) + "&t=" + Date.now()
-        } else {
-            imageUrl += "?t=" + Date.now()
-        }
-        resultImage.source = ""
-        resultImage.source = imageUrl
+    function compositeReady(layer, image) {
+        if (layer === frontLayer) return
+        var previous = frontLayer === 0 ? compositeA : compositeB
+        var firstImage = frontImage.implicitWidth <= 0
+        frontLayer = layer
+        previous.source = ""    // libera la texture precedente
+        if (firstImage) flickable.fitToView()
+        console.log("✓ Composite loaded, size:", image.implicitWidth, "x", image.implicitHeight)
+    }
+    
+    property int frontLayer: 0
+    readonly property Image frontImage: frontLayer === 0 ? compositeA : compositeB
+    
+    Timer {
+        id: compositeTimer
+        interval: 120
+        onTriggered: root.loadComposite()
+    }
+    
+    function updateImage(path) {
+        console.log("updateImage called with:", path)
+        resultPath = path
+        scheduleComposite()
     }
     
     onDisplayPathChanged: {
         console.log("RGB path changed:", displayPath)
-        loadRgbImage()
+        scheduleComposite()
     }
     
     onResultPathChanged: {
         console.log("Result path changed:", resultPath)
-        loadResultImage()
+        scheduleComposite()
     }
     
+    onShowRgbLayerChanged: scheduleComposite()
+    onShowResultLayerChanged: scheduleComposite()
+    onOverlayColorChanged: scheduleComposite()
+    onOverlayOpacityChanged: scheduleComposite()
+    
     ColumnLayout {
         anchors.fill: parent
         spacing: 0
@@ -113,9 +129,9 @@ Item {
                 
                 // Funzione per adattare l'immagine al viewport
                 function fitToView() {
-                    if (rgbImage.implicitWidth > 0 && rgbImage.implicitHeight > 0) {
-                        var scaleX = flickable.width / rgbImage.implicitWidth
-                        var scaleY = flickable.height / rgbImage.implicitHeight
+                    if (root.frontImage.implicitWidth > 0 && root.frontImage.implicitHeight > 0) {
+                        var scaleX = flickable.width / root.frontImage.implicitWidth
+                        var scaleY = flickable.height / root.frontImage.implicitHeight
                         imageScale = Math.min(scaleX, scaleY, 1.0) * 0.95
                         // Centra l'immagine
                         contentX = 0
@@ -166,71 +182,37 @@ Item {
 
                 Item {
                     id: imageContainer
-                    width: rgbImage.implicitWidth * flickable.imageScale
-                    height: rgbImage.implicitHeight * flickable.imageScale
+                    width: root.frontImage.implicitWidth * flickable.imageScale
+                    height: root.frontImage.implicitHeight * flickable.imageScale
                     
                     // Centra quando l'immagine è più piccola del viewport
                     x: Math.max(0, (flickable.width - width) / 2)
                     y: Math.max(0, (flickable.height - height) / 2)
                     
-                    // Layer 1: RGB background
-                    Image {
-                        id: rgbImage
-                        anchors.fill: parent
-                        fillMode: Image.PreserveAspectFit
-                        cache: false
-                        asynchronous: true
-                        sourceSize.width: 4096
-                        sourceSize.height: 4096
-                        visible: root.showRgbLayer && root.displayPath !== ""
-                        z: 0
-                        onStatusChanged: {
-                            if (status === Image.Ready) {
-                                console.log("✓ RGB layer loaded, size:", implicitWidth, "x", implicitHeight)
-                                flickable.fitToView()
-                            }
-                        }
-                    }
-
-                    // Layer 2: Result image (maschera) - anchors.fill per allinearsi all'RGB
+                    // Composito in doppio buffer: resta visibile il precedente finché
+                    // il nuovo non è pronto
                     Image {
-                        id: resultImage
+                        id: compositeA
                         anchors.fill: parent
                         fillMode: Image.PreserveAspectFit
                         cache: false
                         asynchronous: true
-                        sourceSize.width: 4096
-                        sourceSize.height: 4096
-                        visible: root.showResultLayer && root.resultPath !== "" && !colorModeCheck.checked
-                        z: 1
-                        opacity: 1
-                        onStatusChanged: {
-                            if (status === Image.Ready) {
-                                console.log("✓ Result layer loaded, size:", implicitWidth, "x", implicitHeight)
-                            }
-                        }
+                        sourceSize.width: MemoryGovernor.maxPreviewSize
+                        sourceSize.height: MemoryGovernor.maxPreviewSize
+                        visible: root.frontLayer === 0
+                        onStatusChanged: if (status === Image.Ready) root.compositeReady(0, compositeA)
                     }
-
-                    // Layer 3: Maschera colorata con ColorOverlay
+                    
                     Image {
-                        id: resultImageForColor
+                        id: compositeB
                         anchors.fill: parent
                         fillMode: Image.PreserveAspectFit
                         cache: false
                         asynchronous: true
-                        sourceSize.width: 4096
-                        sourceSize.height: 4096
-                        source: resultImage.source
-                        visible: false  // Nascosto, usato come sorgente per ColorOverlay
-                    }
-                    
-                    ColorOverlay {
-                        anchors.fill: parent
-                        source: resultImageForColor
-                        color: root.overlayColor
-                        visible: root.showResultLayer && root.resultPath !== "" && colorModeCheck.checked
-                        opacity: root.overlayOpacity
-                        z: 2
+                        sourceSize.width: MemoryGovernor.maxPreviewSize
+                        sourceSize.height: MemoryGovernor.maxPreviewSize
+                        visible: root.frontLayer === 1
+                        onStatusChanged: if (status === Image.Ready) root.compositeReady(1, compositeB)
                     }
                 }
             }
@@ -287,6 +269,7 @@ Item {
                     text: "False Color"
                     checked: false
                     enabled: root.resultPath !== ""
+                    onCheckedChanged: root.scheduleComposite()
                 }
                 
                 // Palette colori per la maschera
@@ -344,6 +327,29 @@ Item {
                 
                 Item { Layout.fillWidth: true }
                 
+                // Export del composito: layer visibili, maschera colorata come in False Color
+                Button {
+                    text: "Export…"
+                    visible: !root.exporting
+                    enabled: root.processor !== null && !root.processor.derivationRunning
+                             && ((root.showRgbLayer && root.displayPath !== "") || (root.showResultLayer && root.resultPath !== ""))
+                    onClicked: compositeExportDialog.open()
+                }
+                
+                ProgressBar {
+                    Layout.preferredWidth: 80
+                    visible: root.exporting
+                    from: 0
+                    to: 1
+                    value: root.exportProgress
+                }
+                
+                Button {
+                    text: "Cancel"
+                    visible: root.exporting
+                    onClicked: root.processor.cancelDerivation()
+                }
+                
                 // Zoom controls
                 Rectangle { width: 1; Layout.fillHeight: true; color: "#404040" }
                 
@@ -380,4 +386,30 @@ Item {
             }
         }
     }
+    
+    FileDialog {
+        id: compositeExportDialog
+        title: "Export Composite"
+        fileMode: FileDialog.SaveFile
+        defaultSuffix: "tif"
+        nameFilters: ["GeoTIFF (*.tif)", "Cloud Optimized GeoTIFF (*.tif)", "PNG (*.png)"]
+        onAccepted: {
+            var format = ["gtiff", "cog", "png"][Math.max(0, selectedNameFilter.index)]
+            var base = root.showRgbLayer ? root.cleanPath(root.displayPath.replace(/\\/g, '/')) : ""
+            var overlay = root.showResultLayer ? root.cleanPath(root.resultPath.replace(/\\/g, '/')) : ""
+            root.exportProgress = 0
+            root.exporting = true
+            root.processor.exportRendered(base, -1, overlay, colorModeCheck.checked ? root.overlayColor.toString() : "",
+                                          root.overlayOpacity, format, root.cleanPath(selectedFile.toString()))
+        }
+    }
+    
+    Connections {
+        target: root.processor
+        enabled: root.exporting
+        function onDerivationProgress(fraction) { root.exportProgress = fraction }
+        function onDerivationRunningChanged() {
+            if (!root.processor.derivationRunning) root.exporting = false
+        }
+    }
 }
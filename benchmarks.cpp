@@ -0,0 +1,791 @@
+#include "benchmarks.h"
+#include "rasterreader.h"
+#include "rasteralgebra.h"
+#include "denoise.h"
+#include "quantize.h"
+#include "compositor.h"
+#include "tileserver.h"
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QEventLoop>
+#include <QThread>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QHash>
+#include <functional>
+#include <memory>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <gdal_priv.h>
+
+namespace {
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+bool isValidSample(double value, bool hasNoData, double noData)
+{
+    return !std::isnan(value) && !std::isinf(value) && !(hasNoData && value == noData);
+}
+
+// Riferimento ideale per la riduzione: media a box di tutti i pixel validi a
+// piena risoluzione, letta a strisce per tenere limitata la memoria
+bool boxReference(GDALRasterBand *band, int outWidth, int outHeight, std::vector<double> &reference)
+{
+    int width = band->GetXSize();
+    int height = band->GetYSize();
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    std::vector<double> sums((size_t)outWidth * outHeight, 0.0);
+    std::vector<int> counts((size_t)outWidth * outHeight, 0);
+    std::vector<int> columnCell(width);
+    for (int x = 0; x < width; ++x) {
+        columnCell[x] = std::min(outWidth - 1, static_cast<int>((long long)x * outWidth / width));
+    }
+
+    const size_t stripBytes = 64u * 1024u * 1024u;
+    int stripHeight = std::max(1, std::min(height, static_cast<int>(stripBytes / (sizeof(float) * width))));
+    std::vector<float> strip((size_t)width * stripHeight);
+
+    for (int y0 = 0; y0 < height; y0 += stripHeight) {
+        int rows = std::min(stripHeight, height - y0);
+        if (band->RasterIO(GF_Read, 0, y0, width, rows, strip.data(), width, rows, GDT_Float32, 0, 0) != CE_None) {
+            qWarning() << "Reference read failed:" << CPLGetLastErrorMsg();
+            return false;
+        }
+        for (int r = 0; r < rows; ++r) {
+            int cellY = std::min(outHeight - 1, static_cast<int>((long long)(y0 + r) * outHeight / height));
+            const float *line = strip.data() + (size_t)r * width;
+            for (int x = 0; x < width; ++x) {
+                if (!isValidSample(line[x], hasNoData, noData)) {
+                    continue;
+                }
+                size_t idx = (size_t)cellY * outWidth + columnCell[x];
+                sums[idx] += line[x];
+                counts[idx]++;
+            }
+        }
+    }
+
+    reference.assign((size_t)outWidth * outHeight, std::numeric_limits<double>::quiet_NaN());
+    for (size_t i = 0; i < reference.size(); ++i) {
+        if (counts[i] > 0) {
+            reference[i] = sums[i] / counts[i];
+        }
+    }
+    return true;
+}
+
+// Costo (prima lettura e mediana a cache calda) contro qualità (RMSE/PSNR
+// rispetto alla media a box) per ogni modalità e dimensione di anteprima
+int resamplingBenchmark(const QStringList &arguments)
+{
+    if (arguments.isEmpty()) {
+        out() << "Usage: --benchmark resampling <raster.tif> [size ...]\n";
+        return 1;
+    }
+
+    QString path = arguments.first();
+    QList<int> sizes;
+    for (int i = 1; i < arguments.size(); ++i) {
+        if (arguments[i].toInt() > 0) sizes << arguments[i].toInt();
+    }
+    if (sizes.isEmpty()) sizes << 256 << 512 << 1024 << 2048;
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        out() << "Failed to open: " << path << "\n";
+        return 1;
+    }
+    GDALRasterBand *band = dataset->GetRasterBand(1);
+    int width = band->GetXSize();
+    int height = band->GetYSize();
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    out() << "Resampling benchmark: " << path << "\n";
+    out() << "  " << width << " x " << height << ", overviews: " << band->GetOverviewCount() << "\n\n";
+    out() << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                 .arg(QString("size"), -11).arg(QString("mode"), -9).arg(QString("overview"), 9)
+                 .arg(QString("first ms"), 10).arg(QString("median ms"), 10)
+                 .arg(QString("RMSE"), 12).arg(QString("PSNR dB"), 9);
+    out().flush();
+
+    const QList<ResampleMode> modes = {ResampleMode::Nearest, ResampleMode::Average, ResampleMode::Bilinear,
+                                       ResampleMode::Cubic, ResampleMode::Mode};
+    const int repetitions = 5;
+
+    for (int size : sizes) {
+        double scale = std::min(1.0, std::min((double)size / width, (double)size / height));
+        int outWidth = std::max(1, static_cast<int>(width * scale));
+        int outHeight = std::max(1, static_cast<int>(height * scale));
+
+        std::vector<double> reference;
+        if (!boxReference(band, outWidth, outHeight, reference)) {
+            GDALClose(dataset);
+            return 1;
+        }
+        double refMin = std::numeric_limits<double>::max();
+        double refMax = std::numeric_limits<double>::lowest();
+        for (double v : reference) {
+            if (std::isnan(v)) continue;
+            refMin = std::min(refMin, v);
+            refMax = std::max(refMax, v);
+        }
+        double peak = refMax > refMin ? refMax - refMin : 1.0;
+
+        double factorX = 1.0;
+        double factorY = 1.0;
+        RasterReader::bestOverview(band, std::min((double)width / outWidth, (double)height / outHeight),
+                                   factorX, factorY);
+
+        std::vector<float> buffer((size_t)outWidth * outHeight);
+        for (ResampleMode mode : modes) {
+            std::vector<qint64> times;
+            QElapsedTimer timer;
+            bool failed = false;
+            for (int rep = 0; rep <= repetitions && !failed; ++rep) {
+                timer.start();
+                failed = RasterReader::readBand(band, buffer.data(), outWidth, outHeight, GDT_Float32, mode) != CE_None;
+                times.push_back(timer.nsecsElapsed());
+            }
+            if (failed) {
+                out() << "  " << RasterReader::modeName(mode) << ": read failed: " << CPLGetLastErrorMsg() << "\n";
+                continue;
+            }
+
+            double errorSum = 0.0;
+            qint64 samples = 0;
+            for (size_t i = 0; i < buffer.size(); ++i) {
+                if (std::isnan(reference[i]) || !isValidSample(buffer[i], hasNoData, noData)) continue;
+                double diff = buffer[i] - reference[i];
+                errorSum += diff * diff;
+                ++samples;
+            }
+            double rmse = samples > 0 ? std::sqrt(errorSum / samples) : 0.0;
+            double psnr = rmse > 0.0 ? 20.0 * std::log10(peak / rmse) : std::numeric_limits<double>::infinity();
+
+            // La prima lettura include l'I/O a cache fredda, la mediana quella calda
+            qint64 first = times.front();
+            std::vector<qint64> warm(times.begin() + 1, times.end());
+            std::sort(warm.begin(), warm.end());
+            qint64 median = warm[warm.size() / 2];
+
+            out() << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                         .arg(QString("%1x%2").arg(outWidth).arg(outHeight), -11)
+                         .arg(RasterReader::modeName(mode), -9)
+                         .arg(QString("1/%1").arg(std::max(factorX, factorY), 0, 'f', 1), 9)
+                         .arg(first / 1e6, 10, 'f', 2)
+                         .arg(median / 1e6, 10, 'f', 2)
+                         .arg(rmse, 12, 'g', 5)
+                         .arg(psnr, 9, 'f', 2);
+            out().flush();
+        }
+    }
+
+    GDALClose(dataset);
+    return 0;
+}
+
+// Kernel NDVI/CHM: SSE2 contro scalare su dati sintetici (con nodata sparsi),
+// throughput in Mpixel/s e verifica che i due percorsi diano lo stesso risultato
+int algebraBenchmark(const QStringList &arguments)
+{
+    size_t count = arguments.isEmpty() ? 16u * 1024u * 1024u : arguments.first().toULongLong();
+    if (count == 0) {
+        out() << "Usage: --benchmark algebra [pixels]\n";
+        return 1;
+    }
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> reflectance(0.0f, 4000.0f);
+    std::uniform_real_distribution<float> elevation(100.0f, 130.0f);
+    std::vector<float> a(count), b(count), scalar(count), simd(count);
+    for (size_t i = 0; i < count; ++i) {
+        bool hole = (random() % 50) == 0;
+        a[i] = hole ? RasterAlgebra::NoData : reflectance(random);
+        b[i] = reflectance(random);
+    }
+
+    const float noData = std::numeric_limits<float>::quiet_NaN();
+    const int repetitions = 5;
+    auto measure = [&](auto kernel) {
+        std::vector<qint64> times;
+        QElapsedTimer timer;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            timer.start();
+            kernel();
+            times.push_back(timer.nsecsElapsed());
+        }
+        std::sort(times.begin(), times.end());
+        return count / (times[times.size() / 2] / 1e3);    // Mpixel/s
+    };
+
+    out() << "Raster algebra kernels: " << count << " pixels, SSE2 "
+          << (RasterAlgebra::hasSimd() ? "enabled" : "not available") << "\n\n";
+    out() << QString("%1 %2 %3 %4\n").arg(QString("kernel"), -8).arg(QString("scalar Mpx/s"), 14)
+                 .arg(QString("simd Mpx/s"), 14).arg(QString("match"), 7);
+
+    double ndviScalar = measure([&] { RasterAlgebra::ndviKernelScalar(a.data(), b.data(), scalar.data(), count, noData, noData); });
+    double ndviSimd = measure([&] { RasterAlgebra::ndviKernel(a.data(), b.data(), simd.data(), count, noData, noData); });
+    bool ndviMatch = std::memcmp(scalar.data(), simd.data(), count * sizeof(float)) == 0;
+    out() << QString("%1 %2 %3 %4\n").arg(QString("ndvi"), -8).arg(ndviScalar, 14, 'f', 1)
+                 .arg(ndviSimd, 14, 'f', 1).arg(QString(ndviMatch ? "yes" : "NO"), 7);
+
+    for (size_t i = 0; i < count; ++i) {
+        a[i] = a[i] == RasterAlgebra::NoData ? a[i] : elevation(random);
+        b[i] = 100.0f + (i % 1000) * 0.01f;
+    }
+    double chmScalar = measure([&] { RasterAlgebra::chmKernelScalar(a.data(), b.data(), scalar.data(), count, noData, noData); });
+    double chmSimd = measure([&] { RasterAlgebra::chmKernel(a.data(), b.data(), simd.data(), count, noData, noData); });
+    bool chmMatch = std::memcmp(scalar.data(), simd.data(), count * sizeof(float)) == 0;
+    out() << QString("%1 %2 %3 %4\n").arg(QString("chm"), -8).arg(chmScalar, 14, 'f', 1)
+                 .arg(chmSimd, 14, 'f', 1).arg(QString(chmMatch ? "yes" : "NO"), 7);
+    out().flush();
+    return ndviMatch && chmMatch ? 0 : 1;
+}
+
+int denoiseBenchmark(const QStringList &arguments)
+{
+    int side = arguments.isEmpty() ? 1024 : arguments.first().toInt();
+    if (side <= 0) {
+        out() << "Usage: --benchmark denoise [tile side]\n";
+        return 1;
+    }
+
+    // DSM sintetico: pendenza + rumore, qualche picco isolato e qualche buco
+    const int maxHalo = 2 * Denoise::MaxRadius;
+    const int stride = side + 2 * maxHalo;
+    std::mt19937 random(7);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    std::vector<float> source((size_t)stride * stride);
+    for (int y = 0; y < stride; ++y) {
+        for (int x = 0; x < stride; ++x) {
+            float value = 100.0f + 0.02f * x + 0.01f * y + noise(random);
+            if (random() % 400 == 0) value += 25.0f;
+            if (random() % 100 == 0) value = std::numeric_limits<float>::quiet_NaN();
+            source[(size_t)y * stride + x] = value;
+        }
+    }
+
+    const size_t count = (size_t)side * side;
+    std::vector<float> scalar(count), simd(count), scratch;
+    const int repetitions = 3;
+    auto measure = [&](auto kernel) {
+        std::vector<qint64> times;
+        QElapsedTimer timer;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            timer.start();
+            kernel();
+            times.push_back(timer.nsecsElapsed());
+        }
+        std::sort(times.begin(), times.end());
+        return count / (times[times.size() / 2] / 1e3);    // Mpixel/s
+    };
+
+    out() << "Denoise kernels: " << side << " x " << side << " tile, SSE2 "
+          << (Denoise::hasSimd() ? "enabled" : "not available") << "\n\n";
+    out() << QString("%1 %2 %3 %4\n").arg(QString("filter"), -12).arg(QString("scalar Mpx/s"), 14)
+                 .arg(QString("simd Mpx/s"), 14).arg(QString("match"), 7);
+
+    bool allMatch = true;
+    for (Denoise::Filter filter : {Denoise::Filter::Median, Denoise::Filter::Gaussian, Denoise::Filter::Opening}) {
+        for (int radius = 1; radius <= 2; ++radius) {
+            Denoise::Params params;
+            params.filter = filter;
+            params.radius = radius;
+            // Angolo dell'halo del filtro dentro il bordo massimo
+            const int offset = maxHalo - Denoise::haloSize(params);
+            const float *src = source.data() + (size_t)offset * stride + offset;
+            double scalarRate = measure([&] { Denoise::filterTileScalar(params, src, stride, side, side, scalar.data(), scratch); });
+            double simdRate = measure([&] { Denoise::filterTile(params, src, stride, side, side, simd.data(), scratch); });
+            bool match = std::memcmp(scalar.data(), simd.data(), count * sizeof(float)) == 0;
+            allMatch = allMatch && match;
+            QString name = Denoise::filterName(filter) + QString(" %1x%1").arg(2 * radius + 1);
+            out() << QString("%1 %2 %3 %4\n").arg(name, -12).arg(scalarRate, 14, 'f', 1)
+                         .arg(simdRate, 14, 'f', 1).arg(QString(match ? "yes" : "NO"), 7);
+        }
+    }
+    out().flush();
+    return allMatch ? 0 : 1;
+}
+
+// Esito di un passaggio del generatore di carico sul tile server
+struct LoadResult
+{
+    int ok = 0;             // 200
+    int notModified = 0;    // 304
+    int failed = 0;
+    qint64 bytes = 0;
+    double seconds = 0.0;
+    std::vector<double> latenciesMs;
+    QHash<QString, QByteArray> etags;
+};
+
+// Generatore di carico locale: `connections` client keep-alive sul loopback,
+// ognuno con una richiesta in volo, che si spartiscono la lista dei percorsi.
+// Con `etags` manda If-None-Match (revalidazione come un browser).
+LoadResult runLoad(quint16 port, const QStringList &paths, int connections,
+                   const QHash<QString, QByteArray> *etags)
+{
+    struct Client
+    {
+        QTcpSocket socket;
+        QByteArray buffer;
+        QString path;
+        QElapsedTimer started;
+        int headerEnd = -1;
+        int status = 0;
+        qint64 contentLength = 0;
+        QByteArray etag;
+        bool done = false;
+    };
+
+    LoadResult result;
+    QEventLoop loop;
+    int next = 0;
+    int active = 0;
+    std::vector<std::unique_ptr<Client>> clients;
+    QElapsedTimer total;
+    total.start();
+
+    auto finish = [&](Client *client) {
+        client->done = true;
+        client->socket.disconnectFromHost();
+        if (--active == 0) loop.quit();
+    };
+    auto sendNext = [&](Client *client) {
+        if (next >= paths.size()) {
+            finish(client);
+            return;
+        }
+        client->path = paths[next++];
+        QByteArray request = "GET " + client->path.toUtf8() + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+        if (etags && etags->contains(client->path)) {
+            request += "If-None-Match: " + etags->value(client->path) + "\r\n";
+        }
+        request += "\r\n";
+        client->started.start();
+        client->socket.write(request);
+    };
+    auto readResponses = [&](Client *client) {
+        client->buffer += client->socket.readAll();
+        while (true) {
+            if (client->headerEnd < 0) {
+                int end = client->buffer.indexOf("\r\n\r\n");
+                if (end < 0) return;
+                client->headerEnd = end + 4;
+                QList<QByteArray> lines = client->buffer.left(end).split('\n');
+                client->status = lines.value(0).split(' ').value(1).toInt();
+                client->contentLength = 0;
+                client->etag.clear();
+                for (const QByteArray &line : lines) {
+                    int colon = line.indexOf(':');
+                    QByteArray name = line.left(colon).trimmed().toLower();
+                    if (name == "content-length") client->contentLength = line.mid(colon + 1).trimmed().toLongLong();
+                    else if (name == "etag") client->etag = line.mid(colon + 1).trimmed();
+                }
+            }
+            qint64 size = client->headerEnd + client->contentLength;
+            if (client->buffer.size() < size) return;
+
+            result.latenciesMs.push_back(client->started.nsecsElapsed() / 1e6);
+            if (client->status == 200) {
+                result.ok++;
+                result.bytes += client->contentLength;
+                result.etags.insert(client->path, client->etag);
+            } else if (client->status == 304) {
+                result.notModified++;
+            } else {
+                result.failed++;
+            }
+            client->buffer.remove(0, size);
+            client->headerEnd = -1;
+            sendNext(client);
+        }
+    };
+
+    for (int i = 0; i < connections; ++i) {
+        clients.emplace_back(new Client);
+        Client *client = clients.back().get();
+        QObject::connect(&client->socket, &QTcpSocket::connected, &loop, [&, client]() { sendNext(client); });
+        QObject::connect(&client->socket, &QTcpSocket::readyRead, &loop, [&, client]() { readResponses(client); });
+        QObject::connect(&client->socket, &QTcpSocket::errorOccurred, &loop, [&, client]() {
+            if (!client->done) {
+                result.failed++;
+                finish(client);
+            }
+        });
+        active++;
+        client->socket.connectToHost(QHostAddress::LocalHost, port);
+    }
+    if (active > 0) {
+        loop.exec();
+    }
+    result.seconds = total.nsecsElapsed() / 1e9;
+    return result;
+}
+
+// Throughput del tile server (--serve) con il generatore di carico sul
+// loopback: a freddo (resa), a caldo (cache) e revalidazione con ETag (304)
+int tilesBenchmark(const QStringList &arguments)
+{
+    if (arguments.isEmpty()) {
+        out() << "Usage: --benchmark tiles <raster.tif> [zoom] [connections] [max tiles]\n";
+        return 1;
+    }
+
+    TileServer::Options options;
+    options.rasterPath = arguments.first();
+    options.address = QHostAddress::LocalHost;
+    options.port = 0;
+    TileServer server(options);
+    QString error;
+    if (!server.start(&error)) {
+        out() << "Tile server: " << error << "\n";
+        return 1;
+    }
+
+    int zoom = arguments.size() > 1 ? qBound(0, arguments[1].toInt(), (int)TileServer::MaxZoom) : server.nativeZoom();
+    int connections = arguments.size() > 2 ? std::max(1, arguments[2].toInt()) : 16;
+    int maxTiles = arguments.size() > 3 ? std::max(1, arguments[3].toInt()) : 1024;
+
+    // Blocco di tile al centro dell'estensione, al più maxTiles
+    QRect range = server.tileRange(zoom);
+    int side = std::max(1, (int)std::ceil(std::sqrt((double)maxTiles)));
+    QRect block(range.center().x() - side / 2, range.center().y() - side / 2, side, side);
+    block = block.intersected(range);
+    QStringList paths;
+    for (int y = block.top(); y <= block.bottom(); ++y) {
+        for (int x = block.left(); x <= block.right() && paths.size() < maxTiles; ++x) {
+            paths << QString("/%1/%2/%3.png").arg(zoom).arg(x).arg(y);
+        }
+    }
+
+    out() << "Tile server benchmark: " << options.rasterPath << "\n";
+    out() << "  zoom " << zoom << " (native " << server.nativeZoom() << "), " << paths.size() << " tiles, "
+          << connections << " connections, " << QThread::idealThreadCount() << " workers\n\n";
+    out() << QString("%1 %2 %3 %4 %5 %6 %7\n").arg(QString("pass"), -11).arg(QString("requests"), 9)
+                 .arg(QString("tiles/s"), 10).arg(QString("MB/s"), 8).arg(QString("p50 ms"), 8)
+                 .arg(QString("p95 ms"), 8).arg(QString("failed"), 7);
+    out().flush();
+
+    auto report = [&](const QString &name, LoadResult &result) {
+        std::sort(result.latenciesMs.begin(), result.latenciesMs.end());
+        auto percentile = [&](double p) {
+            return result.latenciesMs.empty() ? 0.0
+                   : result.latenciesMs[std::min(result.latenciesMs.size() - 1,
+                                                 (size_t)(p * result.latenciesMs.size()))];
+        };
+        int requests = result.ok + result.notModified + result.failed;
+        out() << QString("%1 %2 %3 %4 %5 %6 %7\n").arg(name, -11).arg(requests, 9)
+                     .arg(requests / std::max(1e-9, result.seconds), 10, 'f', 1)
+                     .arg(result.bytes / 1048576.0 / std::max(1e-9, result.seconds), 8, 'f', 2)
+                     .arg(percentile(0.5), 8, 'f', 2).arg(percentile(0.95), 8, 'f', 2).arg(result.failed, 7);
+        out().flush();
+    };
+
+    LoadResult cold = runLoad(server.port(), paths, connections, nullptr);
+    report("cold", cold);
+    LoadResult warm = runLoad(server.port(), paths, connections, nullptr);
+    report("warm", warm);
+    LoadResult revalidate = runLoad(server.port(), paths, connections, &cold.etags);
+    report("revalidate", revalidate);
+
+    TileServer::Stats stats = server.stats();
+    out() << "\nServer: " << stats.rendered << " rendered, " << stats.cacheHits << " cache hits, "
+          << stats.notModified << " not modified, " << stats.empty << " empty, "
+          << server.cacheBytes() / 1048576.0 << " MB cached\n";
+    out().flush();
+    return cold.failed + warm.failed + revalidate.failed == 0 ? 0 : 1;
+}
+
+// Scalabilità della decodifica parallela a blocchi (RasterReader::readParallel)
+// sulla banda intera: ogni ripetizione apre dataset nuovi, quindi i blocchi si
+// decomprimono davvero; il risultato deve coincidere con la lettura a 1 thread
+int decodeBenchmark(const QStringList &arguments)
+{
+    if (arguments.isEmpty()) {
+        out() << "Usage: --benchmark decode <raster.tif> [threads ...]\n";
+        return 1;
+    }
+
+    QString path = arguments.first();
+    QList<int> threadCounts;
+    for (int i = 1; i < arguments.size(); ++i) {
+        if (arguments[i].toInt() > 0) threadCounts << arguments[i].toInt();
+    }
+    if (threadCounts.isEmpty()) {
+        for (int t = 1; t < QThread::idealThreadCount(); t *= 2) threadCounts << t;
+        threadCounts << QThread::idealThreadCount();
+    }
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        out() << "Failed to open: " << path << "\n";
+        return 1;
+    }
+    GDALRasterBand *band = dataset->GetRasterBand(1);
+    const int width = band->GetXSize();
+    const int height = band->GetYSize();
+    int blockWidth = 0, blockHeight = 0;
+    band->GetBlockSize(&blockWidth, &blockHeight);
+    const char *compression = dataset->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+    out() << "Parallel decode benchmark: " << path << "\n";
+    out() << "  " << width << " x " << height << ", blocks " << blockWidth << " x " << blockHeight
+          << ", compression " << (compression ? compression : "none") << "\n\n";
+    GDALClose(dataset);
+
+    const size_t pixels = (size_t)width * height;
+    const double megabytes = pixels * sizeof(float) / 1048576.0;
+    std::vector<float> reference(pixels);
+    if (RasterReader::readParallel(path, 1, 0, 0, width, height, reference.data(), GDT_Float32, 1) != CE_None) {
+        out() << "Reference read failed: " << CPLGetLastErrorMsg() << "\n";
+        return 1;
+    }
+
+    out() << QString("%1 %2 %3 %4 %5\n")
+                 .arg(QString("threads"), -8).arg(QString("median ms"), 10).arg(QString("MB/s"), 9)
+                 .arg(QString("speedup"), 8).arg(QString("match"), 6);
+    out().flush();
+
+    const int repetitions = 3;
+    std::vector<float> buffer(pixels);
+    double baseline = 0.0;
+    for (int threads : threadCounts) {
+        std::vector<double> times;
+        for (int r = 0; r < repetitions; ++r) {
+            QElapsedTimer timer;
+            timer.start();
+            if (RasterReader::readParallel(path, 1, 0, 0, width, height, buffer.data(), GDT_Float32, threads) != CE_None) {
+                out() << "Read failed with " << threads << " threads\n";
+                return 1;
+            }
+            times.push_back(timer.nsecsElapsed() / 1e6);
+        }
+        std::sort(times.begin(), times.end());
+        const double median = times[times.size() / 2];
+        if (baseline == 0.0) baseline = median;
+        const bool match = std::memcmp(buffer.data(), reference.data(), pixels * sizeof(float)) == 0;
+        out() << QString("%1 %2 %3 %4 %5\n")
+                     .arg(threads, -8).arg(median, 10, 'f', 1).arg(megabytes / (median / 1000.0), 9, 'f', 1)
+                     .arg(baseline / median, 8, 'f', 2).arg(match ? "yes" : "NO", 6);
+        out().flush();
+        if (!match) return 1;
+    }
+    return 0;
+}
+
+int quantizeBenchmark(const QStringList &arguments)
+{
+    int pixels = arguments.isEmpty() ? 4 * 1024 * 1024 : arguments.first().toInt();
+    if (pixels <= 0) {
+        out() << "Usage: --benchmark quantize [pixels]\n";
+        return 1;
+    }
+
+    // DSM sintetico in quota (800-1300 m): il caso peggiore per l'half
+    const float noData = -9999.0f;
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> elevation(800.0f, 1300.0f);
+    std::vector<float> source(pixels);
+    for (float &value : source) {
+        value = elevation(random);
+        if (random() % 200 == 0) value = noData;
+        if (random() % 500 == 0) value = std::numeric_limits<float>::quiet_NaN();
+    }
+    float minValue = 0.0f, maxValue = 0.0f;
+    Quantize::validRange(source.data(), source.size(), noData, minValue, maxValue);
+
+    const int repetitions = 5;
+    auto rate = [&](auto kernel) {
+        std::vector<qint64> times;
+        QElapsedTimer timer;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            timer.start();
+            kernel();
+            times.push_back(timer.nsecsElapsed());
+        }
+        std::sort(times.begin(), times.end());
+        return pixels / (times[times.size() / 2] / 1e3);    // Mpixel/s
+    };
+    // Errore massimo sui validi; nodata e non validi devono tornare esatti
+    auto maxError = [&](const std::vector<float> &decoded, bool &exact) {
+        double error = 0.0;
+        exact = true;
+        for (size_t i = 0; i < source.size(); ++i) {
+            if (std::isnan(source[i])) {
+                exact = exact && std::isnan(decoded[i]);
+            } else if (source[i] == noData) {
+                exact = exact && decoded[i] == noData;
+            } else {
+                error = std::max(error, (double)std::abs(decoded[i] - source[i]));
+            }
+        }
+        return error;
+    };
+
+    out() << "Quantized tile formats: " << pixels << " samples in [" << minValue << ", " << maxValue
+          << "], SSE2 " << (Quantize::hasSimd() ? "enabled" : "not available") << "\n\n";
+    out() << QString("%1 %2 %3 %4 %5 %6 %7 %8\n").arg(QString("format"), -8).arg(QString("bytes"), 6)
+                 .arg(QString("enc scalar"), 11).arg(QString("enc simd"), 10)
+                 .arg(QString("dec scalar"), 11).arg(QString("dec simd"), 10)
+                 .arg(QString("max error"), 10).arg(QString("match"), 6);
+
+    std::vector<float> decodedScalar(pixels), decodedSimd(pixels);
+    std::vector<quint16> codes16(pixels), codes16Scalar(pixels);
+    std::vector<uchar> codes8(pixels), codes8Scalar(pixels);
+    bool allMatch = true;
+    for (Quantize::Format format : {Quantize::Format::Float16, Quantize::Format::UInt16, Quantize::Format::UInt8}) {
+        double encScalar = 0.0, encSimd = 0.0, decScalar = 0.0, decSimd = 0.0;
+        bool codesMatch = true;
+        if (format == Quantize::Format::Float16) {
+            encScalar = rate([&] { Quantize::toHalfScalar(source.data(), pixels, noData, codes16Scalar.data()); });
+            encSimd = rate([&] { Quantize::toHalf(source.data(), pixels, noData, codes16.data()); });
+            decScalar = rate([&] { Quantize::fromHalfScalar(codes16.data(), pixels, noData, decodedScalar.data()); });
+            decSimd = rate([&] { Quantize::fromHalf(codes16.data(), pixels, noData, decodedSimd.data()); });
+            codesMatch = codes16 == codes16Scalar;
+        } else if (format == Quantize::Format::UInt16) {
+            const float scale = (maxValue - minValue) / Quantize::UInt16MaxCode;
+            encScalar = rate([&] { Quantize::toUInt16Scalar(source.data(), pixels, minValue, scale, noData, codes16Scalar.data()); });
+            encSimd = rate([&] { Quantize::toUInt16(source.data(), pixels, minValue, scale, noData, codes16.data()); });
+            decScalar = rate([&] { Quantize::fromUInt16Scalar(codes16.data(), pixels, minValue, scale, noData, decodedScalar.data()); });
+            decSimd = rate([&] { Quantize::fromUInt16(codes16.data(), pixels, minValue, scale, noData, decodedSimd.data()); });
+            codesMatch = codes16 == codes16Scalar;
+        } else {
+            const float scale = (maxValue - minValue) / Quantize::UInt8MaxCode;
+            encScalar = rate([&] { Quantize::toUInt8Scalar(source.data(), pixels, minValue, scale, noData, codes8Scalar.data()); });
+            encSimd = rate([&] { Quantize::toUInt8(source.data(), pixels, minValue, scale, noData, codes8.data()); });
+            decScalar = rate([&] { Quantize::fromUInt8Scalar(codes8.data(), pixels, minValue, scale, noData, decodedScalar.data()); });
+            decSimd = rate([&] { Quantize::fromUInt8(codes8.data(), pixels, minValue, scale, noData, decodedSimd.data()); });
+            codesMatch = codes8 == codes8Scalar;
+        }
+        bool exact = true;
+        const double error = maxError(decodedSimd, exact);
+        // NaN != NaN: il confronto dei decodificati è sui bit
+        const bool match = codesMatch && exact
+                           && std::memcmp(decodedScalar.data(), decodedSimd.data(), pixels * sizeof(float)) == 0;
+        allMatch = allMatch && match;
+        out() << QString("%1 %2 %3 %4 %5 %6 %7 %8\n").arg(Quantize::formatName(format), -8)
+                     .arg(Quantize::sampleBytes(format), 6)
+                     .arg(encScalar, 11, 'f', 0).arg(encSimd, 10, 'f', 0)
+                     .arg(decScalar, 11, 'f', 0).arg(decSimd, 10, 'f', 0)
+                     .arg(error, 10, 'g', 3).arg(QString(match ? "yes" : "NO"), 6);
+    }
+    out() << "\nRates in Mpixel/s; max error in raster units on valid samples\n";
+    out().flush();
+    return allMatch ? 0 : 1;
+}
+
+int compositeBenchmark(const QStringList &arguments)
+{
+    int pixels = arguments.isEmpty() ? 4 * 1024 * 1024 : arguments.first().toInt();
+    if (pixels <= 0) {
+        out() << "Usage: --benchmark composite [pixels]\n";
+        return 1;
+    }
+
+    // RGB casuale e maschera a chiazze (~30% coperto), come un risultato tipico
+    std::mt19937 random(5);
+    std::vector<uchar> red(pixels), green(pixels), blue(pixels), mask(pixels);
+    for (int i = 0; i < pixels; ++i) {
+        red[i] = random() & 0xff;
+        green[i] = random() & 0xff;
+        blue[i] = random() & 0xff;
+        mask[i] = (i / 64 + (int)(random() % 4)) % 10 < 3 ? 1 : 0;
+    }
+    const QRgb color = qRgb(255, 0, 0);
+    const int alpha = 205;  // opacità 0.8
+
+    const int repetitions = 5;
+    auto rate = [&](auto kernel) {
+        std::vector<qint64> times;
+        QElapsedTimer timer;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            timer.start();
+            kernel();
+            times.push_back(timer.nsecsElapsed());
+        }
+        std::sort(times.begin(), times.end());
+        return pixels / (times[times.size() / 2] / 1e3);    // Mpixel/s
+    };
+
+    out() << "Composite kernels: " << pixels << " pixels, SSE2 "
+          << (Compositor::hasSimd() ? "enabled" : "not available") << "\n\n";
+    out() << QString("%1 %2 %3 %4 %5\n").arg(QString("kernel"), -10).arg(QString("scalar"), 10)
+                 .arg(QString("simd"), 10).arg(QString("speedup"), 8).arg(QString("match"), 6);
+
+    std::vector<QRgb> base(pixels), scalar(pixels), simd(pixels);
+    Compositor::packRgbScalar(red.data(), green.data(), blue.data(), pixels, base.data());
+    bool allMatch = true;
+    auto row = [&](const char *name, auto scalarKernel, auto simdKernel) {
+        const double scalarRate = rate([&] { scalar = base; scalarKernel(); });
+        const double simdRate = rate([&] { simd = base; simdKernel(); });
+        const bool match = scalar == simd;
+        allMatch = allMatch && match;
+        out() << QString("%1 %2 %3 %4 %5\n").arg(QString(name), -10).arg(scalarRate, 10, 'f', 0)
+                     .arg(simdRate, 10, 'f', 0).arg(simdRate / scalarRate, 8, 'f', 2)
+                     .arg(QString(match ? "yes" : "NO"), 6);
+    };
+    row("packRgb",
+        [&] { Compositor::packRgbScalar(red.data(), green.data(), blue.data(), pixels, scalar.data()); },
+        [&] { Compositor::packRgb(red.data(), green.data(), blue.data(), pixels, simd.data()); });
+    row("maskGray",
+        [&] { Compositor::maskGrayScalar(mask.data(), pixels, scalar.data()); },
+        [&] { Compositor::maskGray(mask.data(), pixels, simd.data()); });
+    row("blendMask",
+        [&] { Compositor::blendMaskScalar(mask.data(), pixels, color, alpha, scalar.data()); },
+        [&] { Compositor::blendMask(mask.data(), pixels, color, alpha, simd.data()); });
+    out() << "\nRates in Mpixel/s (including the copy of the base row)\n";
+    out().flush();
+    return allMatch ? 0 : 1;
+}
+
+} // namespace
+
+int runBenchmark(const QStringList &arguments)
+{
+    QString name = arguments.value(0);
+    QStringList rest = arguments.mid(1);
+
+    if (name == "resampling") {
+        return resamplingBenchmark(rest);
+    }
+    if (name == "algebra") {
+        return algebraBenchmark(rest);
+    }
+    if (name == "denoise") {
+        return denoiseBenchmark(rest);
+    }
+    if (name == "tiles") {
+        return tilesBenchmark(rest);
+    }
+    if (name == "decode") {
+        return decodeBenchmark(rest);
+    }
+    if (name == "quantize") {
+        return quantizeBenchmark(rest);
+    }
+    if (name == "composite") {
+        return compositeBenchmark(rest);
+    }
+
+    out() << "Available benchmarks:\n";
+    out() << "  resampling <raster.tif> [size ...]   cost vs quality of preview resampling modes\n";
+    out() << "  algebra [pixels]                     NDVI/CHM kernels, SSE2 vs scalar\n";
+    out() << "  denoise [tile side]                  median/gaussian/opening kernels, SSE2 vs scalar\n";
+    out() << "  tiles <raster.tif> [zoom] [conn]     tile server throughput: cold, cached, ETag revalidation\n";
+    out() << "  decode <raster.tif> [threads ...]    parallel block decode of the full band vs thread count\n";
+    out() << "  quantize [pixels]                    float16/uint16/uint8 tile formats: throughput and error\n";
+    out() << "  composite [pixels]                   RGB pack and mask blend kernels, SSE2 vs scalar\n";
+    return name.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QStringList>
+
+// Benchmark headless, lanciati da riga di comando:
+//   OliveM_Viewer --benchmark <nome> [argomenti...]
+// Stampano una tabella su stdout e restituiscono il codice di uscita.
+int runBenchmark(const QStringList &arguments);
+
+#endif // BENCHMARKS_H
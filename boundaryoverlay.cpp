@@ -0,0 +1,258 @@
+#include "boundaryoverlay.h"
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Feature più piccole di così (pixel a schermo) non si disegnano
+const double MinFeaturePixels = 1.5;
+// Vertici più vicini di così al precedente si saltano
+const double MinVertexPixels = 1.0;
+// Oltre questo rapporto di zoom la semplificazione non è più adeguata
+const double RebuildZoomRatio = 1.25;
+
+} // namespace
+
+BoundaryOverlay::BoundaryOverlay(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_visibleRect(0.0, 0.0, 1.0, 1.0)
+    , m_zoom(1.0)
+    , m_color(255, 80, 200, 220)
+    , m_running(false)
+    , m_generation(std::make_shared<QAtomicInt>(0))
+    , m_geometryDirty(true)
+    , m_builtZoom(0.0)
+{
+    setFlag(ItemHasContents, true);
+    m_pool.setMaxThreadCount(1);
+}
+
+BoundaryOverlay::~BoundaryOverlay()
+{
+    m_generation->fetchAndAddOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QString BoundaryOverlay::cleanPath(const QString &path)
+{
+    if (path.startsWith("file:///")) return path.mid(8);
+    if (path.startsWith("file://")) return path.mid(7);
+    return path;
+}
+
+void BoundaryOverlay::setSource(const QString &source)
+{
+    if (m_source == source) {
+        return;
+    }
+    m_source = source;
+    emit sourceChanged();
+    reload();
+}
+
+void BoundaryOverlay::setReference(const QString &reference)
+{
+    if (m_reference == reference) {
+        return;
+    }
+    m_reference = reference;
+    emit referenceChanged();
+    reload();
+}
+
+bool BoundaryOverlay::needsRebuild() const
+{
+    if (m_geometryDirty || m_builtZoom <= 0.0 || m_builtSize != size()) {
+        return true;
+    }
+    const double ratio = m_zoom / m_builtZoom;
+    return !m_builtRect.contains(m_visibleRect) || ratio > RebuildZoomRatio || ratio < 1.0 / RebuildZoomRatio;
+}
+
+void BoundaryOverlay::setVisibleRect(const QRectF &rect)
+{
+    if (m_visibleRect == rect) {
+        return;
+    }
+    m_visibleRect = rect;
+    emit visibleRectChanged();
+    // Pan dentro l'area già costruita: nessun lavoro, sposta solo il nodo
+    if (m_store && needsRebuild()) {
+        update();
+    }
+}
+
+void BoundaryOverlay::setZoom(double zoom)
+{
+    if (m_zoom == zoom) {
+        return;
+    }
+    m_zoom = zoom;
+    emit zoomChanged();
+    if (m_store && needsRebuild()) {
+        update();
+    }
+}
+
+void BoundaryOverlay::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+    m_color = color;
+    emit colorChanged();
+    update();
+}
+
+void BoundaryOverlay::setRunning(bool running)
+{
+    if (m_running == running) {
+        return;
+    }
+    m_running = running;
+    emit runningChanged();
+}
+
+void BoundaryOverlay::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        update();
+    }
+}
+
+void BoundaryOverlay::componentComplete()
+{
+    QQuickItem::componentComplete();
+    reload();
+}
+
+void BoundaryOverlay::reload()
+{
+    const int expected = m_generation->fetchAndAddOrdered(1) + 1;
+    m_pool.clear();
+
+    const QString source = cleanPath(m_source);
+    const QString reference = cleanPath(m_reference);
+    if (m_store) {
+        m_store.reset();
+        m_geometryDirty = true;
+        emit storeChanged();
+        update();
+    }
+    if (source.isEmpty() || reference.isEmpty() || !isComponentComplete()) {
+        setRunning(false);
+        return;
+    }
+    setRunning(true);
+
+    std::shared_ptr<QAtomicInt> generation = m_generation;
+    m_pool.start([this, source, reference, generation, expected]() {
+        if (generation->loadAcquire() != expected) {
+            return;
+        }
+        QString error;
+        std::shared_ptr<const BoundaryStore> store = BoundaryStoreCache::instance().storeFor(source, reference, &error);
+        QMetaObject::invokeMethod(this, [this, expected, store, error]() {
+            if (m_generation->loadAcquire() != expected) return;
+            setRunning(false);
+            if (!store) {
+                qWarning() << "Boundaries:" << error;
+                emit errorOccurred(error);
+                return;
+            }
+            m_store = store;
+            m_geometryDirty = true;
+            emit storeChanged();
+            update();
+        }, Qt::QueuedConnection);
+    });
+}
+
+QSGNode *BoundaryOverlay::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    const double w = width();
+    const double h = height();
+    if (!m_store || m_store->features.empty() || w <= 0.0 || h <= 0.0) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    auto *node = static_cast<QSGGeometryNode *>(oldNode);
+    if (!node) {
+        node = new QSGGeometryNode;
+        auto *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+        geometry->setDrawingMode(QSGGeometry::DrawLines);
+        node->setGeometry(geometry);
+        node->setFlag(QSGNode::OwnsGeometry);
+        node->setMaterial(new QSGFlatColorMaterial);
+        node->setFlag(QSGNode::OwnsMaterial);
+        m_geometryDirty = true;
+    }
+
+    auto *material = static_cast<QSGFlatColorMaterial *>(node->material());
+    if (material->color() != m_color) {
+        material->setColor(m_color);
+        node->markDirty(QSGNode::DirtyMaterial);
+    }
+    if (!needsRebuild()) {
+        return node;
+    }
+
+    // Viewport allargata di metà per lato: i pan brevi non ricostruiscono
+    const double zoom = std::max(m_zoom, 1e-6);
+    const QRectF visible = m_visibleRect.isValid() ? m_visibleRect : QRectF(0.0, 0.0, 1.0, 1.0);
+    const QRectF area = visible.adjusted(-visible.width() / 2, -visible.height() / 2,
+                                         visible.width() / 2, visible.height() / 2);
+    const double screenX = w * zoom;
+    const double screenY = h * zoom;
+    const double minVertex2 = MinVertexPixels * MinVertexPixels / (zoom * zoom);   // in unità dell'item
+
+    std::vector<QSGGeometry::Point2D> vertices;
+    int drawn = 0;
+    const BoundaryStore &store = *m_store;
+    store.query(area, [&](const BoundaryStore::Feature &feature) {
+        if (std::max((feature.maxX - feature.minX) * screenX, (feature.maxY - feature.minY) * screenY) < MinFeaturePixels) {
+            return;
+        }
+        ++drawn;
+        for (quint32 path = feature.firstPath; path < feature.firstPath + feature.pathCount; ++path) {
+            const quint32 begin = store.pathStart[path];
+            const quint32 end = store.pathStart[path + 1];
+            QSGGeometry::Point2D previous = {0.0f, 0.0f};
+            for (quint32 i = begin; i < end; ++i) {
+                QSGGeometry::Point2D vertex;
+                vertex.set(static_cast<float>(store.xy[2 * i] * w), static_cast<float>(store.xy[2 * i + 1] * h));
+                if (i > begin) {
+                    const double dx = vertex.x - previous.x;
+                    const double dy = vertex.y - previous.y;
+                    if (i < end - 1 && dx * dx + dy * dy < minVertex2) {
+                        continue;
+                    }
+                    vertices.push_back(previous);
+                    vertices.push_back(vertex);
+                }
+                previous = vertex;
+            }
+        }
+    });
+
+    QSGGeometry *geometry = node->geometry();
+    geometry->allocate(static_cast<int>(vertices.size()));
+    if (!vertices.empty()) {
+        std::copy(vertices.begin(), vertices.end(), geometry->vertexDataAsPoint2D());
+    }
+    node->markDirty(QSGNode::DirtyGeometry);
+
+    m_geometryDirty = false;
+    m_builtRect = area;
+    m_builtZoom = zoom;
+    m_builtSize = size();
+    qDebug() << "Boundaries:" << drawn << "features," << vertices.size() / 2 << "segments at zoom" << zoom;
+    return node;
+}
@@ -0,0 +1,91 @@
+#ifndef BOUNDARYOVERLAY_H
+#define BOUNDARYOVERLAY_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QRectF>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <memory>
+#include "boundarystore.h"
+
+// Contorni del shapefile di analisi sopra l'immagine `reference`. Lettura e
+// riproiezione in background (BoundaryStoreCache), poi a ogni frame solo le
+// feature che l'R-tree trova nella viewport, con i vertici più vicini di un
+// pixel a schermo saltati. La geometria copre la viewport allargata di metà per
+// lato: il pan la riusa finché non ne esce, lo zoom la rifà oltre il 25%.
+class BoundaryOverlay : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QString reference READ reference WRITE setReference NOTIFY referenceChanged)
+    Q_PROPERTY(QRectF visibleRect READ visibleRect WRITE setVisibleRect NOTIFY visibleRectChanged)
+    Q_PROPERTY(double zoom READ zoom WRITE setZoom NOTIFY zoomChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int featureCount READ featureCount NOTIFY storeChanged)
+
+public:
+    explicit BoundaryOverlay(QQuickItem *parent = nullptr);
+    ~BoundaryOverlay();
+
+    // Archivio zip del shapefile (o .shp)
+    QString source() const { return m_source; }
+    void setSource(const QString &source);
+
+    QString reference() const { return m_reference; }
+    void setReference(const QString &reference);
+
+    // Porzione visibile in coordinate normalizzate dell'item
+    QRectF visibleRect() const { return m_visibleRect; }
+    void setVisibleRect(const QRectF &rect);
+
+    double zoom() const { return m_zoom; }
+    void setZoom(double zoom);
+
+    QColor color() const { return m_color; }
+    void setColor(const QColor &color);
+
+    bool running() const { return m_running; }
+    int featureCount() const { return m_store ? (int)m_store->features.size() : 0; }
+
+signals:
+    void sourceChanged();
+    void referenceChanged();
+    void visibleRectChanged();
+    void zoomChanged();
+    void colorChanged();
+    void runningChanged();
+    void storeChanged();
+    void errorOccurred(const QString &message);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void componentComplete() override;
+
+private:
+    static QString cleanPath(const QString &path);
+    void reload();
+    void setRunning(bool running);
+    bool needsRebuild() const;
+
+    QString m_source;
+    QString m_reference;
+    QRectF m_visibleRect;
+    double m_zoom;
+    QColor m_color;
+    bool m_running;
+
+    QThreadPool m_pool;
+    std::shared_ptr<QAtomicInt> m_generation;
+    std::shared_ptr<const BoundaryStore> m_store;
+
+    // Area e zoom della geometria attuale nel nodo
+    bool m_geometryDirty;
+    QRectF m_builtRect;
+    double m_builtZoom;
+    QSizeF m_builtSize;
+};
+
+#endif // BOUNDARYOVERLAY_H
@@ -0,0 +1,374 @@
+#include "boundarystore.h"
+#include "memorygovernor.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <gdal_priv.h>
+#include <ogrsf_frmts.h>
+#include <ogr_spatialref.h>
+#include <cpl_vsi.h>
+
+namespace {
+
+// Ordinamento Sort-Tile-Recursive: fette verticali di circa sqrt(gruppi) gruppi,
+// ciascuna ordinata in y, così ogni gruppo consecutivo di NodeCapacity elementi
+// copre un'area compatta
+template <typename T>
+void strSort(std::vector<T> &items)
+{
+    const size_t capacity = BoundaryStore::NodeCapacity;
+    const size_t groups = (items.size() + capacity - 1) / capacity;
+    const size_t slices = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt((double)groups))));
+    const size_t sliceSize = slices * capacity;
+    std::sort(items.begin(), items.end(), [](const T &a, const T &b) {
+        return a.minX + a.maxX < b.minX + b.maxX;
+    });
+    for (size_t start = 0; start < items.size(); start += sliceSize) {
+        auto end = items.begin() + std::min(items.size(), start + sliceSize);
+        std::sort(items.begin() + start, end, [](const T &a, const T &b) {
+            return a.minY + a.maxY < b.minY + b.maxY;
+        });
+    }
+}
+
+template <typename T>
+BoundaryStore::Node enclose(const std::vector<T> &items, size_t first, size_t count)
+{
+    BoundaryStore::Node node;
+    node.first = static_cast<quint32>(first);
+    node.count = static_cast<quint32>(count);
+    node.minX = node.minY = std::numeric_limits<float>::max();
+    node.maxX = node.maxY = std::numeric_limits<float>::lowest();
+    for (size_t i = first; i < first + count; ++i) {
+        node.minX = std::min(node.minX, items[i].minX);
+        node.minY = std::min(node.minY, items[i].minY);
+        node.maxX = std::max(node.maxX, items[i].maxX);
+        node.maxY = std::max(node.maxY, items[i].maxY);
+    }
+    return node;
+}
+
+// Il layer Shapefile dentro l'archivio, anche in una sottocartella
+QString vectorPath(const QString &archivePath)
+{
+    if (QFileInfo(archivePath).suffix().toLower() != "zip") {
+        return archivePath;
+    }
+    const QString root = "/vsizip/" + QFileInfo(archivePath).absoluteFilePath();
+    char **entries = VSIReadDirRecursive(root.toUtf8().constData());
+    QString shp;
+    for (int i = 0; entries && entries[i]; ++i) {
+        QString entry = QString::fromUtf8(entries[i]);
+        if (entry.endsWith(".shp", Qt::CaseInsensitive)) {
+            shp = root + '/' + entry;
+            break;
+        }
+    }
+    CSLDestroy(entries);
+    return shp.isEmpty() ? root : shp;
+}
+
+} // namespace
+
+void BoundaryStore::buildIndex()
+{
+    nodes.clear();
+    if (features.empty()) {
+        return;
+    }
+
+    // Foglie: intervalli contigui di feature in ordine STR
+    strSort(features);
+    std::vector<Node> level;
+    for (size_t first = 0; first < features.size(); first += NodeCapacity) {
+        level.push_back(enclose(features, first, std::min<size_t>(NodeCapacity, features.size() - first)));
+    }
+
+    // Livelli superiori: ogni livello è riordinato prima di essere accodato,
+    // così i figli di un nodo sono contigui in nodes
+    while (true) {
+        if (level.size() == 1) {
+            nodes.push_back(level.front());
+            break;
+        }
+        strSort(level);
+        const size_t base = nodes.size();
+        nodes.insert(nodes.end(), level.begin(), level.end());
+        std::vector<Node> parents;
+        for (size_t first = 0; first < level.size(); first += NodeCapacity) {
+            Node parent = enclose(level, first, std::min<size_t>(NodeCapacity, level.size() - first));
+            parent.first += static_cast<quint32>(base);
+            parent.leaf = false;
+            parents.push_back(parent);
+        }
+        level.swap(parents);
+    }
+}
+
+void BoundaryStore::query(const QRectF &rect, const std::function<void(const Feature &)> &visit) const
+{
+    if (nodes.empty()) {
+        return;
+    }
+    const float minX = static_cast<float>(rect.left());
+    const float minY = static_cast<float>(rect.top());
+    const float maxX = static_cast<float>(rect.right());
+    const float maxY = static_cast<float>(rect.bottom());
+    auto intersects = [&](const auto &box) {
+        return box.maxX >= minX && box.minX <= maxX && box.maxY >= minY && box.minY <= maxY;
+    };
+
+    std::vector<quint32> stack;
+    stack.push_back(static_cast<quint32>(nodes.size() - 1));
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        if (!intersects(node)) {
+            continue;
+        }
+        for (quint32 i = node.first; i < node.first + node.count; ++i) {
+            if (node.leaf) {
+                if (intersects(features[i])) {
+                    visit(features[i]);
+                }
+            } else {
+                stack.push_back(i);
+            }
+        }
+    }
+}
+
+size_t BoundaryStore::byteSize() const
+{
+    return xy.size() * sizeof(float) + pathStart.size() * sizeof(quint32) + features.size() * sizeof(Feature)
+           + nodes.size() * sizeof(Node);
+}
+
+BoundaryStoreCache &BoundaryStoreCache::instance()
+{
+    static BoundaryStoreCache cache;
+    return cache;
+}
+
+BoundaryStoreCache::BoundaryStoreCache()
+    : m_usedBytes(0)
+    , m_capacityBytes(256u * 1024u * 1024u)
+{
+}
+
+size_t BoundaryStoreCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+size_t BoundaryStoreCache::trim(size_t targetBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    evictLocked(targetBytes);
+    return m_usedBytes;
+}
+
+void BoundaryStoreCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stores.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
+
+void BoundaryStoreCache::evictLocked(size_t limit)
+{
+    while (m_usedBytes > limit && !m_lru.isEmpty()) {
+        QString key = m_lru.takeLast();
+        auto it = m_stores.find(key);
+        if (it != m_stores.end()) {
+            m_usedBytes -= it.value()->byteSize();
+            m_stores.erase(it);
+        }
+    }
+}
+
+std::shared_ptr<const BoundaryStore> BoundaryStoreCache::storeFor(const QString &archivePath,
+                                                                  const QString &referencePath, QString *error)
+{
+    QString key = archivePath + '|' + QString::number(QFileInfo(archivePath).lastModified().toMSecsSinceEpoch())
+                  + '|' + referencePath;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_stores.constFind(key);
+        if (it != m_stores.constEnd()) {
+            m_lru.removeOne(key);
+            m_lru.prepend(key);
+            return it.value();
+        }
+    }
+
+    // Lettura e riproiezione fuori dal lock
+    std::shared_ptr<BoundaryStore> store = load(archivePath, referencePath, error);
+    if (!store) {
+        return nullptr;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_stores.contains(key)) {
+            m_stores.insert(key, store);
+            m_lru.prepend(key);
+            m_usedBytes += store->byteSize();
+            evictLocked(m_capacityBytes);
+        }
+    }
+    MemoryGovernor::instance()->notifyAllocated();
+    return store;
+}
+
+std::shared_ptr<BoundaryStore> BoundaryStoreCache::load(const QString &archivePath, const QString &referencePath,
+                                                        QString *error)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    GDALDataset *reference = (GDALDataset*)GDALOpen(referencePath.toUtf8().constData(), GA_ReadOnly);
+    if (reference == nullptr) {
+        *error = "Failed to open " + referencePath;
+        return nullptr;
+    }
+    double geoTransform[6];
+    double inverse[6];
+    const bool georeferenced = reference->GetGeoTransform(geoTransform) == CE_None
+                               && GDALInvGeoTransform(geoTransform, inverse);
+    const double width = reference->GetRasterXSize();
+    const double height = reference->GetRasterYSize();
+    OGRSpatialReference referenceSrs;
+    const char *projection = reference->GetProjectionRef();
+    const bool hasReferenceSrs = projection && *projection && referenceSrs.importFromWkt(projection) == OGRERR_NONE;
+    GDALClose(reference);
+    if (!georeferenced) {
+        *error = "Raster is not georeferenced: " + referencePath;
+        return nullptr;
+    }
+    referenceSrs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+    const QString path = vectorPath(archivePath);
+    GDALDataset *vector = (GDALDataset*)GDALOpenEx(path.toUtf8().constData(), GDAL_OF_VECTOR | GDAL_OF_READONLY,
+                                                  nullptr, nullptr, nullptr);
+    if (vector == nullptr || vector->GetLayerCount() == 0) {
+        *error = QString("No vector layer in %1: %2").arg(archivePath, CPLGetLastErrorMsg());
+        if (vector) GDALClose(vector);
+        return nullptr;
+    }
+
+    auto store = std::make_shared<BoundaryStore>();
+    OGRLayer *layer = vector->GetLayer(0);
+    OGRCoordinateTransformation *transform = nullptr;
+    const OGRSpatialReference *layerSrs = layer->GetSpatialRef();
+    if (layerSrs && hasReferenceSrs && !layerSrs->IsSame(&referenceSrs)) {
+        OGRSpatialReference source(*layerSrs);
+        source.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+        transform = OGRCreateCoordinateTransformation(&source, &referenceSrs);
+        if (transform == nullptr) {
+            qWarning() << "Boundaries: no transformation to the raster CRS, drawing in layer coordinates";
+        }
+    }
+
+    // Anelli e linee -> percorsi in coordinate normalizzate del raster
+    BoundaryStore::Feature feature;
+    auto addCurve = [&](const OGRSimpleCurve *curve) {
+        const int count = curve->getNumPoints();
+        if (count < 2) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            const double gx = curve->getX(i);
+            const double gy = curve->getY(i);
+            const float x = static_cast<float>((inverse[0] + gx * inverse[1] + gy * inverse[2]) / width);
+            const float y = static_cast<float>((inverse[3] + gx * inverse[4] + gy * inverse[5]) / height);
+            store->xy.push_back(x);
+            store->xy.push_back(y);
+            feature.minX = std::min(feature.minX, x);
+            feature.minY = std::min(feature.minY, y);
+            feature.maxX = std::max(feature.maxX, x);
+            feature.maxY = std::max(feature.maxY, y);
+        }
+        store->pathStart.push_back(static_cast<quint32>(store->xy.size() / 2));
+        ++feature.pathCount;
+    };
+    std::function<void(const OGRGeometry *)> addGeometry = [&](const OGRGeometry *geometry) {
+        switch (wkbFlatten(geometry->getGeometryType())) {
+        case wkbLineString:
+        case wkbLinearRing:
+            addCurve(geometry->toSimpleCurve());
+            break;
+        case wkbPolygon: {
+            const OGRPolygon *polygon = geometry->toPolygon();
+            for (const OGRLinearRing *ring : *polygon) {
+                addCurve(ring);
+            }
+            break;
+        }
+        case wkbMultiPolygon:
+        case wkbMultiLineString:
+        case wkbGeometryCollection: {
+            const OGRGeometryCollection *collection = geometry->toGeometryCollection();
+            for (const OGRGeometry *part : *collection) {
+                addGeometry(part);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    };
+
+    store->pathStart.push_back(0);
+    qint64 skipped = 0;
+    layer->ResetReading();
+    OGRFeature *source;
+    while ((source = layer->GetNextFeature()) != nullptr) {
+        const OGRGeometry *geometry = source->GetGeometryRef();
+        if (geometry == nullptr || geometry->IsEmpty()) {
+            OGRFeature::DestroyFeature(source);
+            continue;
+        }
+        // Curve (archi) linearizzate, poi nel CRS del raster
+        OGRGeometry *linear = geometry->hasCurveGeometry() ? geometry->getLinearGeometry() : geometry->clone();
+        if (transform && linear->transform(transform) != OGRERR_NONE) {
+            ++skipped;
+            delete linear;
+            OGRFeature::DestroyFeature(source);
+            continue;
+        }
+        feature = BoundaryStore::Feature();
+        feature.firstPath = static_cast<quint32>(store->pathStart.size() - 1);
+        feature.minX = feature.minY = std::numeric_limits<float>::max();
+        feature.maxX = feature.maxY = std::numeric_limits<float>::lowest();
+        addGeometry(linear);
+        if (feature.pathCount > 0) {
+            store->features.push_back(feature);
+        }
+        delete linear;
+        OGRFeature::DestroyFeature(source);
+    }
+    if (transform) {
+        OGRCoordinateTransformation::DestroyCT(transform);
+    }
+    GDALClose(vector);
+
+    store->vertexCount = static_cast<qint64>(store->xy.size() / 2);
+    store->xy.shrink_to_fit();
+    store->pathStart.shrink_to_fit();
+    store->buildIndex();
+    store->features.shrink_to_fit();
+
+    qDebug() << "Boundaries loaded from" << path << ":" << store->features.size() << "features,"
+             << store->vertexCount << "vertices," << store->nodes.size() << "index nodes,"
+             << store->byteSize() / 1024 << "KB in" << timer.elapsed() << "ms"
+             << (skipped > 0 ? QString("(%1 not reprojected)").arg(skipped) : QString());
+    return store;
+}
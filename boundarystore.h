@@ -0,0 +1,80 @@
+#ifndef BOUNDARYSTORE_H
+#define BOUNDARYSTORE_H
+
+#include <QString>
+#include <QRectF>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QtGlobal>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Contorni del shapefile (poligoni e linee) già riproiettati sulla griglia del
+// raster mostrato, in coordinate normalizzate [0, 1]: vertici float in un unico
+// array, un percorso per anello (chiuso, primo = ultimo) e un R-tree impacchettato
+// STR sui bounding box delle feature per interrogare solo la viewport.
+struct BoundaryStore
+{
+    struct Feature
+    {
+        quint32 firstPath = 0;
+        quint32 pathCount = 0;
+        float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+    };
+
+    struct Node
+    {
+        float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+        quint32 first = 0;      // prima feature (foglia) o primo figlio
+        quint32 count = 0;
+        bool leaf = true;
+    };
+
+    static const int NodeCapacity = 16;
+
+    std::vector<float> xy;              // x0, y0, x1, y1, ...
+    std::vector<quint32> pathStart;     // vertice iniziale di ogni percorso, + terminatore
+    std::vector<Feature> features;      // in ordine STR: una foglia = intervallo contiguo
+    std::vector<Node> nodes;            // livelli dal basso, radice in fondo
+    qint64 vertexCount = 0;
+
+    // Costruisce l'R-tree riordinando features (STR: fette in x, poi y)
+    void buildIndex();
+    // Feature il cui bounding box interseca rect (normalizzato)
+    void query(const QRectF &rect, const std::function<void(const Feature &)> &visit) const;
+    size_t byteSize() const;
+};
+
+// Cache LRU dei contorni per (archivio, raster di riferimento): riproiezione e
+// indice si calcolano una volta, i pannelli con lo stesso raster la condividono.
+class BoundaryStoreCache
+{
+public:
+    static BoundaryStoreCache &instance();
+
+    // Legge il primo layer vettoriale dell'archivio zip (/vsizip/) o di un .shp
+    std::shared_ptr<const BoundaryStore> storeFor(const QString &archivePath, const QString &referencePath,
+                                                  QString *error);
+
+    size_t usedBytes() const;
+    // Scarta i contorni meno recenti fino a stare in targetBytes (usato dal MemoryGovernor)
+    size_t trim(size_t targetBytes);
+    void clear();
+
+private:
+    BoundaryStoreCache();
+
+    static std::shared_ptr<BoundaryStore> load(const QString &archivePath, const QString &referencePath,
+                                               QString *error);
+    void evictLocked(size_t limit);
+
+    mutable QMutex m_mutex;
+    QHash<QString, std::shared_ptr<const BoundaryStore>> m_stores;
+    QList<QString> m_lru;    // front = usata più di recente
+    size_t m_usedBytes;
+    size_t m_capacityBytes;
+};
+
+#endif // BOUNDARYSTORE_H
@@ -0,0 +1,21 @@
+#version 440
+
+// Colormap di un'immagine a un canale (GeoTiffTextureProvider, channel=1):
+// il codice a 8 bit indicizza la striscia 256x1 "lut?colormap=N"
+
+layout(location = 0) in vec2 qt_TexCoord0;
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    float qt_Opacity;
+};
+
+layout(binding = 1) uniform sampler2D source;
+layout(binding = 2) uniform sampler2D colormap;
+
+void main()
+{
+    float code = floor(texture(source, qt_TexCoord0).r * 255.0 + 0.5);
+    fragColor = texture(colormap, vec2((code + 0.5) / 256.0, 0.5)) * qt_Opacity;
+}
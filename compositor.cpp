@@ -0,0 +1,355 @@
+#include "compositor.h"
+#include "rasterreader.h"
+#include "rasterexport.h"
+#include "rasteralgebra.h"
+#include "decodepool.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <gdal_priv.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPOSITOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace Compositor {
+
+namespace {
+
+using DatasetPtr = std::shared_ptr<GDALDataset>;
+using RasterAlgebra::openShared;
+
+#ifdef COMPOSITOR_SSE2
+// Byte di maschera di 4 pixel replicati sui 4 canali: un confronto per byte
+// diventa una maschera per pixel
+inline __m128i expandMask(const uchar *mask)
+{
+    int bytes;
+    std::memcpy(&bytes, mask, sizeof(bytes));
+    __m128i m = _mm_cvtsi32_si128(bytes);
+    m = _mm_unpacklo_epi8(m, m);
+    return _mm_unpacklo_epi16(m, m);
+}
+
+inline __m128i select(__m128i mask, __m128i value, __m128i fallback)
+{
+    return _mm_or_si128(_mm_and_si128(mask, value), _mm_andnot_si128(mask, fallback));
+}
+#endif
+
+// Dataset e buffer di un worker: un GDALDataset non va usato da più thread
+struct Worker
+{
+    const Params *params = nullptr;
+    int width = 0;                  // griglia di output
+    int height = 0;
+
+    DatasetPtr base;
+    DatasetPtr mask;
+    DatasetPtr maskAligned;         // dichiarato dopo mask: distrutto prima
+    double baseScaleX = 1.0;        // pixel della base per pixel di output
+    double baseScaleY = 1.0;
+    double maskScaleX = 1.0;        // maschera non georeferenziata: stessa estensione
+    double maskScaleY = 1.0;
+    int baseBands = 0;
+
+    std::vector<uchar> bands;
+    std::vector<uchar> maskValues;
+
+    bool open(QString *error)
+    {
+        if (!params->basePath.isEmpty()) {
+            base = openShared(params->basePath);
+            if (!base) {
+                *error = "Failed to open " + params->basePath;
+                return false;
+            }
+            baseBands = std::min(3, base->GetRasterCount());
+            baseScaleX = (double)base->GetRasterXSize() / width;
+            baseScaleY = (double)base->GetRasterYSize() / height;
+        }
+        if (params->showMask && !params->maskPath.isEmpty()) {
+            mask = openShared(params->maskPath);
+            if (!mask) {
+                *error = "Failed to open " + params->maskPath;
+                return false;
+            }
+            if (base && RasterExport::hasGeoreference(base.get()) && RasterExport::hasGeoreference(mask.get())) {
+                maskAligned = RasterExport::alignedMask(mask.get(), base.get(), width, height);
+                if (!maskAligned) {
+                    *error = QString("Failed to align %1: %2").arg(params->maskPath, CPLGetLastErrorMsg());
+                    return false;
+                }
+            } else {
+                maskScaleX = (double)mask->GetRasterXSize() / width;
+                maskScaleY = (double)mask->GetRasterYSize() / height;
+            }
+        }
+        const size_t pixels = (size_t)TileSize * TileSize;
+        bands.resize(pixels * 3);
+        maskValues.resize(pixels);
+        return true;
+    }
+
+    // Tile w x h in (x, y) della griglia di output, righe di `stride` pixel in out
+    bool render(int x, int y, int w, int h, QRgb *out, size_t stride)
+    {
+        const size_t count = (size_t)w * h;
+        if (base && params->showBase && baseBands > 0) {
+            for (int b = 0; b < baseBands; ++b) {
+                if (RasterReader::readWindow(base->GetRasterBand(b + 1), x * baseScaleX, y * baseScaleY,
+                                             w * baseScaleX, h * baseScaleY, bands.data() + b * count, w, h,
+                                             GDT_Byte, RasterReader::defaultMode()) != CE_None) {
+                    return false;
+                }
+            }
+            // Una o due bande: grigio dalla prima
+            const uchar *r = bands.data();
+            const uchar *g = baseBands == 3 ? bands.data() + count : r;
+            const uchar *bl = baseBands == 3 ? bands.data() + 2 * count : r;
+            for (int row = 0; row < h; ++row) {
+                const size_t offset = (size_t)row * w;
+                packRgb(r + offset, g + offset, bl + offset, w, out + row * stride);
+            }
+        } else {
+            for (int row = 0; row < h; ++row) {
+                std::fill(out + row * stride, out + row * stride + w, 0);
+            }
+        }
+
+        if (!mask) {
+            return true;
+        }
+        CPLErr err;
+        if (maskAligned) {
+            err = maskAligned->GetRasterBand(1)->RasterIO(GF_Read, x, y, w, h, maskValues.data(), w, h, GDT_Byte,
+                                                          0, 0);
+        } else {
+            err = RasterReader::readWindow(mask->GetRasterBand(1), x * maskScaleX, y * maskScaleY, w * maskScaleX,
+                                           h * maskScaleY, maskValues.data(), w, h, GDT_Byte, ResampleMode::Nearest);
+        }
+        if (err != CE_None) {
+            return false;
+        }
+        const bool colored = params->color.isValid();
+        const QRgb color = qRgb(params->color.red(), params->color.green(), params->color.blue());
+        const int alpha = qBound(0, (int)std::lround(params->opacity * 256.0), 256);
+        for (int row = 0; row < h; ++row) {
+            const uchar *m = maskValues.data() + (size_t)row * w;
+            if (colored) {
+                blendMask(m, w, color, alpha, out + row * stride);
+            } else {
+                maskGray(m, w, out + row * stride);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+bool hasSimd()
+{
+#ifdef COMPOSITOR_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void packRgbScalar(const uchar *r, const uchar *g, const uchar *b, size_t count, QRgb *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = qRgb(r[i], g[i], b[i]);
+    }
+}
+
+void packRgb(const uchar *r, const uchar *g, const uchar *b, size_t count, QRgb *out)
+{
+    size_t i = 0;
+#ifdef COMPOSITOR_SSE2
+    const __m128i opaque = _mm_set1_epi8((char)0xff);
+    for (; i + 16 <= count; i += 16) {
+        __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        __m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // In memoria un QRgb è B, G, R, A
+        __m128i bgLo = _mm_unpacklo_epi8(vb, vg);
+        __m128i bgHi = _mm_unpackhi_epi8(vb, vg);
+        __m128i raLo = _mm_unpacklo_epi8(vr, opaque);
+        __m128i raHi = _mm_unpackhi_epi8(vr, opaque);
+        __m128i *dst = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(bgLo, raLo));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(bgLo, raLo));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(bgHi, raHi));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(bgHi, raHi));
+    }
+#endif
+    packRgbScalar(r + i, g + i, b + i, count - i, out + i);
+}
+
+void maskGrayScalar(const uchar *mask, size_t count, QRgb *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (mask[i] != 0) {
+            out[i] = qRgb(mask[i], mask[i], mask[i]);
+        }
+    }
+}
+
+void maskGray(const uchar *mask, size_t count, QRgb *out)
+{
+    size_t i = 0;
+#ifdef COMPOSITOR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i m = expandMask(mask + i);
+        __m128i uncovered = _mm_cmpeq_epi8(m, zero);
+        if (_mm_movemask_epi8(uncovered) == 0xffff) {
+            continue;
+        }
+        __m128i *dst = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(dst, select(uncovered, _mm_loadu_si128(dst), _mm_or_si128(m, opaque)));
+    }
+#endif
+    maskGrayScalar(mask + i, count - i, out + i);
+}
+
+void blendMaskScalar(const uchar *mask, size_t count, QRgb color, int alpha, QRgb *out)
+{
+    const int inverse = 256 - alpha;
+    for (size_t i = 0; i < count; ++i) {
+        if (mask[i] == 0) {
+            continue;
+        }
+        const QRgb p = out[i];
+        QRgb result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            const uint channel = (((p >> shift) & 0xff) * inverse + ((color >> shift) & 0xff) * alpha) >> 8;
+            result |= channel << shift;
+        }
+        out[i] = result;
+    }
+}
+
+void blendMask(const uchar *mask, size_t count, QRgb color, int alpha, QRgb *out)
+{
+    size_t i = 0;
+#ifdef COMPOSITOR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inverse = _mm_set1_epi16((short)(256 - alpha));
+    // color * alpha per i canali di due pixel (16 bit per canale: al più 255 * 256)
+    const __m128i colorAlpha = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero),
+                                               _mm_set1_epi16((short)alpha));
+    for (; i + 4 <= count; i += 4) {
+        __m128i uncovered = _mm_cmpeq_epi8(expandMask(mask + i), zero);
+        if (_mm_movemask_epi8(uncovered) == 0xffff) {
+            continue;
+        }
+        __m128i *dst = reinterpret_cast<__m128i*>(out + i);
+        __m128i p = _mm_loadu_si128(dst);
+        __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), inverse), colorAlpha), 8);
+        __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), inverse), colorAlpha), 8);
+        _mm_storeu_si128(dst, select(uncovered, p, _mm_packus_epi16(lo, hi)));
+    }
+#endif
+    blendMaskScalar(mask + i, count - i, color, alpha, out + i);
+}
+
+QImage render(const Params &params, int maxWidth, int maxHeight, QString *error)
+{
+    auto fail = [error](const QString &message) {
+        qWarning() << "Compositor:" << message;
+        if (error) *error = message;
+        return QImage();
+    };
+
+    // La griglia è quella della base; senza base quella della maschera
+    const QString gridPath = !params.basePath.isEmpty() ? params.basePath : params.maskPath;
+    if (gridPath.isEmpty()) {
+        return fail("Nothing to composite");
+    }
+    GDALDataset *gridDataset = (GDALDataset*)GDALOpen(gridPath.toUtf8().constData(), GA_ReadOnly);
+    if (gridDataset == nullptr) {
+        return fail("Failed to open " + gridPath);
+    }
+    const int sourceWidth = gridDataset->GetRasterXSize();
+    const int sourceHeight = gridDataset->GetRasterYSize();
+    GDALClose(gridDataset);
+
+    int width = sourceWidth;
+    int height = sourceHeight;
+    if (maxWidth > 0 && maxHeight > 0 && (width > maxWidth || height > maxHeight)) {
+        const double scale = std::min((double)maxWidth / sourceWidth, (double)maxHeight / sourceHeight);
+        width = std::max(1, (int)(sourceWidth * scale));
+        height = std::max(1, (int)(sourceHeight * scale));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    if (image.isNull()) {
+        return fail(QString("Failed to allocate %1 x %2").arg(width).arg(height));
+    }
+    // Puntatore preso prima dei worker: scanLine() non const farebbe il detach da più thread
+    QRgb *pixels = reinterpret_cast<QRgb*>(image.bits());
+    const size_t stride = image.bytesPerLine() / sizeof(QRgb);
+
+    const int tilesX = (width + TileSize - 1) / TileSize;
+    const int tilesY = (height + TileSize - 1) / TileSize;
+    const int total = tilesX * tilesY;
+    QAtomicInt next(0);
+    QAtomicInt failed(0);
+    QMutex mutex;
+    QString firstError;
+    auto workerFail = [&](const QString &message) {
+        QMutexLocker locker(&mutex);
+        if (firstError.isEmpty()) firstError = message;
+        failed.storeRelease(1);
+    };
+
+    const int threads = std::max(1, std::min(DecodePool::maxThreads(), total));
+    DecodePool::parallelFor(threads, [&](int) {
+        Worker worker;
+        worker.params = &params;
+        worker.width = width;
+        worker.height = height;
+        QString workerError;
+        if (!worker.open(&workerError)) {
+            workerFail(workerError);
+            return;
+        }
+        while (!failed.loadAcquire()) {
+            const int index = next.fetchAndAddRelaxed(1);
+            if (index >= total) {
+                break;
+            }
+            const int x = (index % tilesX) * TileSize;
+            const int y = (index / tilesX) * TileSize;
+            const int w = std::min(TileSize, width - x);
+            const int h = std::min(TileSize, height - y);
+            if (!worker.render(x, y, w, h, pixels + (size_t)y * stride + x, stride)) {
+                workerFail(QString("Read failed at %1,%2: %3").arg(x).arg(y).arg(CPLGetLastErrorMsg()));
+                break;
+            }
+        }
+    });
+    if (failed.loadAcquire()) {
+        return fail(firstError);
+    }
+
+    qDebug() << "Composite" << width << "x" << height << "from" << total << "tiles on" << threads << "threads in"
+             << timer.elapsed() << "ms" << (hasSimd() ? "(SSE2)" : "(scalar)");
+    return image;
+}
+
+} // namespace Compositor
@@ -0,0 +1,53 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <QString>
+#include <QColor>
+#include <QImage>
+#include <QRgb>
+#include <cstddef>
+
+// Composito della vista risultati in un'unica immagine: RGB della base e
+// maschera di risultato allineata sulla sua griglia, fuse a tile in parallelo
+// (ogni worker con i propri dataset, la maschera da un VRT warpato sulla
+// griglia di output). Un'unica texture invece di tre Image decodificate
+// ognuna dal provider. Output in ARGB32 premoltiplicato, il formato delle
+// texture di Qt Quick; i kernel di fusione sono in SSE2 con varianti scalari.
+namespace Compositor {
+
+const int TileSize = 256;
+
+struct Params
+{
+    QString basePath;           // RGB (bande 1-3; una banda = grigio); vuoto = solo maschera
+    bool showBase = true;       // false: la griglia resta quella della base, sfondo trasparente
+    QString maskPath;           // valori != 0 coperti; vuoto = solo base
+    bool showMask = true;
+    // Colore non valido = valore della maschera in grigio opaco (layer "Result"),
+    // altrimenti colore con opacity (layer "False Color")
+    QColor color;
+    double opacity = 1.0;
+};
+
+// Composito ridotto a stare in maxWidth x maxHeight (mai oltre la risoluzione
+// della base), a tile in parallelo. Immagine nulla se la lettura fallisce
+QImage render(const Params &params, int maxWidth, int maxHeight, QString *error = nullptr);
+
+bool hasSimd();
+
+// Bande a 8 bit in pixel opachi 0xffRRGGBB
+void packRgb(const uchar *r, const uchar *g, const uchar *b, size_t count, QRgb *out);
+void packRgbScalar(const uchar *r, const uchar *g, const uchar *b, size_t count, QRgb *out);
+
+// Maschera in grigio opaco dove != 0; dove 0 resta il pixel di out
+void maskGray(const uchar *mask, size_t count, QRgb *out);
+void maskGrayScalar(const uchar *mask, size_t count, QRgb *out);
+
+// out = out + (color - out) * alpha / 256 dove mask != 0, su tutti e quattro i
+// canali (premoltiplicati: sopra un pixel trasparente resta il colore ad alpha)
+void blendMask(const uchar *mask, size_t count, QRgb color, int alpha, QRgb *out);
+void blendMaskScalar(const uchar *mask, size_t count, QRgb color, int alpha, QRgb *out);
+
+} // namespace Compositor
+
+#endif // COMPOSITOR_H
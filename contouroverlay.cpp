@@ -0,0 +1,409 @@
+#include "contouroverlay.h"
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <gdal_priv.h>
+
+namespace {
+
+// Tolleranza di semplificazione in celle della griglia: sotto il pixel a
+// qualunque zoom, visto che la griglia non supera la risoluzione nativa
+const double SimplifyTolerance = 0.35;
+// Curve più piccole di così (pixel a schermo) non si disegnano
+const double MinLinePixels = 2.0;
+// Vertici più vicini di così al precedente si saltano
+const double MinVertexPixels = 0.75;
+
+QRectF mapBounds(const double *m, const QRectF &bounds)
+{
+    const QPointF corners[4] = {bounds.topLeft(), bounds.topRight(), bounds.bottomLeft(), bounds.bottomRight()};
+    double minX = 0.0, minY = 0.0, maxX = 0.0, maxY = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        double x = m[0] + corners[i].x() * m[1] + corners[i].y() * m[2];
+        double y = m[3] + corners[i].x() * m[4] + corners[i].y() * m[5];
+        if (i == 0) {
+            minX = maxX = x;
+            minY = maxY = y;
+        } else {
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+    }
+    return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+}
+
+QSGGeometryNode *createLineNode()
+{
+    auto *node = new QSGGeometryNode;
+    auto *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+    geometry->setDrawingMode(QSGGeometry::DrawLines);
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+    node->setMaterial(new QSGFlatColorMaterial);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+void updateLineNode(QSGGeometryNode *node, const std::vector<QSGGeometry::Point2D> &vertices, const QColor &color)
+{
+    auto *material = static_cast<QSGFlatColorMaterial *>(node->material());
+    if (material->color() != color) {
+        material->setColor(color);
+        node->markDirty(QSGNode::DirtyMaterial);
+    }
+    QSGGeometry *geometry = node->geometry();
+    geometry->allocate(static_cast<int>(vertices.size()));
+    if (!vertices.empty()) {
+        std::copy(vertices.begin(), vertices.end(), geometry->vertexDataAsPoint2D());
+    }
+    node->markDirty(QSGNode::DirtyGeometry);
+}
+
+} // namespace
+
+ContourOverlay::ContourOverlay(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_interval(0.0)
+    , m_base(0.0)
+    , m_visibleRect(0.0, 0.0, 1.0, 1.0)
+    , m_zoom(1.0)
+    , m_color(255, 255, 255, 150)
+    , m_majorColor(255, 235, 160, 230)
+    , m_running(false)
+    , m_generation(std::make_shared<QAtomicInt>(0))
+    , m_workerGrid(std::make_shared<std::shared_ptr<const Contours::Grid>>())
+{
+    setFlag(ItemHasContents, true);
+    // Un solo thread: le richieste superate restano in coda e vengono saltate
+    m_pool.setMaxThreadCount(1);
+}
+
+ContourOverlay::~ContourOverlay()
+{
+    m_generation->fetchAndAddOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QString ContourOverlay::cleanPath(const QString &path)
+{
+    if (path.startsWith("file:///")) return path.mid(8);
+    if (path.startsWith("file://")) return path.mid(7);
+    return path;
+}
+
+void ContourOverlay::setSource(const QString &source)
+{
+    if (m_source == source) {
+        return;
+    }
+    m_source = source;
+    emit sourceChanged();
+    regenerate();
+}
+
+void ContourOverlay::setReference(const QString &reference)
+{
+    if (m_reference == reference) {
+        return;
+    }
+    m_reference = reference;
+    emit referenceChanged();
+    regenerate();
+}
+
+void ContourOverlay::setInterval(double interval)
+{
+    if (m_interval == interval) {
+        return;
+    }
+    m_interval = interval;
+    emit intervalChanged();
+    regenerate();
+}
+
+void ContourOverlay::setBase(double base)
+{
+    if (m_base == base) {
+        return;
+    }
+    m_base = base;
+    emit baseChanged();
+    regenerate();
+}
+
+void ContourOverlay::setVisibleRect(const QRectF &rect)
+{
+    if (m_visibleRect == rect) {
+        return;
+    }
+    m_visibleRect = rect;
+    emit visibleRectChanged();
+    update();
+}
+
+void ContourOverlay::setZoom(double zoom)
+{
+    if (m_zoom == zoom) {
+        return;
+    }
+    m_zoom = zoom;
+    emit zoomChanged();
+    update();
+}
+
+void ContourOverlay::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+    m_color = color;
+    emit colorChanged();
+    update();
+}
+
+void ContourOverlay::setMajorColor(const QColor &color)
+{
+    if (m_majorColor == color) {
+        return;
+    }
+    m_majorColor = color;
+    emit majorColorChanged();
+    update();
+}
+
+void ContourOverlay::setRunning(bool running)
+{
+    if (m_running == running) {
+        return;
+    }
+    m_running = running;
+    emit runningChanged();
+}
+
+void ContourOverlay::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        update();
+    }
+}
+
+double ContourOverlay::autoInterval(const Contours::Grid &grid)
+{
+    // ~20 livelli, arrotondato a 1, 2, 2.5 o 5 per una potenza di 10
+    double raw = (grid.maxValue - grid.minValue) / 20.0;
+    if (raw <= 0.0) {
+        return 1.0;
+    }
+    double magnitude = std::pow(10.0, std::floor(std::log10(raw)));
+    const double steps[] = {1.0, 2.0, 2.5, 5.0, 10.0};
+    for (double step : steps) {
+        if (raw <= step * magnitude) {
+            return step * magnitude;
+        }
+    }
+    return 10.0 * magnitude;
+}
+
+ContourOverlay::Mapping ContourOverlay::computeMapping(const Contours::Grid &grid, const QString &referencePath)
+{
+    Mapping mapping;
+    mapping.m[1] = 1.0 / grid.sourceWidth;
+    mapping.m[5] = 1.0 / grid.sourceHeight;
+    if (referencePath.isEmpty() || referencePath == grid.path) {
+        return mapping;
+    }
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(referencePath.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        qWarning() << "Contours: cannot open reference" << referencePath << "- using source pixel grid";
+        return mapping;
+    }
+    double referenceTransform[6];
+    double inverse[6];
+    const bool georeferenced = dataset->GetGeoTransform(referenceTransform) == CE_None;
+    const double referenceWidth = dataset->GetRasterXSize();
+    const double referenceHeight = dataset->GetRasterYSize();
+    GDALClose(dataset);
+    if (!georeferenced || !grid.hasGeoTransform || !GDALInvGeoTransform(referenceTransform, inverse)) {
+        // Senza georeferenziazione si assume la stessa area
+        return mapping;
+    }
+
+    // pixel sorgente -> geo -> pixel reference -> normalizzate (stesso CRS)
+    const double *s = grid.geoTransform;
+    mapping.m[0] = (inverse[0] + s[0] * inverse[1] + s[3] * inverse[2]) / referenceWidth;
+    mapping.m[1] = (s[1] * inverse[1] + s[4] * inverse[2]) / referenceWidth;
+    mapping.m[2] = (s[2] * inverse[1] + s[5] * inverse[2]) / referenceWidth;
+    mapping.m[3] = (inverse[3] + s[0] * inverse[4] + s[3] * inverse[5]) / referenceHeight;
+    mapping.m[4] = (s[1] * inverse[4] + s[4] * inverse[5]) / referenceHeight;
+    mapping.m[5] = (s[2] * inverse[4] + s[5] * inverse[5]) / referenceHeight;
+    return mapping;
+}
+
+void ContourOverlay::regenerate()
+{
+    const int expected = m_generation->fetchAndAddOrdered(1) + 1;
+    m_pool.clear();
+
+    const QString source = cleanPath(m_source);
+    if (source.isEmpty() || !isComponentComplete()) {
+        if (m_contours) {
+            m_contours.reset();
+            m_lineBounds.clear();
+            emit contoursChanged();
+            update();
+        }
+        setRunning(false);
+        return;
+    }
+    setRunning(true);
+
+    const QString reference = cleanPath(m_reference);
+    const double interval = m_interval;
+    const double base = m_base;
+    std::shared_ptr<QAtomicInt> generation = m_generation;
+    std::shared_ptr<std::shared_ptr<const Contours::Grid>> workerGrid = m_workerGrid;
+    m_pool.start([this, source, reference, interval, base, generation, workerGrid, expected]() {
+        if (generation->loadAcquire() != expected) {
+            return;
+        }
+        // La griglia resta nel worker finché il source non cambia
+        std::shared_ptr<const Contours::Grid> grid = *workerGrid;
+        if (!grid || grid->path != source) {
+            QString error;
+            workerGrid->reset();
+            grid = Contours::loadGrid(source, &error);
+            if (!grid) {
+                qWarning() << "Contours:" << error;
+                QMetaObject::invokeMethod(this, [this, expected, error]() {
+                    if (m_generation->loadAcquire() != expected) return;
+                    setRunning(false);
+                    emit errorOccurred(error);
+                }, Qt::QueuedConnection);
+                return;
+            }
+            *workerGrid = grid;
+        }
+
+        auto contours = Contours::generate(*grid, interval > 0.0 ? interval : autoInterval(*grid), base,
+                                           SimplifyTolerance, generation.get(), expected);
+        if (!contours) {
+            return;
+        }
+        Mapping mapping = computeMapping(*grid, reference);
+        std::vector<QRectF> bounds;
+        bounds.reserve(contours->lines.size());
+        for (const Contours::Line &line : contours->lines) {
+            bounds.push_back(mapBounds(mapping.m, line.bounds));
+        }
+
+        QMetaObject::invokeMethod(this, [this, expected, grid, contours, mapping, bounds]() {
+            if (m_generation->loadAcquire() != expected) return;
+            m_grid = grid;
+            m_contours = contours;
+            m_mapping = mapping;
+            m_lineBounds = bounds;
+            setRunning(false);
+            emit contoursChanged();
+            update();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ContourOverlay::componentComplete()
+{
+    QQuickItem::componentComplete();
+    regenerate();
+}
+
+QVariantMap ContourOverlay::exportTo(const QString &outputPath)
+{
+    QVariantMap result;
+    result["ok"] = false;
+    if (!m_grid || !m_contours || m_contours->lines.empty()) {
+        result["error"] = QString("No contours to export");
+        return result;
+    }
+    const QString path = cleanPath(outputPath);
+    QString error;
+    if (!Contours::exportLines(*m_grid, *m_contours, path, &error)) {
+        result["error"] = error;
+        return result;
+    }
+    result["ok"] = true;
+    result["path"] = path;
+    result["lines"] = (int)m_contours->lines.size();
+    return result;
+}
+
+QSGNode *ContourOverlay::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    const double w = width();
+    const double h = height();
+    if (!m_contours || m_contours->lines.empty() || w <= 0.0 || h <= 0.0) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    // Due figli: curve normali e principali (sopra)
+    QSGNode *root = oldNode;
+    if (!root) {
+        root = new QSGNode;
+        root->appendChildNode(createLineNode());
+        root->appendChildNode(createLineNode());
+    }
+    auto *minorNode = static_cast<QSGGeometryNode *>(root->firstChild());
+    auto *majorNode = static_cast<QSGGeometryNode *>(root->lastChild());
+
+    // Margine di un pixel a schermo attorno alla porzione visibile
+    const double screenX = w * std::max(m_zoom, 1e-6);
+    const double screenY = h * std::max(m_zoom, 1e-6);
+    const QRectF visible = m_visibleRect.adjusted(-1.0 / screenX, -1.0 / screenY, 1.0 / screenX, 1.0 / screenY);
+    const double minVertex2 = MinVertexPixels * MinVertexPixels;
+    const double *m = m_mapping.m;
+
+    std::vector<QSGGeometry::Point2D> minor;
+    std::vector<QSGGeometry::Point2D> major;
+    for (size_t i = 0; i < m_contours->lines.size(); ++i) {
+        const QRectF &bounds = m_lineBounds[i];
+        if (bounds.right() < visible.left() || bounds.left() > visible.right()
+            || bounds.bottom() < visible.top() || bounds.top() > visible.bottom()) {
+            continue;
+        }
+        if (std::max(bounds.width() * screenX, bounds.height() * screenY) < MinLinePixels) {
+            continue;
+        }
+        const Contours::Line &line = m_contours->lines[i];
+        std::vector<QSGGeometry::Point2D> &out = line.major ? major : minor;
+        QSGGeometry::Point2D previous = {0.0f, 0.0f};
+        const int count = line.points.size();
+        for (int p = 0; p < count; ++p) {
+            const QPointF &point = line.points[p];
+            QSGGeometry::Point2D vertex;
+            vertex.set(static_cast<float>((m[0] + point.x() * m[1] + point.y() * m[2]) * w),
+                       static_cast<float>((m[3] + point.x() * m[4] + point.y() * m[5]) * h));
+            if (p > 0) {
+                // Distanza a schermo: l'item è scalato dallo zoom
+                double dx = (vertex.x - previous.x) * m_zoom;
+                double dy = (vertex.y - previous.y) * m_zoom;
+                if (p < count - 1 && dx * dx + dy * dy < minVertex2) {
+                    continue;
+                }
+                out.push_back(previous);
+                out.push_back(vertex);
+            }
+            previous = vertex;
+        }
+    }
+
+    updateLineNode(minorNode, minor, m_color);
+    updateLineNode(majorNode, major, m_majorColor);
+    return root;
+}
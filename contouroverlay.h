@@ -0,0 +1,125 @@
+#ifndef CONTOUROVERLAY_H
+#define CONTOUROVERLAY_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QRectF>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QVariantMap>
+#include <memory>
+#include <vector>
+#include "contours.h"
+
+// Curve di livello del DSM `source` disegnate sopra l'immagine `reference`
+// (stessa area, anche con griglia diversa: si passa dalle coordinate geografiche).
+// L'estrazione gira in background: un nuovo intervallo annulla quella in corso e
+// riusa la griglia già letta. Nel scene graph due nodi DrawLines (curve normali e
+// principali) con le sole curve che intersecano visibleRect e non più piccole di
+// un paio di pixel allo zoom corrente.
+class ContourOverlay : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QString reference READ reference WRITE setReference NOTIFY referenceChanged)
+    Q_PROPERTY(double interval READ interval WRITE setInterval NOTIFY intervalChanged)
+    Q_PROPERTY(double base READ base WRITE setBase NOTIFY baseChanged)
+    Q_PROPERTY(QRectF visibleRect READ visibleRect WRITE setVisibleRect NOTIFY visibleRectChanged)
+    Q_PROPERTY(double zoom READ zoom WRITE setZoom NOTIFY zoomChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor majorColor READ majorColor WRITE setMajorColor NOTIFY majorColorChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int lineCount READ lineCount NOTIFY contoursChanged)
+    Q_PROPERTY(double effectiveInterval READ effectiveInterval NOTIFY contoursChanged)
+
+public:
+    explicit ContourOverlay(QQuickItem *parent = nullptr);
+    ~ContourOverlay();
+
+    QString source() const { return m_source; }
+    void setSource(const QString &source);
+
+    QString reference() const { return m_reference; }
+    void setReference(const QString &reference);
+
+    // <= 0: intervallo automatico (~20 livelli sull'escursione del DSM)
+    double interval() const { return m_interval; }
+    void setInterval(double interval);
+
+    double base() const { return m_base; }
+    void setBase(double base);
+
+    // Porzione visibile in coordinate normalizzate dell'item
+    QRectF visibleRect() const { return m_visibleRect; }
+    void setVisibleRect(const QRectF &rect);
+
+    double zoom() const { return m_zoom; }
+    void setZoom(double zoom);
+
+    QColor color() const { return m_color; }
+    void setColor(const QColor &color);
+
+    QColor majorColor() const { return m_majorColor; }
+    void setMajorColor(const QColor &color);
+
+    bool running() const { return m_running; }
+    int lineCount() const { return m_contours ? (int)m_contours->lines.size() : 0; }
+    double effectiveInterval() const { return m_contours ? m_contours->interval : 0.0; }
+
+    // Curve correnti in GeoJSON (.geojson) o shapefile (.shp):
+    // { ok, path, lines } oppure { ok: false, error }
+    Q_INVOKABLE QVariantMap exportTo(const QString &outputPath);
+
+signals:
+    void sourceChanged();
+    void referenceChanged();
+    void intervalChanged();
+    void baseChanged();
+    void visibleRectChanged();
+    void zoomChanged();
+    void colorChanged();
+    void majorColorChanged();
+    void runningChanged();
+    void contoursChanged();
+    void errorOccurred(const QString &message);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void componentComplete() override;
+
+private:
+    // Pixel sorgente -> coordinate normalizzate del reference (affine)
+    struct Mapping
+    {
+        double m[6] = {0.0, 1.0, 0.0, 0.0, 0.0, 1.0};   // nx = m0 + x*m1 + y*m2, ny = m3 + x*m4 + y*m5
+    };
+
+    static QString cleanPath(const QString &path);
+    static double autoInterval(const Contours::Grid &grid);
+    static Mapping computeMapping(const Contours::Grid &grid, const QString &referencePath);
+
+    void regenerate();
+    void setRunning(bool running);
+
+    QString m_source;
+    QString m_reference;
+    double m_interval;
+    double m_base;
+    QRectF m_visibleRect;
+    double m_zoom;
+    QColor m_color;
+    QColor m_majorColor;
+    bool m_running;
+
+    QThreadPool m_pool;                              // un'estrazione per volta, le superate escono subito
+    std::shared_ptr<QAtomicInt> m_generation;
+    // Griglia riusata tra le estrazioni: toccata solo dal thread del pool
+    std::shared_ptr<std::shared_ptr<const Contours::Grid>> m_workerGrid;
+    std::shared_ptr<const Contours::Grid> m_grid;    // griglia delle curve mostrate (per l'export)
+    std::shared_ptr<const Contours::ContourSet> m_contours;
+    Mapping m_mapping;
+    std::vector<QRectF> m_lineBounds;                // bounds normalizzati, uno per curva
+};
+
+#endif // CONTOUROVERLAY_H
@@ -0,0 +1,508 @@
+#include "contours.h"
+#include "rasterreader.h"
+#include "decodepool.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <gdal_priv.h>
+#include <ogrsf_frmts.h>
+#include <ogr_spatialref.h>
+
+namespace Contours {
+
+namespace {
+
+// Polilinea parziale in coordinate della griglia; start/end = spigoli della
+// griglia su cui cadono gli estremi (identificativi globali, uguali per i due
+// tile che condividono uno spigolo)
+struct Piece
+{
+    int level = 0;                  // indice del livello rispetto a kMin
+    qint64 start = 0;
+    qint64 end = 0;
+    bool closed = false;
+    std::vector<QPointF> points;
+};
+
+struct TileResult
+{
+    std::vector<Piece> closed;
+    std::vector<Piece> open;
+};
+
+bool isCancelled(const QAtomicInt *generation, int expected)
+{
+    return generation && generation->loadAcquire() != expected;
+}
+
+// Cuce i pezzi che condividono un estremo (stesso livello e stesso spigolo):
+// gli anelli finiscono in closed, le linee con estremi liberi in open
+void joinPieces(std::vector<Piece> &pieces, qint64 edgeCount, std::vector<Piece> &closed, std::vector<Piece> &open)
+{
+    auto key = [edgeCount](int level, qint64 edge) { return (qint64)level * edgeCount + edge; };
+    std::unordered_map<qint64, std::array<int, 2>> ends;
+    ends.reserve(pieces.size() * 2);
+    auto addEnd = [&](qint64 k, int index) {
+        auto it = ends.find(k);
+        if (it == ends.end()) {
+            ends.emplace(k, std::array<int, 2>{index, -1});
+        } else if (it->second[1] < 0) {
+            it->second[1] = index;
+        }
+    };
+    for (int i = 0; i < (int)pieces.size(); ++i) {
+        addEnd(key(pieces[i].level, pieces[i].start), i);
+        addEnd(key(pieces[i].level, pieces[i].end), i);
+    }
+
+    std::vector<char> used(pieces.size(), 0);
+    auto partner = [&](int level, qint64 edge, int self) {
+        auto it = ends.find(key(level, edge));
+        if (it == ends.end()) return -1;
+        for (int index : it->second) {
+            if (index >= 0 && index != self && !used[index]) return index;
+        }
+        return -1;
+    };
+
+    for (int i = 0; i < (int)pieces.size(); ++i) {
+        if (used[i]) {
+            continue;
+        }
+        used[i] = 1;
+        Piece current = std::move(pieces[i]);
+
+        // Avanti dall'estremo finale
+        for (int j = partner(current.level, current.end, i); j >= 0; j = partner(current.level, current.end, i)) {
+            used[j] = 1;
+            Piece &next = pieces[j];
+            if (next.start == current.end) {
+                current.points.insert(current.points.end(), next.points.begin() + 1, next.points.end());
+                current.end = next.end;
+            } else {
+                current.points.insert(current.points.end(), next.points.rbegin() + 1, next.points.rend());
+                current.end = next.start;
+            }
+            if (current.end == current.start) {
+                current.closed = true;
+                break;
+            }
+        }
+
+        // Indietro dall'estremo iniziale (raccolti al contrario, poi anteposti)
+        if (!current.closed) {
+            std::vector<QPointF> front;
+            for (int j = partner(current.level, current.start, i); j >= 0; j = partner(current.level, current.start, i)) {
+                used[j] = 1;
+                Piece &previous = pieces[j];
+                if (previous.end == current.start) {
+                    front.insert(front.end(), previous.points.rbegin() + 1, previous.points.rend());
+                    current.start = previous.start;
+                } else {
+                    front.insert(front.end(), previous.points.begin() + 1, previous.points.end());
+                    current.start = previous.end;
+                }
+            }
+            if (!front.empty()) {
+                std::reverse(front.begin(), front.end());
+                front.insert(front.end(), current.points.begin(), current.points.end());
+                current.points.swap(front);
+            }
+        }
+
+        (current.closed ? closed : open).push_back(std::move(current));
+    }
+}
+
+// Marching squares sulle celle [x0, x1) x [y0, y1); la cella (x, y) ha i
+// campioni (x, y), (x+1, y), (x+1, y+1), (x, y+1) ai vertici
+void marchTile(const Grid &grid, double interval, double base, int kMin, int x0, int y0, int x1, int y1,
+               TileResult &result)
+{
+    const int W = grid.width;
+    const qint64 edgeCount = 2LL * W * grid.height;
+    auto value = [&](int x, int y) { return grid.values[(size_t)y * W + x]; };
+    auto hEdge = [W](int x, int y) { return 2LL * ((qint64)y * W + x); };
+    auto vEdge = [W](int x, int y) { return 2LL * ((qint64)y * W + x) + 1; };
+
+    std::vector<Piece> segments;
+    for (int cy = y0; cy < y1; ++cy) {
+        for (int cx = x0; cx < x1; ++cx) {
+            const float a = value(cx, cy);           // alto-sinistra
+            const float b = value(cx + 1, cy);       // alto-destra
+            const float c = value(cx + 1, cy + 1);   // basso-destra
+            const float d = value(cx, cy + 1);       // basso-sinistra
+            if (std::isnan(a) || std::isnan(b) || std::isnan(c) || std::isnan(d)) {
+                continue;
+            }
+            const float lo = std::min(std::min(a, b), std::min(c, d));
+            const float hi = std::max(std::max(a, b), std::max(c, d));
+            const int kLo = static_cast<int>(std::ceil((lo - base) / interval));
+            const int kHi = static_cast<int>(std::floor((hi - base) / interval));
+
+            for (int k = kLo; k <= kHi; ++k) {
+                const float L = static_cast<float>(base + k * interval);
+                const int index = (a >= L ? 8 : 0) | (b >= L ? 4 : 0) | (c >= L ? 2 : 0) | (d >= L ? 1 : 0);
+                if (index == 0 || index == 15) {
+                    continue;
+                }
+                // Punti sugli spigoli, sempre interpolati dal vertice alto/sinistro:
+                // la cella vicina calcola lo stesso punto per lo stesso spigolo
+                const QPointF top(cx + (L - a) / (b - a), cy);
+                const QPointF bottom(cx + (L - d) / (c - d), cy + 1);
+                const QPointF left(cx, cy + (L - a) / (d - a));
+                const QPointF right(cx + 1, cy + (L - b) / (c - b));
+                const qint64 T = hEdge(cx, cy), B = hEdge(cx, cy + 1), Le = vEdge(cx, cy), R = vEdge(cx + 1, cy);
+                auto addSegment = [&](const QPointF &p, qint64 ep, const QPointF &q, qint64 eq) {
+                    Piece piece;
+                    piece.level = k - kMin;
+                    piece.start = ep;
+                    piece.end = eq;
+                    piece.points = {p, q};
+                    segments.push_back(std::move(piece));
+                };
+                const bool centerHigh = (a + b + c + d) * 0.25f >= L;
+                switch (index) {
+                case 1: case 14: addSegment(left, Le, bottom, B); break;
+                case 2: case 13: addSegment(bottom, B, right, R); break;
+                case 3: case 12: addSegment(left, Le, right, R); break;
+                case 4: case 11: addSegment(top, T, right, R); break;
+                case 6: case 9:  addSegment(top, T, bottom, B); break;
+                case 7: case 8:  addSegment(left, Le, top, T); break;
+                case 5:     // sella: alto-destra e basso-sinistra sopra il livello
+                    if (centerHigh) { addSegment(left, Le, top, T); addSegment(bottom, B, right, R); }
+                    else { addSegment(top, T, right, R); addSegment(left, Le, bottom, B); }
+                    break;
+                case 10:    // sella: alto-sinistra e basso-destra sopra il livello
+                    if (centerHigh) { addSegment(top, T, right, R); addSegment(left, Le, bottom, B); }
+                    else { addSegment(left, Le, top, T); addSegment(bottom, B, right, R); }
+                    break;
+                }
+            }
+        }
+    }
+
+    joinPieces(segments, edgeCount, result.closed, result.open);
+}
+
+double segmentDistance(const QPointF &p, const QPointF &a, const QPointF &b)
+{
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const double length2 = dx * dx + dy * dy;
+    if (length2 <= 0.0) {
+        return std::hypot(p.x() - a.x(), p.y() - a.y());
+    }
+    return std::abs(dy * p.x() - dx * p.y() + b.x() * a.y() - b.y() * a.x()) / std::sqrt(length2);
+}
+
+// Douglas-Peucker iterativo; primo e ultimo punto sempre tenuti
+std::vector<QPointF> simplify(const std::vector<QPointF> &points, double tolerance)
+{
+    if (points.size() <= 3 || tolerance <= 0.0) {
+        return points;
+    }
+    std::vector<char> keep(points.size(), 0);
+    keep.front() = keep.back() = 1;
+    std::vector<std::pair<size_t, size_t>> stack = {{0, points.size() - 1}};
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+        double maxDistance = 0.0;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            double distance = segmentDistance(points[i], points[first], points[last]);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = i;
+            }
+        }
+        if (maxDistance > tolerance) {
+            keep[farthest] = 1;
+            stack.push_back({first, farthest});
+            stack.push_back({farthest, last});
+        }
+    }
+    std::vector<QPointF> result;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) result.push_back(points[i]);
+    }
+    return result;
+}
+
+// Il più piccolo 1, 2 o 5 x 10^k non inferiore a step
+double niceStep(double step)
+{
+    const double magnitude = std::pow(10.0, std::floor(std::log10(step)));
+    for (double factor : {1.0, 2.0, 5.0, 10.0}) {
+        // Tolleranza relativa: 0.3 / 0.1 non deve diventare 5
+        if (factor * magnitude >= step * (1.0 - 1e-9)) {
+            return factor * magnitude;
+        }
+    }
+    return 10.0 * magnitude;
+}
+
+// Esegue body(i) per i in [0, count) sul pool di decodifica, a blocchi
+template <typename Body>
+void forEachChunked(int count, int chunk, Body body)
+{
+    if (count <= 0) {
+        return;
+    }
+    QAtomicInt next(0);
+    const int chunks = (count + chunk - 1) / chunk;
+    DecodePool::parallelFor(chunks, [&](int) {
+        for (int c = next.fetchAndAddRelaxed(1); c < chunks; c = next.fetchAndAddRelaxed(1)) {
+            for (int i = c * chunk; i < std::min(count, (c + 1) * chunk); ++i) {
+                body(i);
+            }
+        }
+    });
+}
+
+} // namespace
+
+QPointF Grid::toSource(double gx, double gy) const
+{
+    return QPointF((gx + 0.5) * sourceWidth / width, (gy + 0.5) * sourceHeight / height);
+}
+
+std::shared_ptr<const Grid> loadGrid(const QString &path, QString *error)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        *error = "Failed to open " + path;
+        return nullptr;
+    }
+    GDALRasterBand *band = dataset->GetRasterBand(1);
+    if (band == nullptr) {
+        *error = "No raster band in " + path;
+        GDALClose(dataset);
+        return nullptr;
+    }
+
+    auto grid = std::make_shared<Grid>();
+    grid->path = path;
+    grid->sourceWidth = dataset->GetRasterXSize();
+    grid->sourceHeight = dataset->GetRasterYSize();
+    grid->hasGeoTransform = dataset->GetGeoTransform(grid->geoTransform) == CE_None;
+    const char *projection = dataset->GetProjectionRef();
+    grid->projection = projection ? QString::fromUtf8(projection) : QString();
+
+    // Griglia ridotta in proporzione, letta dall'overview migliore (media)
+    double decimation = std::max(1.0, std::sqrt((double)grid->sourceWidth * grid->sourceHeight / MaxGridPixels));
+    grid->width = std::max(2, static_cast<int>(std::ceil(grid->sourceWidth / decimation)));
+    grid->height = std::max(2, static_cast<int>(std::ceil(grid->sourceHeight / decimation)));
+    grid->values.resize((size_t)grid->width * grid->height);
+    if (RasterReader::readBand(band, grid->values.data(), grid->width, grid->height, GDT_Float32,
+                               ResampleMode::Average) != CE_None) {
+        *error = QString("Failed to read %1: %2").arg(path, CPLGetLastErrorMsg());
+        GDALClose(dataset);
+        return nullptr;
+    }
+
+    int hasNoData = 0;
+    const double noData = band->GetNoDataValue(&hasNoData);
+    GDALClose(dataset);
+
+    grid->minValue = std::numeric_limits<double>::max();
+    grid->maxValue = std::numeric_limits<double>::lowest();
+    for (float &value : grid->values) {
+        if (std::isnan(value) || std::isinf(value) || value == -9999.0f || (hasNoData && value == (float)noData)) {
+            value = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+        grid->minValue = std::min(grid->minValue, (double)value);
+        grid->maxValue = std::max(grid->maxValue, (double)value);
+    }
+    if (grid->minValue > grid->maxValue) {
+        *error = "No valid elevation values in " + path;
+        return nullptr;
+    }
+
+    qDebug() << "Contour grid" << grid->width << "x" << grid->height << "from" << grid->sourceWidth << "x"
+             << grid->sourceHeight << "range" << grid->minValue << "-" << grid->maxValue << "in" << timer.elapsed() << "ms";
+    return grid;
+}
+
+std::shared_ptr<const ContourSet> generate(const Grid &grid, double interval, double base, double tolerance,
+                                           const QAtomicInt *generation, int expected)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    auto set = std::make_shared<ContourSet>();
+    set->base = base;
+    if (interval <= 0.0 || grid.width < 2 || grid.height < 2) {
+        set->interval = interval;
+        return set;
+    }
+    // Troppi livelli per l'intervallo: si allarga al passo 1/2/5 x 10^k successivo,
+    // così le quote restano numeri tondi
+    if ((grid.maxValue - grid.minValue) / interval > MaxLevels) {
+        interval = niceStep((grid.maxValue - grid.minValue) / MaxLevels);
+        qWarning() << "Contour interval too small, widened to" << interval;
+    }
+    set->interval = interval;
+    const int kMin = static_cast<int>(std::floor((grid.minValue - base) / interval)) - 1;
+    const qint64 edgeCount = 2LL * grid.width * grid.height;
+
+    // Tile di celle in parallelo
+    const int cellsX = grid.width - 1;
+    const int cellsY = grid.height - 1;
+    const int tilesX = (cellsX + TileSize - 1) / TileSize;
+    const int tilesY = (cellsY + TileSize - 1) / TileSize;
+    std::vector<TileResult> tiles((size_t)tilesX * tilesY);
+    forEachChunked(tilesX * tilesY, 1, [&](int index) {
+        if (isCancelled(generation, expected)) {
+            return;
+        }
+        int x0 = (index % tilesX) * TileSize;
+        int y0 = (index / tilesX) * TileSize;
+        marchTile(grid, interval, base, kMin, x0, y0, std::min(cellsX, x0 + TileSize), std::min(cellsY, y0 + TileSize),
+                  tiles[index]);
+    });
+    if (isCancelled(generation, expected)) {
+        return nullptr;
+    }
+
+    // Cucitura lungo i bordi dei tile: solo i pezzi con estremi liberi
+    std::vector<Piece> pieces;
+    std::vector<Piece> seams;
+    for (TileResult &tile : tiles) {
+        for (Piece &piece : tile.closed) pieces.push_back(std::move(piece));
+        for (Piece &piece : tile.open) seams.push_back(std::move(piece));
+    }
+    const size_t seamCount = seams.size();
+    joinPieces(seams, edgeCount, pieces, pieces);
+    if (isCancelled(generation, expected)) {
+        return nullptr;
+    }
+
+    // Semplificazione e passaggio ai pixel sorgente
+    set->lines.resize(pieces.size());
+    forEachChunked((int)pieces.size(), 64, [&](int i) {
+        const Piece &piece = pieces[i];
+        std::vector<QPointF> points = simplify(piece.points, tolerance);
+        Line &line = set->lines[i];
+        const int k = piece.level + kMin;
+        line.level = base + k * interval;
+        line.major = ((k % 5) + 5) % 5 == 0;
+        line.closed = piece.closed;
+        line.points.reserve((int)points.size());
+        double minX = std::numeric_limits<double>::max(), minY = minX;
+        double maxX = std::numeric_limits<double>::lowest(), maxY = maxX;
+        for (const QPointF &p : points) {
+            QPointF source = grid.toSource(p.x(), p.y());
+            line.points.append(source);
+            minX = std::min(minX, source.x());
+            minY = std::min(minY, source.y());
+            maxX = std::max(maxX, source.x());
+            maxY = std::max(maxY, source.y());
+        }
+        line.bounds = QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+    });
+    set->lines.erase(std::remove_if(set->lines.begin(), set->lines.end(),
+                                    [](const Line &line) { return line.points.size() < 2; }),
+                     set->lines.end());
+    for (const Line &line : set->lines) {
+        set->vertexCount += line.points.size();
+    }
+
+    qDebug() << "Contours every" << interval << ":" << set->lines.size() << "lines," << set->vertexCount << "vertices,"
+             << seamCount << "seam pieces," << tilesX * tilesY << "tiles in" << timer.elapsed() << "ms";
+    return set;
+}
+
+bool exportLines(const Grid &grid, const ContourSet &set, const QString &outputPath, QString *error)
+{
+    const QString suffix = QFileInfo(outputPath).suffix().toLower();
+    if (suffix != "shp" && suffix != "geojson" && suffix != "json") {
+        *error = "Unsupported contour format (use .geojson or .shp): " + outputPath;
+        return false;
+    }
+    const char *driverName = suffix == "shp" ? "ESRI Shapefile" : "GeoJSON";
+    GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(driverName);
+    if (driver == nullptr) {
+        *error = QString("%1 driver not available").arg(driverName);
+        return false;
+    }
+    // Lo shapefile ha file accessori: li rimuove il driver
+    if (QFile::exists(outputPath)) {
+        driver->Delete(outputPath.toUtf8().constData());
+    }
+
+    GDALDataset *dataset = driver->Create(outputPath.toUtf8().constData(), 0, 0, 0, GDT_Unknown, nullptr);
+    if (dataset == nullptr) {
+        *error = QString("Failed to create %1: %2").arg(outputPath, CPLGetLastErrorMsg());
+        return false;
+    }
+
+    OGRSpatialReference *srs = nullptr;
+    if (grid.hasGeoTransform && !grid.projection.isEmpty()) {
+        srs = new OGRSpatialReference();
+        if (srs->importFromWkt(grid.projection.toUtf8().constData()) != OGRERR_NONE) {
+            srs->Release();
+            srs = nullptr;
+        } else {
+            srs->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+        }
+    }
+    OGRLayer *layer = dataset->CreateLayer("contours", srs, wkbLineString, nullptr);
+    if (srs) {
+        srs->Release();
+    }
+    OGRFieldDefn elevField("elev", OFTReal);
+    OGRFieldDefn majorField("major", OFTInteger);
+    if (layer == nullptr || layer->CreateField(&elevField) != OGRERR_NONE
+        || layer->CreateField(&majorField) != OGRERR_NONE) {
+        *error = QString("Failed to create contour layer: %1").arg(CPLGetLastErrorMsg());
+        GDALClose(dataset);
+        QFile::remove(outputPath);
+        return false;
+    }
+
+    const double *gt = grid.geoTransform;
+    bool ok = true;
+    for (const Line &line : set.lines) {
+        OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+        feature->SetField("elev", line.level);
+        feature->SetField("major", line.major ? 1 : 0);
+        OGRLineString geometry;
+        for (const QPointF &p : line.points) {
+            if (grid.hasGeoTransform) {
+                geometry.addPoint(gt[0] + p.x() * gt[1] + p.y() * gt[2], gt[3] + p.x() * gt[4] + p.y() * gt[5]);
+            } else {
+                geometry.addPoint(p.x(), p.y());
+            }
+        }
+        feature->SetGeometry(&geometry);
+        ok = layer->CreateFeature(feature) == OGRERR_NONE;
+        OGRFeature::DestroyFeature(feature);
+        if (!ok) {
+            *error = QString("Failed to write contour feature: %1").arg(CPLGetLastErrorMsg());
+            break;
+        }
+    }
+
+    GDALClose(dataset);
+    if (!ok) {
+        QFile::remove(outputPath);
+    }
+    qDebug() << "Contours" << (ok ? "exported to" : "export failed:") << (ok ? outputPath : *error)
+             << "(" << set.lines.size() << "lines )";
+    return ok;
+}
+
+} // namespace Contours
@@ -0,0 +1,72 @@
+#ifndef CONTOURS_H
+#define CONTOURS_H
+
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include <QAtomicInt>
+#include <memory>
+#include <vector>
+
+// Curve di livello dal DSM: marching squares a tile in parallelo su una griglia
+// ridotta (al più MaxGridPixels, dall'overview migliore), segmenti cuciti lungo
+// i bordi dei tile tramite l'identificativo dello spigolo della griglia, poi
+// semplificati (Douglas-Peucker). Le coordinate sono pixel del raster sorgente.
+namespace Contours {
+
+const int TileSize = 256;
+const qint64 MaxGridPixels = 2048LL * 2048LL;
+const int MaxLevels = 2000;
+
+// Valori del DSM su cui si estraggono le curve: caricata una volta per raster,
+// cambiare l'intervallo rilancia solo l'estrazione
+struct Grid
+{
+    QString path;
+    int width = 0;
+    int height = 0;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+    bool hasGeoTransform = false;
+    double geoTransform[6] = {0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    QString projection;
+    std::vector<float> values;      // NaN = nodata
+
+    // Pixel sorgente del campione (gx, gy) della griglia (centro del pixel)
+    QPointF toSource(double gx, double gy) const;
+};
+
+struct Line
+{
+    double level = 0.0;
+    bool major = false;             // ogni 5 intervalli a partire da base
+    bool closed = false;
+    QRectF bounds;                  // pixel sorgente
+    QVector<QPointF> points;        // pixel sorgente
+};
+
+struct ContourSet
+{
+    double interval = 0.0;
+    double base = 0.0;
+    qint64 vertexCount = 0;
+    std::vector<Line> lines;
+};
+
+std::shared_ptr<const Grid> loadGrid(const QString &path, QString *error);
+
+// Estrazione; `generation` diverso da `expected` durante il calcolo = annullata
+// (restituisce nullptr). tolerance in celle della griglia
+std::shared_ptr<const ContourSet> generate(const Grid &grid, double interval, double base, double tolerance,
+                                           const QAtomicInt *generation = nullptr, int expected = 0);
+
+// GeoJSON (.geojson/.json) o shapefile (.shp) con campo "elev" in coordinate del
+// CRS del raster (pixel se il raster non è georeferenziato)
+bool exportLines(const Grid &grid, const ContourSet &set, const QString &outputPath, QString *error);
+
+} // namespace Contours
+
+#endif // CONTOURS_H
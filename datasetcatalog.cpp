@@ -0,0 +1,123 @@
+#include "datasetcatalog.h"
+#include <QFileInfo>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+
+namespace {
+
+// Oltre questo numero di percorsi il catalogo si svuota (voci da poche centinaia di byte)
+const int MaxEntries = 512;
+
+} // namespace
+
+DatasetCatalog &DatasetCatalog::instance()
+{
+    static DatasetCatalog catalog;
+    return catalog;
+}
+
+std::shared_ptr<const DatasetInfo> DatasetCatalog::probe(const QString &path)
+{
+    QFileInfo fileInfo(path);
+    {
+        QMutexLocker locker(&m_mutex);
+        std::shared_ptr<const DatasetInfo> cached = m_entries.value(path);
+        if (cached && cached->modified == fileInfo.lastModified() && cached->fileSize == fileInfo.size()) {
+            return cached;
+        }
+    }
+
+    // Fuori dal lock: l'apertura di un file di rete può richiedere tempo
+    std::shared_ptr<DatasetInfo> info = readHeader(path);
+    info->modified = fileInfo.lastModified();
+    info->fileSize = fileInfo.size();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_entries.size() >= MaxEntries) {
+        m_entries.clear();
+    }
+    m_entries.insert(path, info);
+    return info;
+}
+
+void DatasetCatalog::invalidate(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.remove(path);
+}
+
+void DatasetCatalog::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+}
+
+std::shared_ptr<DatasetInfo> DatasetCatalog::readHeader(const QString &path)
+{
+    std::shared_ptr<DatasetInfo> info = std::make_shared<DatasetInfo>();
+    info->path = path;
+
+    if (!QFileInfo::exists(path)) {
+        info->error = "File does not exist";
+        return info;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    GDALDataset *dataset = (GDALDataset*)GDALOpenEx(path.toUtf8().constData(), GDAL_OF_RASTER | GDAL_OF_READONLY,
+                                                    nullptr, nullptr, nullptr);
+    if (!dataset) {
+        info->error = QString::fromUtf8(CPLGetLastErrorMsg());
+        return info;
+    }
+
+    info->driver = QString::fromUtf8(dataset->GetDriverName());
+    info->width = dataset->GetRasterXSize();
+    info->height = dataset->GetRasterYSize();
+    info->bandCount = dataset->GetRasterCount();
+    info->hasGeoTransform = dataset->GetGeoTransform(info->geoTransform) == CE_None;
+
+    const OGRSpatialReference *srs = dataset->GetSpatialRef();
+    if (srs) {
+        info->crsName = QString::fromUtf8(srs->GetName());
+        const char *authority = srs->GetAuthorityName(nullptr);
+        const char *code = srs->GetAuthorityCode(nullptr);
+        if (authority && code && EQUAL(authority, "EPSG")) {
+            info->epsg = atoi(code);
+        }
+        char *wkt = nullptr;
+        if (srs->exportToWkt(&wkt) == OGRERR_NONE && wkt) {
+            info->crsWkt = QString::fromUtf8(wkt);
+        }
+        CPLFree(wkt);
+    }
+
+    const char *compression = dataset->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+    info->compression = compression ? QString::fromUtf8(compression) : QString();
+    const char *interleave = dataset->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+    info->interleave = interleave ? QString::fromUtf8(interleave) : QString();
+
+    GDALRasterBand *band = info->bandCount > 0 ? dataset->GetRasterBand(1) : nullptr;
+    if (band) {
+        info->dataType = QString::fromUtf8(GDALGetDataTypeName(band->GetRasterDataType()));
+        int hasNoData = 0;
+        info->noData = band->GetNoDataValue(&hasNoData);
+        info->hasNoData = hasNoData != 0;
+        band->GetBlockSize(&info->blockWidth, &info->blockHeight);
+        const int count = band->GetOverviewCount();
+        for (int i = 0; i < count; ++i) {
+            GDALRasterBand *overview = band->GetOverview(i);
+            info->overviews.push_back(overview ? QSize(overview->GetXSize(), overview->GetYSize()) : QSize());
+        }
+        info->valid = true;
+    } else {
+        info->error = "No raster bands found";
+    }
+
+    GDALClose(dataset);
+    qDebug() << "DatasetCatalog: probed" << path << info->width << "x" << info->height << info->bandCount << "bands,"
+             << info->overviews.size() << "overviews in" << timer.elapsed() << "ms";
+    return info;
+}
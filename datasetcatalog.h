@@ -0,0 +1,65 @@
+#ifndef DATASETCATALOG_H
+#define DATASETCATALOG_H
+
+#include <QString>
+#include <QDateTime>
+#include <QSize>
+#include <QMutex>
+#include <QHash>
+#include <memory>
+#include <vector>
+
+// Metadati di un raster letti dall'header, senza toccare i pixel
+struct DatasetInfo
+{
+    QString path;
+    QDateTime modified;
+    qint64 fileSize = 0;
+    bool valid = false;
+    QString error;
+
+    QString driver;
+    int width = 0;
+    int height = 0;
+    int bandCount = 0;
+    QString dataType;               // nome GDAL della banda 1 (Byte, Float32, ...)
+    bool hasNoData = false;
+    double noData = 0.0;
+    QString crsName;
+    int epsg = 0;                   // 0 = nessun codice EPSG
+    QString crsWkt;
+    bool hasGeoTransform = false;
+    double geoTransform[6] = {0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    std::vector<QSize> overviews;   // della banda 1, nell'ordine di GDAL
+    int blockWidth = 0;
+    int blockHeight = 0;
+    QString compression;            // IMAGE_STRUCTURE/COMPRESSION, vuoto = nessuna
+    QString interleave;
+
+    // A strip i blocchi sono larghi quanto il raster
+    bool tiled() const { return blockWidth > 0 && blockWidth < width; }
+};
+
+// Catalogo dei metadati per percorso: il file si apre una volta sola (solo
+// header) e le chiamate successive rispondono dalla cache finché mtime e
+// dimensione non cambiano. Serve a validare le immagini scelte e a chi deve
+// decidere come leggerle (overview, blocchi) senza riaprire il dataset.
+class DatasetCatalog
+{
+public:
+    static DatasetCatalog &instance();
+
+    std::shared_ptr<const DatasetInfo> probe(const QString &path);
+    void invalidate(const QString &path);
+    void clear();
+
+private:
+    DatasetCatalog() = default;
+
+    static std::shared_ptr<DatasetInfo> readHeader(const QString &path);
+
+    QMutex m_mutex;
+    QHash<QString, std::shared_ptr<const DatasetInfo>> m_entries;
+};
+
+#endif // DATASETCATALOG_H
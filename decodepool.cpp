@@ -0,0 +1,92 @@
+#include "decodepool.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace DecodePool {
+
+namespace {
+
+// Il chiamante di parallelFor lavora anche lui: al pool un thread in meno
+QThreadPool &sharedPool()
+{
+    static QThreadPool *pool = [] {
+        auto *created = new QThreadPool;
+        created->setObjectName("DecodePool");
+        created->setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+        return created;
+    }();
+    return *pool;
+}
+
+} // namespace
+
+int maxThreads()
+{
+    return sharedPool().maxThreadCount() + 1;
+}
+
+void parallelFor(int workers, const std::function<void(int worker)> &body, const std::function<void()> &poll)
+{
+    // Con poll il chiamante non lavora: restano i soli thread del pool
+    workers = std::max(1, std::min(workers, poll ? maxThreads() - 1 : maxThreads()));
+    if (workers == 1 && !poll) {
+        body(0);
+        return;
+    }
+
+    QMutex mutex;
+    QWaitCondition finished;
+    int running = 0;
+    QThreadPool &pool = sharedPool();
+    // Non auto-delete: tryTake e la distruzione restano sotto il nostro controllo
+    std::vector<std::unique_ptr<QRunnable>> tasks;
+    for (int worker = poll ? 0 : 1; worker < workers; ++worker) {
+        std::unique_ptr<QRunnable> task(QRunnable::create([&, worker]() {
+            body(worker);
+            QMutexLocker locker(&mutex);
+            if (--running == 0) {
+                finished.wakeAll();
+            }
+        }));
+        task->setAutoDelete(false);
+        {
+            QMutexLocker locker(&mutex);
+            ++running;
+        }
+        pool.start(task.get());
+        tasks.push_back(std::move(task));
+    }
+
+    if (!poll) {
+        body(0);
+        // Il contatore è esaurito: chi non è ancora partito non serve più
+        for (const auto &task : tasks) {
+            if (pool.tryTake(task.get())) {
+                QMutexLocker locker(&mutex);
+                --running;
+            }
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    while (running > 0) {
+        if (!poll) {
+            finished.wait(&mutex);
+            continue;
+        }
+        if (!finished.wait(&mutex, 100) && running > 0) {
+            locker.unlock();
+            poll();
+            locker.relock();
+        }
+    }
+}
+
+} // namespace DecodePool
@@ -0,0 +1,28 @@
+#ifndef DECODEPOOL_H
+#define DECODEPOOL_H
+
+#include <functional>
+
+// Pool di thread unico per le decodifiche e i filtri a tile (letture parallele,
+// cache dei tile, algebra, denoise, curve di livello, composito). Limitato a
+// idealThreadCount: richieste contemporanee dai thread del provider si
+// dividono gli stessi core invece di creare ognuna un pool intero.
+namespace DecodePool {
+
+// Thread usati al più da una parallelFor (worker del pool più il chiamante)
+int maxThreads();
+
+// Esegue body(worker) per worker in [0, workers), limitati a maxThreads().
+// body prende il lavoro da un contatore condiviso, quindi un worker che non
+// parte non lascia lavoro indietro.
+// Senza poll il worker 0 gira nel thread chiamante; quando ha finito, i worker
+// ancora in coda (pool occupato, anche da chi ha chiamato) vengono tolti.
+// Così la chiamata può partire anche da un worker del pool.
+// Con poll il chiamante non lavora: chiama poll ogni 100 ms fino alla fine
+// (avanzamento e annullamento). Da non usare dai worker del pool.
+void parallelFor(int workers, const std::function<void(int worker)> &body,
+                 const std::function<void()> &poll = std::function<void()>());
+
+} // namespace DecodePool
+
+#endif // DECODEPOOL_H
@@ -0,0 +1,588 @@
+#include "denoise.h"
+#include "decodepool.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <gdal_priv.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DENOISE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace Denoise {
+
+namespace {
+
+const float NaN = std::numeric_limits<float>::quiet_NaN();
+const float Inf = std::numeric_limits<float>::infinity();
+
+// min/max con la semantica di minps/maxps: scalare e SSE2 danno lo stesso
+// risultato bit a bit (nessun NaN arriva qui, sono sostituiti prima)
+inline float vmin(float a, float b) { return a < b ? a : b; }
+inline float vmax(float a, float b) { return a > b ? a : b; }
+
+#ifdef DENOISE_SSE2
+inline __m128 vmin(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+inline __m128 vmax(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+
+inline __m128 blend(__m128 mask, __m128 value, __m128 fallback)
+{
+    return _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, fallback));
+}
+#endif
+
+template <typename T>
+inline void sort2(T &a, T &b)
+{
+    T low = vmin(a, b);
+    b = vmax(a, b);
+    a = low;
+}
+
+// Rete di ordinamento per la mediana di 9 valori (19 scambi, senza salti)
+template <typename T>
+inline T median9(T *p)
+{
+    sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+    sort2(p[0], p[1]); sort2(p[3], p[4]); sort2(p[6], p[7]);
+    sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+    sort2(p[0], p[3]); sort2(p[5], p[8]); sort2(p[4], p[7]);
+    sort2(p[3], p[6]); sort2(p[1], p[4]); sort2(p[2], p[5]);
+    sort2(p[4], p[7]); sort2(p[4], p[2]); sort2(p[6], p[4]);
+    sort2(p[4], p[2]);
+    return p[4];
+}
+
+int clampedRadius(int radius)
+{
+    return std::max(1, std::min(MaxRadius, radius));
+}
+
+// Mediana della finestra di (x, y): i vicini non validi prendono il valore del centro
+float medianPixel(const float *src, int stride, int x, int y, int r, std::vector<float> &window)
+{
+    const float center = src[(size_t)(y + r) * stride + x + r];
+    if (std::isnan(center)) {
+        return NaN;
+    }
+    const int size = 2 * r + 1;
+    window.resize((size_t)size * size);
+    for (int j = 0; j < size; ++j) {
+        const float *line = src + (size_t)(y + j) * stride + x;
+        for (int i = 0; i < size; ++i) {
+            window[(size_t)j * size + i] = std::isnan(line[i]) ? center : line[i];
+        }
+    }
+    if (r == 1) {
+        return median9(window.data());
+    }
+    std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+    return window[window.size() / 2];
+}
+
+void medianTile(const float *src, int stride, int w, int h, int r, float *out, std::vector<float> &scratch, bool simd)
+{
+    for (int y = 0; y < h; ++y) {
+        int x = 0;
+#ifdef DENOISE_SSE2
+        if (simd && r == 1) {
+            const float *r0 = src + (size_t)y * stride;
+            const float *r1 = r0 + stride;
+            const float *r2 = r1 + stride;
+            const __m128 nan = _mm_set1_ps(NaN);
+            for (; x + 4 <= w; x += 4) {
+                __m128 center = _mm_loadu_ps(r1 + x + 1);
+                __m128 p[9] = {
+                    _mm_loadu_ps(r0 + x), _mm_loadu_ps(r0 + x + 1), _mm_loadu_ps(r0 + x + 2),
+                    _mm_loadu_ps(r1 + x), center, _mm_loadu_ps(r1 + x + 2),
+                    _mm_loadu_ps(r2 + x), _mm_loadu_ps(r2 + x + 1), _mm_loadu_ps(r2 + x + 2)
+                };
+                for (__m128 &v : p) {
+                    v = blend(_mm_cmpord_ps(v, v), v, center);
+                }
+                __m128 median = median9(p);
+                _mm_storeu_ps(out + (size_t)y * w + x, blend(_mm_cmpord_ps(center, center), median, nan));
+            }
+        }
+#endif
+        for (; x < w; ++x) {
+            out[(size_t)y * w + x] = medianPixel(src, stride, x, y, r, scratch);
+        }
+    }
+}
+
+// Pesi gaussiani troncati al raggio, sigma dal diametro come in OpenCV
+std::vector<float> gaussianWeights(int r)
+{
+    const double sigma = 0.3 * (r - 1) + 0.8;
+    std::vector<float> weights(2 * r + 1);
+    for (int j = -r; j <= r; ++j) {
+        weights[j + r] = static_cast<float>(std::exp(-(double)j * j / (2.0 * sigma * sigma)));
+    }
+    return weights;
+}
+
+// Convoluzione normalizzata separabile: somma pesata dei valori validi e somma
+// dei loro pesi, poi rapporto. I nodata non trascinano il bordo verso lo zero.
+void gaussianTile(const float *src, int stride, int w, int h, int r, float *out, std::vector<float> &scratch, bool simd)
+{
+    const std::vector<float> k = gaussianWeights(r);
+    const int taps = 2 * r + 1;
+    const int rows = h + 2 * r;
+    scratch.resize((size_t)2 * rows * w);
+    float *num = scratch.data();
+    float *den = num + (size_t)rows * w;
+
+    // Orizzontale su tutte le righe del bordo verticale
+    for (int y = 0; y < rows; ++y) {
+        const float *line = src + (size_t)y * stride;
+        float *n = num + (size_t)y * w;
+        float *d = den + (size_t)y * w;
+        int x = 0;
+#ifdef DENOISE_SSE2
+        if (simd) {
+            for (; x + 4 <= w; x += 4) {
+                __m128 sum = _mm_setzero_ps();
+                __m128 weight = _mm_setzero_ps();
+                for (int j = 0; j < taps; ++j) {
+                    __m128 v = _mm_loadu_ps(line + x + j);
+                    __m128 valid = _mm_cmpord_ps(v, v);
+                    __m128 kj = _mm_set1_ps(k[j]);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(kj, _mm_and_ps(valid, v)));
+                    weight = _mm_add_ps(weight, _mm_and_ps(valid, kj));
+                }
+                _mm_storeu_ps(n + x, sum);
+                _mm_storeu_ps(d + x, weight);
+            }
+        }
+#endif
+        for (; x < w; ++x) {
+            float sum = 0.0f;
+            float weight = 0.0f;
+            for (int j = 0; j < taps; ++j) {
+                float v = line[x + j];
+                bool valid = v == v;
+                sum = sum + k[j] * (valid ? v : 0.0f);
+                weight = weight + (valid ? k[j] : 0.0f);
+            }
+            n[x] = sum;
+            d[x] = weight;
+        }
+    }
+
+    // Verticale e rapporto; il centro nodata resta nodata
+    for (int y = 0; y < h; ++y) {
+        const float *centerLine = src + (size_t)(y + r) * stride + r;
+        float *dst = out + (size_t)y * w;
+        int x = 0;
+#ifdef DENOISE_SSE2
+        if (simd) {
+            const __m128 nan = _mm_set1_ps(NaN);
+            for (; x + 4 <= w; x += 4) {
+                __m128 sum = _mm_setzero_ps();
+                __m128 weight = _mm_setzero_ps();
+                for (int j = 0; j < taps; ++j) {
+                    __m128 kj = _mm_set1_ps(k[j]);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(kj, _mm_loadu_ps(num + (size_t)(y + j) * w + x)));
+                    weight = _mm_add_ps(weight, _mm_mul_ps(kj, _mm_loadu_ps(den + (size_t)(y + j) * w + x)));
+                }
+                __m128 center = _mm_loadu_ps(centerLine + x);
+                _mm_storeu_ps(dst + x, blend(_mm_cmpord_ps(center, center), _mm_div_ps(sum, weight), nan));
+            }
+        }
+#endif
+        for (; x < w; ++x) {
+            float sum = 0.0f;
+            float weight = 0.0f;
+            for (int j = 0; j < taps; ++j) {
+                sum = sum + k[j] * num[(size_t)(y + j) * w + x];
+                weight = weight + k[j] * den[(size_t)(y + j) * w + x];
+            }
+            float center = centerLine[x];
+            dst[x] = center == center ? sum / weight : NaN;
+        }
+    }
+}
+
+enum class Pass { Erode, Dilate };
+
+// Erosione: i non validi (NaN) diventano +inf e non vincono mai il minimo.
+// Dilatazione: +inf (finestra senza dati validi) diventa -inf per il massimo.
+inline float prepare(Pass pass, float v)
+{
+    if (pass == Pass::Erode) return v == v ? v : Inf;
+    return v == Inf ? -Inf : v;
+}
+
+inline float extreme(Pass pass, float a, float b)
+{
+    return pass == Pass::Erode ? vmin(a, b) : vmax(a, b);
+}
+
+#ifdef DENOISE_SSE2
+inline __m128 prepare(Pass pass, __m128 v)
+{
+    const __m128 inf = _mm_set1_ps(Inf);
+    if (pass == Pass::Erode) return blend(_mm_cmpord_ps(v, v), v, inf);
+    return blend(_mm_cmpeq_ps(v, inf), _mm_set1_ps(-Inf), v);
+}
+
+inline __m128 extreme(Pass pass, __m128 a, __m128 b)
+{
+    return pass == Pass::Erode ? vmin(a, b) : vmax(a, b);
+}
+#endif
+
+// out (rows x cols) = estremo su `taps` colonne consecutive di in
+void horizontalPass(Pass pass, const float *in, int inStride, int rows, int cols, int taps, float *out, bool simd)
+{
+    for (int y = 0; y < rows; ++y) {
+        const float *line = in + (size_t)y * inStride;
+        float *dst = out + (size_t)y * cols;
+        int x = 0;
+#ifdef DENOISE_SSE2
+        if (simd) {
+            for (; x + 4 <= cols; x += 4) {
+                __m128 acc = prepare(pass, _mm_loadu_ps(line + x));
+                for (int j = 1; j < taps; ++j) {
+                    acc = extreme(pass, acc, prepare(pass, _mm_loadu_ps(line + x + j)));
+                }
+                _mm_storeu_ps(dst + x, acc);
+            }
+        }
+#endif
+        for (; x < cols; ++x) {
+            float acc = prepare(pass, line[x]);
+            for (int j = 1; j < taps; ++j) {
+                acc = extreme(pass, acc, prepare(pass, line[x + j]));
+            }
+            dst[x] = acc;
+        }
+    }
+}
+
+// out (rows x cols) = estremo su `taps` righe consecutive di in (già preparato)
+void verticalPass(Pass pass, const float *in, int rows, int cols, int taps, float *out, bool simd)
+{
+    for (int y = 0; y < rows; ++y) {
+        float *dst = out + (size_t)y * cols;
+        int x = 0;
+#ifdef DENOISE_SSE2
+        if (simd) {
+            for (; x + 4 <= cols; x += 4) {
+                __m128 acc = _mm_loadu_ps(in + (size_t)y * cols + x);
+                for (int j = 1; j < taps; ++j) {
+                    acc = extreme(pass, acc, _mm_loadu_ps(in + (size_t)(y + j) * cols + x));
+                }
+                _mm_storeu_ps(dst + x, acc);
+            }
+        }
+#endif
+        for (; x < cols; ++x) {
+            float acc = in[(size_t)y * cols + x];
+            for (int j = 1; j < taps; ++j) {
+                acc = extreme(pass, acc, in[(size_t)(y + j) * cols + x]);
+            }
+            dst[x] = acc;
+        }
+    }
+}
+
+// Apertura = dilatazione dell'erosione. L'erosione serve anche sul bordo della
+// dilatazione, da cui l'halo di 2r: tile (w + 4r) x (h + 4r) in ingresso
+void openingTile(const float *src, int stride, int w, int h, int r, float *out, std::vector<float> &scratch, bool simd)
+{
+    const int taps = 2 * r + 1;
+    const int erodedW = w + 2 * r;
+    const int erodedH = h + 2 * r;
+    const size_t rowsMin = (size_t)(h + 4 * r) * erodedW;
+    const size_t eroded = (size_t)erodedH * erodedW;
+    const size_t rowsMax = (size_t)erodedH * w;
+    scratch.resize(rowsMin + eroded + rowsMax);
+    float *hMin = scratch.data();
+    float *ero = hMin + rowsMin;
+    float *hMax = ero + eroded;
+
+    horizontalPass(Pass::Erode, src, stride, h + 4 * r, erodedW, taps, hMin, simd);
+    verticalPass(Pass::Erode, hMin, erodedH, erodedW, taps, ero, simd);
+    horizontalPass(Pass::Dilate, ero, erodedW, erodedH, w, taps, hMax, simd);
+    verticalPass(Pass::Dilate, hMax, h, w, taps, out, simd);
+
+    // Il centro nodata resta nodata (con il centro valido il risultato è finito)
+    for (int y = 0; y < h; ++y) {
+        const float *centerLine = src + (size_t)(y + 2 * r) * stride + 2 * r;
+        float *dst = out + (size_t)y * w;
+        for (int x = 0; x < w; ++x) {
+            if (std::isnan(centerLine[x])) {
+                dst[x] = NaN;
+            }
+        }
+    }
+}
+
+void filterTileImpl(const Params &params, const float *src, int srcStride, int w, int h, float *out,
+                    std::vector<float> &scratch, bool simd)
+{
+    const int r = clampedRadius(params.radius);
+    switch (params.filter) {
+    case Filter::Median:
+        medianTile(src, srcStride, w, h, r, out, scratch, simd);
+        break;
+    case Filter::Gaussian:
+        gaussianTile(src, srcStride, w, h, r, out, scratch, simd);
+        break;
+    case Filter::Opening:
+        openingTile(src, srcStride, w, h, r, out, scratch, simd);
+        break;
+    case Filter::None:
+        for (int y = 0; y < h; ++y) {
+            std::memcpy(out + (size_t)y * w, src + (size_t)y * srcStride, w * sizeof(float));
+        }
+        break;
+    }
+}
+
+float bandNoData(GDALRasterBand *band)
+{
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+    return hasNoData ? static_cast<float>(noData) : NaN;
+}
+
+} // namespace
+
+Filter filterFromName(const QString &name)
+{
+    QString key = name.trimmed().toLower();
+    if (key == "median") return Filter::Median;
+    if (key == "gaussian") return Filter::Gaussian;
+    if (key == "opening") return Filter::Opening;
+    return Filter::None;
+}
+
+QString filterName(Filter filter)
+{
+    switch (filter) {
+    case Filter::Median: return "median";
+    case Filter::Gaussian: return "gaussian";
+    case Filter::Opening: return "opening";
+    case Filter::None: break;
+    }
+    return "none";
+}
+
+int haloSize(const Params &params)
+{
+    const int r = clampedRadius(params.radius);
+    switch (params.filter) {
+    case Filter::None: return 0;
+    case Filter::Opening: return 2 * r;
+    default: return r;
+    }
+}
+
+bool hasSimd()
+{
+#ifdef DENOISE_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void markInvalid(float *data, size_t count, float noData)
+{
+    for (size_t i = 0; i < count; ++i) {
+        float value = data[i];
+        if (std::isinf(value) || value == RasterAlgebra::NoData || value == noData) {
+            data[i] = NaN;
+        }
+    }
+}
+
+void filterTile(const Params &params, const float *src, int srcStride, int w, int h, float *out,
+                std::vector<float> &scratch)
+{
+    filterTileImpl(params, src, srcStride, w, h, out, scratch, true);
+}
+
+void filterTileScalar(const Params &params, const float *src, int srcStride, int w, int h, float *out,
+                      std::vector<float> &scratch)
+{
+    filterTileImpl(params, src, srcStride, w, h, out, scratch, false);
+}
+
+void padReplicate(const float *data, int w, int h, int halo, float noData, std::vector<float> &padded)
+{
+    const int stride = w + 2 * halo;
+    padded.resize((size_t)stride * (h + 2 * halo));
+    for (int py = 0; py < h + 2 * halo; ++py) {
+        const float *line = data + (size_t)std::max(0, std::min(h - 1, py - halo)) * w;
+        float *dst = padded.data() + (size_t)py * stride;
+        std::fill(dst, dst + halo, line[0]);
+        std::copy(line, line + w, dst + halo);
+        std::fill(dst + halo + w, dst + stride, line[w - 1]);
+    }
+    markInvalid(padded.data(), padded.size(), noData);
+}
+
+void filterBuffer(const Params &params, const float *padded, int w, int h, float *out)
+{
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const int stride = w + 2 * haloSize(params);
+    const int tileSize = RasterAlgebra::TileSize;
+    const int tilesX = (w + tileSize - 1) / tileSize;
+    const int tilesY = (h + tileSize - 1) / tileSize;
+    const int total = tilesX * tilesY;
+    QAtomicInt next(0);
+
+    DecodePool::parallelFor(total, [&](int) {
+        std::vector<float> scratch;
+        std::vector<float> tile((size_t)tileSize * tileSize);
+        for (int index = next.fetchAndAddRelaxed(1); index < total; index = next.fetchAndAddRelaxed(1)) {
+            int x = (index % tilesX) * tileSize;
+            int y = (index / tilesX) * tileSize;
+            int tw = std::min(tileSize, w - x);
+            int th = std::min(tileSize, h - y);
+            // L'angolo dell'halo del tile coincide con (x, y) nel buffer con bordo
+            filterTile(params, padded + (size_t)y * stride + x, stride, tw, th, tile.data(), scratch);
+            for (int r = 0; r < th; ++r) {
+                std::copy(tile.begin() + (size_t)r * tw, tile.begin() + (size_t)(r + 1) * tw,
+                          out + (size_t)(y + r) * w + x);
+            }
+        }
+    });
+
+    qDebug() << "Denoise" << filterName(params.filter) << "r" << clampedRadius(params.radius) << "on" << w << "x" << h
+             << "in" << timer.elapsed() << "ms" << (hasSimd() ? "(SSE2)" : "(scalar)");
+}
+
+bool readHalo(GDALRasterBand *band, double srcX, double srcY, double srcWidth, double srcHeight,
+              int outW, int outH, int halo, ResampleMode mode, std::vector<float> &data)
+{
+    if (outW <= 0 || outH <= 0 || srcWidth <= 0.0 || srcHeight <= 0.0) {
+        return false;
+    }
+    const double scaleX = srcWidth / outW;
+    const double scaleY = srcHeight / outH;
+    const int rasterW = band->GetXSize();
+    const int rasterH = band->GetYSize();
+
+    // Quanta parte del bordo cade dentro il raster, per lato
+    auto inside = [halo](double span, double scale) {
+        return std::max(0, std::min(halo, static_cast<int>(std::floor(span / scale + 1e-6))));
+    };
+    const int left = inside(srcX, scaleX);
+    const int top = inside(srcY, scaleY);
+    const int right = inside(rasterW - (srcX + srcWidth), scaleX);
+    const int bottom = inside(rasterH - (srcY + srcHeight), scaleY);
+
+    const int stride = outW + 2 * halo;
+    const int rows = outH + 2 * halo;
+    data.assign((size_t)stride * rows, NaN);
+
+    const int readW = outW + left + right;
+    const int readH = outH + top + bottom;
+    double x0 = std::max(0.0, srcX - left * scaleX);
+    double y0 = std::max(0.0, srcY - top * scaleY);
+    double x1 = std::min((double)rasterW, srcX + srcWidth + right * scaleX);
+    double y1 = std::min((double)rasterH, srcY + srcHeight + bottom * scaleY);
+    float *origin = data.data() + (size_t)(halo - top) * stride + (halo - left);
+    if (RasterReader::readWindow(band, x0, y0, x1 - x0, y1 - y0, origin, readW, readH, GDT_Float32, mode,
+                                 sizeof(float), (GSpacing)stride * sizeof(float)) != CE_None) {
+        return false;
+    }
+
+    // Fuori dal raster: replica dell'ultima colonna/riga letta
+    const int c0 = halo - left;
+    const int c1 = halo + outW + right;
+    const int r0 = halo - top;
+    const int r1 = halo + outH + bottom;
+    for (int y = r0; y < r1; ++y) {
+        float *line = data.data() + (size_t)y * stride;
+        std::fill(line, line + c0, line[c0]);
+        std::fill(line + c1, line + stride, line[c1 - 1]);
+    }
+    for (int y = 0; y < r0; ++y) {
+        std::copy(data.begin() + (size_t)r0 * stride, data.begin() + (size_t)(r0 + 1) * stride,
+                  data.begin() + (size_t)y * stride);
+    }
+    for (int y = r1; y < rows; ++y) {
+        std::copy(data.begin() + (size_t)(r1 - 1) * stride, data.begin() + (size_t)r1 * stride,
+                  data.begin() + (size_t)y * stride);
+    }
+
+    markInvalid(data.data(), data.size(), bandNoData(band));
+    return true;
+}
+
+bool filterRaster(const QString &inputPath, int bandIndex, const Params &params, const QString &outputPath,
+                  QString *error, const RasterAlgebra::ProgressFunction &progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    GDALDataset *output = nullptr;
+    {
+        GDALDataset *input = (GDALDataset*)GDALOpen(inputPath.toUtf8().constData(), GA_ReadOnly);
+        if (input == nullptr) {
+            *error = "Failed to open input: " + inputPath;
+            return false;
+        }
+        if (bandIndex < 1 || bandIndex > input->GetRasterCount()) {
+            *error = QString("Band index out of range: %1").arg(bandIndex);
+            GDALClose(input);
+            return false;
+        }
+        output = RasterAlgebra::createOutput(outputPath, input, error);
+        GDALClose(input);
+        if (output == nullptr) {
+            return false;
+        }
+    }
+
+    const int halo = haloSize(params);
+    RasterAlgebra::WorkerFactory factory = [inputPath, bandIndex, params, halo](QString *workerError)
+            -> RasterAlgebra::TileFunction {
+        GDALDataset *opened = (GDALDataset*)GDALOpen(inputPath.toUtf8().constData(), GA_ReadOnly);
+        if (opened == nullptr) {
+            *workerError = "Worker failed to open input: " + inputPath;
+            return RasterAlgebra::TileFunction();
+        }
+        std::shared_ptr<GDALDataset> dataset(opened, [](GDALDataset *d) { GDALClose(d); });
+        GDALRasterBand *band = dataset->GetRasterBand(bandIndex);
+        auto haloBuffer = std::make_shared<std::vector<float>>();
+        auto scratch = std::make_shared<std::vector<float>>();
+        return [dataset, band, params, halo, haloBuffer, scratch](int x, int y, int w, int h, float *out) {
+            // Piena risoluzione: finestra intera, nessun ricampionamento
+            if (!readHalo(band, x, y, w, h, w, h, halo, ResampleMode::Nearest, *haloBuffer)) {
+                return false;
+            }
+            filterTile(params, haloBuffer->data(), w + 2 * halo, w, h, out, *scratch);
+            for (size_t i = 0; i < (size_t)w * h; ++i) {
+                if (std::isnan(out[i])) out[i] = RasterAlgebra::NoData;
+            }
+            return true;
+        };
+    };
+
+    bool ok = RasterAlgebra::finishOutput(output, outputPath,
+                                          RasterAlgebra::runTiles(output, factory, progress, error));
+    qDebug() << "Denoise" << filterName(params.filter) << "r" << clampedRadius(params.radius)
+             << (ok ? "written to" : "failed:") << (ok ? outputPath : *error) << "in" << timer.elapsed() << "ms";
+    return ok;
+}
+
+} // namespace Denoise
@@ -0,0 +1,73 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rasteralgebra.h"
+#include "rasterreader.h"
+#include <QString>
+#include <vector>
+#include <cstddef>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Filtri di denoise nativi per DSM: mediana, gaussiano e apertura morfologica.
+// Lavorano a tile con un bordo (halo) del raggio del filtro, così ogni tile si
+// calcola in modo indipendente: l'anteprima filtra solo la griglia o la porzione
+// visibile, il raster intero si scrive in background con RasterAlgebra::runTiles.
+// I valori non validi sono NaN: non entrano nel filtro e restano nodata.
+namespace Denoise {
+
+enum class Filter
+{
+    None,
+    Median,     // mediana (2r+1)^2; SSE2 per il 3x3
+    Gaussian,   // gaussiano separabile normalizzato sui soli pixel validi
+    Opening     // erosione poi dilatazione (quadrato 2r+1): toglie i picchi isolati
+};
+
+const int MaxRadius = 3;
+
+Filter filterFromName(const QString &name);
+QString filterName(Filter filter);
+
+struct Params
+{
+    Filter filter = Filter::None;
+    int radius = 1;             // 1..MaxRadius: finestra (2r+1) x (2r+1)
+};
+
+// Bordo richiesto attorno al tile: r, 2r per l'apertura (due passate)
+int haloSize(const Params &params);
+
+// Non validi -> NaN: NaN, inf, -9999 e il nodata della banda
+void markInvalid(float *data, size_t count, float noData);
+
+// src = angolo del bordo di un tile w x h con halo = haloSize(params), righe di
+// srcStride float; out compatto (w x h). scratch viene riusato tra le chiamate
+void filterTile(const Params &params, const float *src, int srcStride, int w, int h, float *out,
+                std::vector<float> &scratch);
+void filterTileScalar(const Params &params, const float *src, int srcStride, int w, int h, float *out,
+                      std::vector<float> &scratch);
+
+// Copia di data (w x h) con un bordo di `halo` pixel replicati, non validi a NaN
+void padReplicate(const float *data, int w, int h, int halo, float noData, std::vector<float> &padded);
+
+// Buffer w x h con bordo: padded ha righe di w + 2 * haloSize(params) float
+// (padReplicate o readHalo). Tile in parallelo sui thread disponibili
+void filterBuffer(const Params &params, const float *padded, int w, int h, float *out);
+
+// Finestra sorgente (pixel a piena risoluzione) letta in outW x outH più un bordo
+// di `halo` pixel di output per lato: dentro il raster dai pixel vicini, fuori
+// replicando l'ultima riga/colonna. Righe di outW + 2 * halo float, non validi a NaN
+bool readHalo(GDALRasterBand *band, double srcX, double srcY, double srcWidth, double srcHeight,
+              int outW, int outH, int halo, ResampleMode mode, std::vector<float> &data);
+
+// Raster intero filtrato in un GeoTIFF tiled DEFLATE (nodata RasterAlgebra::NoData)
+bool filterRaster(const QString &inputPath, int bandIndex, const Params &params, const QString &outputPath,
+                  QString *error, const RasterAlgebra::ProgressFunction &progress = RasterAlgebra::ProgressFunction());
+
+bool hasSimd();
+
+} // namespace Denoise
+
+#endif // DENOISE_H
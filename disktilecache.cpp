@@ -0,0 +1,446 @@
+#include "disktilecache.h"
+#include "rastertilecache.h"
+#include <QFile>
+#include <QDir>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const quint32 PackMagic = 0x504d544f;      // "OTMP"
+const quint32 PackVersion = 1;
+const qint64 PackHeaderBytes = 8;
+const quint32 RecordMagic = 0x434d544f;    // "OTMC"
+const qint64 MinPackBytes = 4ll * 1024 * 1024;
+const qint64 MaxPackBytes = 64ll * 1024 * 1024;
+const qint64 MinCapacityBytes = 64ll * 1024 * 1024;
+
+// Header di un record, seguito da payloadBytes di float grezzi
+struct RecordHeader
+{
+    quint32 magic;
+    quint32 payloadBytes;
+    char key[16];
+    qint32 width;
+    qint32 height;
+    quint32 checksum;
+    quint32 reserved;
+};
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader must not be padded");
+const qint64 HeaderBytes = sizeof(RecordHeader);
+
+// FNV-1a: verificato alla lettura, non all'apertura (l'indice legge solo gli header)
+quint32 checksum(const uchar *data, quint32 bytes)
+{
+    quint32 hash = 2166136261u;
+    for (quint32 i = 0; i < bytes; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+DiskTileCache &DiskTileCache::instance()
+{
+    static DiskTileCache cache;
+    return cache;
+}
+
+DiskTileCache::DiskTileCache()
+    : m_usedBytes(0)
+    , m_capacityBytes(2048ll * 1024 * 1024)
+    , m_clock(0)
+{
+}
+
+DiskTileCache::~DiskTileCache()
+{
+    QMutexLocker locker(&m_mutex);
+    closeLocked();
+}
+
+QString DiskTileCache::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tiles";
+}
+
+void DiskTileCache::setDirectory(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    if (path == m_directory) {
+        return;
+    }
+    closeLocked();
+    if (path.isEmpty()) {
+        qDebug() << "Disk tile cache disabled";
+        return;
+    }
+    if (!QDir().mkpath(path)) {
+        qWarning() << "Disk tile cache: cannot create" << path;
+        return;
+    }
+    m_lock.reset(new QLockFile(path + "/cache.lock"));
+    if (!m_lock->tryLock(0)) {
+        qWarning() << "Disk tile cache:" << path << "is in use by another instance, running without it";
+        m_lock.reset();
+        return;
+    }
+    m_directory = path;
+    scanLocked();
+    if (m_usedBytes > m_capacityBytes) {
+        compactLocked();
+    }
+    qDebug() << "Disk tile cache:" << path << "-" << m_index.size() << "tiles in" << m_packs.size() << "packs,"
+             << m_usedBytes / (1024 * 1024) << "MB";
+}
+
+QString DiskTileCache::directory() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directory;
+}
+
+void DiskTileCache::setCapacityBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_capacityBytes = std::max(MinCapacityBytes, bytes);
+    if (m_usedBytes > m_capacityBytes) {
+        compactLocked();
+    }
+}
+
+qint64 DiskTileCache::capacityBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_capacityBytes;
+}
+
+qint64 DiskTileCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+bool DiskTileCache::load(const QString &key, RasterTile &tile)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_directory.isEmpty()) {
+        return false;
+    }
+    const QByteArray digestKey = digest(key);
+    auto it = m_index.find(digestKey);
+    if (it == m_index.end()) {
+        return false;
+    }
+    auto pack = m_packs.find(it->pack);
+    if (pack == m_packs.end()
+        || !ensureMappedLocked(pack->second, it->offset + HeaderBytes + it->payloadBytes)) {
+        m_index.erase(it);
+        return false;
+    }
+
+    RecordHeader header;
+    std::memcpy(&header, pack->second.map + it->offset, HeaderBytes);
+    const uchar *payload = pack->second.map + it->offset + HeaderBytes;
+    if (std::memcmp(header.key, digestKey.constData(), sizeof(header.key)) != 0
+        || header.width <= 0 || header.height <= 0
+        || (qint64)header.width * header.height * (qint64)sizeof(float) != header.payloadBytes
+        || checksum(payload, header.payloadBytes) != header.checksum) {
+        qWarning() << "Disk tile cache: corrupted record in" << pack->second.path << "at" << it->offset;
+        m_index.erase(it);
+        return false;
+    }
+
+    tile.width = header.width;
+    tile.height = header.height;
+    tile.data.resize((size_t)header.width * header.height);
+    std::memcpy(tile.data.data(), payload, header.payloadBytes);
+    it->lastUse = ++m_clock;
+    return true;
+}
+
+void DiskTileCache::store(const QString &key, const RasterTile &tile)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_directory.isEmpty() || tile.data.empty()) {
+        return;
+    }
+    const QByteArray digestKey = digest(key);
+    if (m_index.contains(digestKey)) {
+        return;
+    }
+
+    RecordHeader header;
+    header.magic = RecordMagic;
+    header.payloadBytes = static_cast<quint32>(tile.data.size() * sizeof(float));
+    std::memcpy(header.key, digestKey.constData(), sizeof(header.key));
+    header.width = tile.width;
+    header.height = tile.height;
+    const uchar *payload = reinterpret_cast<const uchar*>(tile.data.data());
+    header.checksum = checksum(payload, header.payloadBytes);
+    header.reserved = 0;
+
+    Location location;
+    if (!appendLocked(reinterpret_cast<const uchar*>(&header), payload, header.payloadBytes, &location)) {
+        return;
+    }
+    location.lastUse = ++m_clock;
+    m_index.insert(digestKey, location);
+    if (m_usedBytes > m_capacityBytes) {
+        compactLocked();
+    }
+}
+
+void DiskTileCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_packs.empty()) {
+        removePackLocked(m_packs.begin()->first);
+    }
+    m_index.clear();
+    m_usedBytes = 0;
+}
+
+QByteArray DiskTileCache::digest(const QString &key)
+{
+    // La chiave contiene percorso e mtime del raster, banda, griglia, modalità e tile
+    return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).left(16);
+}
+
+void DiskTileCache::closeLocked()
+{
+    for (auto &entry : m_packs) {
+        Pack &pack = entry.second;
+        if (pack.map) {
+            pack.file->unmap(pack.map);
+        }
+        pack.file->close();
+    }
+    m_packs.clear();
+    m_index.clear();
+    m_usedBytes = 0;
+    m_lock.reset();
+    m_directory.clear();
+}
+
+void DiskTileCache::scanLocked()
+{
+    const QStringList files = QDir(m_directory).entryList(QStringList() << "pack-*.omt", QDir::Files, QDir::Name);
+    for (const QString &name : files) {
+        bool ok = false;
+        int id = name.mid(5, name.length() - 9).toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+        if (!openPackLocked(id, false)) {
+            qWarning() << "Disk tile cache: discarding unreadable pack" << name;
+            QFile::remove(m_directory + "/" + name);
+            continue;
+        }
+        Pack &pack = m_packs[id];
+        qint64 offset = PackHeaderBytes;
+        if (ensureMappedLocked(pack, pack.size)) {
+            while (offset + HeaderBytes <= pack.size) {
+                RecordHeader header;
+                std::memcpy(&header, pack.map + offset, HeaderBytes);
+                if (header.magic != RecordMagic || offset + HeaderBytes + header.payloadBytes > pack.size) {
+                    break;
+                }
+                // Lo stesso tile più avanti (ricopiato dalla compattazione) sostituisce il precedente
+                m_index.insert(QByteArray(header.key, sizeof(header.key)), Location{id, offset, header.payloadBytes, 0});
+                offset += HeaderBytes + header.payloadBytes;
+            }
+        }
+        if (offset < pack.size) {
+            // Scrittura interrotta (crash): si taglia il record incompleto
+            qWarning() << "Disk tile cache: truncating" << name << "from" << pack.size << "to" << offset << "bytes";
+            if (pack.map) {
+                pack.file->unmap(pack.map);
+                pack.map = nullptr;
+                pack.mappedSize = 0;
+            }
+            pack.file->resize(offset);
+            pack.size = offset;
+        }
+        m_usedBytes += pack.size;
+    }
+}
+
+bool DiskTileCache::openPackLocked(int id, bool create)
+{
+    Pack pack;
+    pack.path = m_directory + QString("/pack-%1.omt").arg(id, 6, 10, QChar('0'));
+    pack.file.reset(new QFile(pack.path));
+    if (!pack.file->open(QIODevice::ReadWrite)) {
+        qWarning() << "Disk tile cache: cannot open" << pack.path << pack.file->errorString();
+        return false;
+    }
+    quint32 fileHeader[2] = {PackMagic, PackVersion};
+    if (create) {
+        pack.file->resize(0);
+        if (pack.file->write(reinterpret_cast<const char*>(fileHeader), PackHeaderBytes) != PackHeaderBytes
+            || !pack.file->flush()) {
+            qWarning() << "Disk tile cache: cannot write" << pack.path << pack.file->errorString();
+            return false;
+        }
+    } else {
+        quint32 existing[2] = {0, 0};
+        if (pack.file->read(reinterpret_cast<char*>(existing), PackHeaderBytes) != PackHeaderBytes
+            || existing[0] != PackMagic || existing[1] != PackVersion) {
+            pack.file->close();
+            return false;
+        }
+    }
+    pack.size = pack.file->size();
+    m_packs[id] = std::move(pack);
+    return true;
+}
+
+bool DiskTileCache::ensureMappedLocked(Pack &pack, qint64 end)
+{
+    if (pack.map && pack.mappedSize >= end) {
+        return true;
+    }
+    // Il pack attivo cresce: si rimappa per intero alla dimensione corrente
+    if (pack.map) {
+        pack.file->unmap(pack.map);
+        pack.map = nullptr;
+        pack.mappedSize = 0;
+    }
+    if (pack.size < end || pack.size <= 0) {
+        return false;
+    }
+    pack.map = pack.file->map(0, pack.size);
+    if (pack.map == nullptr) {
+        qWarning() << "Disk tile cache: cannot map" << pack.path << pack.file->errorString();
+        return false;
+    }
+    pack.mappedSize = pack.size;
+    return true;
+}
+
+int DiskTileCache::activePackLocked(qint64 recordBytes)
+{
+    const qint64 packLimit = std::max(MinPackBytes, std::min(MaxPackBytes, m_capacityBytes / 8));
+    if (!m_packs.empty()) {
+        const Pack &last = m_packs.rbegin()->second;
+        if (last.size + recordBytes <= packLimit || last.size <= PackHeaderBytes) {
+            return m_packs.rbegin()->first;
+        }
+    }
+    int id = m_packs.empty() ? 1 : m_packs.rbegin()->first + 1;
+    if (!openPackLocked(id, true)) {
+        return -1;
+    }
+    m_usedBytes += PackHeaderBytes;
+    return id;
+}
+
+bool DiskTileCache::appendLocked(const uchar *header, const uchar *payload, quint32 payloadBytes, Location *location)
+{
+    int id = activePackLocked(HeaderBytes + payloadBytes);
+    if (id < 0) {
+        return false;
+    }
+    Pack &pack = m_packs[id];
+    const qint64 offset = pack.size;
+    if (!pack.file->seek(offset)
+        || pack.file->write(reinterpret_cast<const char*>(header), HeaderBytes) != HeaderBytes
+        || pack.file->write(reinterpret_cast<const char*>(payload), payloadBytes) != payloadBytes
+        || !pack.file->flush()) {
+        qWarning() << "Disk tile cache: write failed on" << pack.path << pack.file->errorString();
+        if (pack.map) {
+            pack.file->unmap(pack.map);
+            pack.map = nullptr;
+            pack.mappedSize = 0;
+        }
+        pack.file->resize(offset);
+        return false;
+    }
+    pack.size = offset + HeaderBytes + payloadBytes;
+    m_usedBytes += HeaderBytes + payloadBytes;
+    location->pack = id;
+    location->offset = offset;
+    location->payloadBytes = payloadBytes;
+    return true;
+}
+
+void DiskTileCache::compactLocked()
+{
+    while (m_usedBytes > m_capacityBytes && !m_packs.empty()) {
+        const int oldestId = m_packs.begin()->first;
+        if (m_packs.size() == 1) {
+            // Il più vecchio è anche quello attivo: se ne apre uno nuovo per le ricopie
+            if (!openPackLocked(oldestId + 1, true)) {
+                break;
+            }
+            m_usedBytes += PackHeaderBytes;
+        }
+        Pack &oldest = m_packs.begin()->second;
+
+        // Tile del pack usati in questa sessione, dal più recente: si ricopiano
+        // in coda finché l'uso resta sotto 3/4 della capacità
+        std::vector<std::pair<quint64, QByteArray>> hot;
+        for (auto it = m_index.cbegin(); it != m_index.cend(); ++it) {
+            if (it->pack == oldestId && it->lastUse > 0) {
+                hot.emplace_back(it->lastUse, it.key());
+            }
+        }
+        std::sort(hot.begin(), hot.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        qint64 remaining = m_usedBytes - oldest.size;
+        int rescued = 0;
+        if (!hot.empty() && ensureMappedLocked(oldest, oldest.size)) {
+            for (const auto &entry : hot) {
+                Location &location = m_index[entry.second];
+                const qint64 recordBytes = HeaderBytes + location.payloadBytes;
+                if (remaining + recordBytes > m_capacityBytes / 4 * 3) {
+                    break;
+                }
+                const uchar *record = oldest.map + location.offset;
+                Location moved;
+                if (!appendLocked(record, record + HeaderBytes, location.payloadBytes, &moved)) {
+                    break;
+                }
+                moved.lastUse = location.lastUse;
+                location = moved;
+                remaining += recordBytes;
+                ++rescued;
+            }
+        }
+        qDebug() << "Disk tile cache: evicting" << oldest.path << "-" << rescued << "recently used tiles kept";
+        removePackLocked(oldestId);
+    }
+}
+
+void DiskTileCache::removePackLocked(int id)
+{
+    auto pack = m_packs.find(id);
+    if (pack == m_packs.end()) {
+        return;
+    }
+    for (auto it = m_index.begin(); it != m_index.end();) {
+        if (it->pack == id) {
+            it = m_index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Su Windows un file mappato o aperto non si cancella
+    if (pack->second.map) {
+        pack->second.file->unmap(pack->second.map);
+    }
+    pack->second.file->close();
+    QFile::remove(pack->second.path);
+    m_usedBytes -= pack->second.size;
+    m_packs.erase(pack);
+}
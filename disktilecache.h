@@ -0,0 +1,85 @@
+#ifndef DISKTILECACHE_H
+#define DISKTILECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <map>
+#include <memory>
+
+class QFile;
+class QLockFile;
+struct RasterTile;
+
+// Cache persistente dei tile decodificati (livello sotto RasterTileCache): i
+// tile float di una griglia sopravvivono alla sessione, così riaprire il campo
+// del giorno prima non ripassa da GDAL. I record (header con chiave e checksum
+// + payload grezzo) si accodano a file "pack" append-only letti tramite mmap;
+// l'indice si ricostruisce all'apertura leggendo solo gli header.
+// Capacità: superato il limite si elimina il pack più vecchio, dopo aver
+// ricopiato in coda i suoi tile usati in questa sessione (LRU a generazioni).
+// La ricopia precede la cancellazione, quindi un crash lascia al più dei
+// duplicati (vince l'ultimo); un record troncato in coda viene tagliato.
+class DiskTileCache
+{
+public:
+    static DiskTileCache &instance();
+
+    // Percorso vuoto = disattivata. Un'altra istanza con la stessa cartella la
+    // trova bloccata (QLockFile) e lavora senza cache su disco.
+    void setDirectory(const QString &path);
+    QString directory() const;
+    static QString defaultDirectory();
+
+    void setCapacityBytes(qint64 bytes);
+    qint64 capacityBytes() const;
+    qint64 usedBytes() const;
+
+    // key: chiave del tile in RasterTileCache (griglia con percorso e mtime + indice)
+    bool load(const QString &key, RasterTile &tile);
+    void store(const QString &key, const RasterTile &tile);
+    void clear();
+
+private:
+    DiskTileCache();
+    ~DiskTileCache();
+
+    struct Pack
+    {
+        QString path;
+        std::unique_ptr<QFile> file;
+        uchar *map = nullptr;
+        qint64 mappedSize = 0;
+        qint64 size = 0;
+    };
+
+    struct Location
+    {
+        int pack = 0;
+        qint64 offset = 0;
+        quint32 payloadBytes = 0;
+        quint64 lastUse = 0;    // 0 = non usato in questa sessione
+    };
+
+    static QByteArray digest(const QString &key);
+    void closeLocked();
+    void scanLocked();
+    bool openPackLocked(int id, bool create);
+    bool ensureMappedLocked(Pack &pack, qint64 end);
+    int activePackLocked(qint64 recordBytes);
+    bool appendLocked(const uchar *header, const uchar *payload, quint32 payloadBytes, Location *location);
+    void compactLocked();
+    void removePackLocked(int id);
+
+    mutable QMutex m_mutex;
+    QString m_directory;
+    std::unique_ptr<QLockFile> m_lock;
+    std::map<int, Pack> m_packs;            // per id crescente: dal più vecchio
+    QHash<QByteArray, Location> m_index;
+    qint64 m_usedBytes;
+    qint64 m_capacityBytes;
+    quint64 m_clock;
+};
+
+#endif // DISKTILECACHE_H
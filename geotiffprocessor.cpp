@@ -1,4 +1,19 @@
 #include "geotiffprocessor.h"
+#include "warpgridcache.h"
+#include "rasterreader.h"
+#include "rastertilecache.h"
+#include "disktilecache.h"
+#include "summarypyramid.h"
+#include "summedareatable.h"
+#include "rasteralgebra.h"
+#include "terrain.h"
+#include "denoise.h"
+#include "rasterexport.h"
+#include "memorygovernor.h"
+#include "prefetchscheduler.h"
+#include "datasetcatalog.h"
+#include "quantize.h"
+#include "compositor.h"
 #include <QDebug>
 #include <QFileInfo>
 #include <QDir>
@@ -6,12 +21,135 @@
 #include <QCoreApplication>
 #include <QLibrary>
 #include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QtMath>
 #include <string>
 #include <cstring>
 #include <cmath>
+#include <limits>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
 #include <gdal_priv.h>
 #include <gdalwarper.h>
+#include <ogr_spatialref.h>
+
+namespace {
+
+// Compone la QImage di output a partire dalle bande già allineate (GDT_Byte):
+// 3+ bande = RGB, 1 banda = maschera con nero trasparente
+QImage imageFromByteBands(const std::vector<std::vector<uint8_t>> &bands, int width, int height)
+{
+    QImage img;
+    if (bands.size() >= 3) {
+        img = QImage(width, height, QImage::Format_RGB32);
+        for (int y = 0; y < height; ++y) {
+            const size_t row = (size_t)y * width;
+            Compositor::packRgb(bands[0].data() + row, bands[1].data() + row, bands[2].data() + row, width,
+                                (QRgb*)img.scanLine(y));
+        }
+    } else if (bands.size() == 1) {
+        // Trasparente dove 0, grigio opaco altrove (kernel del compositore)
+        img = QImage(width, height, QImage::Format_ARGB32);
+        img.fill(Qt::transparent);
+        for (int y = 0; y < height; ++y) {
+            Compositor::maskGray(bands[0].data() + (size_t)y * width, width, (QRgb*)img.scanLine(y));
+        }
+    } else {
+        qWarning() << "  Unsupported band count:" << bands.size();
+    }
+    return img;
+}
+
+// Vero se src e ref hanno stesso CRS, nessuna rotazione, stessa risoluzione e
+// origini che differiscono di un numero intero di pixel. srcOffsetX/Y è la
+// colonna/riga della sorgente che corrisponde al pixel (0, 0) del riferimento.
+bool gridsCoincide(GDALDataset *srcDS, GDALDataset *refDS, int &srcOffsetX, int &srcOffsetY)
+{
+    double srcGT[6];
+    double refGT[6];
+    if (srcDS->GetGeoTransform(srcGT) != CE_None || refDS->GetGeoTransform(refGT) != CE_None) {
+        return false;
+    }
+
+    const OGRSpatialReference *srcSRS = srcDS->GetSpatialRef();
+    const OGRSpatialReference *refSRS = refDS->GetSpatialRef();
+    if (!srcSRS || !refSRS || !srcSRS->IsSame(refSRS)) {
+        return false;
+    }
+
+    if (srcGT[2] != 0.0 || srcGT[4] != 0.0 || refGT[2] != 0.0 || refGT[4] != 0.0) {
+        return false;
+    }
+
+    // Errore di scala accumulato sull'intera larghezza < 1/100 di pixel
+    int refWidth = refDS->GetRasterXSize();
+    int refHeight = refDS->GetRasterYSize();
+    if (std::fabs(srcGT[1] - refGT[1]) * refWidth > 0.01 * std::fabs(refGT[1]) ||
+        std::fabs(srcGT[5] - refGT[5]) * refHeight > 0.01 * std::fabs(refGT[5])) {
+        return false;
+    }
+
+    double offsetX = (refGT[0] - srcGT[0]) / srcGT[1];
+    double offsetY = (refGT[3] - srcGT[3]) / srcGT[5];
+    if (std::fabs(offsetX - std::round(offsetX)) > 0.01 || std::fabs(offsetY - std::round(offsetY)) > 0.01) {
+        return false;
+    }
+
+    srcOffsetX = static_cast<int>(std::lround(offsetX));
+    srcOffsetY = static_cast<int>(std::lround(offsetY));
+    return true;
+}
+
+// Fast path per griglie coincidenti: lettura a finestra e decimata della sorgente
+// direttamente nel buffer di output, senza transformer né dataset MEM
+QImage readAlignedWindow(GDALDataset *srcDS, int srcOffsetX, int srcOffsetY,
+                         int refWidth, int refHeight, int outWidth, int outHeight, ResampleMode mode)
+{
+    int srcBands = srcDS->GetRasterCount();
+    int bandCount = srcBands >= 3 ? 3 : srcBands;
+
+    // Intersezione tra griglia di riferimento e sorgente, in pixel di riferimento
+    int x0 = std::max(0, -srcOffsetX);
+    int y0 = std::max(0, -srcOffsetY);
+    int x1 = std::min(refWidth, srcDS->GetRasterXSize() - srcOffsetX);
+    int y1 = std::min(refHeight, srcDS->GetRasterYSize() - srcOffsetY);
+
+    // Fuori dalla sorgente resta 0, come nel warp
+    std::vector<std::vector<uint8_t>> bands(bandCount, std::vector<uint8_t>(outWidth * outHeight, 0));
+
+    if (x1 > x0 && y1 > y0) {
+        double scaleX = (double)outWidth / refWidth;
+        double scaleY = (double)outHeight / refHeight;
+        int outX0 = std::min(outWidth, static_cast<int>(std::lround(x0 * scaleX)));
+        int outY0 = std::min(outHeight, static_cast<int>(std::lround(y0 * scaleY)));
+        int outX1 = std::min(outWidth, static_cast<int>(std::lround(x1 * scaleX)));
+        int outY1 = std::min(outHeight, static_cast<int>(std::lround(y1 * scaleY)));
+
+        if (outX1 > outX0 && outY1 > outY0) {
+            for (int b = 0; b < bandCount; ++b) {
+                uint8_t *dst = bands[b].data() + (size_t)outY0 * outWidth + outX0;
+                CPLErr err = RasterReader::readWindow(
+                    srcDS->GetRasterBand(b + 1), x0 + srcOffsetX, y0 + srcOffsetY, x1 - x0, y1 - y0,
+                    dst, outX1 - outX0, outY1 - outY0, GDT_Byte, mode, 1, outWidth);
+                if (err != CE_None) {
+                    qWarning() << "Windowed read failed:" << CPLGetLastErrorMsg();
+                    return QImage();
+                }
+            }
+        }
+    }
+
+    return imageFromByteBands(bands, outWidth, outHeight);
+}
+
+} // namespace
 
 // Riallinea srcPath su refPath usando GDAL e restituisce QImage allineata
 QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString &refPath)
@@ -61,6 +199,10 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
     qDebug() << "  refSize:" << xSize << "x" << ySize;
     qDebug() << "  srcBands:" << srcBands;
     
+    // Maschere a 1 banda: moda, così la riduzione non inventa classi intermedie
+    ResampleMode resampleMode = srcBands == 1 ? ResampleMode::Mode : RasterReader::defaultMode();
+    qDebug() << "  Resampling:" << RasterReader::modeName(resampleMode);
+    
     // Limita la dimensione per evitare allocazioni enormi
     int maxDim = 4096;
     int outWidth = xSize;
@@ -82,9 +224,9 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
             std::vector<uint8_t> rBuf(outWidth * outHeight);
             std::vector<uint8_t> gBuf(outWidth * outHeight);
             std::vector<uint8_t> bBuf(outWidth * outHeight);
-            srcDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), rBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-            srcDS->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), gBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-            srcDS->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), bBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
+            RasterReader::readBand(srcDS->GetRasterBand(1), rBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+            RasterReader::readBand(srcDS->GetRasterBand(2), gBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+            RasterReader::readBand(srcDS->GetRasterBand(3), bBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
             for (int y = 0; y < outHeight; ++y) {
                 QRgb *scanLine = (QRgb*)img.scanLine(y);
                 for (int x = 0; x < outWidth; ++x) {
@@ -94,7 +236,8 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
             }
         } else if (srcBands == 1) {
             img = QImage(outWidth, outHeight, QImage::Format_Grayscale8);
-            srcDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), img.bits(), outWidth, outHeight, GDT_Byte, 0, 0);
+            RasterReader::readWindow(srcDS->GetRasterBand(1), 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(),
+                                     img.bits(), outWidth, outHeight, GDT_Byte, resampleMode, 1, img.bytesPerLine());
         }
         
         GDALClose(srcDS);
@@ -102,6 +245,18 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
         return img;
     }
     
+    // Griglie coincidenti (stesso CRS e risoluzione, offset intero): niente warp
+    int srcOffsetX = 0;
+    int srcOffsetY = 0;
+    if (gridsCoincide(srcDS, refDS, srcOffsetX, srcOffsetY)) {
+        qDebug() << "  Grids coincide, source offset:" << srcOffsetX << srcOffsetY << "- using windowed read";
+        QImage img = readAlignedWindow(srcDS, srcOffsetX, srcOffsetY, xSize, ySize, outWidth, outHeight, resampleMode);
+        GDALClose(srcDS);
+        GDALClose(refDS);
+        qDebug() << "  Output image created:" << img.size();
+        return img;
+    }
+    
     GDALDriver *memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
     if (!memDriver) {
         qWarning() << "Failed to get MEM driver";
@@ -131,8 +286,12 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
     outDS->SetGeoTransform(outGeoTransform);
     outDS->SetProjection(refProj);
 
-    void *transformArg = GDALCreateGenImgProjTransformer(srcDS, srcProj,
-                                                         outDS, refProj, FALSE, 0, 1);
+    // Transformer approssimato: griglia di coordinate sorgente con errore limitato,
+    // in cache per (CRS/geotransform sorgente, griglia di riferimento) e riusata
+    // da overlay ripetuti e livelli di zoom diversi
+    std::shared_ptr<const WarpGrid> warpGrid = WarpGridCache::instance().gridFor(srcDS, refDS);
+    void *transformArg = warpGrid ? createCachedGridTransformer(warpGrid, srcDS, refDS, outWidth, outHeight)
+                                  : nullptr;
     if (!transformArg) {
         qWarning() << "Failed to create projection transformer, loading source directly";
         GDALClose(outDS);
@@ -144,9 +303,9 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
             std::vector<uint8_t> rBuf(outWidth * outHeight);
             std::vector<uint8_t> gBuf(outWidth * outHeight);
             std::vector<uint8_t> bBuf(outWidth * outHeight);
-            srcDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), rBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-            srcDS->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), gBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-            srcDS->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), bBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
+            RasterReader::readBand(srcDS->GetRasterBand(1), rBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+            RasterReader::readBand(srcDS->GetRasterBand(2), gBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+            RasterReader::readBand(srcDS->GetRasterBand(3), bBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
             for (int y = 0; y < outHeight; ++y) {
                 QRgb *scanLine = (QRgb*)img.scanLine(y);
                 for (int x = 0; x < outWidth; ++x) {
@@ -156,7 +315,8 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
             }
         } else if (srcBands == 1) {
             img = QImage(outWidth, outHeight, QImage::Format_Grayscale8);
-            srcDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(), img.bits(), outWidth, outHeight, GDT_Byte, 0, 0);
+            RasterReader::readWindow(srcDS->GetRasterBand(1), 0, 0, srcDS->GetRasterXSize(), srcDS->GetRasterYSize(),
+                                     img.bits(), outWidth, outHeight, GDT_Byte, resampleMode, 1, img.bytesPerLine());
         }
         
         GDALClose(srcDS);
@@ -168,7 +328,9 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
     warpOptions->hSrcDS = srcDS;
     warpOptions->hDstDS = outDS;
     warpOptions->pTransformerArg = transformArg;
-    warpOptions->pfnTransformer = GDALGenImgProjTransform;
+    warpOptions->pfnTransformer = cachedGridTransform;
+    warpOptions->eResampleAlg = RasterReader::warpAlgorithm(resampleMode);
+    warpOptions->dfWarpMemoryLimit = MemoryGovernor::warpMemoryLimitBytes();
     warpOptions->nBandCount = srcBands;
     warpOptions->panSrcBands = (int *)CPLMalloc(sizeof(int) * warpOptions->nBandCount);
     warpOptions->panDstBands = (int *)CPLMalloc(sizeof(int) * warpOptions->nBandCount);
@@ -185,7 +347,7 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
         CPLErr warpErr = warpOp.Initialize(warpOptions);
         if (warpErr != CE_None) {
             qWarning() << "Failed to initialize warp operation";
-            GDALDestroyGenImgProjTransformer(transformArg);
+            destroyCachedGridTransformer(transformArg);
             GDALClose(srcDS);
             GDALClose(refDS);
             GDALClose(outDS);
@@ -204,47 +366,13 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
     qDebug() << "  Output bands:" << outDS->GetRasterCount();
 
     // Per immagini binarie/maschera a 1 banda, crea ARGB con nero=trasparente
-    QImage img;
     int bands = outDS->GetRasterCount();
-    
-    if (bands >= 3) {
-        qDebug() << "  Reading as RGB...";
-        img = QImage(outWidth, outHeight, QImage::Format_RGB32);
-        std::vector<uint8_t> rBuf(outWidth * outHeight);
-        std::vector<uint8_t> gBuf(outWidth * outHeight);
-        std::vector<uint8_t> bBuf(outWidth * outHeight);
-        outDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, outWidth, outHeight, rBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        outDS->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, outWidth, outHeight, gBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        outDS->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, outWidth, outHeight, bBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        for (int y = 0; y < outHeight; ++y) {
-            QRgb *scanLine = (QRgb*)img.scanLine(y);
-            for (int x = 0; x < outWidth; ++x) {
-                int idx = y * outWidth + x;
-                scanLine[x] = qRgb(rBuf[idx], gBuf[idx], bBuf[idx]);
-            }
-        }
-    } else if (bands == 1) {
-        // Immagine maschera: nero = trasparente, altri valori = colore basato sul valore
-        qDebug() << "  Reading as mask with transparency...";
-        img = QImage(outWidth, outHeight, QImage::Format_ARGB32);
-        std::vector<uint8_t> buf(outWidth * outHeight);
-        outDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, outWidth, outHeight, buf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        for (int y = 0; y < outHeight; ++y) {
-            QRgb *scanLine = (QRgb*)img.scanLine(y);
-            for (int x = 0; x < outWidth; ++x) {
-                int idx = y * outWidth + x;
-                uint8_t val = buf[idx];
-                if (val == 0) {
-                    scanLine[x] = qRgba(0, 0, 0, 0); // trasparente
-                } else {
-                    scanLine[x] = qRgba(val, val, val, 255); // opaco grigio
-                }
-            }
-        }
-    } else {
-        qWarning() << "  Unsupported band count:" << bands;
-        img = QImage();
+    int readBands = bands >= 3 ? 3 : bands;
+    std::vector<std::vector<uint8_t>> bandBuffers(readBands, std::vector<uint8_t>(outWidth * outHeight));
+    for (int b = 0; b < readBands; ++b) {
+        outDS->GetRasterBand(b + 1)->RasterIO(GF_Read, 0, 0, outWidth, outHeight, bandBuffers[b].data(), outWidth, outHeight, GDT_Byte, 0, 0);
     }
+    QImage img = imageFromByteBands(bandBuffers, outWidth, outHeight);
     
     qDebug() << "  Output image created:" << img.size();
     
@@ -262,7 +390,7 @@ QImage GeoTiffProcessor::warpImageToMatch(const QString &srcPath, const QString
     GDALDestroyWarpOptions(warpOptions);
     
     // Ora possiamo distruggere il transformer in sicurezza
-    GDALDestroyGenImgProjTransformer(transformArg);
+    destroyCachedGridTransformer(transformArg);
     
     qDebug() << "Closing datasets...";
     GDALClose(outDS);
@@ -279,13 +407,32 @@ GeoTiffProcessor::GeoTiffProcessor(QObject *parent)
     , m_hasImage2(false)
     , m_denoiseFlag(false)
     , m_areaThreshold(70)
+    , m_sweepCancelled(0)
+    , m_sweepRunning(false)
+    , m_derivationCancelled(0)
+    , m_derivationRunning(false)
+    , m_statistics(new StatisticsService(this))
 {
+    // Una derivazione per volta: i tile al suo interno sono già paralleli
+    m_derivationPool.setMaxThreadCount(1);
+
     // Initialize GDAL
     GDALAllRegister();
+
+    connect(m_statistics, &StatisticsService::statisticsReady, this,
+            [this](int handle, const QString &imagePath, const RasterStatistics &statistics) {
+                emit statisticsReady(handle, imagePath, statistics.valid, statistics.min, statistics.max,
+                                     statistics.mean, statistics.stdDev);
+            });
 }
 
 GeoTiffProcessor::~GeoTiffProcessor()
 {
+    // Le varianti in coda non partono più, quelle in corso vanno attese
+    m_sweepCancelled.storeRelease(1);
+    m_sweepPool.waitForDone();
+    m_derivationCancelled.storeRelease(1);
+    m_derivationPool.waitForDone();
 }
 
 bool GeoTiffProcessor::hasValidImages() const
@@ -298,6 +445,21 @@ bool GeoTiffProcessor::hasShapefileSelected() const
     return !m_shapefileZipPath.isEmpty();
 }
 
+QString GeoTiffProcessor::shapefileZip() const
+{
+    return m_shapefileZipPath;
+}
+
+bool GeoTiffProcessor::sweepRunning() const
+{
+    return m_sweepRunning;
+}
+
+bool GeoTiffProcessor::derivationRunning() const
+{
+    return m_derivationRunning;
+}
+
 void GeoTiffProcessor::setImage1(const QString &path)
 {
     m_image1Path = path;
@@ -339,34 +501,117 @@ void GeoTiffProcessor::setAreaThreshold(int threshold)
     qDebug() << "Area threshold set to:" << threshold;
 }
 
-bool GeoTiffProcessor::loadGeoTiff(const QString &path)
+QString GeoTiffProcessor::resamplingMode() const
 {
-    QFileInfo fileInfo(path);
-    if (!fileInfo.exists()) {
-        qWarning() << "File does not exist:" << path;
-        return false;
+    return RasterReader::modeName(RasterReader::defaultMode());
+}
+
+void GeoTiffProcessor::setResamplingMode(const QString &mode)
+{
+    ResampleMode current = RasterReader::defaultMode();
+    ResampleMode requested = RasterReader::modeFromName(mode, current);
+    if (requested == current) {
+        return;
     }
+    RasterReader::setDefaultMode(requested);
+    emit resamplingModeChanged();
+}
 
-    // Open with GDAL
-    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
-    if (dataset == nullptr) {
-        qWarning() << "Failed to open GeoTIFF:" << path;
-        return false;
+QString GeoTiffProcessor::rasterCacheFormat() const
+{
+    return Quantize::formatName(RasterTileCache::instance().format());
+}
+
+void GeoTiffProcessor::setRasterCacheFormat(const QString &format)
+{
+    Quantize::Format requested = Quantize::formatFromName(format);
+    if (requested == RasterTileCache::instance().format()) {
+        return;
     }
+    RasterTileCache::instance().setFormat(requested);
+    emit rasterCacheFormatChanged();
+}
 
-    // Validate it's a proper GeoTIFF
-    int rasterCount = dataset->GetRasterCount();
-    if (rasterCount == 0) {
-        qWarning() << "No raster bands found in:" << path;
-        GDALClose(dataset);
+QString GeoTiffProcessor::tileCacheDirectory() const
+{
+    return DiskTileCache::instance().directory();
+}
+
+void GeoTiffProcessor::setTileCacheDirectory(const QString &path)
+{
+    QString cleanPath = path.startsWith("file:///") ? QUrl(path).toLocalFile() : path;
+    DiskTileCache::instance().setDirectory(cleanPath);
+    emit tileCacheChanged();
+}
+
+int GeoTiffProcessor::tileCacheLimitMB() const
+{
+    return static_cast<int>(DiskTileCache::instance().capacityBytes() / (1024 * 1024));
+}
+
+void GeoTiffProcessor::setTileCacheLimitMB(int megabytes)
+{
+    DiskTileCache::instance().setCapacityBytes(static_cast<qint64>(megabytes) * 1024 * 1024);
+    emit tileCacheChanged();
+}
+
+int GeoTiffProcessor::tileCacheUsedMB() const
+{
+    return static_cast<int>(DiskTileCache::instance().usedBytes() / (1024 * 1024));
+}
+
+QString GeoTiffProcessor::defaultTileCacheDirectory() const
+{
+    return DiskTileCache::defaultDirectory();
+}
+
+void GeoTiffProcessor::clearTileCache()
+{
+    DiskTileCache::instance().clear();
+    emit tileCacheChanged();
+}
+
+QVariantMap GeoTiffProcessor::rasterCacheStats() const
+{
+    RasterTileCache::Stats stats = RasterTileCache::instance().stats();
+    QVariantMap result;
+    result["hotMB"] = stats.hotBytes / (1024.0 * 1024.0);
+    result["coldMB"] = stats.coldBytes / (1024.0 * 1024.0);
+    result["hotTiles"] = stats.hotTiles;
+    result["coldTiles"] = stats.coldTiles;
+    result["ratio"] = stats.coldBytes > 0 ? (double)stats.coldRawBytes / stats.coldBytes : 0.0;
+    result["codec"] = stats.codec;
+    result["format"] = stats.format;
+    result["decompressions"] = stats.decompressions;
+    result["decompressMeanUs"] = stats.decompressMeanUs;
+    result["decompressMaxUs"] = stats.decompressMaxUs;
+    return result;
+}
+
+void GeoTiffProcessor::refreshTileCache()
+{
+    emit tileCacheChanged();
+}
+
+void GeoTiffProcessor::setWarpErrorThreshold(double pixels)
+{
+    WarpGridCache::instance().setMaxError(pixels);
+}
+
+bool GeoTiffProcessor::loadGeoTiff(const QString &path)
+{
+    // Solo header, dal catalogo: lo ritrovano i pannelli (RasterMetadata) e le
+    // statistiche ROI. Il provider e gli istogrammi aprono comunque il dataset
+    // per leggere i pixel, e dimensioni, geotransform e nodata li prendono da lì
+    std::shared_ptr<const DatasetInfo> info = DatasetCatalog::instance().probe(path);
+    if (!info->valid) {
+        qWarning() << "Failed to load GeoTIFF:" << path << info->error;
         return false;
     }
 
     qDebug() << "Successfully loaded GeoTIFF:" << path;
-    qDebug() << "Dimensions:" << dataset->GetRasterXSize() << "x" << dataset->GetRasterYSize();
-    qDebug() << "Bands:" << rasterCount;
-
-    GDALClose(dataset);
+    qDebug() << "Dimensions:" << info->width << "x" << info->height;
+    qDebug() << "Bands:" << info->bandCount;
     return true;
 }
 
@@ -381,7 +626,8 @@ void GeoTiffProcessor::runAnalysis()
     double fCov = 0.0;
     double meanNdvi = 0.0;
 
-    if (callRunAnalysis(m_image1Path, m_image2Path, m_shapefileZipPath, outputPath, fCov, meanNdvi)) {
+    if (callRunAnalysis(m_image1Path, m_image2Path, m_shapefileZipPath, m_denoiseFlag, m_areaThreshold,
+                        outputPath, fCov, meanNdvi)) {
         emit analysisCompleted(outputPath, fCov, meanNdvi);
     } else {
         emit errorOccurred("Analysis failed. Check that OliveMatrixBridge.dll and OliveMatrixLibCore.dll are available and .NET 6 runtime is installed.");
@@ -389,8 +635,8 @@ void GeoTiffProcessor::runAnalysis()
 }
 
 bool GeoTiffProcessor::callRunAnalysis(const QString &dsmPath, const QString &ndviPath,
-                                        const QString &shapefileZip, QString &outputPath, 
-                                        double &fCov, double &meanNdvi)
+                                        const QString &shapefileZip, bool denoise, int areaThreshold,
+                                        QString &outputPath, double &fCov, double &meanNdvi)
 {
     qDebug() << "=== Loading OliveMatrixBridge (C++/CLI) ===";
     
@@ -421,6 +667,12 @@ bool GeoTiffProcessor::callRunAnalysis(const QString &dsmPath, const QString &nd
     
     qDebug() << "OliveMatrixLibCore.dll found in app directory";
     
+    // Una chiamata al backend alla volta (anche tra analisi singola e varianti
+    // dello sweep): la rientranza del backend .NET e il load/unload concorrente
+    // del bridge non sono garantiti. In parallelo restano copia ed esito
+    static QMutex backendMutex;
+    QMutexLocker backendLocker(&backendMutex);
+
     // Load bridge DLL
     QLibrary bridge(bridgeDll);
     
@@ -476,8 +728,8 @@ bool GeoTiffProcessor::callRunAnalysis(const QString &dsmPath, const QString &nd
     qDebug() << "  DSM:" << winDsmPath;
     qDebug() << "  NDVI:" << winNdviPath;
     qDebug() << "  Shapefile:" << (winShapefilePath.isEmpty() ? "(none)" : winShapefilePath);
-    qDebug() << "  Denoise:" << m_denoiseFlag;
-    qDebug() << "  AreaThreshold:" << m_areaThreshold;
+    qDebug() << "  Denoise:" << denoise;
+    qDebug() << "  AreaThreshold:" << areaThreshold;
     
     // OliveMatrixLibCore creates clippedDir automatically
     
@@ -488,8 +740,8 @@ bool GeoTiffProcessor::callRunAnalysis(const QString &dsmPath, const QString &nd
         shapeWide,
         &fCov,
         &meanNdvi,
-        m_denoiseFlag,
-        m_areaThreshold
+        denoise,
+        areaThreshold
     );
     
     bridge.unload();
@@ -558,6 +810,520 @@ bool GeoTiffProcessor::callRunAnalysis(const QString &dsmPath, const QString &nd
     }
 }
 
+// ============================================================================
+// Parameter sweep
+// ============================================================================
+
+namespace {
+
+const int kSweepThumbnailSize = 256;
+
+// Input condivisi da tutte le varianti: decodificati una sola volta per sweep
+struct SweepInputs
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> ndvi;     // NDVI ridotto alla dimensione dei thumbnail
+    QImage ndviPreview;          // NDVI colorato, sfondo dei thumbnail
+};
+
+struct SweepVariant
+{
+    int index = 0;
+    bool denoise = false;
+    int areaThreshold = 0;
+};
+
+struct SweepState
+{
+    QMutex mutex;
+    QVariantList results;
+    int completed = 0;
+};
+
+bool isValidNdvi(float value)
+{
+    return !std::isnan(value) && !std::isinf(value) && value != -9999.0f;
+}
+
+std::shared_ptr<const SweepInputs> decodeSweepInputs(const QString &ndviPath)
+{
+    auto inputs = std::make_shared<SweepInputs>();
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(ndviPath.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        qWarning() << "Sweep: failed to open NDVI:" << ndviPath;
+        return inputs;
+    }
+
+    int width = dataset->GetRasterXSize();
+    int height = dataset->GetRasterYSize();
+    double scale = std::min(1.0, std::min((double)kSweepThumbnailSize / width,
+                                          (double)kSweepThumbnailSize / height));
+    int outWidth = std::max(1, static_cast<int>(width * scale));
+    int outHeight = std::max(1, static_cast<int>(height * scale));
+
+    std::vector<float> ndvi(outWidth * outHeight);
+    CPLErr err = RasterReader::readBand(dataset->GetRasterBand(1), ndvi.data(), outWidth, outHeight,
+                                        GDT_Float32, ResampleMode::Average);
+    GDALClose(dataset);
+    if (err != CE_None) {
+        qWarning() << "Sweep: failed to read NDVI:" << CPLGetLastErrorMsg();
+        return inputs;
+    }
+
+    // Sfondo dei thumbnail: NDVI in [-1, 1] con colormap Viridis
+    QVector<QColor> colors = GeoTiffImageProvider::getColorMapColors(3);
+    QImage preview(outWidth, outHeight, QImage::Format_RGB32);
+    for (int y = 0; y < outHeight; ++y) {
+        QRgb *scanLine = (QRgb*)preview.scanLine(y);
+        for (int x = 0; x < outWidth; ++x) {
+            float value = ndvi[y * outWidth + x];
+            if (!isValidNdvi(value)) {
+                scanLine[x] = qRgb(0, 0, 0);
+                continue;
+            }
+            double normalized = qBound(0.0, (value + 1.0) / 2.0, 1.0);
+            int colorIndex = qBound(0, (int)(normalized * (colors.size() - 1)), colors.size() - 2);
+            double localPos = normalized * (colors.size() - 1) - colorIndex;
+            const QColor &c1 = colors[colorIndex];
+            const QColor &c2 = colors[colorIndex + 1];
+            scanLine[x] = qRgb(c1.red() + localPos * (c2.red() - c1.red()),
+                               c1.green() + localPos * (c2.green() - c1.green()),
+                               c1.blue() + localPos * (c2.blue() - c1.blue()));
+        }
+    }
+
+    inputs->width = outWidth;
+    inputs->height = outHeight;
+    inputs->ndvi = std::move(ndvi);
+    inputs->ndviPreview = preview;
+    qDebug() << "Sweep: shared NDVI decoded at" << outWidth << "x" << outHeight;
+    return inputs;
+}
+
+const QStringList sweepRasterSuffixes = {"tif", "tiff", "ovr"};
+
+// Copia privata del DSM (con i sidecar .aux.xml/.ovr/.tfw) per tutto lo sweep,
+// una volta sola: le varianti la collegano invece dell'originale, così un
+// backend che scrivesse sul proprio input non toccherebbe il file dell'utente.
+// Raster e overview restano in sola lettura finché lo sweep è in corso
+bool stageSweepSource(const QString &dsmPath, const QString &inputDir, QString &stagedPath)
+{
+    QFileInfo dsmInfo(dsmPath);
+    QStringList filters;
+    filters << dsmInfo.completeBaseName() + ".*";
+    if (!QDir().mkpath(inputDir)) {
+        qWarning() << "Sweep: failed to create" << inputDir;
+        return false;
+    }
+    for (const QFileInfo &file : dsmInfo.absoluteDir().entryInfoList(filters, QDir::Files)) {
+        const QString target = inputDir + "/" + file.fileName();
+        if (!QFile::copy(file.absoluteFilePath(), target)) {
+            qWarning() << "Sweep: failed to copy" << file.absoluteFilePath();
+            return false;
+        }
+        if (sweepRasterSuffixes.contains(file.suffix().toLower())) {
+            QFile::setPermissions(target, QFile::ReadOwner | QFile::ReadUser | QFile::ReadGroup | QFile::ReadOther);
+        }
+    }
+    stagedPath = inputDir + "/" + dsmInfo.fileName();
+    return QFile::exists(stagedPath);
+}
+
+// A sweep finito la copia torna scrivibile, altrimenti la cartella non si cancella
+void releaseSweepSource(const QString &inputDir)
+{
+    for (const QFileInfo &file : QDir(inputDir).entryInfoList(QDir::Files)) {
+        QFile::setPermissions(file.absoluteFilePath(), file.permissions() | QFile::WriteOwner | QFile::WriteUser);
+    }
+}
+
+// Porta il DSM della copia privata nella cartella della variante:
+// OliveMatrixLibCore scrive in <dir DSM>/clippedDir, così le varianti non collidono.
+// Raster e overview si collegano con un hard link alla copia in sola lettura
+// (nessuna copia di GB per variante), con la copia come ripiego tra volumi
+// diversi o su FAT. I sidecar piccoli si copiano sempre: GDAL può riscrivere
+// l'.aux.xml sul posto, e con un link cambierebbe quello delle altre varianti
+bool stageSweepDsm(const QString &sourceDsm, const QString &variantDir, QString &stagedPath)
+{
+    if (sourceDsm.isEmpty()) {
+        return false;
+    }
+    QFileInfo dsmInfo(sourceDsm);
+    QDir sourceDir = dsmInfo.absoluteDir();
+    QStringList filters;
+    filters << dsmInfo.completeBaseName() + ".*";
+    int linked = 0;
+    for (const QFileInfo &file : sourceDir.entryInfoList(filters, QDir::Files)) {
+        const QString target = variantDir + "/" + file.fileName();
+        if (sweepRasterSuffixes.contains(file.suffix().toLower())) {
+            std::error_code error;
+            std::filesystem::create_hard_link(std::filesystem::path(file.absoluteFilePath().toStdWString()),
+                                              std::filesystem::path(target.toStdWString()), error);
+            if (!error) {
+                ++linked;
+                continue;
+            }
+        }
+        if (!QFile::copy(file.absoluteFilePath(), target)) {
+            qWarning() << "Sweep: failed to stage" << file.absoluteFilePath();
+            return false;
+        }
+    }
+    stagedPath = variantDir + "/" + dsmInfo.fileName();
+    qDebug() << "Sweep: staged DSM in" << variantDir << "(" << linked << "hard links)";
+    return QFile::exists(stagedPath);
+}
+
+// Metriche e thumbnail della maschera risultato sulla griglia dell'NDVI condiviso
+void evaluateSweepResult(const SweepInputs &inputs, const QString &resultPath,
+                         const QString &ndviPath, const QString &variantDir, QVariantMap &row)
+{
+    if (inputs.ndvi.empty()) {
+        return;
+    }
+
+    QImage mask = GeoTiffProcessor::warpImageToMatch(resultPath, ndviPath);
+    if (mask.isNull()) {
+        qWarning() << "Sweep: failed to align result mask:" << resultPath;
+        return;
+    }
+    mask = mask.convertToFormat(QImage::Format_ARGB32)
+               .scaled(inputs.width, inputs.height, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+
+    QImage thumbnail = inputs.ndviPreview.copy();
+    qint64 validPixels = 0;
+    qint64 crownPixels = 0;
+    double crownNdviSum = 0.0;
+
+    for (int y = 0; y < inputs.height; ++y) {
+        const QRgb *maskLine = (const QRgb*)mask.constScanLine(y);
+        QRgb *thumbLine = (QRgb*)thumbnail.scanLine(y);
+        for (int x = 0; x < inputs.width; ++x) {
+            float value = inputs.ndvi[y * inputs.width + x];
+            if (!isValidNdvi(value)) {
+                continue;
+            }
+            ++validPixels;
+            // La maschera warpata è trasparente dove il valore è 0
+            if (qAlpha(maskLine[x]) == 0) {
+                continue;
+            }
+            ++crownPixels;
+            crownNdviSum += value;
+            QRgb base = thumbLine[x];
+            thumbLine[x] = qRgb((qRed(base) * 2 + 255 * 3) / 5, (qGreen(base) * 2) / 5, (qBlue(base) * 2) / 5);
+        }
+    }
+
+    row["crownFraction"] = validPixels > 0 ? (double)crownPixels / validPixels : 0.0;
+    row["crownMeanNdvi"] = crownPixels > 0 ? crownNdviSum / crownPixels : 0.0;
+
+    QString thumbnailPath = variantDir + "/thumbnail.png";
+    if (thumbnail.save(thumbnailPath)) {
+        row["thumbnail"] = QUrl::fromLocalFile(thumbnailPath).toString();
+    }
+}
+
+void writeSweepTable(const QString &sweepDir, const QVariantList &results)
+{
+    QFile file(sweepDir + "/sweep_results.csv");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Sweep: failed to write comparison table in" << sweepDir;
+        return;
+    }
+    QTextStream out(&file);
+    out << "index,denoise,areaThreshold,status,fCov,meanNdvi,crownFraction,crownMeanNdvi,elapsedMs,resultPath\n";
+    for (const QVariant &entry : results) {
+        QVariantMap row = entry.toMap();
+        out << row.value("index").toInt() << ','
+            << (row.value("denoise").toBool() ? 1 : 0) << ','
+            << row.value("areaThreshold").toInt() << ','
+            << row.value("status").toString() << ','
+            << row.value("fCov").toDouble() << ','
+            << row.value("meanNdvi").toDouble() << ','
+            << row.value("crownFraction").toDouble() << ','
+            << row.value("crownMeanNdvi").toDouble() << ','
+            << row.value("elapsedMs").toLongLong() << ','
+            << '"' << row.value("resultPath").toString() << '"' << '\n';
+    }
+}
+
+} // namespace
+
+void GeoTiffProcessor::runParameterSweep(const QVariantMap &grid)
+{
+    if (m_sweepRunning) {
+        emit errorOccurred("A parameter sweep is already running");
+        return;
+    }
+    if (!hasValidImages()) {
+        emit errorOccurred("Both DSM and NDVI images must be loaded before running a parameter sweep");
+        return;
+    }
+    if (!hasShapefileSelected()) {
+        emit errorOccurred("Shapefile archive is required for the parameter sweep");
+        return;
+    }
+
+    // Valori mancanti nella griglia = impostazioni correnti
+    QList<bool> denoiseValues;
+    for (const QVariant &value : grid.value("denoise").toList()) {
+        if (!denoiseValues.contains(value.toBool())) denoiseValues << value.toBool();
+    }
+    if (denoiseValues.isEmpty()) denoiseValues << m_denoiseFlag;
+
+    QList<int> thresholdValues;
+    for (const QVariant &value : grid.value("areaThreshold").toList()) {
+        if (value.toInt() > 0 && !thresholdValues.contains(value.toInt())) thresholdValues << value.toInt();
+    }
+    if (thresholdValues.isEmpty()) thresholdValues << m_areaThreshold;
+
+    int maxConcurrent = grid.value("maxConcurrent", std::max(1, QThread::idealThreadCount() / 2)).toInt();
+
+    QVector<SweepVariant> variants;
+    for (bool denoise : denoiseValues) {
+        for (int threshold : thresholdValues) {
+            SweepVariant variant;
+            variant.index = variants.size();
+            variant.denoise = denoise;
+            variant.areaThreshold = threshold;
+            variants.append(variant);
+        }
+    }
+
+    QFileInfo dsmInfo(m_image1Path);
+    QString sweepDir = dsmInfo.absolutePath() + "/sweep_"
+                       + QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss");
+    if (!QDir().mkpath(sweepDir)) {
+        emit errorOccurred("Failed to create sweep directory: " + sweepDir);
+        return;
+    }
+
+    qDebug() << "=== Parameter sweep ===";
+    qDebug() << "  Variants:" << variants.size() << "Concurrent:" << maxConcurrent;
+    qDebug() << "  Output:" << sweepDir;
+
+    m_sweepCancelled.storeRelease(0);
+    m_sweepPool.setMaxThreadCount(std::max(1, maxConcurrent));
+    m_sweepRunning = true;
+    emit sweepRunningChanged();
+    emit sweepProgress(0, variants.size());
+
+    const QString dsmPath = m_image1Path;
+    const QString ndviPath = m_image2Path;
+    const QString shapefilePath = m_shapefileZipPath;
+    auto state = std::make_shared<SweepState>();
+    for (int i = 0; i < variants.size(); ++i) state->results.append(QVariant());
+
+    m_sweepPool.start([this, variants, dsmPath, ndviPath, shapefilePath, sweepDir, state]() {
+        std::shared_ptr<const SweepInputs> inputs = decodeSweepInputs(ndviPath);
+        const int total = variants.size();
+        // Vuoto se la copia fallisce: ogni variante termina come "failed"
+        const QString inputDir = sweepDir + "/input";
+        QString sourceDsm;
+        if (!stageSweepSource(dsmPath, inputDir, sourceDsm)) {
+            sourceDsm.clear();
+        }
+
+        for (const SweepVariant &variant : variants) {
+            m_sweepPool.start([this, variant, inputs, total, sourceDsm, inputDir, ndviPath, shapefilePath, sweepDir,
+                               state]() {
+                QVariantMap row;
+                row["index"] = variant.index;
+                row["denoise"] = variant.denoise;
+                row["areaThreshold"] = variant.areaThreshold;
+                row["status"] = QString("cancelled");
+
+                if (!m_sweepCancelled.loadAcquire()) {
+                    QString variantDir = sweepDir + QString("/v%1_d%2_a%3")
+                                             .arg(variant.index, 2, 10, QChar('0'))
+                                             .arg(variant.denoise ? 1 : 0)
+                                             .arg(variant.areaThreshold);
+                    QString stagedDsm;
+                    QElapsedTimer timer;
+                    timer.start();
+
+                    QString outputPath;
+                    double fCov = 0.0;
+                    double meanNdvi = 0.0;
+                    bool ok = QDir().mkpath(variantDir) && stageSweepDsm(sourceDsm, variantDir, stagedDsm)
+                              && callRunAnalysis(stagedDsm, ndviPath, shapefilePath, variant.denoise,
+                                                 variant.areaThreshold, outputPath, fCov, meanNdvi);
+                    row["status"] = QString(ok ? "ok" : "failed");
+                    if (ok) {
+                        row["resultPath"] = outputPath;
+                        row["fCov"] = fCov;
+                        row["meanNdvi"] = meanNdvi;
+                        evaluateSweepResult(*inputs, outputPath, ndviPath, variantDir, row);
+                    }
+                    row["elapsedMs"] = timer.elapsed();
+                    qDebug() << "Sweep variant" << variant.index << "finished:" << row["status"].toString()
+                             << "in" << row["elapsedMs"].toLongLong() << "ms";
+                }
+
+                int completed = 0;
+                QVariantList results;
+                {
+                    QMutexLocker locker(&state->mutex);
+                    state->results[variant.index] = row;
+                    completed = ++state->completed;
+                    if (completed == total) results = state->results;
+                }
+
+                QMetaObject::invokeMethod(this, [this, completed, total]() {
+                    emit sweepProgress(completed, total);
+                }, Qt::QueuedConnection);
+
+                if (completed == total) {
+                    releaseSweepSource(inputDir);
+                    writeSweepTable(sweepDir, results);
+                    QMetaObject::invokeMethod(this, [this, sweepDir, results]() {
+                        m_sweepRunning = false;
+                        emit sweepRunningChanged();
+                        emit sweepCompleted(sweepDir, results);
+                    }, Qt::QueuedConnection);
+                }
+            });
+        }
+    });
+}
+
+void GeoTiffProcessor::cancelParameterSweep()
+{
+    if (!m_sweepRunning) {
+        return;
+    }
+    // Le varianti già avviate nel backend .NET non sono interrompibili:
+    // quelle in coda terminano subito come "cancelled"
+    qDebug() << "Cancelling parameter sweep";
+    m_sweepCancelled.storeRelease(1);
+}
+
+// ============================================================================
+// Derivazione NDVI / CHM / denoise
+// ============================================================================
+
+namespace {
+
+QString derivedPath(const QString &inputPath, const QString &suffix)
+{
+    QFileInfo info(inputPath);
+    return info.absolutePath() + "/" + info.completeBaseName() + "_" + suffix + ".tif";
+}
+
+} // namespace
+
+void GeoTiffProcessor::deriveNdvi(const QString &redPath, int redBand, const QString &nirPath, int nirBand,
+                                  const QString &outputPath)
+{
+    QString target = outputPath.isEmpty() ? derivedPath(redPath, "ndvi") : outputPath;
+    qDebug() << "=== NDVI derivation ===";
+    qDebug() << "  Red:" << redPath << "band" << redBand;
+    qDebug() << "  NIR:" << (nirPath.isEmpty() ? redPath : nirPath) << "band" << nirBand;
+    startDerivation("ndvi", target, [=](QString *error, const RasterAlgebra::ProgressFunction &progress) {
+        return RasterAlgebra::computeNdvi(redPath, redBand, nirPath, nirBand, target, error, progress);
+    });
+}
+
+void GeoTiffProcessor::deriveChm(const QString &dsmPath, const QString &dtmPath, int groundWindow,
+                                 const QString &outputPath)
+{
+    QString target = outputPath.isEmpty() ? derivedPath(dsmPath, "chm") : outputPath;
+    qDebug() << "=== CHM derivation ===";
+    qDebug() << "  DSM:" << dsmPath;
+    qDebug() << "  Ground:" << (dtmPath.isEmpty() ? QString("estimated") : dtmPath);
+    startDerivation("chm", target, [=](QString *error, const RasterAlgebra::ProgressFunction &progress) {
+        return RasterAlgebra::computeChm(dsmPath, dtmPath, groundWindow, target, error, progress);
+    });
+}
+
+void GeoTiffProcessor::denoiseRaster(const QString &inputPath, const QString &filter, int radius,
+                                     const QString &outputPath)
+{
+    Denoise::Params params;
+    params.filter = Denoise::filterFromName(filter);
+    params.radius = qBound(1, radius, Denoise::MaxRadius);
+    if (params.filter == Denoise::Filter::None) {
+        emit errorOccurred("Unknown denoise filter: " + filter);
+        return;
+    }
+    QString suffix = Denoise::filterName(params.filter) + QString::number(2 * params.radius + 1);
+    QString target = outputPath.isEmpty() ? derivedPath(inputPath, suffix) : outputPath;
+    qDebug() << "=== Denoise ===";
+    qDebug() << "  Input:" << inputPath;
+    qDebug() << "  Filter:" << Denoise::filterName(params.filter) << "radius" << params.radius;
+    startDerivation("denoise", target, [=](QString *error, const RasterAlgebra::ProgressFunction &progress) {
+        return Denoise::filterRaster(inputPath, 1, params, target, error, progress);
+    });
+}
+
+void GeoTiffProcessor::exportRendered(const QString &basePath, int colorMap, const QString &overlayPath,
+                                      const QString &overlayColor, double overlayOpacity, const QString &format,
+                                      const QString &outputPath)
+{
+    RasterExport::Params params;
+    params.basePath = basePath;
+    params.rgb = colorMap < 0;
+    params.colors = GeoTiffImageProvider::getColorMapColors(colorMap);
+    params.overlayPath = overlayPath;
+    params.overlayColor = overlayColor.isEmpty() ? QColor() : QColor(overlayColor);
+    params.overlayOpacity = qBound(0.0, overlayOpacity, 1.0);
+    params.format = RasterExport::formatFromName(format);
+    qDebug() << "=== Export ===";
+    qDebug() << "  Base:" << (basePath.isEmpty() ? QString("(none)") : basePath) << "colormap" << colorMap;
+    qDebug() << "  Overlay:" << (overlayPath.isEmpty() ? QString("(none)") : overlayPath);
+    qDebug() << "  Format:" << RasterExport::formatName(params.format) << "->" << outputPath;
+    startDerivation("export", outputPath, [=](QString *error, const RasterAlgebra::ProgressFunction &progress) {
+        return RasterExport::exportComposite(params, outputPath, error, progress);
+    });
+}
+
+void GeoTiffProcessor::startDerivation(const QString &kind, const QString &outputPath, const DerivationJob &job)
+{
+    if (m_derivationRunning) {
+        emit errorOccurred("A derivation is already running");
+        return;
+    }
+    m_derivationCancelled.storeRelease(0);
+    m_derivationRunning = true;
+    emit derivationRunningChanged();
+    emit derivationProgress(0.0);
+
+    m_derivationPool.start([this, kind, outputPath, job]() {
+        QElapsedTimer timer;
+        timer.start();
+        QString error;
+        // Avanzamento al più ogni 100 ms (polling di RasterAlgebra)
+        bool ok = job(&error, [this](double fraction) {
+            QMetaObject::invokeMethod(this, [this, fraction]() {
+                emit derivationProgress(fraction);
+            }, Qt::QueuedConnection);
+            return !m_derivationCancelled.loadAcquire();
+        });
+        qint64 elapsed = timer.elapsed();
+
+        QMetaObject::invokeMethod(this, [this, ok, kind, outputPath, error, elapsed]() {
+            m_derivationRunning = false;
+            emit derivationRunningChanged();
+            if (ok) {
+                emit derivationCompleted(kind, outputPath, elapsed);
+            } else if (!m_derivationCancelled.loadAcquire()) {
+                emit errorOccurred("Derivation failed: " + error);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeoTiffProcessor::cancelDerivation()
+{
+    if (m_derivationRunning) {
+        qDebug() << "Cancelling derivation";
+        m_derivationCancelled.storeRelease(1);
+    }
+}
+
 // Statistics methods
 
 // ============================================================================
@@ -572,6 +1338,8 @@ GeoTiffImageProvider::GeoTiffImageProvider()
 QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
 {
     qDebug() << "GeoTiffImageProvider::requestImage called with id:" << id;
+    // Richiesta visibile: i prefetch in background aspettano che finisca
+    PrefetchScheduler::VisibleRequest visibleRequest;
     
     // Parse the id: "encoded_path?colormap=0&t=timestamp"
     QStringList parts = id.split("?");
@@ -587,6 +1355,34 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
     // Parse parameters
     int colorMapIndex = 0;
     QString refPath;
+    ResampleMode resampleMode = RasterReader::defaultMode();
+    // Stretch adattivo: percentili (es. stretch=2,98) sulla viewport normalizzata
+    // (view=x0,y0,x1,y1), calcolati dalla piramide di riepilogo
+    bool adaptiveStretch = false;
+    double stretchLow = 2.0;
+    double stretchHigh = 98.0;
+    QRectF viewport(0.0, 0.0, 1.0, 1.0);
+    // Resa derivata per DSM: mode=hillshade|slope|aspect, az/alt (gradi), z, blend.
+    // Solo sulla griglia intera: con region= la richiesta è rifiutata. Con filter=
+    // il rilievo si calcola sull'elevazione filtrata
+    Terrain::Params terrain;
+    // Denoise in anteprima: filter=median|gaussian|opening, radius=1..3; con
+    // region=x0,y0,x1,y1 (normalizzata) si rende solo quella porzione, fino alla
+    // risoluzione nativa, leggendo il bordo del filtro dai pixel vicini
+    Denoise::Params denoise;
+    bool hasRegion = false;
+    QRectF region(0.0, 0.0, 1.0, 1.0);
+    // Anteprima del caricamento progressivo (preview=1): statistiche approssimate
+    // (overview) invece della scansione completa, mai oltre la risoluzione nativa
+    bool preview = false;
+    // Composito della vista risultati (composite=1): il percorso è la base RGB
+    // (anche vuoto), overlay= la maschera, overlayColor= (vuoto = grigio),
+    // opacity=, base=0/overlay=... assente per nascondere un layer
+    bool composite = false;
+    Compositor::Params compositeParams;
+    // Banda singola a un canale (channel=1): codici a 8 bit sul range invece
+    // dei colori, la colormap la applica lo shader (GeoTiffTextureProvider)
+    bool singleChannel = false;
     if (parts.size() > 1) {
         QStringList params = parts[1].split("&");
         for (const QString &param : params) {
@@ -596,10 +1392,102 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
             if (param.startsWith("alignTo=")) {
                 refPath = QUrl::fromPercentEncoding(param.mid(8).toUtf8());
             }
+            if (param.startsWith("resample=")) {
+                resampleMode = RasterReader::modeFromName(param.mid(9), resampleMode);
+            }
+            if (param.startsWith("stretch=")) {
+                QStringList values = param.mid(8).split(",");
+                if (values.size() == 2) {
+                    adaptiveStretch = true;
+                    stretchLow = values[0].toDouble();
+                    stretchHigh = values[1].toDouble();
+                }
+            }
+            if (param.startsWith("mode=")) {
+                terrain.mode = Terrain::modeFromName(param.mid(5));
+            }
+            if (param.startsWith("az=")) {
+                terrain.azimuth = param.mid(3).toDouble();
+            }
+            if (param.startsWith("alt=")) {
+                terrain.altitude = qBound(0.0, param.mid(4).toDouble(), 90.0);
+            }
+            if (param.startsWith("z=")) {
+                terrain.zFactor = param.mid(2).toDouble();
+            }
+            if (param.startsWith("blend=")) {
+                terrain.blend = param.mid(6).toDouble();
+            }
+            if (param.startsWith("filter=")) {
+                denoise.filter = Denoise::filterFromName(param.mid(7));
+            }
+            if (param.startsWith("radius=")) {
+                denoise.radius = qBound(1, param.mid(7).toInt(), Denoise::MaxRadius);
+            }
+            if (param.startsWith("region=")) {
+                QStringList values = param.mid(7).split(",");
+                if (values.size() == 4) {
+                    region = QRectF(QPointF(values[0].toDouble(), values[1].toDouble()),
+                                    QPointF(values[2].toDouble(), values[3].toDouble()))
+                                 .intersected(QRectF(0.0, 0.0, 1.0, 1.0));
+                    hasRegion = !region.isEmpty();
+                }
+            }
+            if (param.startsWith("preview=")) {
+                preview = param.mid(8).toInt() != 0;
+            }
+            if (param.startsWith("composite=")) {
+                composite = param.mid(10).toInt() != 0;
+            }
+            if (param.startsWith("overlay=")) {
+                compositeParams.maskPath = QUrl::fromPercentEncoding(param.mid(8).toUtf8());
+            }
+            if (param.startsWith("overlayColor=")) {
+                compositeParams.color = QColor(QUrl::fromPercentEncoding(param.mid(13).toUtf8()));
+            }
+            if (param.startsWith("opacity=")) {
+                compositeParams.opacity = qBound(0.0, param.mid(8).toDouble(), 1.0);
+            }
+            if (param.startsWith("base=")) {
+                compositeParams.showBase = param.mid(5).toInt() != 0;
+            }
+            if (param.startsWith("channel=")) {
+                singleChannel = param.mid(8).toInt() == 1;
+            }
+            if (param.startsWith("view=")) {
+                QStringList values = param.mid(5).split(",");
+                if (values.size() == 4) {
+                    viewport = QRectF(QPointF(values[0].toDouble(), values[1].toDouble()),
+                                      QPointF(values[2].toDouble(), values[3].toDouble()));
+                }
+            }
         }
     }
 
-    qDebug() << "Using colormap index:" << colorMapIndex;
+    qDebug() << "Using colormap index:" << colorMapIndex << "resampling:" << RasterReader::modeName(resampleMode);
+    if (terrain.mode != Terrain::Mode::None && hasRegion) {
+        // Il rilievo di una porzione richiederebbe il bordo del gradiente fuori
+        // dalla griglia dei tile: il viewer non lo chiede, qui si rifiuta
+        qWarning() << "Terrain mode is not supported with region=, request rejected:" << id;
+        return QImage();
+    }
+    if (composite) {
+        // Base e maschera fuse in un'unica immagine, a tile e in parallelo
+        auto cleanPath = [](QString path) {
+            if (path.startsWith("file:///")) path = path.mid(8);
+            else if (path.startsWith("file://")) path = path.mid(7);
+            return path;
+        };
+        compositeParams.basePath = cleanPath(filePath);
+        compositeParams.maskPath = cleanPath(compositeParams.maskPath);
+        // Senza sourceSize lo stesso limite di warpImageToMatch
+        const int maxSide = 4096;
+        QImage image = Compositor::render(compositeParams,
+                                          requestedSize.width() > 0 ? requestedSize.width() : maxSide,
+                                          requestedSize.height() > 0 ? requestedSize.height() : maxSide);
+        if (size) *size = image.size();
+        return image;
+    }
     if (!refPath.isEmpty()) {
         // Pulisci i path da file:/// e decodifica
         QString filePathClean = filePath;
@@ -652,6 +1540,10 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
                 outHeight = requestedSize.height();
                 outWidth = (int)(outHeight * aspectRatio);
             }
+            if (preview && outWidth > width) {
+                outWidth = width;
+                outHeight = height;
+            }
         }
         
         QImage image(outWidth, outHeight, QImage::Format_RGB32);
@@ -666,9 +1558,9 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
         GDALRasterBand *gBand = dataset->GetRasterBand(2);
         GDALRasterBand *bBand = dataset->GetRasterBand(3);
         
-        rBand->RasterIO(GF_Read, 0, 0, width, height, rBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        gBand->RasterIO(GF_Read, 0, 0, width, height, gBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
-        bBand->RasterIO(GF_Read, 0, 0, width, height, bBuf.data(), outWidth, outHeight, GDT_Byte, 0, 0);
+        RasterReader::readBand(rBand, rBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+        RasterReader::readBand(gBand, gBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
+        RasterReader::readBand(bBand, bBuf.data(), outWidth, outHeight, GDT_Byte, resampleMode);
         
         // Componi l'immagine RGB
         for (int y = 0; y < outHeight; ++y) {
@@ -700,12 +1592,17 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
     qDebug() << "Band info - Width:" << width << "Height:" << height << "Type:" << dataType;
 
     // Determine output size (downsample if requested)
-    int outWidth = width;
-    int outHeight = height;
+    // Con region: la finestra sorgente è solo la porzione richiesta
+    const double srcX = hasRegion ? region.left() * width : 0.0;
+    const double srcY = hasRegion ? region.top() * height : 0.0;
+    const double srcWidth = hasRegion ? region.width() * width : width;
+    const double srcHeight = hasRegion ? region.height() * height : height;
+    int outWidth = std::max(1, (int)std::ceil(srcWidth));
+    int outHeight = std::max(1, (int)std::ceil(srcHeight));
     
     if (requestedSize.width() > 0 && requestedSize.height() > 0) {
         // Calculate aspect-preserving size
-        double aspectRatio = (double)width / height;
+        double aspectRatio = srcWidth / srcHeight;
         outWidth = requestedSize.width();
         outHeight = (int)(outWidth / aspectRatio);
         
@@ -714,40 +1611,108 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
             outWidth = (int)(outHeight * aspectRatio);
         }
         
+        // La porzione (e l'anteprima) non si ingrandisce oltre la risoluzione nativa
+        if ((hasRegion || preview) && outWidth > std::ceil(srcWidth)) {
+            outWidth = std::max(1, (int)std::ceil(srcWidth));
+            outHeight = std::max(1, (int)std::ceil(srcHeight));
+        }
+        
         qDebug() << "Downsampling to:" << outWidth << "x" << outHeight;
     }
 
-    // Allocate buffer for reading data
-    float *buffer = new float[outWidth * outHeight];
-    
-    // Read the data with resampling
-    CPLErr err = band->RasterIO(
-        GF_Read,
-        0, 0,                    // Source offset
-        width, height,           // Source size
-        buffer,                  // Buffer
-        outWidth, outHeight,     // Buffer size
-        GDT_Float32,            // Buffer type
-        0, 0                    // Pixel/line spacing
-    );
+    // Il raggio del filtro è in pixel sorgente: sulla griglia ridotta (anteprima
+    // senza region=, o porzione letta sotto la risoluzione nativa) si scala del
+    // fattore di decimazione, così la vista ridotta e quella a piena risoluzione
+    // filtrano la stessa estensione a terra. Sotto il mezzo pixel il filtro
+    // non avrebbe effetto visibile e si salta
+    if (denoise.filter != Denoise::Filter::None) {
+        const double decimation = std::max(srcWidth / outWidth, srcHeight / outHeight);
+        if (decimation > 1.0) {
+            const int scaled = static_cast<int>(std::lround(denoise.radius / decimation));
+            qDebug() << "Denoise radius" << denoise.radius << "at decimation" << decimation << "->" << scaled;
+            if (scaled < 1) {
+                denoise.filter = Denoise::Filter::None;
+            } else {
+                denoise.radius = scaled;
+            }
+        }
+    }
 
-    if (err != CE_None) {
+    // Griglia intera senza filtro: si colora (o con channel=1 si quantizza a 8
+    // bit, o se ne calcola il rilievo) direttamente dai tile in cache, senza un
+    // buffer float grande quanto l'immagine
+    const bool fromTiles = !hasRegion && denoise.filter == Denoise::Filter::None;
+
+    // Allocate buffer for reading data
+    float *buffer = fromTiles ? nullptr : new float[outWidth * outHeight];
+    
+    // Read the data with resampling (overview migliore + GDALRasterIOExtraArg),
+    // a tile tramite la cache dei raster decodificati gestita dal MemoryGovernor
+    RasterGrid grid = RasterGrid::create(cleanFilePath, band, 1, outWidth, outHeight, resampleMode);
+    if (fromTiles) {
+        // Letti (e decodificati se mancano) da RasterTileCache::colorize
+    } else if (hasRegion) {
+        // Porzione visibile: lettura diretta con il bordo del filtro, poi filtro a tile.
+        // Se il viewer tiene il raster in un PrefetchScheduler si legge dal suo
+        // dataset, la cui block cache contiene i blocchi già prefetchati
+        std::shared_ptr<PrefetchScheduler::SharedSource> shared = PrefetchScheduler::SharedSource::find(cleanFilePath);
+        QMutexLocker sharedLock(shared ? shared->mutex() : nullptr);
+        GDALRasterBand *regionBand = shared ? shared->dataset()->GetRasterBand(1) : band;
+        std::vector<float> padded;
+        if (!Denoise::readHalo(regionBand, srcX, srcY, srcWidth, srcHeight, outWidth, outHeight,
+                               Denoise::haloSize(denoise), resampleMode, padded)) {
+            qWarning() << "Failed to read raster region:" << CPLGetLastErrorMsg();
+            delete[] buffer;
+            GDALClose(dataset);
+            return QImage();
+        }
+        sharedLock.unlock();
+        Denoise::filterBuffer(denoise, padded.data(), outWidth, outHeight, buffer);
+    } else if (!RasterTileCache::instance().readRaster(grid, band, buffer)) {
         qWarning() << "Failed to read raster data:" << CPLGetLastErrorMsg();
         delete[] buffer;
         GDALClose(dataset);
         return QImage();
+    } else if (denoise.filter != Denoise::Filter::None) {
+        // Griglia intera dai tile in cache: si paga solo il filtro
+        int hasNoData = 0;
+        double noData = band->GetNoDataValue(&hasNoData);
+        std::vector<float> padded;
+        Denoise::padReplicate(buffer, outWidth, outHeight, Denoise::haloSize(denoise),
+                              hasNoData ? (float)noData : std::numeric_limits<float>::quiet_NaN(), padded);
+        Denoise::filterBuffer(denoise, padded.data(), outWidth, outHeight, buffer);
     }
     
     qDebug() << "Raster data read successfully";
 
     // Get statistics for normalization
-    double minVal, maxVal, meanVal, stdDev;
-    band->ComputeStatistics(false, &minVal, &maxVal, &meanVal, &stdDev, nullptr, nullptr);
-    
-    qDebug() << "Statistics - Min:" << minVal << "Max:" << maxVal << "Mean:" << meanVal << "StdDev:" << stdDev;
+    double minVal = 0.0, maxVal = 0.0, meanVal = 0.0, stdDev = 0.0;
+    bool stretched = false;
+    if (adaptiveStretch) {
+        // Percentili della viewport dalla piramide (costruita una volta per raster):
+        // i tile decodificati sono in cache, cambia solo la ricolorazione
+        std::shared_ptr<const SummaryPyramid> pyramid = SummaryPyramidCache::instance().pyramidFor(cleanFilePath, band);
+        if (pyramid) {
+            SummaryPyramid::Stretch stretch = pyramid->percentileStretch(viewport, stretchLow, stretchHigh);
+            if (stretch.valid) {
+                minVal = stretch.low;
+                maxVal = stretch.high;
+                stretched = true;
+                qDebug() << "Viewport stretch" << stretchLow << "-" << stretchHigh << "%:" << minVal << "to" << maxVal
+                         << "from" << stretch.samples << "samples";
+            }
+        }
+    }
+    if (!stretched) {
+        band->ComputeStatistics(preview, &minVal, &maxVal, &meanVal, &stdDev, nullptr, nullptr);
+        qDebug() << "Statistics - Min:" << minVal << "Max:" << maxVal << "Mean:" << meanVal << "StdDev:" << stdDev;
+    }
     
     // Handle invalid statistics
-    if (minVal == maxVal || std::isnan(minVal) || std::isnan(maxVal)) {
+    if ((minVal == maxVal || std::isnan(minVal) || std::isnan(maxVal)) && fromTiles) {
+        qWarning() << "Invalid statistics, computing from cached tiles";
+        RasterTileCache::instance().valueRange(grid, band, minVal, maxVal);
+    } else if (minVal == maxVal || std::isnan(minVal) || std::isnan(maxVal)) {
         qWarning() << "Invalid statistics, computing from buffer";
         minVal = buffer[0];
         maxVal = buffer[0];
@@ -759,44 +1724,94 @@ QImage GeoTiffImageProvider::requestImage(const QString &id, QSize *size, const
         }
     }
 
-    // Create output image
-    QImage image(outWidth, outHeight, QImage::Format_RGB32);
-    
-    double range = maxVal - minVal;
-    if (range < 1e-10) range = 1.0; // Avoid division by zero
-    
-    // Fill image with color-mapped values
-    QVector<QColor> colors = getColorMapColors(colorMapIndex);
-    
-    for (int y = 0; y < outHeight; ++y) {
-        QRgb *scanLine = (QRgb*)image.scanLine(y);
-        for (int x = 0; x < outWidth; ++x) {
-            float value = buffer[y * outWidth + x];
-            
-            // Handle NaN and Inf
-            if (std::isnan(value) || std::isinf(value)) {
-                scanLine[x] = qRgb(0, 0, 0); // Black for invalid values
-                continue;
+    if (terrain.mode != Terrain::Mode::None) {
+        // Dimensione a terra di un pixel della griglia; per CRS geografici da
+        // gradi a metri alla latitudine centrale
+        double cellX = (double)width / outWidth;
+        double cellY = (double)height / outHeight;
+        double geoTransform[6];
+        if (dataset->GetGeoTransform(geoTransform) == CE_None) {
+            cellX *= std::abs(geoTransform[1]);
+            cellY *= std::abs(geoTransform[5]);
+            const OGRSpatialReference *srs = dataset->GetSpatialRef();
+            if (srs && srs->IsGeographic()) {
+                double latitude = geoTransform[3] + geoTransform[5] * height / 2.0;
+                cellX *= 111320.0 * std::cos(qDegreesToRadians(latitude));
+                cellY *= 110574.0;
             }
-            
-            // Normalize to 0-1
-            double normalized = (value - minVal) / range;
-            normalized = qBound(0.0, normalized, 1.0);
-            
-            // Map to color
-            int colorIndex = (int)(normalized * (colors.size() - 1));
-            colorIndex = qBound(0, colorIndex, colors.size() - 2);
-            
-            double localPos = normalized * (colors.size() - 1) - colorIndex;
-            
-            QColor c1 = colors[colorIndex];
-            QColor c2 = colors[colorIndex + 1];
-            
-            int r = c1.red() + localPos * (c2.red() - c1.red());
-            int g = c1.green() + localPos * (c2.green() - c1.green());
-            int b = c1.blue() + localPos * (c2.blue() - c1.blue());
-            
-            scanLine[x] = qRgb(qBound(0, r, 255), qBound(0, g, 255), qBound(0, b, 255));
+        }
+        // Senza filtro dai tile in cache; con il filtro dalla griglia filtrata
+        QImage image;
+        if (fromTiles) {
+            image = Terrain::render(grid, band, terrain, cellX, cellY, getColorMapColors(colorMapIndex),
+                                    minVal, maxVal);
+        } else {
+            int hasNoData = 0;
+            const double noData = band->GetNoDataValue(&hasNoData);
+            image = Terrain::render(buffer, outWidth, outHeight,
+                                    hasNoData ? (float)noData : std::numeric_limits<float>::quiet_NaN(),
+                                    terrain, cellX, cellY, getColorMapColors(colorMapIndex), minVal, maxVal);
+        }
+        delete[] buffer;
+        GDALClose(dataset);
+        if (size) {
+            *size = image.size();
+        }
+        return image;
+    }
+
+    if (singleChannel && fromTiles) {
+        QImage image;
+        if (!RasterTileCache::instance().quantize(grid, band, minVal, maxVal, image)) {
+            qWarning() << "Failed to read raster data:" << CPLGetLastErrorMsg();
+            GDALClose(dataset);
+            return QImage();
+        }
+        GDALClose(dataset);
+        if (size) {
+            *size = image.size();
+        }
+        qDebug() << "Single-channel image complete from tiles:" << image.size();
+        return image;
+    }
+    if (singleChannel) {
+        // Stessa scala della colormap (indice = codice * (LutSize - 1) / UInt8MaxCode)
+        int hasNoData = 0;
+        const double noData = band->GetNoDataValue(&hasNoData);
+        double range = maxVal - minVal;
+        if (range < 1e-10) range = 1.0;
+        const float scale = static_cast<float>(range / Quantize::UInt8MaxCode);
+        QImage image(outWidth, outHeight, QImage::Format_Grayscale8);
+        for (int y = 0; y < outHeight; ++y) {
+            Quantize::toUInt8(buffer + (size_t)y * outWidth, outWidth, static_cast<float>(minVal), scale,
+                              hasNoData ? (float)noData : std::numeric_limits<float>::quiet_NaN(), image.scanLine(y));
+        }
+        delete[] buffer;
+        GDALClose(dataset);
+        if (size) {
+            *size = image.size();
+        }
+        qDebug() << "Single-channel image complete:" << image.size();
+        return image;
+    }
+
+    // Colormap tabulata (come l'export e il tile server), applicata in SSE2
+    const std::vector<QRgb> lut = RasterExport::buildLut(getColorMapColors(colorMapIndex));
+    QImage image;
+    if (fromTiles) {
+        if (!RasterTileCache::instance().colorize(grid, band, lut, minVal, maxVal, image)) {
+            qWarning() << "Failed to read raster data:" << CPLGetLastErrorMsg();
+            GDALClose(dataset);
+            return QImage();
+        }
+    } else {
+        image = QImage(outWidth, outHeight, QImage::Format_RGB32);
+        double range = maxVal - minVal;
+        if (range < 1e-10) range = 1.0; // Avoid division by zero
+        const float lutScale = static_cast<float>((RasterExport::LutSize - 1) / range);
+        for (int y = 0; y < outHeight; ++y) {
+            Quantize::colorize(buffer + (size_t)y * outWidth, outWidth, static_cast<float>(minVal), lutScale,
+                               lut.data(), RasterExport::LutSize, (QRgb*)image.scanLine(y));
         }
     }
 
@@ -837,38 +1852,120 @@ QVariantMap GeoTiffProcessor::getImageStatistics(const QString &imagePath)
         return stats;
     }
     
-    GDALDataset *dataset = (GDALDataset*)GDALOpen(imagePath.toUtf8().constData(), GA_ReadOnly);
-    if (dataset == nullptr) {
-        qWarning() << "Failed to open GeoTIFF for statistics:" << imagePath;
-        return stats;
+    // Versione sincrona (blocca il chiamante): dalla GUI usare requestStatistics
+    RasterStatistics statistics = StatisticsService::compute(imagePath, nullptr);
+    stats["valid"] = statistics.valid;
+    if (statistics.valid) {
+        stats["min"] = statistics.min;
+        stats["max"] = statistics.max;
+        stats["mean"] = statistics.mean;
+        stats["stdDev"] = statistics.stdDev;
     }
-    
-    GDALRasterBand *band = dataset->GetRasterBand(1);
-    if (band == nullptr) {
-        qWarning() << "No raster band found for statistics";
-        GDALClose(dataset);
-        return stats;
+    return stats;
+}
+
+int GeoTiffProcessor::requestStatistics(const QString &imagePath, const QString &channel)
+{
+    if (imagePath.isEmpty()) {
+        return 0;
     }
-    
-    double minVal, maxVal, meanVal, stdDev;
-    CPLErr err = band->ComputeStatistics(false, &minVal, &maxVal, &meanVal, &stdDev, nullptr, nullptr);
-    
-    if (err == CE_None) {
-        stats["min"] = minVal;
-        stats["max"] = maxVal;
-        stats["mean"] = meanVal;
-        stats["stdDev"] = stdDev;
-        stats["valid"] = true;
-        
-        qDebug() << "Image statistics:" << imagePath;
-        qDebug() << "  Min:" << minVal << "Max:" << maxVal << "Mean:" << meanVal;
+    return m_statistics->requestStatistics(imagePath, channel);
+}
+
+void GeoTiffProcessor::cancelStatistics(const QString &channel)
+{
+    m_statistics->cancel(channel);
+}
+
+QVariantMap GeoTiffProcessor::viewportStretch(const QString &imagePath, double x0, double y0, double x1, double y1,
+                                              double lowPercent, double highPercent)
+{
+    QVariantMap result;
+    result["valid"] = false;
+
+    // Solo piramidi già costruite dal provider: nessuna lettura nel thread GUI
+    std::shared_ptr<const SummaryPyramid> pyramid = SummaryPyramidCache::instance().cached(imagePath);
+    if (!pyramid) {
+        return result;
+    }
+    SummaryPyramid::Stretch stretch = pyramid->percentileStretch(QRectF(QPointF(x0, y0), QPointF(x1, y1)),
+                                                                 lowPercent, highPercent);
+    result["valid"] = stretch.valid;
+    result["min"] = stretch.low;
+    result["max"] = stretch.high;
+    return result;
+}
+
+QVariantMap GeoTiffProcessor::roiStatistics(const QString &imagePath, const QVariantList &points)
+{
+    QVariantMap result;
+    result["valid"] = false;
+    result["pending"] = false;
+    if (imagePath.isEmpty() || points.size() < 2) {
+        return result;
+    }
+
+    QSize rasterSize = SummedAreaTableCache::instance().rasterSize(imagePath);
+    if (rasterSize.isEmpty()) {
+        return result;
+    }
+
+    // Punti normalizzati -> pixel sorgente
+    QPolygonF polygon;
+    for (const QVariant &point : points) {
+        QVariantMap map = point.toMap();
+        polygon << QPointF(map.value("x").toDouble() * rasterSize.width(),
+                           map.value("y").toDouble() * rasterSize.height());
+    }
+    QRectF bounds = polygon.boundingRect();
+    int level = SummedAreaTableCache::levelFor(rasterSize, bounds.width(), bounds.height());
+
+    std::shared_ptr<const SummedAreaTable> table = SummedAreaTableCache::instance().table(imagePath, level);
+    if (!table) {
+        result["pending"] = true;
+        if (SummedAreaTableCache::instance().beginBuild(imagePath, level)) {
+            qDebug() << "Building summed-area table level" << level << "for:" << imagePath;
+            QThreadPool::globalInstance()->start([this, imagePath, level]() {
+                SummedAreaTableCache::instance().build(imagePath, level);
+                QMetaObject::invokeMethod(this, [this, imagePath]() {
+                    emit roiTablesReady(imagePath);
+                }, Qt::QueuedConnection);
+            });
+        }
+        return result;
+    }
+
+    // Coordinate del livello: scala per lato (l'ultima cella può essere parziale)
+    double scaleX = (double)table->width() / rasterSize.width();
+    double scaleY = (double)table->height() / rasterSize.height();
+    SummedAreaTable::Sums sums;
+    if (polygon.size() == 2) {
+        QRectF rect = bounds;
+        sums = table->rect(qRound(rect.left() * scaleX), qRound(rect.top() * scaleY),
+                           qRound(rect.right() * scaleX), qRound(rect.bottom() * scaleY));
     } else {
-        qWarning() << "Failed to compute statistics";
-        stats["valid"] = false;
+        QPolygonF levelPolygon;
+        for (const QPointF &point : std::as_const(polygon)) {
+            levelPolygon << QPointF(point.x() * scaleX, point.y() * scaleY);
+        }
+        sums = table->polygon(levelPolygon);
     }
-    
-    GDALClose(dataset);
-    return stats;
+
+    result["level"] = level;
+    // Le tabelle contano i pixel sorgente validi a ogni livello
+    result["count"] = static_cast<double>(sums.count);
+    result["area"] = static_cast<double>(sums.count);
+    if (sums.count == 0) {
+        return result;
+    }
+    double mean = sums.sum / sums.count;
+    double variance = std::max(0.0, sums.sumSq / sums.count - mean * mean);
+    result["valid"] = true;
+    result["mean"] = mean + table->offset();
+    // Somme dei pixel a ogni livello: ai livelli > 0 è approssimato solo il bordo
+    result["stdDev"] = std::sqrt(variance);
+    result["exact"] = level == 0;
+    return result;
 }
 
 QVariantList GeoTiffProcessor::getHeightData(const QString &imagePath, int maxWidth, int maxHeight)
@@ -950,6 +2047,11 @@ void GeoTiffProcessor::clearCache()
     m_image2Path.clear();
     m_hasImage1 = false;
     m_hasImage2 = false;
+    RasterTileCache::instance().clear();
+    m_statistics->clear();
+    SummaryPyramidCache::instance().clear();
+    SummedAreaTableCache::instance().clear();
+    DatasetCatalog::instance().clear();
     
     emit imagesChanged();
     
@@ -981,9 +2083,9 @@ QVariantList GeoTiffProcessor::getHistogramData(const QString &imagePath, int bi
     int height = band->GetYSize();
     int pixelCount = width * height;
     
-    // Read all data
+    // Read all data (blocchi decodificati in parallelo, un dataset per thread)
     std::vector<float> data(pixelCount);
-    CPLErr err = band->RasterIO(GF_Read, 0, 0, width, height, data.data(), width, height, GDT_Float32, 0, 0);
+    CPLErr err = RasterReader::readParallel(imagePath, 1, 0, 0, width, height, data.data(), GDT_Float32);
     
     if (err != CE_None) {
         qWarning() << "Failed to read raster data for histogram";
@@ -1128,3 +2230,104 @@ QVariantList GeoTiffProcessor::getHistogramData(const QString &imagePath, int bi
     qDebug() << "Generated histogram with" << bins << "bins (NaN/inf and upper outliers removed)";
     return result;
 }
+
+void GeoTiffProcessor::streamHistogram(const QString &imagePath, HistogramBuffer *buffer, int bins)
+{
+    if (imagePath.isEmpty() || buffer == nullptr) {
+        return;
+    }
+
+    // Il worker tiene solo i conteggi condivisi: se il buffer viene distrutto
+    // o riavviato la generazione cambia e lo stream si ferma
+    std::shared_ptr<HistogramCounts> counts = buffer->counts();
+    quint64 generation = counts->begin();
+    bins = qBound(2, bins, 65536);
+
+    QThreadPool::globalInstance()->start([imagePath, counts, generation, bins]() {
+        QElapsedTimer timer;
+        timer.start();
+
+        GDALDataset *dataset = (GDALDataset*)GDALOpen(imagePath.toUtf8().constData(), GA_ReadOnly);
+        if (dataset == nullptr) {
+            qWarning() << "Failed to open GeoTIFF for histogram:" << imagePath;
+            counts->finish(generation, false);
+            return;
+        }
+        GDALRasterBand *band = dataset->GetRasterBand(1);
+        int width = band->GetXSize();
+        int height = band->GetYSize();
+        int hasNoData = 0;
+        double noData = band->GetNoDataValue(&hasNoData);
+
+        // 1) Intervallo da un campione ridotto (nearest: conserva i valori reali),
+        //    con lo stesso limite superiore Q3 + 1.5*IQR di getHistogramData
+        double scale = std::min(1.0, 1024.0 / std::max(width, height));
+        int sampleWidth = std::max(1, static_cast<int>(width * scale));
+        int sampleHeight = std::max(1, static_cast<int>(height * scale));
+        std::vector<float> sample((size_t)sampleWidth * sampleHeight);
+        if (RasterReader::readBand(band, sample.data(), sampleWidth, sampleHeight, GDT_Float32,
+                                   ResampleMode::Nearest) != CE_None) {
+            qWarning() << "Failed to read histogram sample:" << CPLGetLastErrorMsg();
+            counts->finish(generation, false);
+            GDALClose(dataset);
+            return;
+        }
+        std::vector<float> validSample;
+        validSample.reserve(sample.size());
+        for (float value : sample) {
+            if (!std::isnan(value) && !std::isinf(value) && value != -9999.0f && !(hasNoData && value == noData)) {
+                validSample.push_back(value);
+            }
+        }
+        if (validSample.empty()) {
+            // Nessun valore valido: istogramma vuoto ma definitivo
+            counts->finish(generation, true);
+            GDALClose(dataset);
+            return;
+        }
+        std::sort(validSample.begin(), validSample.end());
+        size_t n = validSample.size();
+        float q1 = validSample[n / 4];
+        float q3 = validSample[3 * n / 4];
+        float upperBound = q3 + 1.5f * (q3 - q1);
+        float minVal = validSample.front();
+        float maxVal = *(std::upper_bound(validSample.begin(), validSample.end(), upperBound) - 1);
+        if (!counts->setRange(generation, bins, minVal, maxVal)) {
+            GDALClose(dataset);
+            return;
+        }
+
+        // 2) Piena risoluzione a strisce allineate ai blocchi, ognuna decodificata
+        //    in parallelo sul pool condiviso (readParallel apre i dataset dei worker)
+        int blockWidth = 0;
+        int blockHeight = 0;
+        band->GetBlockSize(&blockWidth, &blockHeight);
+        blockHeight = std::max(1, blockHeight);
+        int stripRows = std::max(1, static_cast<int>((64u * 1024u * 1024u) / (sizeof(float) * width)));
+        stripRows = std::max(blockHeight, stripRows / blockHeight * blockHeight);
+        std::vector<float> strip((size_t)width * std::min(stripRows, height));
+
+        bool cancelled = false;
+        for (int y0 = 0; y0 < height; y0 += stripRows) {
+            int rows = std::min(stripRows, height - y0);
+            if (RasterReader::readParallel(imagePath, 1, 0, y0, width, rows, strip.data(), GDT_Float32) != CE_None) {
+                qWarning() << "Failed to read raster data for histogram:" << CPLGetLastErrorMsg();
+                // Conteggi parziali: restano incompleti e marcati come falliti
+                counts->finish(generation, false);
+                GDALClose(dataset);
+                return;
+            }
+            if (!counts->accumulate(generation, strip.data(), (size_t)width * rows, hasNoData != 0, noData)) {
+                cancelled = true;
+                break;
+            }
+        }
+        GDALClose(dataset);
+
+        if (cancelled || !counts->finish(generation, true, true)) {
+            qDebug() << "Histogram stream superseded:" << imagePath;
+            return;
+        }
+        qDebug() << "Streamed histogram with" << bins << "bins in" << timer.elapsed() << "ms";
+    });
+}
@@ -6,7 +6,13 @@
 #include <QImage>
 #include <QQuickImageProvider>
 #include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
 #include <QVariantMap>
+#include <functional>
+#include "histogrambuffer.h"
+#include "statisticsservice.h"
+#include "rasteralgebra.h"
 
 // Forward declaration for GDAL
 class GDALDataset;
@@ -16,6 +22,15 @@ class GeoTiffProcessor : public QObject
     Q_OBJECT
     Q_PROPERTY(bool hasValidImages READ hasValidImages NOTIFY imagesChanged)
     Q_PROPERTY(bool hasShapefileSelected READ hasShapefileSelected NOTIFY shapefileChanged)
+    Q_PROPERTY(QString shapefileZip READ shapefileZip NOTIFY shapefileChanged)
+    Q_PROPERTY(bool sweepRunning READ sweepRunning NOTIFY sweepRunningChanged)
+    Q_PROPERTY(bool derivationRunning READ derivationRunning NOTIFY derivationRunningChanged)
+    Q_PROPERTY(QString resamplingMode READ resamplingMode WRITE setResamplingMode NOTIFY resamplingModeChanged)
+    Q_PROPERTY(QString rasterCacheFormat READ rasterCacheFormat WRITE setRasterCacheFormat NOTIFY rasterCacheFormatChanged)
+    Q_PROPERTY(QString tileCacheDirectory READ tileCacheDirectory WRITE setTileCacheDirectory NOTIFY tileCacheChanged)
+    Q_PROPERTY(int tileCacheLimitMB READ tileCacheLimitMB WRITE setTileCacheLimitMB NOTIFY tileCacheChanged)
+    Q_PROPERTY(int tileCacheUsedMB READ tileCacheUsedMB NOTIFY tileCacheChanged)
+    Q_PROPERTY(QString defaultTileCacheDirectory READ defaultTileCacheDirectory CONSTANT)
 
 public:
     explicit GeoTiffProcessor(QObject *parent = nullptr);
@@ -23,6 +38,25 @@ public:
 
     bool hasValidImages() const;
     bool hasShapefileSelected() const;
+    QString shapefileZip() const;
+    bool sweepRunning() const;
+    bool derivationRunning() const;
+
+    // Ricampionamento di default delle anteprime: nearest, average, bilinear, cubic, mode
+    QString resamplingMode() const;
+    void setResamplingMode(const QString &mode);
+
+    // Formato dei tile decodificati in memoria: float32, float16, uint16, uint8
+    QString rasterCacheFormat() const;
+    void setRasterCacheFormat(const QString &format);
+
+    // Cache persistente dei tile decodificati (DiskTileCache); cartella vuota = disattivata
+    QString tileCacheDirectory() const;
+    void setTileCacheDirectory(const QString &path);
+    int tileCacheLimitMB() const;
+    void setTileCacheLimitMB(int megabytes);
+    int tileCacheUsedMB() const;
+    QString defaultTileCacheDirectory() const;
 
 public slots:
     void setImage1(const QString &path);
@@ -31,10 +65,63 @@ public slots:
     void runAnalysis();
     void setDenoiseFlag(bool enabled);
     void setAreaThreshold(int threshold);
+    // Errore massimo (pixel sorgente) del transformer approssimato del warp
+    void setWarpErrorThreshold(double pixels);
     QVariantMap getImageStatistics(const QString &imagePath);
+    // Statistiche asincrone: restituisce un handle, il risultato arriva con
+    // statisticsReady. Una nuova richiesta sullo stesso canale annulla la precedente.
+    int requestStatistics(const QString &imagePath, const QString &channel = QString());
+    void cancelStatistics(const QString &channel);
+    // Stretch a percentile della viewport (coordinate normalizzate) dalla piramide
+    // di riepilogo già costruita dal provider; valid=false se non ancora disponibile
+    QVariantMap viewportStretch(const QString &imagePath, double x0, double y0, double x1, double y1,
+                                double lowPercent, double highPercent);
+    // Statistiche di una ROI (punti normalizzati {x, y}: 2 = rettangolo dagli angoli,
+    // 3+ = poligono) dalle tabelle a somme cumulate: O(1) per il rettangolo, una
+    // riga di scansione per riga del livello per il poligono. Se la tabella del
+    // livello adatto manca parte la costruzione e si ha pending=true; a tabella
+    // pronta arriva roiTablesReady e la query va ripetuta.
+    QVariantMap roiStatistics(const QString &imagePath, const QVariantList &points);
     QVariantList getHeightData(const QString &imagePath, int maxWidth, int maxHeight);
     QVariantList getHistogramData(const QString &imagePath, int bins);
+    // Istogramma a strisce in un worker, direttamente nei conteggi del buffer
+    // (HistogramItem si aggiorna man mano); un nuovo stream annulla il precedente
+    void streamHistogram(const QString &imagePath, HistogramBuffer *buffer, int bins);
     void clearCache();
+    void clearTileCache();
+    // Livelli della cache dei raster decodificati: MB in chiaro e compressi,
+    // rapporto di compressione, codec, latenza media/massima di decompressione (µs)
+    QVariantMap rasterCacheStats() const;
+    // Aggiorna tileCacheUsedMB (l'uso cresce dai thread del provider senza notifiche)
+    void refreshTileCache();
+
+    // Parameter sweep: esegue runAnalysis per ogni combinazione della griglia
+    // { "denoise": [true, false], "areaThreshold": [50, 70, 100], "maxConcurrent": 2 }
+    // e restituisce una tabella di confronto con thumbnail per variante. maxConcurrent
+    // varianti preparano input ed esito in parallelo; il backend .NET ne esegue una alla volta
+    void runParameterSweep(const QVariantMap &grid);
+    void cancelParameterSweep();
+
+    // Derivazione nativa degli input (RasterAlgebra) in background, GeoTIFF tiled
+    // DEFLATE; outputPath vuoto = <input>_ndvi.tif / <input>_chm.tif accanto all'input.
+    // NDVI: nirPath vuoto = stessa immagine multispettrale; bande 1-based.
+    // CHM: dtmPath vuoto = suolo stimato dal DSM (groundWindow pixel, 0 = automatico)
+    void deriveNdvi(const QString &redPath, int redBand, const QString &nirPath, int nirBand,
+                    const QString &outputPath = QString());
+    void deriveChm(const QString &dsmPath, const QString &dtmPath, int groundWindow = 0,
+                   const QString &outputPath = QString());
+    // Denoise nativo del raster intero (Denoise: median, gaussian, opening, raggio
+    // 1..3) con lo stesso filtro dell'anteprima; outputPath vuoto = <input>_<filtro>.tif
+    void denoiseRaster(const QString &inputPath, const QString &filter, int radius,
+                       const QString &outputPath = QString());
+    // Export a piena risoluzione di quanto mostrato (RasterExport) sullo stesso
+    // canale in background: derivationProgress, cancelDerivation, kind "export".
+    // colorMap -1 = RGB della base; basePath vuoto = solo maschera su nero;
+    // overlayColor vuoto = maschera in grigio; format: gtiff, cog, png
+    void exportRendered(const QString &basePath, int colorMap, const QString &overlayPath,
+                        const QString &overlayColor, double overlayOpacity, const QString &format,
+                        const QString &outputPath);
+    void cancelDerivation();
 
     // Allinea srcPath su refPath e restituisce QImage allineata (statica)
     static QImage warpImageToMatch(const QString &srcPath, const QString &refPath);
@@ -44,6 +131,19 @@ signals:
     void shapefileChanged();
     void analysisCompleted(const QString &resultPath, double fCov, double meanNdvi);
     void errorOccurred(const QString &errorMessage);
+    void sweepRunningChanged();
+    void resamplingModeChanged();
+    void rasterCacheFormatChanged();
+    void tileCacheChanged();
+    void sweepProgress(int completed, int total);
+    void sweepCompleted(const QString &sweepDir, const QVariantList &results);
+    void statisticsReady(int handle, const QString &imagePath, bool valid,
+                         double min, double max, double mean, double stdDev);
+    void roiTablesReady(const QString &imagePath);
+    void derivationRunningChanged();
+    void derivationProgress(double fraction);
+    // kind: "ndvi", "chm", "denoise" o "export"
+    void derivationCompleted(const QString &kind, const QString &outputPath, qint64 elapsedMs);
 
 private:
     QString m_image1Path;
@@ -54,13 +154,28 @@ private:
     bool m_denoiseFlag;
     int m_areaThreshold;
 
+    // Parameter sweep
+    QThreadPool m_sweepPool;
+    QAtomicInt m_sweepCancelled;
+    bool m_sweepRunning;
+
+    // Derivazione NDVI/CHM
+    QThreadPool m_derivationPool;
+    QAtomicInt m_derivationCancelled;
+    bool m_derivationRunning;
+    using DerivationJob = std::function<bool(QString *error, const RasterAlgebra::ProgressFunction &progress)>;
+    void startDerivation(const QString &kind, const QString &outputPath, const DerivationJob &job);
+
+    // Statistiche asincrone condivise tra i pannelli
+    StatisticsService *m_statistics;
+
     // Load GeoTIFF and validate
     bool loadGeoTiff(const QString &path);
     
-    // Call external DLL function
-    bool callRunAnalysis(const QString &dsmPath, const QString &ndviPath, 
-                         const QString &shapefileZip, QString &outputPath, 
-                         double &fCov, double &meanNdvi);
+    // Call external DLL function (statica: usata anche dai worker dello sweep)
+    static bool callRunAnalysis(const QString &dsmPath, const QString &ndviPath, 
+                                const QString &shapefileZip, bool denoise, int areaThreshold,
+                                QString &outputPath, double &fCov, double &meanNdvi);
 };
 
 // Image provider for displaying GeoTIFF with color maps
@@ -71,8 +186,7 @@ public:
     
     QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
 
-private:
-    QVector<QColor> getColorMapColors(int index);
+    static QVector<QColor> getColorMapColors(int index);
 };
 
 #endif // GEOTIFFPROCESSOR_H
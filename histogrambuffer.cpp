@@ -0,0 +1,213 @@
+#include "histogrambuffer.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+HistogramCounts::HistogramCounts()
+    : m_generation(0)
+{
+    m_lastNotify.start();
+}
+
+quint64 HistogramCounts::begin()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_counts.clear();
+    m_summary = Summary();
+    m_summary.revision = m_generation;
+    notifyLocked(true);
+    return m_generation;
+}
+
+bool HistogramCounts::isCurrent(quint64 generation) const
+{
+    QMutexLocker locker(&m_mutex);
+    return generation == m_generation;
+}
+
+bool HistogramCounts::setRange(quint64 generation, int bins, double minValue, double maxValue)
+{
+    QMutexLocker locker(&m_mutex);
+    if (generation != m_generation) {
+        return false;
+    }
+    m_counts = QVector<quint32>(std::max(2, bins), 0);
+    m_summary.bins = m_counts.size();
+    m_summary.minValue = minValue;
+    m_summary.maxValue = maxValue > minValue ? maxValue : minValue + 1.0;
+    m_summary.maxCount = 0;
+    m_summary.totalCount = 0;
+    m_summary.revision++;
+    notifyLocked(true);
+    return true;
+}
+
+bool HistogramCounts::accumulate(quint64 generation, const float *values, size_t count, bool hasNoData, double noData)
+{
+    QMutexLocker locker(&m_mutex);
+    if (generation != m_generation || m_counts.isEmpty()) {
+        return false;
+    }
+
+    // Stessa mappatura di getHistogramData: bin = normalized * (bins - 1)
+    const int bins = m_counts.size();
+    const double minValue = m_summary.minValue;
+    const double maxValue = m_summary.maxValue;
+    const double scale = (bins - 1) / (maxValue - minValue);
+    quint32 *data = m_counts.data();
+    quint64 added = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        float value = values[i];
+        if (std::isnan(value) || std::isinf(value) || value == -9999.0f || (hasNoData && value == noData)) {
+            continue;
+        }
+        if (value > maxValue) {
+            continue;
+        }
+        int binIndex = static_cast<int>((value - minValue) * scale);
+        binIndex = std::max(0, std::min(bins - 1, binIndex));
+        quint32 binCount = ++data[binIndex];
+        m_summary.maxCount = std::max<quint64>(m_summary.maxCount, binCount);
+        ++added;
+    }
+
+    m_summary.totalCount += added;
+    m_summary.revision++;
+    notifyLocked(false);
+    return true;
+}
+
+bool HistogramCounts::finish(quint64 generation, bool ok, bool suppressPeaks)
+{
+    QMutexLocker locker(&m_mutex);
+    if (generation != m_generation) {
+        return false;
+    }
+
+    if (!ok) {
+        m_summary.complete = false;
+        m_summary.failed = true;
+        m_summary.revision++;
+        notifyLocked(true);
+        return true;
+    }
+
+    if (suppressPeaks && !m_counts.isEmpty()) {
+        std::vector<quint32> binCounts;
+        for (quint32 count : m_counts) {
+            if (count > 0) binCounts.push_back(count);
+        }
+        if (!binCounts.empty()) {
+            std::sort(binCounts.begin(), binCounts.end());
+            qint64 q1 = binCounts[binCounts.size() / 4];
+            qint64 q3 = binCounts[3 * binCounts.size() / 4];
+            qint64 upperBound = q3 + 3 * (q3 - q1);
+            int removedBins = 0;
+            for (quint32 &count : m_counts) {
+                if (count > upperBound) {
+                    m_summary.totalCount -= count;
+                    count = 0;
+                    removedBins++;
+                }
+            }
+            qDebug() << "Histogram peak suppression: removed" << removedBins << "anomalous bins";
+        }
+    }
+
+    m_summary.maxCount = 0;
+    for (quint32 count : m_counts) {
+        m_summary.maxCount = std::max<quint64>(m_summary.maxCount, count);
+    }
+    m_summary.complete = true;
+    m_summary.revision++;
+    notifyLocked(true);
+    return true;
+}
+
+HistogramCounts::Summary HistogramCounts::summary() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_summary;
+}
+
+QVector<quint32> HistogramCounts::counts() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_counts;
+}
+
+void HistogramCounts::setNotifier(std::function<void()> notifier)
+{
+    QMutexLocker locker(&m_mutex);
+    m_notifier = std::move(notifier);
+}
+
+void HistogramCounts::notifyLocked(bool force)
+{
+    // Aggiornamenti live a ~25 Hz: il render accorpa comunque per frame
+    if (!m_notifier || (!force && m_lastNotify.elapsed() < 40)) {
+        return;
+    }
+    m_lastNotify.restart();
+    m_notifier();
+}
+
+HistogramBuffer::HistogramBuffer(QObject *parent)
+    : QObject(parent)
+    , m_counts(std::make_shared<HistogramCounts>())
+{
+    // Il riempimento può sopravvivere al buffer: il notifier viene rimosso
+    // nel distruttore e le chiamate accodate verso un oggetto distrutto sono scartate
+    m_counts->setNotifier([this] {
+        QMetaObject::invokeMethod(this, "changed", Qt::QueuedConnection);
+    });
+}
+
+HistogramBuffer::~HistogramBuffer()
+{
+    m_counts->setNotifier(nullptr);
+    m_counts->begin();
+}
+
+int HistogramBuffer::bins() const
+{
+    return m_counts->summary().bins;
+}
+
+double HistogramBuffer::minValue() const
+{
+    return m_counts->summary().minValue;
+}
+
+double HistogramBuffer::maxValue() const
+{
+    return m_counts->summary().maxValue;
+}
+
+double HistogramBuffer::maxCount() const
+{
+    return static_cast<double>(m_counts->summary().maxCount);
+}
+
+double HistogramBuffer::totalCount() const
+{
+    return static_cast<double>(m_counts->summary().totalCount);
+}
+
+bool HistogramBuffer::complete() const
+{
+    return m_counts->summary().complete;
+}
+
+bool HistogramBuffer::failed() const
+{
+    return m_counts->summary().failed;
+}
+
+void HistogramBuffer::clear()
+{
+    m_counts->begin();
+}
@@ -0,0 +1,96 @@
+#ifndef HISTOGRAMBUFFER_H
+#define HISTOGRAMBUFFER_H
+
+#include <QObject>
+#include <QVector>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <functional>
+#include <memory>
+
+// Conteggi impacchettati condivisi tra chi riempie l'istogramma (thread di
+// lavoro, a strisce) e chi lo disegna (HistogramItem nel thread di render).
+// Ogni riempimento ha una generazione: begin() invalida quelli in corso.
+class HistogramCounts
+{
+public:
+    struct Summary
+    {
+        int bins = 0;
+        double minValue = 0.0;
+        double maxValue = 0.0;
+        quint64 maxCount = 0;
+        quint64 totalCount = 0;
+        bool complete = false;
+        bool failed = false;     // lettura fallita: i conteggi sono parziali
+        quint64 revision = 0;
+    };
+
+    HistogramCounts();
+
+    quint64 begin();
+    bool isCurrent(quint64 generation) const;
+    bool setRange(quint64 generation, int bins, double minValue, double maxValue);
+
+    // Aggiunge un blocco di valori; NaN/inf, -9999, nodata e valori oltre
+    // maxValue sono esclusi, quelli sotto minValue finiscono nel primo bin
+    bool accumulate(quint64 generation, const float *values, size_t count, bool hasNoData, double noData);
+
+    // Chiude il riempimento. Con ok falso (lettura fallita) i conteggi restano
+    // incompleti e il riepilogo è marcato failed; altrimenti suppressPeaks
+    // azzera i bin anomali (IQR x3 sui conteggi)
+    bool finish(quint64 generation, bool ok, bool suppressPeaks = true);
+
+    Summary summary() const;
+    QVector<quint32> counts() const;    // copia implicitamente condivisa
+
+    // Chiamato (sotto lock) quando i conteggi cambiano, al più ogni ~40 ms
+    void setNotifier(std::function<void()> notifier);
+
+private:
+    void notifyLocked(bool force);
+
+    mutable QMutex m_mutex;
+    QVector<quint32> m_counts;
+    Summary m_summary;
+    quint64 m_generation;
+    std::function<void()> m_notifier;
+    QElapsedTimer m_lastNotify;
+};
+
+// Wrapper QML dei conteggi: proprietà di riepilogo per assi ed etichette
+class HistogramBuffer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int bins READ bins NOTIFY changed)
+    Q_PROPERTY(double minValue READ minValue NOTIFY changed)
+    Q_PROPERTY(double maxValue READ maxValue NOTIFY changed)
+    Q_PROPERTY(double maxCount READ maxCount NOTIFY changed)
+    Q_PROPERTY(double totalCount READ totalCount NOTIFY changed)
+    Q_PROPERTY(bool complete READ complete NOTIFY changed)
+    Q_PROPERTY(bool failed READ failed NOTIFY changed)
+
+public:
+    explicit HistogramBuffer(QObject *parent = nullptr);
+    ~HistogramBuffer();
+
+    std::shared_ptr<HistogramCounts> counts() const { return m_counts; }
+
+    int bins() const;
+    double minValue() const;
+    double maxValue() const;
+    double maxCount() const;
+    double totalCount() const;
+    bool complete() const;
+    bool failed() const;
+
+    Q_INVOKABLE void clear();
+
+signals:
+    void changed();
+
+private:
+    std::shared_ptr<HistogramCounts> m_counts;
+};
+
+#endif // HISTOGRAMBUFFER_H
@@ -0,0 +1,128 @@
+#include "histogramitem.h"
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+HistogramItem::HistogramItem(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_logScale(false)
+    , m_color("#4a90e2")
+{
+    setFlag(ItemHasContents, true);
+}
+
+void HistogramItem::setBuffer(HistogramBuffer *buffer)
+{
+    if (m_buffer == buffer) {
+        return;
+    }
+    if (m_buffer) {
+        disconnect(m_buffer, nullptr, this, nullptr);
+    }
+    m_buffer = buffer;
+    if (m_buffer) {
+        connect(m_buffer, &HistogramBuffer::changed, this, &QQuickItem::update);
+    }
+    emit bufferChanged();
+    update();
+}
+
+void HistogramItem::setLogScale(bool logScale)
+{
+    if (m_logScale == logScale) {
+        return;
+    }
+    m_logScale = logScale;
+    emit logScaleChanged();
+    update();
+}
+
+void HistogramItem::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+    m_color = color;
+    emit colorChanged();
+    update();
+}
+
+void HistogramItem::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        update();
+    }
+}
+
+QSGNode *HistogramItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    QVector<quint32> counts = m_buffer ? m_buffer->counts()->counts() : QVector<quint32>();
+    const double w = width();
+    const double h = height();
+    if (counts.isEmpty() || w <= 0.0 || h <= 0.0) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    // Una colonna per bin, o per pixel se i bin sono più dei pixel
+    const int bins = counts.size();
+    const int columns = std::max(1, std::min(bins, static_cast<int>(w)));
+    std::vector<quint32> columnCounts(columns, 0);
+    quint32 maxCount = 0;
+    for (int i = 0; i < bins; ++i) {
+        int column = static_cast<int>((qint64)i * columns / bins);
+        columnCounts[column] = std::max(columnCounts[column], counts[i]);
+        maxCount = std::max(maxCount, counts[i]);
+    }
+
+    auto *node = static_cast<QSGGeometryNode *>(oldNode);
+    if (!node) {
+        node = new QSGGeometryNode;
+        auto *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+        geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+        node->setGeometry(geometry);
+        node->setFlag(QSGNode::OwnsGeometry);
+        node->setMaterial(new QSGFlatColorMaterial);
+        node->setFlag(QSGNode::OwnsMaterial);
+    }
+
+    auto *material = static_cast<QSGFlatColorMaterial *>(node->material());
+    if (material->color() != m_color) {
+        material->setColor(m_color);
+        node->markDirty(QSGNode::DirtyMaterial);
+    }
+
+    // Due triangoli per colonna; 1 px di separazione finché le barre sono larghe
+    QSGGeometry *geometry = node->geometry();
+    geometry->allocate(columns * 6);
+    QSGGeometry::Point2D *vertices = geometry->vertexDataAsPoint2D();
+    const double columnWidth = w / columns;
+    const double gap = columnWidth >= 3.0 ? 1.0 : 0.0;
+    const double logMax = std::log1p(static_cast<double>(maxCount));
+
+    for (int c = 0; c < columns; ++c) {
+        double fraction = 0.0;
+        if (maxCount > 0) {
+            fraction = m_logScale ? std::log1p(static_cast<double>(columnCounts[c])) / logMax
+                                  : static_cast<double>(columnCounts[c]) / maxCount;
+        }
+        float x0 = static_cast<float>(c * columnWidth);
+        float x1 = static_cast<float>((c + 1) * columnWidth - gap);
+        float y0 = static_cast<float>(h - fraction * h);
+        float y1 = static_cast<float>(h);
+
+        QSGGeometry::Point2D *v = vertices + c * 6;
+        v[0].set(x0, y0);
+        v[1].set(x1, y0);
+        v[2].set(x0, y1);
+        v[3].set(x1, y0);
+        v[4].set(x1, y1);
+        v[5].set(x0, y1);
+    }
+    node->markDirty(QSGNode::DirtyGeometry);
+
+    return node;
+}
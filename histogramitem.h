@@ -0,0 +1,46 @@
+#ifndef HISTOGRAMITEM_H
+#define HISTOGRAMITEM_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QPointer>
+#include "histogrambuffer.h"
+
+// Barre dell'istogramma disegnate con un unico QSGGeometryNode a partire dai
+// conteggi impacchettati di HistogramBuffer: nessun passaggio dal motore JS.
+// Con più bin che pixel le colonne mostrano il massimo dei bin coperti.
+class HistogramItem : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(HistogramBuffer *buffer READ buffer WRITE setBuffer NOTIFY bufferChanged)
+    Q_PROPERTY(bool logScale READ logScale WRITE setLogScale NOTIFY logScaleChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+
+public:
+    explicit HistogramItem(QQuickItem *parent = nullptr);
+
+    HistogramBuffer *buffer() const { return m_buffer; }
+    void setBuffer(HistogramBuffer *buffer);
+
+    bool logScale() const { return m_logScale; }
+    void setLogScale(bool logScale);
+
+    QColor color() const { return m_color; }
+    void setColor(const QColor &color);
+
+signals:
+    void bufferChanged();
+    void logScaleChanged();
+    void colorChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+
+private:
+    QPointer<HistogramBuffer> m_buffer;
+    bool m_logScale;
+    QColor m_color;
+};
+
+#endif // HISTOGRAMITEM_H
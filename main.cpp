@@ -3,15 +3,72 @@
 #include <QQmlContext>
 #include <QQuickStyle>
 #include <QDebug>
-#include <QImageReader>
 #include "geotiffprocessor.h"
+#include "textureprovider.h"
+#include "memorygovernor.h"
+#include "histogramitem.h"
+#include "contouroverlay.h"
+#include "boundaryoverlay.h"
+#include "prefetchscheduler.h"
+#include "rastermetadata.h"
+#include "rastertilecache.h"
+#include "summarypyramid.h"
+#include "summedareatable.h"
+#include "warpgridcache.h"
+#include "benchmarks.h"
+#include "tileserver.h"
 #include <gdal_priv.h>
 
+namespace {
+
+// Budget di memoria unico: il governor imposta GDAL_CACHEMAX e il limite di
+// allocazione di QImageReader (prima fisso a 2 GB) e riduce le cache registrate.
+// Creato nel thread principale in tutte le modalità, anche headless: le cache
+// lo notificano dai thread di lavoro e non devono crearlo lì
+MemoryGovernor *setupMemoryGovernor()
+{
+    MemoryGovernor *memoryGovernor = MemoryGovernor::instance();
+    memoryGovernor->registerConsumer("Decoded rasters", MemoryGovernor::Normal,
+                                     [] { return RasterTileCache::instance().usedBytes(); },
+                                     [](qint64 target) { return RasterTileCache::instance().trim(target); });
+    memoryGovernor->registerConsumer("Summary pyramids", MemoryGovernor::Normal,
+                                     [] { return SummaryPyramidCache::instance().usedBytes(); },
+                                     [](qint64 target) { return SummaryPyramidCache::instance().trim(target); });
+    memoryGovernor->registerConsumer("ROI tables", MemoryGovernor::Normal,
+                                     [] { return SummedAreaTableCache::instance().usedBytes(); },
+                                     [](qint64 target) { return SummedAreaTableCache::instance().trim(target); });
+    memoryGovernor->registerConsumer("Warp grids", MemoryGovernor::Low,
+                                     [] { return static_cast<qint64>(WarpGridCache::instance().usedBytes()); },
+                                     [](qint64 target) {
+                                         return static_cast<qint64>(WarpGridCache::instance().trim(static_cast<size_t>(target)));
+                                     });
+    memoryGovernor->registerConsumer("Boundaries", MemoryGovernor::Low,
+                                     [] { return static_cast<qint64>(BoundaryStoreCache::instance().usedBytes()); },
+                                     [](qint64 target) {
+                                         return static_cast<qint64>(BoundaryStoreCache::instance().trim(static_cast<size_t>(target)));
+                                     });
+    return memoryGovernor;
+}
+
+} // namespace
+
 int main(int argc, char *argv[])
 {
-    // Increase image allocation limit for large GeoTIFF files
-    // Default is 256 MB, increase to 2 GB for high-resolution imagery
-    QImageReader::setAllocationLimit(2048);  // 2048 MB = 2 GB
+    // Benchmark headless: OliveM_Viewer --benchmark <nome> [argomenti...]
+    if (argc > 1 && qstrcmp(argv[1], "--benchmark") == 0) {
+        QCoreApplication app(argc, argv);
+        GDALAllRegister();
+        setupMemoryGovernor();
+        return runBenchmark(app.arguments().mid(2));
+    }
+    
+    // Tile server headless: OliveM_Viewer --serve <raster.tif> [--port N] ...
+    if (argc > 1 && qstrcmp(argv[1], "--serve") == 0) {
+        QCoreApplication app(argc, argv);
+        GDALAllRegister();
+        setupMemoryGovernor();
+        return runTileServer(app.arguments().mid(2));
+    }
     
     QGuiApplication app(argc, argv);
     
@@ -19,6 +76,8 @@ int main(int argc, char *argv[])
     GDALAllRegister();
     qDebug() << "GDAL initialized, version:" << GDALVersionInfo("VERSION_NUM");
     
+    MemoryGovernor *memoryGovernor = setupMemoryGovernor();
+    
     // Set application information
     app.setApplicationName("OM Tree Crown Segmentation Tool");
     app.setOrganizationName("OliveAnalysis");
@@ -29,11 +88,20 @@ int main(int argc, char *argv[])
     
     // Register types
     qmlRegisterType<GeoTiffProcessor>("GeoTiffProcessor", 1, 0, "GeoTiffProcessor");
+    qmlRegisterType<HistogramBuffer>("GeoTiffProcessor", 1, 0, "HistogramBuffer");
+    qmlRegisterType<HistogramItem>("GeoTiffProcessor", 1, 0, "HistogramItem");
+    qmlRegisterType<ContourOverlay>("GeoTiffProcessor", 1, 0, "ContourOverlay");
+    qmlRegisterType<BoundaryOverlay>("GeoTiffProcessor", 1, 0, "BoundaryOverlay");
+    qmlRegisterType<PrefetchScheduler>("GeoTiffProcessor", 1, 0, "PrefetchScheduler");
+    qmlRegisterType<RasterMetadata>("GeoTiffProcessor", 1, 0, "RasterMetadata");
+    qmlRegisterSingletonInstance("GeoTiffProcessor", 1, 0, "MemoryGovernor", memoryGovernor);
     
     QQmlApplicationEngine engine;
     
     // Add image provider
     engine.addImageProvider("geotiff", new GeoTiffImageProvider());
+    // Stessi id come texture già nel formato di upload, condivise fra i pannelli
+    engine.addImageProvider("geotifftex", new GeoTiffTextureProvider());
     
     // Load main QML file
     const QUrl url(QStringLiteral("qrc:/main.qml"));
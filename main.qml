@@ -26,6 +26,12 @@ ApplicationWindow {
     // Settings
     property bool denoiseEnabled: true
     property int areaThreshold: 70
+    property string previewResampling: "average"
+    property int memoryBudgetMB: 2048
+    property string rasterCacheFormat: "uint16"   // tile decodificati in memoria
+    property bool tileCacheEnabled: true
+    property string tileCacheDirectory: ""     // vuoto = cartella di cache dell'utente
+    property int tileCacheLimitMB: 2048
     
     // Persistent settings
     Settings {
@@ -35,11 +41,32 @@ ApplicationWindow {
         property alias isDarkTheme: mainWindow.isDarkTheme
         property alias denoiseEnabled: mainWindow.denoiseEnabled
         property alias areaThreshold: mainWindow.areaThreshold
+        property alias previewResampling: mainWindow.previewResampling
+        property alias memoryBudgetMB: mainWindow.memoryBudgetMB
+        property alias rasterCacheFormat: mainWindow.rasterCacheFormat
+        property alias tileCacheEnabled: mainWindow.tileCacheEnabled
+        property alias tileCacheDirectory: mainWindow.tileCacheDirectory
+        property alias tileCacheLimitMB: mainWindow.tileCacheLimitMB
+    }
+    
+    // Budget unico per cache GDAL, raster decodificati e anteprime
+    Binding {
+        target: MemoryGovernor
+        property: "budgetMB"
+        value: mainWindow.memoryBudgetMB
     }
     
     // Processor backend
     GeoTiffProcessor {
         id: processor
+        resamplingMode: mainWindow.previewResampling
+        rasterCacheFormat: mainWindow.rasterCacheFormat
+        // Tile decodificati persistenti tra le sessioni
+        tileCacheLimitMB: mainWindow.tileCacheLimitMB
+        tileCacheDirectory: mainWindow.tileCacheEnabled
+                            ? (mainWindow.tileCacheDirectory !== "" ? mainWindow.tileCacheDirectory
+                                                                    : defaultTileCacheDirectory)
+                            : ""
         onAnalysisCompleted: (resultPath, param1, param2) => {
             // Always update result - dual layer system handles both RGB and result
             resultImage.updateImage(resultPath)
@@ -50,6 +77,14 @@ ApplicationWindow {
             errorDialog.text = errorMessage
             errorDialog.open()
         }
+        onSweepProgress: (completed, total) => {
+            sweepDialog.completed = completed
+            sweepDialog.total = total
+        }
+        onSweepCompleted: (sweepDir, results) => {
+            console.log("Parameter sweep completed in:", sweepDir)
+            sweepDialog.results = results
+        }
     }
     
     // Color maps definition (verified correct order)
@@ -127,7 +162,93 @@ ApplicationWindow {
                     ToolTip.text: "Reset System"
                 }
                 
+                // Parameter sweep button
+                ToolButton {
+                    implicitWidth: 40
+                    implicitHeight: 40
+                    enabled: processor.hasValidImages
+                    
+                    contentItem: Text {
+                        text: "▦"
+                        font.pixelSize: 22
+                        color: parent.enabled ? mainWindow.textColor : "#666666"
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    
+                    background: Rectangle {
+                        color: parent.pressed ? mainWindow.buttonPressedColor : 
+                               (parent.hovered ? mainWindow.buttonHoverColor : mainWindow.buttonColor)
+                        radius: 4
+                    }
+                    
+                    onClicked: sweepDialog.open()
+                    
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Parameter Sweep"
+                }
+                
+                // NDVI / CHM derivation button
+                ToolButton {
+                    implicitWidth: 40
+                    implicitHeight: 40
+                    
+                    contentItem: Text {
+                        text: "ƒ"
+                        font.pixelSize: 22
+                        color: mainWindow.textColor
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                    }
+                    
+                    background: Rectangle {
+                        color: parent.pressed ? mainWindow.buttonPressedColor : 
+                               (parent.hovered ? mainWindow.buttonHoverColor : mainWindow.buttonColor)
+                        radius: 4
+                    }
+                    
+                    onClicked: deriveDialog.open()
+                    
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Derive NDVI / CHM"
+                }
+                
                 Item { Layout.fillWidth: true }
+                
+                // Uso memoria in tempo reale (MemoryGovernor)
+                Label {
+                    text: "Memory: " + MemoryGovernor.usedMB + " / " + MemoryGovernor.budgetMB + " MB"
+                    font.pixelSize: 11
+                    color: MemoryGovernor.usedMB > MemoryGovernor.budgetMB * 0.9 ? "#ff6666" : mainWindow.textSecondaryColor
+                    Layout.rightMargin: 10
+                    
+                    MouseArea {
+                        id: memoryHover
+                        anchors.fill: parent
+                        hoverEnabled: true
+                    }
+                    
+                    ToolTip.visible: memoryHover.containsMouse
+                    ToolTip.text: {
+                        var lines = []
+                        var consumers = MemoryGovernor.consumers
+                        for (var i = 0; i < consumers.length; ++i) {
+                            lines.push(consumers[i].name + ": " + consumers[i].usedMB.toFixed(1) + " MB")
+                        }
+                        lines.push("GDAL_CACHEMAX: " + MemoryGovernor.gdalCacheMB + " MB")
+                        // Livello compresso dei raster decodificati
+                        var tiles = processor.rasterCacheStats()
+                        lines.push("Decoded tiles: " + tiles.hotTiles + " as " + tiles.format
+                                   + ", " + tiles.hotMB.toFixed(1) + " MB")
+                        if (tiles.coldTiles > 0) {
+                            lines.push("Compressed tiles: " + tiles.coldTiles + " (" + tiles.codec + ", "
+                                       + tiles.ratio.toFixed(1) + ":1, decompress "
+                                       + tiles.decompressMeanUs.toFixed(0) + " µs avg / "
+                                       + tiles.decompressMaxUs.toFixed(0) + " µs max)")
+                        }
+                        return lines.join("\n")
+                    }
+                }
             }
         }
         
@@ -231,6 +352,7 @@ ApplicationWindow {
                         panelTitle: "Input DSM"
                         colorMaps: mainWindow.colorMaps
                         processor: processor
+                        boundarySource: processor.shapefileZip
                         themeColors: ({
                             panelColor: mainWindow.panelColor,
                             borderColor: mainWindow.borderColor,
@@ -259,6 +381,9 @@ ApplicationWindow {
                         panelTitle: "Input NDVI"
                         colorMaps: mainWindow.colorMaps
                         processor: processor
+                        // Curve di livello del DSM sopra l'NDVI (stessa area)
+                        contourSource: image1Panel.imagePath
+                        boundarySource: processor.shapefileZip
                         themeColors: ({
                             panelColor: mainWindow.panelColor,
                             borderColor: mainWindow.borderColor,
@@ -325,6 +450,7 @@ ApplicationWindow {
                             anchors.fill: parent
                             anchors.margins: 5
                             displayPath: rgbImagePath !== "" ? rgbImagePath : ""
+                            processor: processor
                         }
                     }
                 }
@@ -464,15 +590,22 @@ ApplicationWindow {
         id: settingsDialog
         title: "Settings"
         width: 400
-        height: 350
+        height: 660
         modal: true
         anchors.centerIn: parent
         standardButtons: Dialog.Ok | Dialog.Cancel
         
+        onOpened: processor.refreshTileCache()
         onAccepted: {
             mainWindow.isDarkTheme = darkThemeRadio.checked
             mainWindow.denoiseEnabled = denoiseCheck.checked
             mainWindow.areaThreshold = areaSlider.value
+            mainWindow.previewResampling = resamplingCombo.currentText
+            mainWindow.memoryBudgetMB = memoryBudgetSpin.value
+            mainWindow.rasterCacheFormat = cacheFormatCombo.currentText
+            mainWindow.tileCacheEnabled = tileCacheCheck.checked
+            mainWindow.tileCacheDirectory = tileCacheDirField.text.trim()
+            mainWindow.tileCacheLimitMB = tileCacheLimitSpin.value
             
             // Update processor settings
             processor.setDenoiseFlag(mainWindow.denoiseEnabled)
@@ -537,11 +670,486 @@ ApplicationWindow {
                         enabled: denoiseCheck.checked
                         opacity: denoiseCheck.checked ? 1.0 : 0.5
                     }
+                    
+                    RowLayout {
+                        Layout.fillWidth: true
+                        spacing: 10
+                        
+                        Label {
+                            text: "Preview resampling:"
+                            font.pixelSize: 11
+                        }
+                        
+                        ComboBox {
+                            id: resamplingCombo
+                            Layout.fillWidth: true
+                            model: ["nearest", "average", "bilinear", "cubic"]
+                            currentIndex: Math.max(0, model.indexOf(mainWindow.previewResampling))
+                        }
+                    }
+                }
+            }
+            
+            // Memory section
+            GroupBox {
+                title: "Memory"
+                Layout.fillWidth: true
+                
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: 10
+                    
+                    RowLayout {
+                        Layout.fillWidth: true
+                        spacing: 10
+                        
+                        Label {
+                            text: "Cache budget (MB):"
+                            font.pixelSize: 11
+                        }
+                        
+                        SpinBox {
+                            id: memoryBudgetSpin
+                            Layout.fillWidth: true
+                            from: 256
+                            to: 32768
+                            stepSize: 256
+                            editable: true
+                            value: mainWindow.memoryBudgetMB
+                        }
+                    }
+                    
+                    RowLayout {
+                        Layout.fillWidth: true
+                        spacing: 10
+                        
+                        Label {
+                            text: "Decoded tiles as:"
+                            font.pixelSize: 11
+                        }
+                        
+                        // uint16 per tile: metà dei float, errore di pochi mm su un DSM
+                        ComboBox {
+                            id: cacheFormatCombo
+                            Layout.fillWidth: true
+                            model: ["float32", "float16", "uint16", "uint8"]
+                            currentIndex: Math.max(0, model.indexOf(mainWindow.rasterCacheFormat))
+                        }
+                    }
+                    
+                    Label {
+                        text: "In use: " + MemoryGovernor.usedMB + " MB, GDAL cache " + MemoryGovernor.gdalCacheMB
+                              + " MB, preview " + MemoryGovernor.maxPreviewSize + " px"
+                        font.pixelSize: 11
+                        opacity: 0.7
+                    }
+                }
+            }
+            
+            // Cache su disco dei tile decodificati (riapertura senza ridecodificare)
+            GroupBox {
+                title: "Disk Tile Cache"
+                Layout.fillWidth: true
+                
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: 10
+                    
+                    CheckBox {
+                        id: tileCacheCheck
+                        text: "Keep decoded tiles between sessions"
+                        checked: mainWindow.tileCacheEnabled
+                    }
+                    
+                    TextField {
+                        id: tileCacheDirField
+                        Layout.fillWidth: true
+                        enabled: tileCacheCheck.checked
+                        text: mainWindow.tileCacheDirectory
+                        placeholderText: processor.defaultTileCacheDirectory
+                        font.pixelSize: 11
+                    }
+                    
+                    RowLayout {
+                        Layout.fillWidth: true
+                        spacing: 10
+                        enabled: tileCacheCheck.checked
+                        
+                        Label {
+                            text: "Limit (MB):"
+                            font.pixelSize: 11
+                        }
+                        
+                        SpinBox {
+                            id: tileCacheLimitSpin
+                            Layout.fillWidth: true
+                            from: 64
+                            to: 262144
+                            stepSize: 512
+                            editable: true
+                            value: mainWindow.tileCacheLimitMB
+                        }
+                        
+                        Button {
+                            text: "Clear"
+                            onClicked: processor.clearTileCache()
+                        }
+                    }
+                    
+                    Label {
+                        text: processor.tileCacheDirectory !== ""
+                              ? "On disk: " + processor.tileCacheUsedMB + " MB"
+                              : "Disabled"
+                        font.pixelSize: 11
+                        opacity: 0.7
+                    }
+                }
+            }
+        }
+    }
+    
+    // Parameter sweep dialog
+    Dialog {
+        id: sweepDialog
+        title: "Parameter Sweep"
+        width: 640
+        height: 560
+        modal: false
+        anchors.centerIn: parent
+        standardButtons: Dialog.Close
+        
+        property int completed: 0
+        property int total: 0
+        property var results: []
+        
+        function parseThresholds() {
+            var values = []
+            var parts = thresholdsField.text.split(",")
+            for (var i = 0; i < parts.length; ++i) {
+                var value = parseInt(parts[i].trim())
+                if (!isNaN(value) && value > 0) values.push(value)
+            }
+            return values
+        }
+        
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: 10
+            
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+                
+                Label { text: "Area thresholds:" }
+                TextField {
+                    id: thresholdsField
+                    Layout.fillWidth: true
+                    text: "50, 70, 100"
+                    placeholderText: "e.g. 50, 70, 100"
+                }
+            }
+            
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+                
+                CheckBox { id: sweepDenoiseOn; text: "Denoise on"; checked: true }
+                CheckBox { id: sweepDenoiseOff; text: "Denoise off"; checked: true }
+                Item { Layout.fillWidth: true }
+                Label { text: "Parallel runs:" }
+                SpinBox { id: sweepConcurrency; from: 1; to: 8; value: 2 }
+            }
+            
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+                
+                Button {
+                    text: "Run Sweep"
+                    enabled: !processor.sweepRunning && processor.hasValidImages
+                    onClicked: {
+                        if (!processor.hasShapefileSelected) {
+                            errorDialog.text = "Shapefile archive is required for the parameter sweep."
+                            errorDialog.open()
+                            return
+                        }
+                        var denoise = []
+                        if (sweepDenoiseOn.checked) denoise.push(true)
+                        if (sweepDenoiseOff.checked) denoise.push(false)
+                        sweepDialog.results = []
+                        sweepDialog.completed = 0
+                        processor.runParameterSweep({
+                            denoise: denoise,
+                            areaThreshold: sweepDialog.parseThresholds(),
+                            maxConcurrent: sweepConcurrency.value
+                        })
+                    }
+                }
+                
+                Button {
+                    text: "Cancel"
+                    enabled: processor.sweepRunning
+                    onClicked: processor.cancelParameterSweep()
+                }
+                
+                ProgressBar {
+                    Layout.fillWidth: true
+                    from: 0
+                    to: Math.max(1, sweepDialog.total)
+                    value: sweepDialog.completed
+                    visible: processor.sweepRunning || sweepDialog.results.length > 0
+                }
+            }
+            
+            // Comparison table: click a row to show that result
+            ListView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                clip: true
+                spacing: 4
+                model: sweepDialog.results
+                
+                delegate: Rectangle {
+                    width: ListView.view.width
+                    height: 72
+                    color: rowArea.containsMouse ? mainWindow.buttonHoverColor : mainWindow.panelColor
+                    border.color: mainWindow.borderColor
+                    border.width: 1
+                    radius: 3
+                    
+                    RowLayout {
+                        anchors.fill: parent
+                        anchors.margins: 4
+                        spacing: 10
+                        
+                        Image {
+                            Layout.preferredWidth: 64
+                            Layout.preferredHeight: 64
+                            fillMode: Image.PreserveAspectFit
+                            cache: false
+                            source: modelData.thumbnail !== undefined ? modelData.thumbnail : ""
+                        }
+                        
+                        Label {
+                            Layout.fillWidth: true
+                            color: mainWindow.textColor
+                            font.pixelSize: 11
+                            text: "Denoise: " + (modelData.denoise ? "on" : "off")
+                                  + "   Area threshold: " + modelData.areaThreshold
+                                  + "   [" + modelData.status + "]\n"
+                                  + (modelData.status === "ok"
+                                     ? "fCov " + modelData.fCov.toFixed(4)
+                                       + "   Mean NDVI " + modelData.meanNdvi.toFixed(4)
+                                       + "   Crowns " + ((modelData.crownFraction || 0) * 100).toFixed(1) + "%"
+                                       + "   " + (modelData.elapsedMs / 1000).toFixed(1) + " s"
+                                     : "")
+                        }
+                    }
+                    
+                    MouseArea {
+                        id: rowArea
+                        anchors.fill: parent
+                        hoverEnabled: true
+                        enabled: modelData.status === "ok"
+                        onClicked: {
+                            resultImage.updateImage(modelData.resultPath)
+                            param1Text.text = modelData.fCov.toFixed(4)
+                            param2Text.text = modelData.meanNdvi.toFixed(4)
+                        }
+                    }
                 }
             }
         }
     }
     
+    // Derivazione nativa degli input: NDVI da rosso/NIR, CHM da DSM - DTM (o suolo stimato)
+    Dialog {
+        id: deriveDialog
+        title: "Derive Inputs"
+        width: 560
+        height: 520
+        modal: false
+        anchors.centerIn: parent
+        standardButtons: Dialog.Close
+        
+        property real progress: 0
+        
+        onOpened: if (denoisePathField.text === "") denoisePathField.text = image1Panel.imagePath
+        
+        function cleanPath(url) {
+            var path = url.toString()
+            if (path.startsWith("file:///")) return path.substring(8)
+            if (path.startsWith("file://")) return path.substring(7)
+            return path
+        }
+        
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: 10
+            
+            GroupBox {
+                title: "NDVI = (NIR - Red) / (NIR + Red)"
+                Layout.fillWidth: true
+                
+                GridLayout {
+                    anchors.fill: parent
+                    columns: 4
+                    columnSpacing: 8
+                    
+                    Label { text: "Red:" }
+                    TextField { id: redPathField; Layout.fillWidth: true; placeholderText: "multispectral or red band GeoTIFF" }
+                    SpinBox { id: redBandBox; from: 1; to: 16; value: 3; ToolTip.visible: hovered; ToolTip.text: "Red band" }
+                    Button { text: "…"; implicitWidth: 32; onClicked: deriveFileDialog.pick(redPathField) }
+                    
+                    Label { text: "NIR:" }
+                    TextField { id: nirPathField; Layout.fillWidth: true; placeholderText: "empty = same file as red" }
+                    SpinBox { id: nirBandBox; from: 1; to: 16; value: 4; ToolTip.visible: hovered; ToolTip.text: "NIR band" }
+                    Button { text: "…"; implicitWidth: 32; onClicked: deriveFileDialog.pick(nirPathField) }
+                    
+                    Item { Layout.columnSpan: 3; Layout.fillWidth: true }
+                    Button {
+                        text: "Compute"
+                        enabled: !processor.derivationRunning && redPathField.text !== ""
+                        onClicked: processor.deriveNdvi(redPathField.text, redBandBox.value, nirPathField.text, nirBandBox.value)
+                    }
+                }
+            }
+            
+            GroupBox {
+                title: "Canopy height = DSM - ground"
+                Layout.fillWidth: true
+                
+                GridLayout {
+                    anchors.fill: parent
+                    columns: 4
+                    columnSpacing: 8
+                    
+                    Label { text: "DSM:" }
+                    TextField { id: dsmPathField; Layout.fillWidth: true; Layout.columnSpan: 2; placeholderText: "absolute surface model GeoTIFF" }
+                    Button { text: "…"; implicitWidth: 32; onClicked: deriveFileDialog.pick(dsmPathField) }
+                    
+                    Label { text: "DTM:" }
+                    TextField { id: dtmPathField; Layout.fillWidth: true; Layout.columnSpan: 2; placeholderText: "empty = estimate ground from DSM minima" }
+                    Button { text: "…"; implicitWidth: 32; onClicked: deriveFileDialog.pick(dtmPathField) }
+                    
+                    Label { text: "Ground window:" }
+                    SpinBox {
+                        id: groundWindowBox
+                        from: 0; to: 512; stepSize: 8; value: 0
+                        enabled: dtmPathField.text === ""
+                        ToolTip.visible: hovered
+                        ToolTip.text: "Pixels per ground cell (0 = about 20 m)"
+                    }
+                    Item { Layout.fillWidth: true }
+                    Button {
+                        text: "Compute"
+                        enabled: !processor.derivationRunning && dsmPathField.text !== ""
+                        onClicked: processor.deriveChm(dsmPathField.text, dtmPathField.text, groundWindowBox.value)
+                    }
+                }
+            }
+            
+            // Stesso filtro dell'anteprima del pannello Input DSM, sul raster intero
+            GroupBox {
+                title: "Denoise DSM (filter of the Input DSM preview)"
+                Layout.fillWidth: true
+                
+                GridLayout {
+                    anchors.fill: parent
+                    columns: 4
+                    columnSpacing: 8
+                    
+                    Label { text: "DSM:" }
+                    TextField { id: denoisePathField; Layout.fillWidth: true; Layout.columnSpan: 2; placeholderText: "surface model GeoTIFF" }
+                    Button { text: "…"; implicitWidth: 32; onClicked: deriveFileDialog.pick(denoisePathField) }
+                    
+                    Label { text: "Filter:" }
+                    Label {
+                        Layout.fillWidth: true
+                        Layout.columnSpan: 2
+                        text: image1Panel.denoiseFilter === "" ? "none (choose one in the Input DSM panel)"
+                              : image1Panel.denoiseFilter + " " + (2 * image1Panel.denoiseRadius + 1) + "×"
+                                + (2 * image1Panel.denoiseRadius + 1)
+                        opacity: image1Panel.denoiseFilter === "" ? 0.6 : 1.0
+                    }
+                    Button {
+                        text: "Compute"
+                        enabled: !processor.derivationRunning && denoisePathField.text !== "" && image1Panel.denoiseFilter !== ""
+                        onClicked: processor.denoiseRaster(denoisePathField.text, image1Panel.denoiseFilter, image1Panel.denoiseRadius)
+                    }
+                }
+            }
+            
+            CheckBox {
+                id: loadDerivedCheck
+                text: "Load result as analysis input (NDVI → Input NDVI, CHM/denoised → Input DSM)"
+                checked: true
+            }
+            
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+                
+                ProgressBar {
+                    Layout.fillWidth: true
+                    from: 0
+                    to: 1
+                    value: deriveDialog.progress
+                }
+                
+                Button {
+                    text: "Cancel"
+                    enabled: processor.derivationRunning
+                    onClicked: processor.cancelDerivation()
+                }
+            }
+            
+            Label {
+                id: deriveStatus
+                Layout.fillWidth: true
+                color: mainWindow.textSecondaryColor
+                elide: Text.ElideMiddle
+            }
+            
+            Item { Layout.fillHeight: true }
+        }
+        
+        Connections {
+            target: processor
+            function onDerivationProgress(fraction) { deriveDialog.progress = fraction }
+            function onDerivationCompleted(kind, outputPath, elapsedMs) {
+                // Gli export dei viewer non sono input dell'analisi
+                if (kind === "export") return
+                deriveStatus.text = kind.toUpperCase() + " written in " + (elapsedMs / 1000).toFixed(1) + " s: " + outputPath
+                if (!loadDerivedCheck.checked) return
+                if (kind === "ndvi") {
+                    image2Panel.imagePath = outputPath
+                    processor.setImage2(outputPath)
+                } else {
+                    // Il DSM filtrato non va filtrato di nuovo in anteprima
+                    if (kind === "denoise") image1Panel.denoiseFilter = ""
+                    image1Panel.imagePath = outputPath
+                    processor.setImage1(outputPath)
+                }
+            }
+        }
+    }
+    
+    FileDialog {
+        id: deriveFileDialog
+        title: "Select Raster"
+        fileMode: FileDialog.OpenFile
+        nameFilters: ["GeoTIFF files (*.tif *.tiff)", "All files (*)"]
+        property var target: null
+        
+        function pick(field) {
+            target = field
+            open()
+        }
+        
+        onAccepted: if (target) target.text = deriveDialog.cleanPath(selectedFile)
+    }
+    
     // Error dialog
     Dialog {
         id: errorDialog
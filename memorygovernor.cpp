@@ -0,0 +1,261 @@
+#include "memorygovernor.h"
+#include <QCoreApplication>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QVariantMap>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <gdal.h>
+
+namespace {
+
+// Default pensato per i portatili da 16 GB usati sul campo
+const int kDefaultBudgetMB = 2048;
+const int kMinBudgetMB = 256;
+
+// Quote del budget: block cache GDAL e buffer del warper sono limiti fissi
+// (GDAL li rispetta da sé), il resto è conteso dalle cache decodificate
+const double kGdalCacheShare = 0.25;
+const double kWarpShare = 1.0 / 16.0;
+const qint64 kMinWarpBytes = 64ll * 1024 * 1024;
+
+// Le tre QImage di ResultImageViewer possono usare al più questa frazione
+const double kPreviewShare = 1.0 / 8.0;
+const int kPreviewImages = 3;
+
+const qint64 kMB = 1024ll * 1024;
+
+} // namespace
+
+std::atomic<qint64> MemoryGovernor::s_budgetBytes(kDefaultBudgetMB * kMB);
+
+MemoryGovernor *MemoryGovernor::instance()
+{
+    static MemoryGovernor *governor = new MemoryGovernor(QCoreApplication::instance());
+    return governor;
+}
+
+MemoryGovernor::MemoryGovernor(QObject *parent)
+    : QObject(parent)
+    , m_enforcePending(false)
+    , m_nextId(1)
+    , m_lastReportedUsage(-1)
+    , m_refreshTimer(this)
+{
+    m_trimThread.setMaxThreadCount(1);
+    m_trimThread.setObjectName("MemoryGovernor");
+
+    // La block cache di GDAL è il primo consumer: la riduzione abbassa
+    // temporaneamente GDAL_CACHEMAX, che scarta i blocchi meno recenti, poi
+    // ripristina la quota del budget corrente. Sotto m_gdalCacheMutex come
+    // applyBudget: un cambio di budget concorrente non viene sovrascritto
+    registerConsumer("GDAL block cache", Normal,
+                     [] { return static_cast<qint64>(GDALGetCacheUsed64()); },
+                     [this](qint64 targetBytes) {
+                         QMutexLocker locker(&m_gdalCacheMutex);
+                         GDALSetCacheMax64(std::max<qint64>(targetBytes, 0));
+                         GDALSetCacheMax64(gdalCacheShareBytes());
+                         return static_cast<qint64>(GDALGetCacheUsed64());
+                     });
+
+    applyBudget();
+
+    // Le cache si riempiono dai thread del provider: l'uso per QML viene
+    // campionato qui invece di emettere segnali da thread diversi
+    m_refreshTimer.setInterval(1000);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &MemoryGovernor::refreshUsage);
+    m_refreshTimer.start();
+}
+
+int MemoryGovernor::registerConsumer(const QString &name, Priority priority,
+                                     UsageFunction usage, TrimFunction trim)
+{
+    QMutexLocker locker(&m_mutex);
+    Consumer consumer;
+    consumer.id = m_nextId++;
+    consumer.name = name;
+    consumer.priority = priority;
+    consumer.usage = std::move(usage);
+    consumer.trim = std::move(trim);
+    m_consumers.append(consumer);
+
+    // Ordine di eviction stabile: priorità crescente, poi ordine di registrazione
+    std::stable_sort(m_consumers.begin(), m_consumers.end(),
+                     [](const Consumer &a, const Consumer &b) { return a.priority < b.priority; });
+
+    qDebug() << "Memory consumer registered:" << name << "priority" << priority;
+    return consumer.id;
+}
+
+void MemoryGovernor::unregisterConsumer(int id)
+{
+    QMutexLocker trimLocker(&m_trimMutex);
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_consumers.size(); ++i) {
+        if (m_consumers[i].id == id) {
+            m_consumers.removeAt(i);
+            return;
+        }
+    }
+}
+
+void MemoryGovernor::notifyAllocated()
+{
+    scheduleEnforce();
+}
+
+void MemoryGovernor::scheduleEnforce()
+{
+    // Già in coda: la passata in attesa vedrà anche questa allocazione
+    if (m_enforcePending.exchange(true)) {
+        return;
+    }
+    m_trimThread.start([this]() {
+        // Azzerato prima di misurare: un'allocazione durante il trim ne accoda un'altra
+        m_enforcePending.store(false);
+        enforceBudget();
+    });
+}
+
+void MemoryGovernor::enforceBudget()
+{
+    QMutexLocker trimLocker(&m_trimMutex);
+
+    // Copia dei consumer sotto il lock, poi usage() e trim() senza: un trim
+    // lento (compressione dei tile) non blocca chi registra o legge l'uso
+    QVector<Consumer> consumers;
+    {
+        QMutexLocker locker(&m_mutex);
+        consumers = m_consumers;
+    }
+
+    qint64 budget = s_budgetBytes.load();
+    QVector<qint64> usage(consumers.size());
+    qint64 total = 0;
+    for (int i = 0; i < consumers.size(); ++i) {
+        usage[i] = consumers[i].usage();
+        total += usage[i];
+    }
+    if (total <= budget) {
+        return;
+    }
+
+    qint64 before = total;
+    for (int i = 0; i < consumers.size() && total > budget; ++i) {
+        qint64 overflow = total - budget;
+        qint64 target = std::max<qint64>(0, usage[i] - overflow);
+        qint64 after = consumers[i].trim(target);
+        total -= usage[i] - after;
+    }
+
+    qDebug() << "Memory budget enforced:" << before / kMB << "MB ->" << total / kMB
+             << "MB (budget" << budget / kMB << "MB)";
+}
+
+int MemoryGovernor::budgetMB() const
+{
+    return static_cast<int>(s_budgetBytes.load() / kMB);
+}
+
+int MemoryGovernor::usedMB() const
+{
+    QMutexLocker locker(&m_mutex);
+    return static_cast<int>(totalUsageLocked() / kMB);
+}
+
+int MemoryGovernor::gdalCacheMB() const
+{
+    return static_cast<int>(GDALGetCacheMax64() / kMB);
+}
+
+int MemoryGovernor::maxPreviewSize() const
+{
+    // Lato (potenza di 2) tale che le anteprime ARGB stiano nella loro quota
+    qint64 perImage = static_cast<qint64>(s_budgetBytes.load() * kPreviewShare) / kPreviewImages;
+    int side = static_cast<int>(std::sqrt(perImage / 4.0));
+    int size = 1024;
+    while (size * 2 <= side && size < 4096) {
+        size *= 2;
+    }
+    return size;
+}
+
+QVariantList MemoryGovernor::consumers() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantList list;
+    for (const Consumer &consumer : m_consumers) {
+        QVariantMap entry;
+        entry["name"] = consumer.name;
+        entry["priority"] = static_cast<int>(consumer.priority);
+        entry["usedMB"] = static_cast<double>(consumer.usage()) / kMB;
+        list.append(entry);
+    }
+    return list;
+}
+
+qint64 MemoryGovernor::budgetBytes()
+{
+    return s_budgetBytes.load();
+}
+
+qint64 MemoryGovernor::warpMemoryLimitBytes()
+{
+    return std::max(kMinWarpBytes, static_cast<qint64>(s_budgetBytes.load() * kWarpShare));
+}
+
+void MemoryGovernor::setBudgetMB(int megabytes)
+{
+    megabytes = std::max(kMinBudgetMB, megabytes);
+    if (megabytes == budgetMB()) {
+        return;
+    }
+    s_budgetBytes.store(megabytes * kMB);
+    applyBudget();
+    scheduleEnforce();
+    emit budgetChanged();
+    refreshUsage();
+}
+
+void MemoryGovernor::applyBudget()
+{
+    qint64 budget = s_budgetBytes.load();
+    {
+        QMutexLocker locker(&m_gdalCacheMutex);
+        GDALSetCacheMax64(gdalCacheShareBytes());
+    }
+
+    // Una singola immagine decodificata da QImageReader non può superare il budget
+    QImageReader::setAllocationLimit(static_cast<int>(budget / kMB));
+
+    qDebug() << "Memory budget:" << budget / kMB << "MB, GDAL_CACHEMAX:" << GDALGetCacheMax64() / kMB
+             << "MB, warp buffers:" << warpMemoryLimitBytes() / kMB << "MB, preview size:" << maxPreviewSize();
+}
+
+qint64 MemoryGovernor::gdalCacheShareBytes()
+{
+    return static_cast<qint64>(s_budgetBytes.load() * kGdalCacheShare);
+}
+
+qint64 MemoryGovernor::totalUsageLocked() const
+{
+    qint64 total = 0;
+    for (const Consumer &consumer : m_consumers) {
+        total += consumer.usage();
+    }
+    return total;
+}
+
+void MemoryGovernor::refreshUsage()
+{
+    qint64 total;
+    {
+        QMutexLocker locker(&m_mutex);
+        total = totalUsageLocked();
+    }
+    if (qAbs(total - m_lastReportedUsage) >= kMB) {
+        m_lastReportedUsage = total;
+        emit usageChanged();
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <QObject>
+#include <QString>
+#include <QVariantList>
+#include <QMutex>
+#include <QTimer>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+// Budget di memoria unico per tutte le cache dell'applicazione: block cache di
+// GDAL (GDAL_CACHEMAX), raster decodificati, griglie di warp, buffer del warper
+// e limite di allocazione delle QImage. Quando il totale supera il budget i
+// consumer vengono ridotti in ordine di priorità crescente.
+class MemoryGovernor : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int budgetMB READ budgetMB WRITE setBudgetMB NOTIFY budgetChanged)
+    Q_PROPERTY(int usedMB READ usedMB NOTIFY usageChanged)
+    Q_PROPERTY(int gdalCacheMB READ gdalCacheMB NOTIFY budgetChanged)
+    Q_PROPERTY(int maxPreviewSize READ maxPreviewSize NOTIFY budgetChanged)
+    Q_PROPERTY(QVariantList consumers READ consumers NOTIFY usageChanged)
+
+public:
+    // Ordine di eviction: prima Low, poi Normal, High solo se non basta
+    enum Priority { Low = 0, Normal = 1, High = 2 };
+    Q_ENUM(Priority)
+
+    using UsageFunction = std::function<qint64()>;
+    // Riduce il consumer a non più di targetBytes, restituisce l'uso risultante
+    using TrimFunction = std::function<qint64(qint64 targetBytes)>;
+
+    // Da creare nel thread GUI (main.cpp) prima di registrare i consumer
+    static MemoryGovernor *instance();
+
+    int registerConsumer(const QString &name, Priority priority, UsageFunction usage, TrimFunction trim);
+    void unregisterConsumer(int id);
+
+    // Chiamato dai consumer dopo aver allocato (da qualsiasi thread, senza lock propri).
+    // Non riduce nel thread chiamante: accoda un enforceBudget nel thread del
+    // governor, e le notifiche arrivate nel frattempo si fondono in quella passata
+    void notifyAllocated();
+
+    int budgetMB() const;
+    int usedMB() const;
+    int gdalCacheMB() const;
+    int maxPreviewSize() const;
+    QVariantList consumers() const;
+
+    // Thread-safe, usati anche senza istanza (es. warpImageToMatch dai thread del provider)
+    static qint64 budgetBytes();
+    static qint64 warpMemoryLimitBytes();
+
+public slots:
+    void setBudgetMB(int megabytes);
+    // Riduce i consumer fino al budget nel thread chiamante; i trim girano
+    // fuori da m_mutex, su una copia dei consumer
+    void enforceBudget();
+
+signals:
+    void budgetChanged();
+    void usageChanged();
+
+private:
+    explicit MemoryGovernor(QObject *parent = nullptr);
+
+    struct Consumer
+    {
+        int id = 0;
+        QString name;
+        Priority priority = Normal;
+        UsageFunction usage;
+        TrimFunction trim;
+    };
+
+    void applyBudget();
+    // Quota di GDAL_CACHEMAX per il budget corrente
+    static qint64 gdalCacheShareBytes();
+    qint64 totalUsageLocked() const;
+    void refreshUsage();
+    void scheduleEnforce();
+
+    mutable QMutex m_mutex;
+    // Una passata di trim alla volta; unregisterConsumer la attende, così
+    // nessun trim di un consumer rimosso resta in corso
+    QMutex m_trimMutex;
+    // GDAL_CACHEMAX si scrive solo sotto questo lock (applyBudget e trim GDAL)
+    QMutex m_gdalCacheMutex;
+    std::atomic<bool> m_enforcePending;
+    QThreadPool m_trimThread;
+    QVector<Consumer> m_consumers;
+    int m_nextId;
+    qint64 m_lastReportedUsage;
+    QTimer m_refreshTimer;
+
+    static std::atomic<qint64> s_budgetBytes;
+};
+
+#endif // MEMORYGOVERNOR_H
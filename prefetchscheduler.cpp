@@ -0,0 +1,471 @@
+#include "prefetchscheduler.h"
+#include <QThread>
+#include <QFileInfo>
+#include <QHash>
+#include <QWaitCondition>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <gdal_priv.h>
+
+namespace {
+
+// Orizzonti di previsione della viewport (ms)
+const double Horizons[] = {250.0, 500.0};
+// Peso del campione nuovo nella media esponenziale di velocità e zoom
+const double Smoothing = 0.5;
+// Oltre questa pausa tra due campioni il gesto è finito: si riparte da fermi
+const qint64 GestureGapMs = 400;
+// Coseno minimo tra la direzione nuova e quella stimata per non annullare
+const double MinDirectionCosine = 0.5;
+// Velocità sotto la quale (unità normalizzate al ms) la direzione non conta
+const double MinSpeed = 1e-5;
+// Blocchi in coda al massimo: oltre, la previsione è comunque troppo lontana
+const int MaxQueued = 64;
+// Insieme dei blocchi prefetchati ancora da vedere: oltre si ricomincia
+const int MaxPrefetched = 4096;
+
+// Richieste visibili in corso nel provider; il worker attende sulla condizione
+// finché non scendono a zero (o il suo job viene annullato)
+QMutex visibleMutex;
+QWaitCondition visibleIdle;
+int visibleRequests = 0;
+
+// Sveglia i worker in attesa: dopo un cambio di generazione escono subito
+void wakeWaitingWorkers()
+{
+    QMutexLocker locker(&visibleMutex);
+    visibleIdle.wakeAll();
+}
+
+// Dataset aperti dagli scheduler, per percorso; li tengono in vita i worker
+QMutex sharedSourcesMutex;
+QHash<QString, std::weak_ptr<PrefetchScheduler::SharedSource>> sharedSources;
+
+} // namespace
+
+PrefetchScheduler::VisibleRequest::VisibleRequest()
+{
+    QMutexLocker locker(&visibleMutex);
+    ++visibleRequests;
+}
+
+PrefetchScheduler::VisibleRequest::~VisibleRequest()
+{
+    QMutexLocker locker(&visibleMutex);
+    if (--visibleRequests == 0) {
+        visibleIdle.wakeAll();
+    }
+}
+
+PrefetchScheduler::SharedSource::~SharedSource()
+{
+    if (m_dataset) GDALClose(m_dataset);
+}
+
+std::shared_ptr<PrefetchScheduler::SharedSource> PrefetchScheduler::SharedSource::find(const QString &path)
+{
+    QMutexLocker locker(&sharedSourcesMutex);
+    std::shared_ptr<SharedSource> source = sharedSources.value(path).lock();
+    // Raster riscritto (output rielaborato): il dataset aperto è superato
+    if (source && source->m_modified != QFileInfo(path).lastModified()) {
+        return nullptr;
+    }
+    return source;
+}
+
+std::shared_ptr<PrefetchScheduler::SharedSource> PrefetchScheduler::SharedSource::acquire(const QString &path)
+{
+    std::shared_ptr<SharedSource> source = find(path);
+    if (source) {
+        return source;
+    }
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (!dataset) {
+        return nullptr;
+    }
+    source.reset(new SharedSource());
+    source->m_path = path;
+    source->m_modified = QFileInfo(path).lastModified();
+    source->m_dataset = dataset;
+
+    QMutexLocker locker(&sharedSourcesMutex);
+    sharedSources.insert(path, source);
+    return source;
+}
+
+PrefetchScheduler::PrefetchScheduler(QObject *parent)
+    : QObject(parent)
+    , m_visibleRect(0.0, 0.0, 1.0, 1.0)
+    , m_enabled(true)
+    , m_sourceSerial(0)
+    , m_hasSample(false)
+    , m_sampleTime(0)
+    , m_sampleLogSize(0.0)
+    , m_zoomRate(0.0)
+    , m_issued(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_cancelled(0)
+    , m_generation(std::make_shared<QAtomicInt>(0))
+    , m_worker(std::make_shared<Worker>())
+{
+    // Un solo thread a priorità minima: non contende i core alle richieste visibili
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowestPriority);
+    m_clock.start();
+}
+
+PrefetchScheduler::~PrefetchScheduler()
+{
+    m_generation->fetchAndAddOrdered(1);
+    wakeWaitingWorkers();
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QString PrefetchScheduler::cleanPath(const QString &path)
+{
+    if (path.startsWith("file:///")) return path.mid(8);
+    if (path.startsWith("file://")) return path.mid(7);
+    return path;
+}
+
+PrefetchScheduler::BlockKey PrefetchScheduler::blockKey(int level, int column, int row)
+{
+    return ((BlockKey)level << 48) | ((BlockKey)row << 24) | (BlockKey)column;
+}
+
+void PrefetchScheduler::setSource(const QString &source)
+{
+    if (m_source == source) {
+        return;
+    }
+    m_source = source;
+    emit sourceChanged();
+    loadLevels();
+}
+
+void PrefetchScheduler::setVisibleRect(const QRectF &rect)
+{
+    if (m_visibleRect == rect) {
+        return;
+    }
+    m_visibleRect = rect;
+    emit visibleRectChanged();
+    update();
+}
+
+void PrefetchScheduler::setViewportSize(const QSizeF &size)
+{
+    if (m_viewportSize == size) {
+        return;
+    }
+    m_viewportSize = size;
+    emit viewportSizeChanged();
+    update();
+}
+
+void PrefetchScheduler::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    emit enabledChanged();
+    if (!enabled) {
+        cancelPending();
+        m_visible.clear();
+        m_prefetched.clear();
+        m_hasSample = false;
+    }
+    update();
+}
+
+void PrefetchScheduler::resetStats()
+{
+    m_issued = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_cancelled = 0;
+    emit statsChanged();
+}
+
+void PrefetchScheduler::cancelPending()
+{
+    if (m_queued.isEmpty()) {
+        return;
+    }
+    // I job già partiti si fermano al blocco successivo (generazione cambiata)
+    m_generation->fetchAndAddOrdered(1);
+    wakeWaitingWorkers();
+    m_pool.clear();
+    m_cancelled += m_queued.size();
+    m_queued.clear();
+    emit statsChanged();
+}
+
+void PrefetchScheduler::loadLevels()
+{
+    cancelPending();
+    const int expected = m_generation->fetchAndAddOrdered(1) + 1;
+    wakeWaitingWorkers();
+    const int serial = ++m_sourceSerial;
+    m_levels.clear();
+    m_visible.clear();
+    m_prefetched.clear();
+    m_hasSample = false;
+
+    const QString path = cleanPath(m_source);
+    std::shared_ptr<QAtomicInt> generation = m_generation;
+    std::shared_ptr<Worker> worker = m_worker;
+    m_pool.start([this, path, generation, worker, expected, serial]() {
+        // Senza sorgente il dataset condiviso si rilascia (il file non resta aperto)
+        worker->source.reset();
+        if (path.isEmpty() || generation->loadAcquire() != expected) return;
+        worker->source = SharedSource::acquire(path);
+        if (!worker->source) {
+            qWarning() << "PrefetchScheduler: cannot open" << path;
+            return;
+        }
+
+        std::vector<Level> levels;
+        {
+            QMutexLocker locker(worker->source->mutex());
+            GDALRasterBand *band = worker->source->dataset()->GetRasterBand(1);
+            if (!band) return;
+            auto addLevel = [&levels, band](GDALRasterBand *level) {
+                Level entry;
+                entry.width = level->GetXSize();
+                entry.height = level->GetYSize();
+                level->GetBlockSize(&entry.blockWidth, &entry.blockHeight);
+                entry.factor = std::max((double)band->GetXSize() / std::max(1, entry.width),
+                                        (double)band->GetYSize() / std::max(1, entry.height));
+                levels.push_back(entry);
+            };
+            addLevel(band);
+            const int count = band->GetOverviewCount();
+            for (int i = 0; i < count; ++i) {
+                GDALRasterBand *overview = band->GetOverview(i);
+                if (overview && overview->GetXSize() > 0 && overview->GetYSize() > 0) {
+                    addLevel(overview);
+                } else {
+                    // Segnaposto: mantiene livello i + 1 = overview i
+                    levels.push_back(Level());
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [this, serial, levels]() {
+            if (m_sourceSerial != serial) return;
+            m_levels = levels;
+            update();
+        }, Qt::QueuedConnection);
+    });
+}
+
+int PrefetchScheduler::levelFor(const QRectF &rect) const
+{
+    // Stessa scelta di RasterReader::bestOverview sulla decimazione della regione
+    const Level &base = m_levels.front();
+    const double decimation = std::max(rect.width() * base.width / m_viewportSize.width(),
+                                       rect.height() * base.height / m_viewportSize.height());
+    int best = 0;
+    for (size_t i = 1; i < m_levels.size(); ++i) {
+        const Level &level = m_levels[i];
+        if (level.width > 0 && level.factor <= decimation + 1e-6 && level.factor > m_levels[best].factor) {
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+void PrefetchScheduler::blocksFor(const QRectF &rect, int level, std::vector<BlockKey> &out) const
+{
+    const Level &l = m_levels[level];
+    if (l.width <= 0 || l.blockWidth <= 0 || l.blockHeight <= 0) {
+        return;
+    }
+    const QRectF clipped = rect.intersected(QRectF(0.0, 0.0, 1.0, 1.0));
+    if (clipped.isEmpty()) {
+        return;
+    }
+    const int columns = (l.width + l.blockWidth - 1) / l.blockWidth;
+    const int rows = (l.height + l.blockHeight - 1) / l.blockHeight;
+    const int x0 = std::clamp((int)std::floor(clipped.left() * l.width / l.blockWidth), 0, columns - 1);
+    const int x1 = std::clamp((int)std::ceil(clipped.right() * l.width / l.blockWidth) - 1, x0, columns - 1);
+    const int y0 = std::clamp((int)std::floor(clipped.top() * l.height / l.blockHeight), 0, rows - 1);
+    const int y1 = std::clamp((int)std::ceil(clipped.bottom() * l.height / l.blockHeight) - 1, y0, rows - 1);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            out.push_back(blockKey(level, x, y));
+        }
+    }
+}
+
+void PrefetchScheduler::update()
+{
+    if (!m_enabled || m_levels.empty() || m_visibleRect.isEmpty()
+        || m_viewportSize.width() <= 0.0 || m_viewportSize.height() <= 0.0) {
+        return;
+    }
+
+    // Modello del moto: velocità del centro e tasso di zoom, medie esponenziali
+    const qint64 now = m_clock.elapsed();
+    const QPointF center = m_visibleRect.center();
+    const double logSize = std::log(std::max(1e-9, m_visibleRect.width()));
+    const QPointF previousVelocity = m_velocity;
+    const double previousZoomRate = m_zoomRate;
+    if (m_hasSample && now > m_sampleTime && now - m_sampleTime <= GestureGapMs) {
+        const double dt = (double)(now - m_sampleTime);
+        m_velocity = m_velocity * (1.0 - Smoothing) + (center - m_sampleCenter) / dt * Smoothing;
+        m_zoomRate = m_zoomRate * (1.0 - Smoothing) + (logSize - m_sampleLogSize) / dt * Smoothing;
+    } else if (!m_hasSample || now - m_sampleTime > GestureGapMs) {
+        m_velocity = QPointF();
+        m_zoomRate = 0.0;
+    }
+    m_hasSample = true;
+    m_sampleTime = now;
+    m_sampleCenter = center;
+    m_sampleLogSize = logSize;
+
+    // Blocchi visibili al livello che userà la lettura della regione
+    const int level = levelFor(m_visibleRect);
+    std::vector<BlockKey> visible;
+    blocksFor(m_visibleRect, level, visible);
+    QSet<BlockKey> visibleSet;
+    bool counted = false;
+    for (BlockKey key : visible) {
+        visibleSet.insert(key);
+        // Il primo fotogramma dopo l'apertura non è prevedibile: non si conta
+        if (m_visible.isEmpty() || m_visible.contains(key)) continue;
+        if (m_prefetched.remove(key)) {
+            ++m_hits;
+        } else {
+            ++m_misses;
+        }
+        counted = true;
+    }
+    m_visible = visibleSet;
+
+    // Cambio di direzione o di verso dello zoom: la coda insegue il gesto vecchio
+    const double speed = std::hypot(m_velocity.x(), m_velocity.y());
+    const double previousSpeed = std::hypot(previousVelocity.x(), previousVelocity.y());
+    bool changed = false;
+    if (speed > MinSpeed && previousSpeed > MinSpeed) {
+        const double cosine = (m_velocity.x() * previousVelocity.x() + m_velocity.y() * previousVelocity.y())
+                              / (speed * previousSpeed);
+        changed = cosine < MinDirectionCosine;
+    }
+    if ((m_zoomRate < 0.0 && previousZoomRate > 0.0) || (m_zoomRate > 0.0 && previousZoomRate < 0.0)) {
+        changed = true;
+    }
+    if (changed) {
+        cancelPending();
+    }
+
+    // Viewport prevista agli orizzonti, più un anello di blocchi attorno alla vista
+    std::vector<BlockKey> wanted;
+    QPointF target = center;
+    for (double horizon : Horizons) {
+        const double scale = std::exp(m_zoomRate * horizon);
+        const QPointF predictedCenter = center + m_velocity * horizon;
+        const QSizeF size(m_visibleRect.width() * scale, m_visibleRect.height() * scale);
+        const QRectF predicted(predictedCenter.x() - size.width() / 2.0, predictedCenter.y() - size.height() / 2.0,
+                               size.width(), size.height());
+        blocksFor(predicted, levelFor(predicted), wanted);
+        if (horizon == Horizons[0]) target = predictedCenter;
+    }
+    const Level &current = m_levels[level];
+    if (current.width > 0 && current.blockWidth > 0 && current.blockHeight > 0) {
+        const double dx = (double)current.blockWidth / current.width;
+        const double dy = (double)current.blockHeight / current.height;
+        blocksFor(m_visibleRect.adjusted(-dx, -dy, dx, dy), level, wanted);
+    }
+
+    // Solo i blocchi nuovi, i più vicini al centro previsto per primi
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    struct Candidate { BlockKey key; double distance; };
+    std::vector<Candidate> candidates;
+    for (BlockKey key : wanted) {
+        if (visibleSet.contains(key) || m_queued.contains(key) || m_prefetched.contains(key)) continue;
+        const Level &l = m_levels[key >> 48];
+        const double x = ((key & 0xffffff) + 0.5) * l.blockWidth / l.width;
+        const double y = (((key >> 24) & 0xffffff) + 0.5) * l.blockHeight / l.height;
+        candidates.push_back({key, std::hypot(x - target.x(), y - target.y())});
+    }
+    const int room = MaxQueued - m_queued.size();
+    if (candidates.empty() || room <= 0) {
+        if (counted) emit statsChanged();
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) { return a.distance < b.distance; });
+    if ((int)candidates.size() > room) candidates.resize(room);
+
+    std::vector<BlockKey> blocks;
+    for (const Candidate &candidate : candidates) {
+        blocks.push_back(candidate.key);
+        m_queued.insert(candidate.key);
+    }
+    m_issued += (int)blocks.size();
+    emit statsChanged();
+
+    const int expected = m_generation->loadAcquire();
+    const int serial = m_sourceSerial;
+    std::shared_ptr<QAtomicInt> generation = m_generation;
+    std::shared_ptr<Worker> worker = m_worker;
+    m_pool.start([this, generation, worker, expected, serial, blocks]() {
+        std::vector<BlockKey> done;
+        for (BlockKey key : blocks) {
+            // Precedenza alle richieste visibili: si riprende quando sono finite
+            {
+                QMutexLocker visibleLocker(&visibleMutex);
+                while (visibleRequests > 0 && generation->loadAcquire() == expected) {
+                    visibleIdle.wait(&visibleMutex);
+                }
+            }
+            if (!worker->source || generation->loadAcquire() != expected) break;
+
+            // Il blocco decodificato resta nella block cache del dataset
+            // condiviso, dove lo trova la lettura della regione
+            QMutexLocker locker(worker->source->mutex());
+            GDALRasterBand *band = worker->source->dataset()->GetRasterBand(1);
+            const int level = (int)(key >> 48);
+            GDALRasterBand *source = level == 0 ? band : band->GetOverview(level - 1);
+            GDALRasterBlock *block = source ? source->GetLockedBlockRef((int)(key & 0xffffff),
+                                                                       (int)((key >> 24) & 0xffffff)) : nullptr;
+            if (block) {
+                block->DropLock();
+                done.push_back(key);
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, serial, expected, blocks, done]() {
+            blocksDone(serial, expected, blocks, done);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PrefetchScheduler::blocksDone(int serial, int generation, const std::vector<BlockKey> &blocks,
+                                   const std::vector<BlockKey> &done)
+{
+    if (serial != m_sourceSerial) {
+        return;
+    }
+    // Un job annullato ha già tolto i suoi blocchi dalla coda
+    if (m_generation->loadAcquire() == generation) {
+        for (BlockKey key : blocks) m_queued.remove(key);
+    }
+    if (m_prefetched.size() + (int)done.size() > MaxPrefetched) {
+        m_prefetched.clear();
+    }
+    for (BlockKey key : done) {
+        // Decodificato quando era già visibile: non conta né come hit né come miss
+        if (!m_visible.contains(key)) m_prefetched.insert(key);
+    }
+    if (!done.empty()) {
+        qDebug() << "PrefetchScheduler:" << done.size() << "blocks prefetched, hit rate" << hitRate()
+                 << "(" << m_hits << "hits," << m_misses << "misses," << m_cancelled << "cancelled)";
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef PREFETCHSCHEDULER_H
+#define PREFETCHSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QRectF>
+#include <QPointF>
+#include <QSizeF>
+#include <QSet>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QMutex>
+#include <memory>
+#include <vector>
+
+class GDALDataset;
+
+// Prefetch dei blocchi GDAL guidato dal movimento della viewport. Dai campioni di
+// visibleRect stima velocità di pan e tendenza dello zoom (media esponenziale),
+// estrapola la viewport a 250 e 500 ms e decodifica nella block cache di GDAL i
+// blocchi della banda 1 al livello (overview) che la lettura della regione
+// sceglierà, più un anello di blocchi attorno alla vista. Il worker è uno, a
+// priorità minima, e si ferma finché il provider ha richieste visibili in
+// corso; un cambio di direzione (o di verso dello zoom) annulla quelli in coda.
+// Hit/miss: un blocco che entra nella vista già prefetchato è un hit, uno non
+// prefetchato (o ancora in coda) un miss.
+// La block cache di GDAL è per dataset: il raster si tiene aperto in un
+// SharedSource, da cui legge anche la regione del provider finché esiste.
+class PrefetchScheduler : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QRectF visibleRect READ visibleRect WRITE setVisibleRect NOTIFY visibleRectChanged)
+    Q_PROPERTY(QSizeF viewportSize READ viewportSize WRITE setViewportSize NOTIFY viewportSizeChanged)
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(int issued READ issued NOTIFY statsChanged)
+    Q_PROPERTY(int hits READ hits NOTIFY statsChanged)
+    Q_PROPERTY(int misses READ misses NOTIFY statsChanged)
+    Q_PROPERTY(int cancelled READ cancelled NOTIFY statsChanged)
+    Q_PROPERTY(double hitRate READ hitRate NOTIFY statsChanged)
+
+public:
+    // Da tenere in vita per la durata di una richiesta visibile (provider):
+    // finché ce n'è almeno una i prefetch restano in attesa
+    class VisibleRequest
+    {
+    public:
+        VisibleRequest();
+        ~VisibleRequest();
+    };
+
+    // Dataset aperto una volta per percorso e condiviso tra prefetch e provider;
+    // GDAL non ammette letture concorrenti sullo stesso handle, da cui il mutex
+    class SharedSource
+    {
+    public:
+        ~SharedSource();
+        // Riusa il dataset aperto (se il file non è cambiato) o ne apre uno
+        static std::shared_ptr<SharedSource> acquire(const QString &path);
+        // Solo se già aperto da uno scheduler: nullptr altrimenti
+        static std::shared_ptr<SharedSource> find(const QString &path);
+
+        GDALDataset *dataset() const { return m_dataset; }
+        QMutex *mutex() { return &m_mutex; }
+
+    private:
+        SharedSource() = default;
+
+        QString m_path;
+        QDateTime m_modified;
+        GDALDataset *m_dataset = nullptr;
+        QMutex m_mutex;
+    };
+
+    explicit PrefetchScheduler(QObject *parent = nullptr);
+    ~PrefetchScheduler();
+
+    QString source() const { return m_source; }
+    void setSource(const QString &source);
+
+    // Porzione visibile in coordinate normalizzate dell'immagine
+    QRectF visibleRect() const { return m_visibleRect; }
+    void setVisibleRect(const QRectF &rect);
+
+    // Pixel a schermo su cui viene letta la porzione visibile (sourceSize della regione)
+    QSizeF viewportSize() const { return m_viewportSize; }
+    void setViewportSize(const QSizeF &size);
+
+    bool enabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    int issued() const { return m_issued; }
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+    int cancelled() const { return m_cancelled; }
+    double hitRate() const { return m_hits + m_misses > 0 ? (double)m_hits / (m_hits + m_misses) : 0.0; }
+
+    Q_INVOKABLE void resetStats();
+
+signals:
+    void sourceChanged();
+    void visibleRectChanged();
+    void viewportSizeChanged();
+    void enabledChanged();
+    void statsChanged();
+
+private:
+    // Livello 0 = banda piena, i > 0 = overview i - 1 (ordine GDAL)
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        int blockWidth = 0;
+        int blockHeight = 0;
+        double factor = 1.0;
+    };
+
+    using BlockKey = quint64;   // livello << 48 | riga << 24 | colonna
+
+    // Sorgente del worker: usata solo dal thread del pool
+    struct Worker
+    {
+        std::shared_ptr<SharedSource> source;
+    };
+
+    static QString cleanPath(const QString &path);
+    static BlockKey blockKey(int level, int column, int row);
+
+    void loadLevels();
+    void update();
+    int levelFor(const QRectF &rect) const;
+    void blocksFor(const QRectF &rect, int level, std::vector<BlockKey> &out) const;
+    void cancelPending();
+    void blocksDone(int serial, int generation, const std::vector<BlockKey> &blocks,
+                    const std::vector<BlockKey> &done);
+
+    QString m_source;
+    QRectF m_visibleRect;
+    QSizeF m_viewportSize;
+    bool m_enabled;
+
+    std::vector<Level> m_levels;
+    int m_sourceSerial;         // cambia con la sorgente: i blocchi vecchi non valgono più
+    QElapsedTimer m_clock;
+    bool m_hasSample;
+    qint64 m_sampleTime;
+    QPointF m_sampleCenter;
+    double m_sampleLogSize;
+    QPointF m_velocity;         // unità normalizzate al ms
+    double m_zoomRate;          // d(log larghezza)/dt al ms, < 0 = zoom in
+
+    QSet<BlockKey> m_visible;
+    QSet<BlockKey> m_queued;    // in coda o in lettura
+    QSet<BlockKey> m_prefetched;
+
+    int m_issued;
+    int m_hits;
+    int m_misses;
+    int m_cancelled;
+
+    QThreadPool m_pool;                          // un worker a priorità minima
+    std::shared_ptr<QAtomicInt> m_generation;
+    std::shared_ptr<Worker> m_worker;
+};
+
+#endif // PREFETCHSCHEDULER_H
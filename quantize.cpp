@@ -0,0 +1,437 @@
+#include "quantize.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUANTIZE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(QUANTIZE_SSE2) && defined(__F16C__)
+#define QUANTIZE_F16C 1
+#include <immintrin.h>
+#endif
+
+namespace Quantize {
+
+namespace {
+
+const float Infinity = std::numeric_limits<float>::infinity();
+const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+inline bool isFinite(float value)
+{
+    return std::fabs(value) < Infinity;
+}
+
+inline float inverseScale(float scale)
+{
+    return scale > 0.0f ? 1.0f / scale : 0.0f;
+}
+
+inline quint32 floatBits(float value)
+{
+    quint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(quint32 bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Conversioni half di F. Giesen (arrotondamento al pari, denormali inclusi)
+quint16 floatToHalf(float value)
+{
+    const quint32 f16Max = (127 + 16) << 23;
+    const quint32 denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+    quint32 x = floatBits(value);
+    const quint32 sign = x & 0x80000000u;
+    x ^= sign;
+
+    quint32 out;
+    if (x >= f16Max) {
+        out = x > 0x7f800000u ? HalfInvalid : 0x7c00;
+    } else if (x < (113u << 23)) {
+        out = floatBits(bitsFloat(x) + bitsFloat(denormMagic)) - denormMagic;
+    } else {
+        const quint32 mantissaOdd = (x >> 13) & 1;
+        x += ((quint32)(15 - 127) << 23) + 0xfff;
+        x += mantissaOdd;
+        out = x >> 13;
+    }
+    return static_cast<quint16>(out | (sign >> 16));
+}
+
+float halfToFloat(quint16 half)
+{
+    const quint32 shiftedExp = 0x7c00u << 13;
+    quint32 out = (quint32)(half & 0x7fff) << 13;
+    const quint32 exponent = shiftedExp & out;
+    out += (quint32)(127 - 15) << 23;
+    float value;
+    if (exponent == shiftedExp) {
+        out += (quint32)(128 - 16) << 23;       // inf/NaN
+        value = bitsFloat(out);
+    } else if (exponent == 0) {
+        out += 1u << 23;                        // denormale: rinormalizza
+        value = bitsFloat(out) - bitsFloat(113u << 23);
+    } else {
+        value = bitsFloat(out);
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+#ifdef QUANTIZE_SSE2
+inline __m128 finiteMask(__m128 value)
+{
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    return _mm_cmplt_ps(_mm_and_ps(value, absMask), _mm_set1_ps(Infinity));
+}
+
+inline __m128i blendInt(__m128i mask, __m128i value, __m128i fallback)
+{
+    return _mm_or_si128(_mm_and_si128(mask, value), _mm_andnot_si128(mask, fallback));
+}
+
+inline __m128 blend(__m128 mask, __m128 value, __m128 fallback)
+{
+    return _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, fallback));
+}
+
+// Codici di 4 valori in epi32: (v - offset) * inv + 0.5 troncato in [0, maxCode],
+// poi i codici riservati (nodata vince su non valido, come nello scalare)
+inline __m128i quantize4(__m128 value, __m128 offset, __m128 inv, __m128 maxCode, __m128 noData,
+                         __m128i invalidCode, __m128i noDataCode)
+{
+    __m128 q = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(value, offset), inv), _mm_set1_ps(0.5f));
+    q = _mm_min_ps(_mm_max_ps(q, _mm_setzero_ps()), maxCode);
+    __m128i code = _mm_cvttps_epi32(q);
+    code = blendInt(_mm_castps_si128(finiteMask(value)), code, invalidCode);
+    return blendInt(_mm_castps_si128(_mm_cmpeq_ps(value, noData)), noDataCode, code);
+}
+
+inline __m128 dequantize4(__m128i code, __m128 offset, __m128 scale, __m128 noData,
+                          __m128i invalidCode, __m128i noDataCode)
+{
+    __m128 value = _mm_add_ps(offset, _mm_mul_ps(_mm_cvtepi32_ps(code), scale));
+    value = blend(_mm_castsi128_ps(_mm_cmpeq_epi32(code, invalidCode)), _mm_set1_ps(NaN), value);
+    return blend(_mm_castsi128_ps(_mm_cmpeq_epi32(code, noDataCode)), noData, value);
+}
+#endif
+
+} // namespace
+
+Format formatFromName(const QString &name)
+{
+    const QString key = name.trimmed().toLower();
+    if (key == "float32") return Format::Float32;
+    if (key == "float16" || key == "half") return Format::Float16;
+    if (key == "uint8") return Format::UInt8;
+    return Format::UInt16;
+}
+
+QString formatName(Format format)
+{
+    switch (format) {
+    case Format::Float32: return "float32";
+    case Format::Float16: return "float16";
+    case Format::UInt8: return "uint8";
+    case Format::UInt16: break;
+    }
+    return "uint16";
+}
+
+int sampleBytes(Format format)
+{
+    switch (format) {
+    case Format::Float32: return 4;
+    case Format::Float16:
+    case Format::UInt16: return 2;
+    case Format::UInt8: return 1;
+    }
+    return 4;
+}
+
+bool hasSimd()
+{
+#ifdef QUANTIZE_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool validRange(const float *src, size_t count, float noData, float &minValue, float &maxValue)
+{
+    float lo = Infinity;
+    float hi = -Infinity;
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128 posInf = _mm_set1_ps(Infinity);
+    const __m128 negInf = _mm_set1_ps(-Infinity);
+    __m128 vlo = posInf;
+    __m128 vhi = negInf;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(src + i);
+        __m128 valid = _mm_andnot_ps(_mm_cmpeq_ps(v, nd), finiteMask(v));
+        vlo = _mm_min_ps(vlo, blend(valid, v, posInf));
+        vhi = _mm_max_ps(vhi, blend(valid, v, negInf));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vlo);
+    lo = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, vhi);
+    hi = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; ++i) {
+        const float v = src[i];
+        if (isFinite(v) && v != noData) {
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+    }
+    if (lo > hi) {
+        return false;
+    }
+    minValue = lo;
+    maxValue = hi;
+    return true;
+}
+
+void toUInt16Scalar(const float *src, size_t count, float offset, float scale, float noData, quint16 *out)
+{
+    const float inv = inverseScale(scale);
+    for (size_t i = 0; i < count; ++i) {
+        const float v = src[i];
+        if (v == noData) {
+            out[i] = UInt16NoData;
+        } else if (!isFinite(v)) {
+            out[i] = UInt16Invalid;
+        } else {
+            float q = (v - offset) * inv + 0.5f;
+            out[i] = static_cast<quint16>(std::min(std::max(q, 0.0f), (float)UInt16MaxCode));
+        }
+    }
+}
+
+void fromUInt16Scalar(const quint16 *src, size_t count, float offset, float scale, float noData, float *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const quint16 code = src[i];
+        out[i] = code == UInt16NoData ? noData
+               : code == UInt16Invalid ? NaN
+               : offset + (float)code * scale;
+    }
+}
+
+void toUInt16(const float *src, size_t count, float offset, float scale, float noData, quint16 *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 inv = _mm_set1_ps(inverseScale(scale));
+    const __m128 maxCode = _mm_set1_ps((float)UInt16MaxCode);
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i invalidCode = _mm_set1_epi32(UInt16Invalid);
+    const __m128i noDataCode = _mm_set1_epi32(UInt16NoData);
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = quantize4(_mm_loadu_ps(src + i), off, inv, maxCode, nd, invalidCode, noDataCode);
+        __m128i b = quantize4(_mm_loadu_ps(src + i + 4), off, inv, maxCode, nd, invalidCode, noDataCode);
+        // SSE2 ha solo il pack con segno: si trasla di 0x8000 e si torna indietro con lo xor
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(packed, _mm_set1_epi16((short)0x8000)));
+    }
+#endif
+    toUInt16Scalar(src + i, count - i, offset, scale, noData, out + i);
+}
+
+void fromUInt16(const quint16 *src, size_t count, float offset, float scale, float noData, float *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 sc = _mm_set1_ps(scale);
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i invalidCode = _mm_set1_epi32(UInt16Invalid);
+    const __m128i noDataCode = _mm_set1_epi32(UInt16NoData);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i codes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(out + i, dequantize4(_mm_unpacklo_epi16(codes, zero), off, sc, nd, invalidCode, noDataCode));
+        _mm_storeu_ps(out + i + 4, dequantize4(_mm_unpackhi_epi16(codes, zero), off, sc, nd, invalidCode, noDataCode));
+    }
+#endif
+    fromUInt16Scalar(src + i, count - i, offset, scale, noData, out + i);
+}
+
+void toUInt8Scalar(const float *src, size_t count, float offset, float scale, float noData, uchar *out)
+{
+    const float inv = inverseScale(scale);
+    for (size_t i = 0; i < count; ++i) {
+        const float v = src[i];
+        if (v == noData) {
+            out[i] = UInt8NoData;
+        } else if (!isFinite(v)) {
+            out[i] = UInt8Invalid;
+        } else {
+            float q = (v - offset) * inv + 0.5f;
+            out[i] = static_cast<uchar>(std::min(std::max(q, 0.0f), (float)UInt8MaxCode));
+        }
+    }
+}
+
+void fromUInt8Scalar(const uchar *src, size_t count, float offset, float scale, float noData, float *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const uchar code = src[i];
+        out[i] = code == UInt8NoData ? noData
+               : code == UInt8Invalid ? NaN
+               : offset + (float)code * scale;
+    }
+}
+
+void toUInt8(const float *src, size_t count, float offset, float scale, float noData, uchar *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 inv = _mm_set1_ps(inverseScale(scale));
+    const __m128 maxCode = _mm_set1_ps((float)UInt8MaxCode);
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i invalidCode = _mm_set1_epi32(UInt8Invalid);
+    const __m128i noDataCode = _mm_set1_epi32(UInt8NoData);
+    for (; i + 16 <= count; i += 16) {
+        __m128i c0 = quantize4(_mm_loadu_ps(src + i), off, inv, maxCode, nd, invalidCode, noDataCode);
+        __m128i c1 = quantize4(_mm_loadu_ps(src + i + 4), off, inv, maxCode, nd, invalidCode, noDataCode);
+        __m128i c2 = quantize4(_mm_loadu_ps(src + i + 8), off, inv, maxCode, nd, invalidCode, noDataCode);
+        __m128i c3 = quantize4(_mm_loadu_ps(src + i + 12), off, inv, maxCode, nd, invalidCode, noDataCode);
+        // Codici in [0, 255]: i pack con saturazione sono esatti
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+#endif
+    toUInt8Scalar(src + i, count - i, offset, scale, noData, out + i);
+}
+
+void fromUInt8(const uchar *src, size_t count, float offset, float scale, float noData, float *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 sc = _mm_set1_ps(scale);
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i invalidCode = _mm_set1_epi32(UInt8Invalid);
+    const __m128i noDataCode = _mm_set1_epi32(UInt8NoData);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i codes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(codes, zero);
+        __m128i hi = _mm_unpackhi_epi8(codes, zero);
+        _mm_storeu_ps(out + i, dequantize4(_mm_unpacklo_epi16(lo, zero), off, sc, nd, invalidCode, noDataCode));
+        _mm_storeu_ps(out + i + 4, dequantize4(_mm_unpackhi_epi16(lo, zero), off, sc, nd, invalidCode, noDataCode));
+        _mm_storeu_ps(out + i + 8, dequantize4(_mm_unpacklo_epi16(hi, zero), off, sc, nd, invalidCode, noDataCode));
+        _mm_storeu_ps(out + i + 12, dequantize4(_mm_unpackhi_epi16(hi, zero), off, sc, nd, invalidCode, noDataCode));
+    }
+#endif
+    fromUInt8Scalar(src + i, count - i, offset, scale, noData, out + i);
+}
+
+void toHalfScalar(const float *src, size_t count, float noData, quint16 *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = src[i] == noData ? HalfNoData : floatToHalf(src[i]);
+    }
+}
+
+void fromHalfScalar(const quint16 *src, size_t count, float noData, float *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = src[i] == HalfNoData ? noData : halfToFloat(src[i]);
+    }
+}
+
+void toHalf(const float *src, size_t count, float noData, quint16 *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_F16C
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i noDataCode = _mm_set1_epi16((short)HalfNoData);
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_loadu_ps(src + i);
+        __m128 b = _mm_loadu_ps(src + i + 4);
+        __m128i half = _mm_unpacklo_epi64(_mm_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT),
+                                          _mm_cvtps_ph(b, _MM_FROUND_TO_NEAREST_INT));
+        __m128i isNoData = _mm_packs_epi32(_mm_castps_si128(_mm_cmpeq_ps(a, nd)),
+                                           _mm_castps_si128(_mm_cmpeq_ps(b, nd)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), blendInt(isNoData, noDataCode, half));
+    }
+#endif
+    toHalfScalar(src + i, count - i, noData, out + i);
+}
+
+void fromHalf(const quint16 *src, size_t count, float noData, float *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_F16C
+    const __m128 nd = _mm_set1_ps(noData);
+    const __m128i noDataCode = _mm_set1_epi16((short)HalfNoData);
+    for (; i + 8 <= count; i += 8) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i isNoData = _mm_cmpeq_epi16(half, noDataCode);
+        __m128 lo = _mm_cvtph_ps(half);
+        __m128 hi = _mm_cvtph_ps(_mm_unpackhi_epi64(half, half));
+        _mm_storeu_ps(out + i, blend(_mm_castsi128_ps(_mm_unpacklo_epi16(isNoData, isNoData)), nd, lo));
+        _mm_storeu_ps(out + i + 4, blend(_mm_castsi128_ps(_mm_unpackhi_epi16(isNoData, isNoData)), nd, hi));
+    }
+#endif
+    fromHalfScalar(src + i, count - i, noData, out + i);
+}
+
+void colorizeScalar(const float *src, size_t count, float minValue, float lutScale, const QRgb *lut, int lutSize,
+                    QRgb *out)
+{
+    const float maxIndex = (float)(lutSize - 1);
+    for (size_t i = 0; i < count; ++i) {
+        const float v = src[i];
+        if (!isFinite(v)) {
+            out[i] = qRgb(0, 0, 0);
+            continue;
+        }
+        float index = (v - minValue) * lutScale + 0.5f;
+        out[i] = lut[static_cast<int>(std::min(std::max(index, 0.0f), maxIndex))];
+    }
+}
+
+void colorize(const float *src, size_t count, float minValue, float lutScale, const QRgb *lut, int lutSize,
+              QRgb *out)
+{
+    size_t i = 0;
+#ifdef QUANTIZE_SSE2
+    const __m128 minV = _mm_set1_ps(minValue);
+    const __m128 sc = _mm_set1_ps(lutScale);
+    const __m128 maxIndex = _mm_set1_ps((float)(lutSize - 1));
+    const QRgb black = qRgb(0, 0, 0);
+    alignas(16) int indices[4];
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(src + i);
+        __m128 index = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, minV), sc), _mm_set1_ps(0.5f));
+        index = _mm_min_ps(_mm_max_ps(index, _mm_setzero_ps()), maxIndex);
+        // Non validi all'indice -1: il gather scalare li fa neri
+        __m128i idx = blendInt(_mm_castps_si128(finiteMask(v)), _mm_cvttps_epi32(index), _mm_set1_epi32(-1));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), idx);
+        for (int k = 0; k < 4; ++k) {
+            out[i + k] = indices[k] >= 0 ? lut[indices[k]] : black;
+        }
+    }
+#endif
+    colorizeScalar(src + i, count - i, minValue, lutScale, lut, lutSize, out + i);
+}
+
+} // namespace Quantize
@@ -0,0 +1,71 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <QString>
+#include <QRgb>
+#include <QtGlobal>
+#include <cstddef>
+
+// Formati compatti dei tile decodificati: per l'anteprima 32 bit per campione
+// sono troppi (DSM al centimetro, NDVI in [-1, 1]). UInt16/UInt8 quantizzano
+// linearmente sul range del tile (valore = offset + codice * scale), Float16 è
+// half IEEE. I codici più alti sono riservati: nodata si ripristina esatto e
+// NaN/inf restano non validi. Conversioni in SSE2 (F16C per l'half se
+// compilato con -mf16c), con varianti scalari di riferimento.
+namespace Quantize {
+
+enum class Format
+{
+    Float32,    // in chiaro, 4 byte
+    Float16,    // half: ~3 cifre significative, |v| <= 65504
+    UInt16,     // 65534 livelli sul range del tile
+    UInt8       // 254 livelli: solo visualizzazione
+};
+
+Format formatFromName(const QString &name);
+QString formatName(Format format);
+int sampleBytes(Format format);
+
+const quint16 UInt16Invalid = 0xffff;
+const quint16 UInt16NoData = 0xfffe;
+const quint16 UInt16MaxCode = 0xfffd;
+const uchar UInt8Invalid = 0xff;
+const uchar UInt8NoData = 0xfe;
+const uchar UInt8MaxCode = 0xfd;
+// NaN half con payload: non si confonde con i NaN letti dal raster
+const quint16 HalfNoData = 0x7c01;
+const quint16 HalfInvalid = 0x7e00;
+const float HalfMax = 65504.0f;
+
+bool hasSimd();
+
+// Min/max dei valori validi (finiti e diversi da noData); false se non ce ne sono
+bool validRange(const float *src, size_t count, float noData, float &minValue, float &maxValue);
+
+// offset/scale da validRange: scale = (max - min) / maxCode, 0 se il tile è costante
+void toUInt16(const float *src, size_t count, float offset, float scale, float noData, quint16 *out);
+void fromUInt16(const quint16 *src, size_t count, float offset, float scale, float noData, float *out);
+void toUInt16Scalar(const float *src, size_t count, float offset, float scale, float noData, quint16 *out);
+void fromUInt16Scalar(const quint16 *src, size_t count, float offset, float scale, float noData, float *out);
+
+void toUInt8(const float *src, size_t count, float offset, float scale, float noData, uchar *out);
+void fromUInt8(const uchar *src, size_t count, float offset, float scale, float noData, float *out);
+void toUInt8Scalar(const float *src, size_t count, float offset, float scale, float noData, uchar *out);
+void fromUInt8Scalar(const uchar *src, size_t count, float offset, float scale, float noData, float *out);
+
+// Arrotondamento al pari; oltre HalfMax -> inf (il chiamante lo evita con validRange)
+void toHalf(const float *src, size_t count, float noData, quint16 *out);
+void fromHalf(const quint16 *src, size_t count, float noData, float *out);
+void toHalfScalar(const float *src, size_t count, float noData, quint16 *out);
+void fromHalfScalar(const quint16 *src, size_t count, float noData, float *out);
+
+// Colormap tabulata (RasterExport::buildLut): indice = (v - minValue) * lutScale + 0.5
+// limitato a [0, lutSize - 1]; NaN/inf neri come nel provider
+void colorize(const float *src, size_t count, float minValue, float lutScale, const QRgb *lut, int lutSize,
+              QRgb *out);
+void colorizeScalar(const float *src, size_t count, float minValue, float lutScale, const QRgb *lut, int lutSize,
+                    QRgb *out);
+
+} // namespace Quantize
+
+#endif // QUANTIZE_H
@@ -0,0 +1,579 @@
+#include "rasteralgebra.h"
+#include "rasterreader.h"
+#include "decodepool.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTERALGEBRA_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace RasterAlgebra {
+
+namespace {
+
+inline bool isValid(float value, float noData)
+{
+    return !std::isnan(value) && !std::isinf(value) && value != NoData && value != noData;
+}
+
+#ifdef RASTERALGEBRA_SSE2
+// Stessa condizione di isValid su 4 valori: il confronto con NaN/inf è falso
+inline __m128 validMask(__m128 value, __m128 noData)
+{
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 finite = _mm_cmplt_ps(_mm_and_ps(value, absMask), infinity);
+    __m128 notNoData = _mm_and_ps(_mm_cmpneq_ps(value, _mm_set1_ps(NoData)), _mm_cmpneq_ps(value, noData));
+    return _mm_and_ps(finite, notNoData);
+}
+
+inline __m128 blend(__m128 mask, __m128 value, __m128 fallback)
+{
+    return _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, fallback));
+}
+#endif
+
+float bandNoData(GDALRasterBand *band)
+{
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+    // Senza nodata dichiarato: NaN non è mai uguale a nessun valore
+    return hasNoData ? static_cast<float>(noData) : std::numeric_limits<float>::quiet_NaN();
+}
+
+using DatasetPtr = std::shared_ptr<GDALDataset>;
+
+// Pixel del DTM = offset + pixel del DSM * scale (griglie nord-su nello stesso CRS)
+struct GridMapping
+{
+    double scaleX = 1.0;
+    double scaleY = 1.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+};
+
+bool gridMapping(GDALDataset *dsm, GDALDataset *dtm, GridMapping &mapping, QString *error)
+{
+    double dsmTransform[6];
+    double dtmTransform[6];
+    bool dsmGeo = dsm->GetGeoTransform(dsmTransform) == CE_None;
+    bool dtmGeo = dtm->GetGeoTransform(dtmTransform) == CE_None;
+    if (!dsmGeo || !dtmGeo) {
+        if (dsm->GetRasterXSize() == dtm->GetRasterXSize() && dsm->GetRasterYSize() == dtm->GetRasterYSize()) {
+            return true;
+        }
+        *error = "DTM and DSM have different sizes and no georeferencing";
+        return false;
+    }
+    if (dsmTransform[2] != 0.0 || dsmTransform[4] != 0.0 || dtmTransform[2] != 0.0 || dtmTransform[4] != 0.0) {
+        *error = "Rotated grids are not supported for CHM, warp the DTM first";
+        return false;
+    }
+
+    OGRSpatialReference dsmSrs;
+    OGRSpatialReference dtmSrs;
+    const char *dsmWkt = dsm->GetProjectionRef();
+    const char *dtmWkt = dtm->GetProjectionRef();
+    if (dsmWkt && dsmWkt[0] && dtmWkt && dtmWkt[0]
+        && dsmSrs.importFromWkt(dsmWkt) == OGRERR_NONE && dtmSrs.importFromWkt(dtmWkt) == OGRERR_NONE
+        && !dsmSrs.IsSame(&dtmSrs)) {
+        *error = "DTM and DSM use different coordinate systems, reproject the DTM first";
+        return false;
+    }
+
+    mapping.scaleX = dsmTransform[1] / dtmTransform[1];
+    mapping.scaleY = dsmTransform[5] / dtmTransform[5];
+    mapping.offsetX = (dsmTransform[0] - dtmTransform[0]) / dtmTransform[1];
+    mapping.offsetY = (dsmTransform[3] - dtmTransform[3]) / dtmTransform[5];
+    if (mapping.scaleX <= 0.0 || mapping.scaleY <= 0.0) {
+        *error = "DTM and DSM grids have opposite orientation";
+        return false;
+    }
+    return true;
+}
+
+// Finestra del DTM corrispondente al tile, ricampionata bilineare; NaN fuori estensione
+bool readAligned(GDALRasterBand *band, const GridMapping &mapping, int x, int y, int w, int h, float *out)
+{
+    std::fill(out, out + (size_t)w * h, std::numeric_limits<float>::quiet_NaN());
+
+    int dx0 = std::max(0, static_cast<int>(std::ceil(-mapping.offsetX / mapping.scaleX)) - x);
+    int dx1 = std::min(w, static_cast<int>(std::floor((band->GetXSize() - mapping.offsetX) / mapping.scaleX)) - x);
+    int dy0 = std::max(0, static_cast<int>(std::ceil(-mapping.offsetY / mapping.scaleY)) - y);
+    int dy1 = std::min(h, static_cast<int>(std::floor((band->GetYSize() - mapping.offsetY) / mapping.scaleY)) - y);
+    if (dx1 <= dx0 || dy1 <= dy0) {
+        return true;
+    }
+
+    double srcX = mapping.offsetX + (x + dx0) * mapping.scaleX;
+    double srcY = mapping.offsetY + (y + dy0) * mapping.scaleY;
+    return RasterReader::readWindow(band, srcX, srcY, (dx1 - dx0) * mapping.scaleX, (dy1 - dy0) * mapping.scaleY,
+                                    out + (size_t)dy0 * w + dx0, dx1 - dx0, dy1 - dy0, GDT_Float32,
+                                    ResampleMode::Bilinear, sizeof(float), (GSpacing)w * sizeof(float)) == CE_None;
+}
+
+// Suolo stimato: minimo del DSM per cella, eroso 3x3 (celle interamente sotto
+// chioma prendono il suolo dalle vicine), interpolato bilineare sui pixel
+struct GroundGrid
+{
+    int cell = 64;
+    int cols = 0;
+    int rows = 0;
+    std::vector<float> values;
+
+    float at(int cx, int cy) const
+    {
+        return values[(size_t)std::max(0, std::min(rows - 1, cy)) * cols + std::max(0, std::min(cols - 1, cx))];
+    }
+
+    float sample(int px, int py) const
+    {
+        double gx = (px + 0.5) / cell - 0.5;
+        double gy = (py + 0.5) / cell - 0.5;
+        int cx = static_cast<int>(std::floor(gx));
+        int cy = static_cast<int>(std::floor(gy));
+        float fx = static_cast<float>(gx - cx);
+        float fy = static_cast<float>(gy - cy);
+        float v00 = at(cx, cy), v10 = at(cx + 1, cy), v01 = at(cx, cy + 1), v11 = at(cx + 1, cy + 1);
+        if (std::isnan(v00) || std::isnan(v10) || std::isnan(v01) || std::isnan(v11)) {
+            return at(static_cast<int>(std::lround(gx)), static_cast<int>(std::lround(gy)));
+        }
+        return (v00 * (1 - fx) + v10 * fx) * (1 - fy) + (v01 * (1 - fx) + v11 * fx) * fy;
+    }
+};
+
+bool estimateGround(GDALDataset *dsm, int groundWindow, GroundGrid &grid, const ProgressFunction &progress,
+                    QString *error)
+{
+    GDALRasterBand *band = dsm->GetRasterBand(1);
+    const int width = band->GetXSize();
+    const int height = band->GetYSize();
+    const float noData = bandNoData(band);
+
+    int cell = groundWindow;
+    if (cell <= 0) {
+        double geoTransform[6];
+        cell = 64;
+        if (dsm->GetGeoTransform(geoTransform) == CE_None && geoTransform[1] != 0.0) {
+            cell = static_cast<int>(std::ceil(20.0 / std::abs(geoTransform[1])));
+        }
+    }
+    grid.cell = std::max(8, std::min(512, cell));
+    grid.cols = (width + grid.cell - 1) / grid.cell;
+    grid.rows = (height + grid.cell - 1) / grid.cell;
+    std::vector<float> minima((size_t)grid.cols * grid.rows, std::numeric_limits<float>::infinity());
+
+    // Blocchi di una riga di celle per al più ~4096 colonne
+    const int chunkWidth = std::min(width, std::max(1, 4096 / grid.cell) * grid.cell);
+    std::vector<float> chunk((size_t)chunkWidth * grid.cell);
+    for (int cy = 0; cy < grid.rows; ++cy) {
+        int y0 = cy * grid.cell;
+        int rows = std::min(grid.cell, height - y0);
+        for (int x0 = 0; x0 < width; x0 += chunkWidth) {
+            int cols = std::min(chunkWidth, width - x0);
+            if (band->RasterIO(GF_Read, x0, y0, cols, rows, chunk.data(), cols, rows, GDT_Float32, 0, 0) != CE_None) {
+                *error = QString("Ground estimate read failed: %1").arg(CPLGetLastErrorMsg());
+                return false;
+            }
+            for (int r = 0; r < rows; ++r) {
+                const float *line = chunk.data() + (size_t)r * cols;
+                for (int c = 0; c < cols; ++c) {
+                    if (isValid(line[c], noData)) {
+                        float &m = minima[(size_t)cy * grid.cols + (x0 + c) / grid.cell];
+                        m = std::min(m, line[c]);
+                    }
+                }
+            }
+        }
+        // Prima metà dell'avanzamento: stima del suolo
+        if (progress && !progress(0.5 * (cy + 1) / grid.rows)) {
+            *error = "Cancelled";
+            return false;
+        }
+    }
+
+    grid.values.assign(minima.size(), std::numeric_limits<float>::quiet_NaN());
+    for (int cy = 0; cy < grid.rows; ++cy) {
+        for (int cx = 0; cx < grid.cols; ++cx) {
+            float m = std::numeric_limits<float>::infinity();
+            for (int ny = std::max(0, cy - 1); ny <= std::min(grid.rows - 1, cy + 1); ++ny) {
+                for (int nx = std::max(0, cx - 1); nx <= std::min(grid.cols - 1, cx + 1); ++nx) {
+                    m = std::min(m, minima[(size_t)ny * grid.cols + nx]);
+                }
+            }
+            if (!std::isinf(m)) {
+                grid.values[(size_t)cy * grid.cols + cx] = m;
+            }
+        }
+    }
+    qDebug() << "Ground estimate:" << grid.cols << "x" << grid.rows << "cells of" << grid.cell << "px";
+    return true;
+}
+
+// Ciclo comune delle due runTiles: Sample float per le bande di analisi,
+// uint8_t per gli RGB degli export
+template <typename Sample, typename Factory>
+bool runTilesOf(GDALDataset *output, GDALDataType type, const Factory &factory, const ProgressFunction &progress,
+                QString *error)
+{
+    const int width = output->GetRasterXSize();
+    const int height = output->GetRasterYSize();
+    const int bands = output->GetRasterCount();
+    const int tilesX = (width + TileSize - 1) / TileSize;
+    const int tilesY = (height + TileSize - 1) / TileSize;
+    const int total = tilesX * tilesY;
+
+    QAtomicInt next(0);
+    QAtomicInt done(0);
+    QAtomicInt failed(0);
+    QMutex mutex;    // scritture sull'output ed errore
+    QString firstError;
+    auto fail = [&](const QString &message) {
+        QMutexLocker locker(&mutex);
+        if (firstError.isEmpty()) firstError = message;
+        failed.storeRelease(1);
+    };
+
+    // Il chiamante riporta l'avanzamento, i tile li calcolano i worker del pool
+    const int threads = std::max(1, std::min(DecodePool::maxThreads() - 1, total));
+    auto work = [&](int) {
+        QString workerError;
+        auto compute = factory(&workerError);
+        if (!compute) {
+            fail(workerError);
+            return;
+        }
+        std::vector<Sample> buffer((size_t)TileSize * TileSize * bands);
+        const GSpacing pixelSpacing = (GSpacing)sizeof(Sample) * bands;
+        while (!failed.loadAcquire()) {
+            int index = next.fetchAndAddRelaxed(1);
+            if (index >= total) {
+                break;
+            }
+            int x = (index % tilesX) * TileSize;
+            int y = (index / tilesX) * TileSize;
+            int w = std::min(TileSize, width - x);
+            int h = std::min(TileSize, height - y);
+            if (!compute(x, y, w, h, buffer.data())) {
+                fail(QString("Read failed at %1,%2: %3").arg(x).arg(y).arg(CPLGetLastErrorMsg()));
+                break;
+            }
+            CPLErr err;
+            {
+                QMutexLocker locker(&mutex);
+                err = output->RasterIO(GF_Write, x, y, w, h, buffer.data(), w, h, type, bands, nullptr,
+                                       pixelSpacing, pixelSpacing * w, sizeof(Sample));
+            }
+            if (err != CE_None) {
+                fail(QString("Write failed at %1,%2: %3").arg(x).arg(y).arg(CPLGetLastErrorMsg()));
+                break;
+            }
+            done.fetchAndAddRelaxed(1);
+        }
+    };
+    DecodePool::parallelFor(threads, work, [&]() {
+        if (progress && !progress((double)done.loadRelaxed() / total)) {
+            fail("Cancelled");
+        }
+    });
+    if (failed.loadAcquire()) {
+        *error = firstError;
+        return false;
+    }
+    if (progress) {
+        progress(1.0);
+    }
+    return true;
+}
+
+} // namespace
+
+DatasetPtr openShared(const QString &path)
+{
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        return nullptr;
+    }
+    return DatasetPtr(dataset, [](GDALDataset *d) { GDALClose(d); });
+}
+
+
+GDALDataset *createOutput(const QString &outputPath, GDALDataset *reference, QString *error)
+{
+    GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (driver == nullptr) {
+        *error = "GTiff driver not available";
+        return nullptr;
+    }
+
+    // Tile = unità di lavoro dei worker; PREDICTOR=3 per i float
+    QByteArray blockSize = QByteArray::number(TileSize);
+    char **options = nullptr;
+    options = CSLSetNameValue(options, "TILED", "YES");
+    options = CSLSetNameValue(options, "BLOCKXSIZE", blockSize.constData());
+    options = CSLSetNameValue(options, "BLOCKYSIZE", blockSize.constData());
+    options = CSLSetNameValue(options, "COMPRESS", "DEFLATE");
+    options = CSLSetNameValue(options, "PREDICTOR", "3");
+    options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+    options = CSLSetNameValue(options, "NUM_THREADS", "ALL_CPUS");
+
+    GDALDataset *output = driver->Create(outputPath.toUtf8().constData(), reference->GetRasterXSize(),
+                                         reference->GetRasterYSize(), 1, GDT_Float32, options);
+    CSLDestroy(options);
+    if (output == nullptr) {
+        *error = QString("Failed to create %1: %2").arg(outputPath, CPLGetLastErrorMsg());
+        return nullptr;
+    }
+
+    double geoTransform[6];
+    if (reference->GetGeoTransform(geoTransform) == CE_None) {
+        output->SetGeoTransform(geoTransform);
+    }
+    const char *projection = reference->GetProjectionRef();
+    if (projection && projection[0] != '\0') {
+        output->SetProjection(projection);
+    }
+    output->GetRasterBand(1)->SetNoDataValue(NoData);
+    return output;
+}
+
+bool runTiles(GDALDataset *output, const WorkerFactory &factory, const ProgressFunction &progress, QString *error)
+{
+    return runTilesOf<float>(output, GDT_Float32, factory, progress, error);
+}
+
+bool runTiles(GDALDataset *output, const ByteWorkerFactory &factory, const ProgressFunction &progress, QString *error)
+{
+    return runTilesOf<uint8_t>(output, GDT_Byte, factory, progress, error);
+}
+
+bool finishOutput(GDALDataset *output, const QString &outputPath, bool ok)
+{
+    // La chiusura scrive (e comprime) i blocchi ancora nella cache di GDAL
+    GDALClose(output);
+    if (!ok) {
+        QFile::remove(outputPath);
+    }
+    return ok;
+}
+
+bool hasSimd()
+{
+#ifdef RASTERALGEBRA_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ndviKernelScalar(const float *red, const float *nir, float *out, size_t count, float redNoData, float nirNoData)
+{
+    for (size_t i = 0; i < count; ++i) {
+        float sum = nir[i] + red[i];
+        float diff = nir[i] - red[i];
+        out[i] = isValid(red[i], redNoData) && isValid(nir[i], nirNoData) && sum != 0.0f ? diff / sum : NoData;
+    }
+}
+
+void ndviKernel(const float *red, const float *nir, float *out, size_t count, float redNoData, float nirNoData)
+{
+    size_t i = 0;
+#ifdef RASTERALGEBRA_SSE2
+    const __m128 redNd = _mm_set1_ps(redNoData);
+    const __m128 nirNd = _mm_set1_ps(nirNoData);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 outNd = _mm_set1_ps(NoData);
+    for (; i + 4 <= count; i += 4) {
+        __m128 r = _mm_loadu_ps(red + i);
+        __m128 n = _mm_loadu_ps(nir + i);
+        __m128 sum = _mm_add_ps(n, r);
+        __m128 valid = _mm_and_ps(_mm_and_ps(validMask(r, redNd), validMask(n, nirNd)), _mm_cmpneq_ps(sum, zero));
+        // Le corsie con sum == 0 producono inf/NaN, scartate dalla maschera
+        __m128 ndvi = _mm_div_ps(_mm_sub_ps(n, r), sum);
+        _mm_storeu_ps(out + i, blend(valid, ndvi, outNd));
+    }
+#endif
+    ndviKernelScalar(red + i, nir + i, out + i, count - i, redNoData, nirNoData);
+}
+
+void chmKernelScalar(const float *dsm, const float *ground, float *out, size_t count, float dsmNoData, float groundNoData)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = isValid(dsm[i], dsmNoData) && isValid(ground[i], groundNoData)
+                     ? std::max(dsm[i] - ground[i], 0.0f) : NoData;
+    }
+}
+
+void chmKernel(const float *dsm, const float *ground, float *out, size_t count, float dsmNoData, float groundNoData)
+{
+    size_t i = 0;
+#ifdef RASTERALGEBRA_SSE2
+    const __m128 dsmNd = _mm_set1_ps(dsmNoData);
+    const __m128 groundNd = _mm_set1_ps(groundNoData);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 outNd = _mm_set1_ps(NoData);
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_loadu_ps(dsm + i);
+        __m128 g = _mm_loadu_ps(ground + i);
+        __m128 valid = _mm_and_ps(validMask(d, dsmNd), validMask(g, groundNd));
+        __m128 height = _mm_max_ps(_mm_sub_ps(d, g), zero);
+        _mm_storeu_ps(out + i, blend(valid, height, outNd));
+    }
+#endif
+    chmKernelScalar(dsm + i, ground + i, out + i, count - i, dsmNoData, groundNoData);
+}
+
+bool computeNdvi(const QString &redPath, int redBand, const QString &nirPath, int nirBand,
+                 const QString &outputPath, QString *error, const ProgressFunction &progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const bool sameFile = nirPath.isEmpty() || nirPath == redPath;
+    const QString nirSource = sameFile ? redPath : nirPath;
+
+    GDALDataset *output = nullptr;
+    {
+        DatasetPtr red = openShared(redPath);
+        DatasetPtr nir = sameFile ? red : openShared(nirSource);
+        if (!red || !nir) {
+            *error = "Failed to open red/NIR input: " + (red ? nirSource : redPath);
+            return false;
+        }
+        if (redBand < 1 || redBand > red->GetRasterCount() || nirBand < 1 || nirBand > nir->GetRasterCount()) {
+            *error = QString("Band index out of range (red %1, NIR %2)").arg(redBand).arg(nirBand);
+            return false;
+        }
+        if (red->GetRasterXSize() != nir->GetRasterXSize() || red->GetRasterYSize() != nir->GetRasterYSize()) {
+            *error = "Red and NIR bands must share the same grid";
+            return false;
+        }
+        output = createOutput(outputPath, red.get(), error);
+        if (output == nullptr) {
+            return false;
+        }
+    }
+
+    WorkerFactory factory = [redPath, nirSource, sameFile, redBand, nirBand](QString *workerError) -> TileFunction {
+        DatasetPtr redDataset = openShared(redPath);
+        DatasetPtr nirDataset = sameFile ? redDataset : openShared(nirSource);
+        if (!redDataset || !nirDataset) {
+            *workerError = "Worker failed to open red/NIR input";
+            return TileFunction();
+        }
+        GDALRasterBand *red = redDataset->GetRasterBand(redBand);
+        GDALRasterBand *nir = nirDataset->GetRasterBand(nirBand);
+        float redNoData = bandNoData(red);
+        float nirNoData = bandNoData(nir);
+        auto redBuffer = std::make_shared<std::vector<float>>((size_t)TileSize * TileSize);
+        auto nirBuffer = std::make_shared<std::vector<float>>((size_t)TileSize * TileSize);
+        return [redDataset, nirDataset, red, nir, redNoData, nirNoData, redBuffer, nirBuffer]
+               (int x, int y, int w, int h, float *out) {
+            if (red->RasterIO(GF_Read, x, y, w, h, redBuffer->data(), w, h, GDT_Float32, 0, 0) != CE_None
+                || nir->RasterIO(GF_Read, x, y, w, h, nirBuffer->data(), w, h, GDT_Float32, 0, 0) != CE_None) {
+                return false;
+            }
+            ndviKernel(redBuffer->data(), nirBuffer->data(), out, (size_t)w * h, redNoData, nirNoData);
+            return true;
+        };
+    };
+
+    bool ok = finishOutput(output, outputPath, runTiles(output, factory, progress, error));
+    qDebug() << "NDVI derivation" << (ok ? "written to" : "failed:") << (ok ? outputPath : *error)
+             << "in" << timer.elapsed() << "ms" << (hasSimd() ? "(SSE2)" : "(scalar)");
+    return ok;
+}
+
+bool computeChm(const QString &dsmPath, const QString &dtmPath, int groundWindow,
+                const QString &outputPath, QString *error, const ProgressFunction &progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    GDALDataset *output = nullptr;
+    GridMapping mapping;
+    auto ground = std::make_shared<GroundGrid>();
+    {
+        DatasetPtr dsm = openShared(dsmPath);
+        if (!dsm) {
+            *error = "Failed to open DSM: " + dsmPath;
+            return false;
+        }
+        if (!dtmPath.isEmpty()) {
+            DatasetPtr dtm = openShared(dtmPath);
+            if (!dtm) {
+                *error = "Failed to open DTM: " + dtmPath;
+                return false;
+            }
+            if (!gridMapping(dsm.get(), dtm.get(), mapping, error)) {
+                return false;
+            }
+        } else if (!estimateGround(dsm.get(), groundWindow, *ground, progress, error)) {
+            return false;
+        }
+        output = createOutput(outputPath, dsm.get(), error);
+        if (output == nullptr) {
+            return false;
+        }
+    }
+
+    // Con la stima del suolo la prima metà dell'avanzamento è già passata
+    ProgressFunction tileProgress = progress;
+    if (progress && dtmPath.isEmpty()) {
+        tileProgress = [progress](double fraction) { return progress(0.5 + 0.5 * fraction); };
+    }
+
+    WorkerFactory factory = [dsmPath, dtmPath, mapping, ground](QString *workerError) -> TileFunction {
+        DatasetPtr dsmDataset = openShared(dsmPath);
+        DatasetPtr dtmDataset = dtmPath.isEmpty() ? nullptr : openShared(dtmPath);
+        if (!dsmDataset || (!dtmPath.isEmpty() && !dtmDataset)) {
+            *workerError = "Worker failed to open DSM/DTM input";
+            return TileFunction();
+        }
+        GDALRasterBand *dsm = dsmDataset->GetRasterBand(1);
+        GDALRasterBand *dtm = dtmDataset ? dtmDataset->GetRasterBand(1) : nullptr;
+        float dsmNoData = bandNoData(dsm);
+        float groundNoData = dtm ? bandNoData(dtm) : std::numeric_limits<float>::quiet_NaN();
+        auto dsmBuffer = std::make_shared<std::vector<float>>((size_t)TileSize * TileSize);
+        auto groundBuffer = std::make_shared<std::vector<float>>((size_t)TileSize * TileSize);
+        return [dsmDataset, dtmDataset, dsm, dtm, mapping, ground, dsmNoData, groundNoData, dsmBuffer, groundBuffer]
+               (int x, int y, int w, int h, float *out) {
+            if (dsm->RasterIO(GF_Read, x, y, w, h, dsmBuffer->data(), w, h, GDT_Float32, 0, 0) != CE_None) {
+                return false;
+            }
+            if (dtm) {
+                if (!readAligned(dtm, mapping, x, y, w, h, groundBuffer->data())) {
+                    return false;
+                }
+            } else {
+                float *line = groundBuffer->data();
+                for (int r = 0; r < h; ++r) {
+                    for (int c = 0; c < w; ++c) {
+                        *line++ = ground->sample(x + c, y + r);
+                    }
+                }
+            }
+            chmKernel(dsmBuffer->data(), groundBuffer->data(), out, (size_t)w * h, dsmNoData, groundNoData);
+            return true;
+        };
+    };
+
+    bool ok = finishOutput(output, outputPath, runTiles(output, factory, tileProgress, error));
+    qDebug() << "CHM derivation" << (ok ? "written to" : "failed:") << (ok ? outputPath : *error)
+             << "in" << timer.elapsed() << "ms" << (dtmPath.isEmpty() ? "(estimated ground)" : "(DTM)");
+    return ok;
+}
+
+} // namespace RasterAlgebra
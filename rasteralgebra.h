@@ -0,0 +1,68 @@
+#ifndef RASTERALGEBRA_H
+#define RASTERALGEBRA_H
+
+#include <QString>
+#include <functional>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Forward declaration for GDAL
+class GDALDataset;
+
+// Raster algebra nativo per gli input dell'analisi: NDVI da bande rosso/NIR e
+// altezza chioma (CHM = DSM - suolo). L'output è un GeoTIFF tiled DEFLATE
+// scritto a blocchi: ogni worker legge e calcola un tile per volta (kernel
+// SSE2 con fallback scalare), nessun buffer grande quanto la banda.
+namespace RasterAlgebra {
+
+const float NoData = -9999.0f;
+const int TileSize = 256;
+
+// Avanzamento 0..1 dal thread chiamante; false annulla il calcolo
+using ProgressFunction = std::function<bool(double)>;
+
+// redPath/nirPath possono coincidere (multispettrale): bande 1-based
+bool computeNdvi(const QString &redPath, int redBand, const QString &nirPath, int nirBand,
+                 const QString &outputPath, QString *error, const ProgressFunction &progress = ProgressFunction());
+
+// dtmPath vuoto: suolo stimato come minimo locale del DSM su celle di
+// groundWindow pixel (0 = ~20 m dalla risoluzione), eroso 3x3 e interpolato.
+// Un DTM con griglia diversa è ricampionato (bilineare) sulla griglia del DSM.
+bool computeChm(const QString &dsmPath, const QString &dtmPath, int groundWindow,
+                const QString &outputPath, QString *error, const ProgressFunction &progress = ProgressFunction());
+
+// Esecuzione a tile condivisa con gli altri filtri raster (es. Denoise):
+// calcola out (w x h, compatto) per il tile in (x, y)
+using TileFunction = std::function<bool(int x, int y, int w, int h, float *out)>;
+// Chiamata una volta per worker, nel suo thread: ogni worker apre i propri
+// dataset (un GDALDataset non va usato da più thread)
+using WorkerFactory = std::function<TileFunction(QString *error)>;
+// Variante a byte per output a più bande (es. RGB degli export): out è
+// interleaved per pixel, tante bande quante l'output
+using ByteTileFunction = std::function<bool(int x, int y, int w, int h, uint8_t *out)>;
+using ByteWorkerFactory = std::function<ByteTileFunction(QString *error)>;
+
+// Dataset in sola lettura chiuso con l'ultimo riferimento (nullptr se non si apre)
+std::shared_ptr<GDALDataset> openShared(const QString &path);
+
+// GeoTIFF float a una banda con griglia e CRS di reference, nodata = NoData
+GDALDataset *createOutput(const QString &outputPath, GDALDataset *reference, QString *error);
+// Tile di TileSize in parallelo sui thread disponibili, scritture serializzate
+bool runTiles(GDALDataset *output, const WorkerFactory &factory, const ProgressFunction &progress, QString *error);
+bool runTiles(GDALDataset *output, const ByteWorkerFactory &factory, const ProgressFunction &progress, QString *error);
+// Chiude l'output; se !ok rimuove il file parziale. Restituisce ok
+bool finishOutput(GDALDataset *output, const QString &outputPath, bool ok);
+
+// Kernel per elemento: nodata, NaN, inf e -9999 in ingresso producono NoData
+void ndviKernel(const float *red, const float *nir, float *out, size_t count, float redNoData, float nirNoData);
+void ndviKernelScalar(const float *red, const float *nir, float *out, size_t count, float redNoData, float nirNoData);
+// Altezze negative (rumore del DSM sotto il suolo) limitate a 0
+void chmKernel(const float *dsm, const float *ground, float *out, size_t count, float dsmNoData, float groundNoData);
+void chmKernelScalar(const float *dsm, const float *ground, float *out, size_t count, float dsmNoData, float groundNoData);
+
+bool hasSimd();
+
+} // namespace RasterAlgebra
+
+#endif // RASTERALGEBRA_H
@@ -0,0 +1,402 @@
+#include "rasterexport.h"
+#include "rasterreader.h"
+#include "compositor.h"
+#include "quantize.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <gdal_priv.h>
+#include <gdalwarper.h>
+#include <gdal_alg.h>
+
+namespace RasterExport {
+
+namespace {
+
+using DatasetPtr = std::shared_ptr<GDALDataset>;
+using RasterAlgebra::openShared;
+
+// Dataset e buffer di un worker: un GDALDataset non va usato da più thread
+struct Worker
+{
+    const Params *params = nullptr;
+    const std::vector<QRgb> *lut = nullptr;
+    double minValue = 0.0;
+    double range = 1.0;
+
+    DatasetPtr base;
+    DatasetPtr mask;
+    DatasetPtr maskAligned;         // dichiarato dopo mask: distrutto prima
+    double maskScaleX = 1.0;        // maschera non georeferenziata: stessa estensione
+    double maskScaleY = 1.0;
+    float noData = std::numeric_limits<float>::quiet_NaN();
+
+    std::vector<float> values;
+    std::vector<uint8_t> bands;
+    std::vector<uint8_t> maskValues;
+    std::vector<QRgb> pixels;
+
+    bool open(int width, int height, QString *error)
+    {
+        if (!params->basePath.isEmpty()) {
+            base = openShared(params->basePath);
+            if (!base) {
+                *error = "Failed to open " + params->basePath;
+                return false;
+            }
+            int hasNoData = 0;
+            double value = base->GetRasterBand(1)->GetNoDataValue(&hasNoData);
+            if (hasNoData) noData = static_cast<float>(value);
+        }
+        if (!params->overlayPath.isEmpty()) {
+            mask = openShared(params->overlayPath);
+            if (!mask) {
+                *error = "Failed to open " + params->overlayPath;
+                return false;
+            }
+            if (base && hasGeoreference(base.get()) && hasGeoreference(mask.get())) {
+                maskAligned = alignedMask(mask.get(), base.get(), base->GetRasterXSize(), base->GetRasterYSize());
+                if (!maskAligned) {
+                    *error = QString("Failed to align %1: %2").arg(params->overlayPath, CPLGetLastErrorMsg());
+                    return false;
+                }
+            } else {
+                maskScaleX = (double)mask->GetRasterXSize() / width;
+                maskScaleY = (double)mask->GetRasterYSize() / height;
+            }
+        }
+        const size_t tilePixels = (size_t)TileSize * TileSize;
+        values.resize(tilePixels);
+        bands.resize(tilePixels * 3);
+        maskValues.resize(tilePixels);
+        pixels.resize(tilePixels);
+        return true;
+    }
+
+    bool readMask(int x, int y, int w, int h)
+    {
+        if (maskAligned) {
+            return maskAligned->GetRasterBand(1)->RasterIO(GF_Read, x, y, w, h, maskValues.data(), w, h, GDT_Byte,
+                                                          0, 0) == CE_None;
+        }
+        return RasterReader::readWindow(mask->GetRasterBand(1), x * maskScaleX, y * maskScaleY, w * maskScaleX,
+                                        h * maskScaleY, maskValues.data(), w, h, GDT_Byte, ResampleMode::Nearest)
+               == CE_None;
+    }
+
+    // Blocco w x h in (x, y) come RGB interleaved in out. Stessi kernel della
+    // vista: Quantize::colorize per la colormap, Compositor per RGB e maschera
+    bool render(int x, int y, int w, int h, uint8_t *out)
+    {
+        const size_t count = (size_t)w * h;
+        QRgb *argb = pixels.data();
+        if (!base) {
+            std::fill(argb, argb + count, qRgb(0, 0, 0));
+        } else if (params->rgb) {
+            for (int b = 0; b < 3; ++b) {
+                if (base->GetRasterBand(b + 1)->RasterIO(GF_Read, x, y, w, h, bands.data() + b * count, w, h,
+                                                         GDT_Byte, 0, 0) != CE_None) {
+                    return false;
+                }
+            }
+            Compositor::packRgb(bands.data(), bands.data() + count, bands.data() + 2 * count, count, argb);
+        } else {
+            if (base->GetRasterBand(1)->RasterIO(GF_Read, x, y, w, h, values.data(), w, h, GDT_Float32,
+                                                 0, 0) != CE_None) {
+                return false;
+            }
+            // Il nodata resta nero come NaN/inf (colorize li lascia neri)
+            if (!std::isnan(noData)) {
+                std::replace(values.begin(), values.begin() + count, noData,
+                             std::numeric_limits<float>::quiet_NaN());
+            }
+            Quantize::colorize(values.data(), count, static_cast<float>(minValue),
+                               static_cast<float>((LutSize - 1) / range), lut->data(), LutSize, argb);
+        }
+
+        if (mask) {
+            if (!readMask(x, y, w, h)) {
+                return false;
+            }
+            if (params->overlayColor.isValid()) {
+                const int alpha = qBound(0, (int)std::lround(params->overlayOpacity * 256.0), 256);
+                Compositor::blendMask(maskValues.data(), count, params->overlayColor.rgb(), alpha, argb);
+            } else {
+                Compositor::maskGray(maskValues.data(), count, argb);
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            out[3 * i] = qRed(argb[i]);
+            out[3 * i + 1] = qGreen(argb[i]);
+            out[3 * i + 2] = qBlue(argb[i]);
+        }
+        return true;
+    }
+};
+
+GDALDataset *createRgbTiff(const QString &path, int width, int height, GDALDataset *reference, bool intermediate,
+                           QString *error)
+{
+    GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (driver == nullptr) {
+        *error = "GTiff driver not available";
+        return nullptr;
+    }
+    QByteArray blockSize = QByteArray::number(TileSize);
+    char **options = nullptr;
+    options = CSLSetNameValue(options, "TILED", "YES");
+    options = CSLSetNameValue(options, "BLOCKXSIZE", blockSize.constData());
+    options = CSLSetNameValue(options, "BLOCKYSIZE", blockSize.constData());
+    options = CSLSetNameValue(options, "COMPRESS", "DEFLATE");
+    options = CSLSetNameValue(options, "PREDICTOR", "2");
+    // File intermedio (COG/PNG): compressione veloce, viene riletto subito
+    options = CSLSetNameValue(options, "ZLEVEL", intermediate ? "1" : "6");
+    options = CSLSetNameValue(options, "PHOTOMETRIC", "RGB");
+    options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+    options = CSLSetNameValue(options, "NUM_THREADS", "ALL_CPUS");
+    GDALDataset *output = driver->Create(path.toUtf8().constData(), width, height, 3, GDT_Byte, options);
+    CSLDestroy(options);
+    if (output == nullptr) {
+        *error = QString("Failed to create %1: %2").arg(path, CPLGetLastErrorMsg());
+        return nullptr;
+    }
+    double geoTransform[6];
+    if (reference->GetGeoTransform(geoTransform) == CE_None) {
+        output->SetGeoTransform(geoTransform);
+    }
+    const char *projection = reference->GetProjectionRef();
+    if (projection && projection[0] != '\0') {
+        output->SetProjection(projection);
+    }
+    return output;
+}
+
+struct CopyProgress
+{
+    const RasterAlgebra::ProgressFunction *progress = nullptr;
+    double start = 0.0;
+    bool cancelled = false;
+    QElapsedTimer timer;
+};
+
+int CPL_STDCALL copyProgress(double complete, const char *, void *arg)
+{
+    auto *state = static_cast<CopyProgress *>(arg);
+    // Stesso ritmo del polling dei tile: al più ogni 100 ms
+    if (!*state->progress || (state->timer.isValid() && state->timer.elapsed() < 100 && complete < 1.0)) {
+        return TRUE;
+    }
+    state->timer.restart();
+    state->cancelled = !(*state->progress)(state->start + (1.0 - state->start) * complete);
+    return state->cancelled ? FALSE : TRUE;
+}
+
+} // namespace
+
+bool hasGeoreference(GDALDataset *dataset)
+{
+    double geoTransform[6];
+    const char *projection = dataset->GetProjectionRef();
+    return dataset->GetGeoTransform(geoTransform) == CE_None && projection && projection[0] != '\0';
+}
+
+std::shared_ptr<GDALDataset> alignedMask(GDALDataset *mask, GDALDataset *base, int width, int height)
+{
+    // Geotransform della base ridotta a width x height
+    double baseTransform[6];
+    base->GetGeoTransform(baseTransform);
+    const double scaleX = (double)base->GetRasterXSize() / width;
+    const double scaleY = (double)base->GetRasterYSize() / height;
+    baseTransform[1] *= scaleX;
+    baseTransform[2] *= scaleY;
+    baseTransform[4] *= scaleX;
+    baseTransform[5] *= scaleY;
+    void *transformer = GDALCreateGenImgProjTransformer(mask, mask->GetProjectionRef(), nullptr,
+                                                        base->GetProjectionRef(), FALSE, 0, 1);
+    if (transformer == nullptr) {
+        return nullptr;
+    }
+    GDALSetGenImgProjTransformerDstGeoTransform(transformer, baseTransform);
+
+    GDALWarpOptions *options = GDALCreateWarpOptions();
+    options->hSrcDS = mask;
+    options->eResampleAlg = GRA_NearestNeighbour;
+    options->nBandCount = 1;
+    options->panSrcBands = (int *)CPLMalloc(sizeof(int));
+    options->panDstBands = (int *)CPLMalloc(sizeof(int));
+    options->panSrcBands[0] = 1;
+    options->panDstBands[0] = 1;
+    options->pfnTransformer = GDALGenImgProjTransform;
+    options->pTransformerArg = transformer;
+
+    // Il VRT prende in carico il transformer (come GDALAutoCreateWarpedVRT)
+    GDALDatasetH vrt = GDALCreateWarpedVRT(mask, width, height, baseTransform, options);
+    GDALDestroyWarpOptions(options);
+    if (vrt == nullptr) {
+        GDALDestroyGenImgProjTransformer(transformer);
+        return nullptr;
+    }
+    GDALSetProjection(vrt, base->GetProjectionRef());
+    return std::shared_ptr<GDALDataset>(GDALDataset::FromHandle(vrt), [](GDALDataset *d) { GDALClose(d); });
+}
+
+// Stessa interpolazione tra le tappe della colormap del provider
+std::vector<QRgb> buildLut(const QVector<QColor> &colors)
+{
+    std::vector<QRgb> lut(LutSize, qRgb(0, 0, 0));
+    if (colors.size() < 2) {
+        return lut;
+    }
+    for (int i = 0; i < LutSize; ++i) {
+        double normalized = (double)i / (LutSize - 1);
+        int colorIndex = qBound(0, (int)(normalized * (colors.size() - 1)), colors.size() - 2);
+        double localPos = normalized * (colors.size() - 1) - colorIndex;
+        const QColor &c1 = colors[colorIndex];
+        const QColor &c2 = colors[colorIndex + 1];
+        int r = c1.red() + localPos * (c2.red() - c1.red());
+        int g = c1.green() + localPos * (c2.green() - c1.green());
+        int b = c1.blue() + localPos * (c2.blue() - c1.blue());
+        lut[i] = qRgb(qBound(0, r, 255), qBound(0, g, 255), qBound(0, b, 255));
+    }
+    return lut;
+}
+
+Format formatFromName(const QString &name)
+{
+    const QString lower = name.toLower();
+    if (lower == "cog") return Format::Cog;
+    if (lower == "png") return Format::Png;
+    return Format::GeoTiff;
+}
+
+QString formatName(Format format)
+{
+    switch (format) {
+    case Format::Cog: return "cog";
+    case Format::Png: return "png";
+    case Format::GeoTiff: break;
+    }
+    return "gtiff";
+}
+
+bool exportComposite(const Params &params, const QString &outputPath, QString *error,
+                     const RasterAlgebra::ProgressFunction &progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Griglia dell'output: la base, o la maschera da sola
+    const QString referencePath = params.basePath.isEmpty() ? params.overlayPath : params.basePath;
+    if (referencePath.isEmpty()) {
+        *error = "Nothing to export";
+        return false;
+    }
+    DatasetPtr reference = openShared(referencePath);
+    if (!reference) {
+        *error = "Failed to open " + referencePath;
+        return false;
+    }
+    // Come il provider: colormap=-1 su un raster a una banda resta colorato
+    Params effective = params;
+    effective.rgb = params.rgb && !params.basePath.isEmpty() && reference->GetRasterCount() >= 3;
+    const int width = reference->GetRasterXSize();
+    const int height = reference->GetRasterYSize();
+
+    // Stretch come l'anteprima: statistiche della banda se non indicato
+    double minValue = params.minValue;
+    double maxValue = params.maxValue;
+    if (!params.basePath.isEmpty() && !effective.rgb && minValue == maxValue) {
+        double mean = 0.0, stdDev = 0.0;
+        if (reference->GetRasterBand(1)->ComputeStatistics(false, &minValue, &maxValue, &mean, &stdDev,
+                                                           nullptr, nullptr) != CE_None) {
+            *error = QString("Failed to compute statistics of %1: %2").arg(params.basePath, CPLGetLastErrorMsg());
+            return false;
+        }
+    }
+    double range = maxValue - minValue;
+    if (range < 1e-10) range = 1.0;
+    const std::vector<QRgb> lut = buildLut(params.colors);
+
+    // GeoTIFF direttamente; COG e PNG si creano solo per copia da un GeoTIFF
+    // intermedio, che il driver rilegge a strisce
+    const bool direct = params.format == Format::GeoTiff;
+    const QString tilesPath = direct ? outputPath : outputPath + ".part.tif";
+    GDALDataset *output = createRgbTiff(tilesPath, width, height, reference.get(), !direct, error);
+    if (output == nullptr) {
+        return false;
+    }
+    reference.reset();
+
+    const double tileShare = direct ? 1.0 : 0.8;
+    RasterAlgebra::ProgressFunction tileProgress;
+    if (progress) {
+        tileProgress = [&progress, tileShare](double fraction) { return progress(fraction * tileShare); };
+    }
+    // Un Worker per thread di RasterAlgebra::runTiles, con i propri dataset
+    RasterAlgebra::ByteWorkerFactory factory = [&effective, &lut, minValue, range, width,
+                                                height](QString *workerError) -> RasterAlgebra::ByteTileFunction {
+        auto worker = std::make_shared<Worker>();
+        worker->params = &effective;
+        worker->lut = &lut;
+        worker->minValue = minValue;
+        worker->range = range;
+        if (!worker->open(width, height, workerError)) {
+            return nullptr;
+        }
+        return [worker](int x, int y, int w, int h, uint8_t *out) { return worker->render(x, y, w, h, out); };
+    };
+    bool ok = RasterAlgebra::runTiles(output, factory, tileProgress, error);
+    if (direct) {
+        RasterAlgebra::finishOutput(output, outputPath, ok);
+    } else {
+        GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(params.format == Format::Cog ? "COG" : "PNG");
+        if (ok && driver == nullptr) {
+            *error = QString("%1 driver not available").arg(params.format == Format::Cog ? "COG" : "PNG");
+            ok = false;
+        }
+        if (ok) {
+            char **options = nullptr;
+            if (params.format == Format::Cog) {
+                options = CSLSetNameValue(options, "COMPRESS", "DEFLATE");
+                options = CSLSetNameValue(options, "PREDICTOR", "YES");
+                options = CSLSetNameValue(options, "BLOCKSIZE", "512");
+                options = CSLSetNameValue(options, "OVERVIEW_RESAMPLING", "AVERAGE");
+                options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+                options = CSLSetNameValue(options, "NUM_THREADS", "ALL_CPUS");
+            } else {
+                options = CSLSetNameValue(options, "WORLDFILE", "YES");
+            }
+            CopyProgress state;
+            state.progress = &progress;
+            state.start = tileShare;
+            GDALDataset *copy = driver->CreateCopy(outputPath.toUtf8().constData(), output, FALSE, options,
+                                                   copyProgress, &state);
+            CSLDestroy(options);
+            if (copy == nullptr) {
+                *error = state.cancelled ? QString("Cancelled")
+                                         : QString("Failed to write %1: %2").arg(outputPath, CPLGetLastErrorMsg());
+                ok = false;
+                driver->Delete(outputPath.toUtf8().constData());
+            } else {
+                GDALClose(copy);
+            }
+        }
+        // Il GeoTIFF intermedio non serve più in ogni caso
+        RasterAlgebra::finishOutput(output, tilesPath, false);
+    }
+
+    if (ok && progress) {
+        progress(1.0);
+    }
+    qDebug() << "Export" << formatName(params.format) << (ok ? "written to" : "failed:") << (ok ? outputPath : *error)
+             << width << "x" << height << "in" << timer.elapsed() << "ms";
+    return ok;
+}
+
+} // namespace RasterExport
@@ -0,0 +1,73 @@
+#ifndef RASTEREXPORT_H
+#define RASTEREXPORT_H
+
+#include "rasteralgebra.h"
+#include <QString>
+#include <QColor>
+#include <QVector>
+#include <QRgb>
+#include <memory>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALDataset;
+
+// Export a piena risoluzione di ciò che mostrano i viewer: raster colorato con
+// la colormap (o RGB) ed eventuale maschera di risultato sopra, allineata alla
+// griglia della base. Si rende a blocchi di TileSize in parallelo (ogni worker
+// apre i propri dataset, la maschera passa da un VRT warpato sulla griglia
+// della base), quindi la memoria non dipende dalla dimensione del raster.
+namespace RasterExport {
+
+enum class Format
+{
+    GeoTiff,    // tiled DEFLATE, georeferenziato
+    Cog,        // Cloud Optimized GeoTIFF (driver COG, overview incluse)
+    Png         // per i report, con world file
+};
+
+const int TileSize = 256;
+
+// Valori normalizzati della colormap tabulati: l'errore (1/4096) è sotto il
+// passo di un canale a 8 bit
+const int LutSize = 4096;
+
+// Colormap del provider campionata in LutSize colori (usata anche dal tile server)
+std::vector<QRgb> buildLut(const QVector<QColor> &colors);
+
+// Geotransform e proiezione presenti
+bool hasGeoreference(GDALDataset *dataset);
+
+// Maschera ricampionata (nearest) sulla griglia della base ridotta a width x height
+// (dimensioni della base = piena risoluzione): il VRT warpa solo le finestre
+// lette. Il VRT va chiuso prima di mask
+std::shared_ptr<GDALDataset> alignedMask(GDALDataset *mask, GDALDataset *base, int width, int height);
+
+Format formatFromName(const QString &name);
+QString formatName(Format format);
+
+struct Params
+{
+    // Base: basePath vuoto = sfondo nero sulla griglia della maschera
+    QString basePath;
+    bool rgb = false;               // bande 1-3 come RGB (colormap=-1 nel provider)
+    QVector<QColor> colors;         // colormap per la base a una banda
+    // Stretch della colormap; minValue == maxValue = statistiche della banda
+    double minValue = 0.0;
+    double maxValue = 0.0;
+
+    // Maschera: valori != 0 coperti; colore non valido = valore della maschera
+    // in grigio opaco (layer "Result"), altrimenti colore con overlayOpacity
+    QString overlayPath;
+    QColor overlayColor;
+    double overlayOpacity = 1.0;
+
+    Format format = Format::GeoTiff;
+};
+
+bool exportComposite(const Params &params, const QString &outputPath, QString *error,
+                     const RasterAlgebra::ProgressFunction &progress = RasterAlgebra::ProgressFunction());
+
+} // namespace RasterExport
+
+#endif // RASTEREXPORT_H
@@ -0,0 +1,104 @@
+#include "rastermetadata.h"
+#include "datasetcatalog.h"
+#include <QStringList>
+#include <cmath>
+
+RasterMetadata::RasterMetadata(QObject *parent)
+    : QObject(parent)
+{
+}
+
+RasterMetadata::~RasterMetadata()
+{
+}
+
+QString RasterMetadata::cleanPath(const QString &path)
+{
+    if (path.startsWith("file:///")) return path.mid(8);
+    if (path.startsWith("file://")) return path.mid(7);
+    return path;
+}
+
+void RasterMetadata::setSource(const QString &source)
+{
+    if (m_source == source) {
+        return;
+    }
+    m_source = source;
+    emit sourceChanged();
+    refresh();
+}
+
+void RasterMetadata::refresh()
+{
+    const QString path = cleanPath(m_source);
+    std::shared_ptr<const DatasetInfo> info = path.isEmpty() ? nullptr : DatasetCatalog::instance().probe(path);
+    if (info == m_info) {
+        return;
+    }
+    m_info = info;
+    emit changed();
+}
+
+bool RasterMetadata::valid() const { return m_info && m_info->valid; }
+QString RasterMetadata::error() const { return m_info ? m_info->error : QString(); }
+QString RasterMetadata::driver() const { return m_info ? m_info->driver : QString(); }
+int RasterMetadata::width() const { return m_info ? m_info->width : 0; }
+int RasterMetadata::height() const { return m_info ? m_info->height : 0; }
+int RasterMetadata::bandCount() const { return m_info ? m_info->bandCount : 0; }
+QString RasterMetadata::dataType() const { return m_info ? m_info->dataType : QString(); }
+bool RasterMetadata::hasNoData() const { return m_info && m_info->hasNoData; }
+double RasterMetadata::noData() const { return m_info ? m_info->noData : 0.0; }
+QString RasterMetadata::crsName() const { return m_info ? m_info->crsName : QString(); }
+int RasterMetadata::epsg() const { return m_info ? m_info->epsg : 0; }
+QString RasterMetadata::crsWkt() const { return m_info ? m_info->crsWkt : QString(); }
+int RasterMetadata::overviewCount() const { return m_info ? (int)m_info->overviews.size() : 0; }
+int RasterMetadata::blockWidth() const { return m_info ? m_info->blockWidth : 0; }
+int RasterMetadata::blockHeight() const { return m_info ? m_info->blockHeight : 0; }
+bool RasterMetadata::tiled() const { return m_info && m_info->tiled(); }
+QString RasterMetadata::compression() const { return m_info ? m_info->compression : QString(); }
+
+QVariantList RasterMetadata::geoTransform() const
+{
+    QVariantList values;
+    if (m_info && m_info->hasGeoTransform) {
+        for (double value : m_info->geoTransform) values.append(value);
+    }
+    return values;
+}
+
+double RasterMetadata::pixelSizeX() const
+{
+    return m_info && m_info->hasGeoTransform ? std::abs(m_info->geoTransform[1]) : 0.0;
+}
+
+double RasterMetadata::pixelSizeY() const
+{
+    return m_info && m_info->hasGeoTransform ? std::abs(m_info->geoTransform[5]) : 0.0;
+}
+
+QVariantList RasterMetadata::overviews() const
+{
+    QVariantList levels;
+    if (m_info) {
+        for (const QSize &size : m_info->overviews) levels.append(size);
+    }
+    return levels;
+}
+
+QString RasterMetadata::summary() const
+{
+    if (!m_info) return QString();
+    if (!m_info->valid) return m_info->error;
+    QStringList parts;
+    parts << QString("%1×%2").arg(m_info->width).arg(m_info->height);
+    parts << QString("%1×%2").arg(m_info->bandCount).arg(m_info->dataType);
+    if (m_info->epsg > 0) {
+        parts << QString("EPSG:%1").arg(m_info->epsg);
+    } else if (!m_info->crsName.isEmpty()) {
+        parts << m_info->crsName;
+    }
+    if (!m_info->compression.isEmpty()) parts << m_info->compression;
+    if (!m_info->overviews.empty()) parts << QString("%1 ovr").arg(m_info->overviews.size());
+    return parts.join(" · ");
+}
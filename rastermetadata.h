@@ -0,0 +1,86 @@
+#ifndef RASTERMETADATA_H
+#define RASTERMETADATA_H
+
+#include <QObject>
+#include <QString>
+#include <QVariantList>
+#include <memory>
+
+struct DatasetInfo;
+
+// Metadati del raster `source` per il QML, dal DatasetCatalog: i pannelli li
+// usano per impaginare e scegliere come leggere (overview presenti, blocchi)
+// appena il file è scelto. source accetta anche URL file://.
+class RasterMetadata : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(bool valid READ valid NOTIFY changed)
+    Q_PROPERTY(QString error READ error NOTIFY changed)
+    Q_PROPERTY(QString driver READ driver NOTIFY changed)
+    Q_PROPERTY(int width READ width NOTIFY changed)
+    Q_PROPERTY(int height READ height NOTIFY changed)
+    Q_PROPERTY(int bandCount READ bandCount NOTIFY changed)
+    Q_PROPERTY(QString dataType READ dataType NOTIFY changed)
+    Q_PROPERTY(bool hasNoData READ hasNoData NOTIFY changed)
+    Q_PROPERTY(double noData READ noData NOTIFY changed)
+    Q_PROPERTY(QString crsName READ crsName NOTIFY changed)
+    Q_PROPERTY(int epsg READ epsg NOTIFY changed)
+    Q_PROPERTY(QString crsWkt READ crsWkt NOTIFY changed)
+    Q_PROPERTY(QVariantList geoTransform READ geoTransform NOTIFY changed)
+    Q_PROPERTY(double pixelSizeX READ pixelSizeX NOTIFY changed)
+    Q_PROPERTY(double pixelSizeY READ pixelSizeY NOTIFY changed)
+    Q_PROPERTY(int overviewCount READ overviewCount NOTIFY changed)
+    Q_PROPERTY(QVariantList overviews READ overviews NOTIFY changed)
+    Q_PROPERTY(int blockWidth READ blockWidth NOTIFY changed)
+    Q_PROPERTY(int blockHeight READ blockHeight NOTIFY changed)
+    Q_PROPERTY(bool tiled READ tiled NOTIFY changed)
+    Q_PROPERTY(QString compression READ compression NOTIFY changed)
+    Q_PROPERTY(QString summary READ summary NOTIFY changed)
+
+public:
+    explicit RasterMetadata(QObject *parent = nullptr);
+    ~RasterMetadata();
+
+    QString source() const { return m_source; }
+    void setSource(const QString &source);
+
+    bool valid() const;
+    QString error() const;
+    QString driver() const;
+    int width() const;
+    int height() const;
+    int bandCount() const;
+    QString dataType() const;
+    bool hasNoData() const;
+    double noData() const;
+    QString crsName() const;
+    int epsg() const;
+    QString crsWkt() const;
+    QVariantList geoTransform() const;
+    double pixelSizeX() const;
+    double pixelSizeY() const;
+    int overviewCount() const;
+    QVariantList overviews() const;     // QSize per livello
+    int blockWidth() const;
+    int blockHeight() const;
+    bool tiled() const;
+    QString compression() const;
+    // Riga compatta per l'intestazione del pannello: 12000×8000 · 1×Float32 · EPSG:32632 · DEFLATE
+    QString summary() const;
+
+    // Rilegge l'header se il file è cambiato (il catalogo confronta mtime e dimensione)
+    Q_INVOKABLE void refresh();
+
+signals:
+    void sourceChanged();
+    void changed();
+
+private:
+    static QString cleanPath(const QString &path);
+
+    QString m_source;
+    std::shared_ptr<const DatasetInfo> m_info;
+};
+
+#endif // RASTERMETADATA_H
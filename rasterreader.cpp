@@ -0,0 +1,246 @@
+#include "rasterreader.h"
+#include "decodepool.h"
+#include <QDebug>
+#include <QAtomicInt>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <gdal_priv.h>
+
+namespace {
+
+std::atomic<int> g_defaultMode(static_cast<int>(ResampleMode::Average));
+
+} // namespace
+
+namespace RasterReader {
+
+ResampleMode modeFromName(const QString &name, ResampleMode fallback)
+{
+    QString key = name.trimmed().toLower();
+    if (key == "nearest" || key == "fast") return ResampleMode::Nearest;
+    if (key == "average" || key == "quality") return ResampleMode::Average;
+    if (key == "bilinear") return ResampleMode::Bilinear;
+    if (key == "cubic") return ResampleMode::Cubic;
+    if (key == "mode") return ResampleMode::Mode;
+    return fallback;
+}
+
+QString modeName(ResampleMode mode)
+{
+    switch (mode) {
+        case ResampleMode::Nearest: return "nearest";
+        case ResampleMode::Average: return "average";
+        case ResampleMode::Bilinear: return "bilinear";
+        case ResampleMode::Cubic: return "cubic";
+        case ResampleMode::Mode: return "mode";
+    }
+    return "nearest";
+}
+
+GDALRIOResampleAlg rioAlgorithm(ResampleMode mode)
+{
+    switch (mode) {
+        case ResampleMode::Nearest: return GRIORA_NearestNeighbour;
+        case ResampleMode::Average: return GRIORA_Average;
+        case ResampleMode::Bilinear: return GRIORA_Bilinear;
+        case ResampleMode::Cubic: return GRIORA_Cubic;
+        case ResampleMode::Mode: return GRIORA_Mode;
+    }
+    return GRIORA_NearestNeighbour;
+}
+
+GDALResampleAlg warpAlgorithm(ResampleMode mode)
+{
+    switch (mode) {
+        case ResampleMode::Nearest: return GRA_NearestNeighbour;
+        case ResampleMode::Average: return GRA_Average;
+        case ResampleMode::Bilinear: return GRA_Bilinear;
+        case ResampleMode::Cubic: return GRA_Cubic;
+        case ResampleMode::Mode: return GRA_Mode;
+    }
+    return GRA_NearestNeighbour;
+}
+
+void setDefaultMode(ResampleMode mode)
+{
+    g_defaultMode.store(static_cast<int>(mode));
+    qDebug() << "Default preview resampling set to:" << modeName(mode);
+}
+
+ResampleMode defaultMode()
+{
+    return static_cast<ResampleMode>(g_defaultMode.load());
+}
+
+GDALRasterBand *bestOverview(GDALRasterBand *band, double decimation, double &factorX, double &factorY)
+{
+    factorX = 1.0;
+    factorY = 1.0;
+    GDALRasterBand *best = band;
+
+    // Nessuna overview più grossolana della decimazione richiesta:
+    // ogni pixel di output deve coprire almeno un pixel dell'overview
+    int count = band->GetOverviewCount();
+    for (int i = 0; i < count; ++i) {
+        GDALRasterBand *overview = band->GetOverview(i);
+        if (!overview || overview->GetXSize() <= 0 || overview->GetYSize() <= 0) {
+            continue;
+        }
+        double fx = (double)band->GetXSize() / overview->GetXSize();
+        double fy = (double)band->GetYSize() / overview->GetYSize();
+        double factor = std::max(fx, fy);
+        if (factor <= decimation + 1e-6 && factor > std::max(factorX, factorY)) {
+            best = overview;
+            factorX = fx;
+            factorY = fy;
+        }
+    }
+    return best;
+}
+
+CPLErr readWindow(GDALRasterBand *band, double srcX, double srcY, double srcWidth, double srcHeight,
+                  void *buffer, int bufWidth, int bufHeight, GDALDataType bufType, ResampleMode mode,
+                  GSpacing pixelSpace, GSpacing lineSpace)
+{
+    if (!band || bufWidth <= 0 || bufHeight <= 0 || srcWidth <= 0.0 || srcHeight <= 0.0) {
+        return CE_Failure;
+    }
+
+    double decimation = std::min(srcWidth / bufWidth, srcHeight / bufHeight);
+    double factorX = 1.0;
+    double factorY = 1.0;
+    GDALRasterBand *source = decimation > 1.0 ? bestOverview(band, decimation, factorX, factorY) : band;
+
+    // Finestra nelle coordinate del livello scelto, limitata all'estensione
+    int levelWidth = source->GetXSize();
+    int levelHeight = source->GetYSize();
+    double x = std::max(0.0, srcX / factorX);
+    double y = std::max(0.0, srcY / factorY);
+    double w = std::min(srcWidth / factorX, levelWidth - x);
+    double h = std::min(srcHeight / factorY, levelHeight - y);
+    if (w <= 0.0 || h <= 0.0) {
+        return CE_Failure;
+    }
+
+    int xOff = std::min(levelWidth - 1, static_cast<int>(std::floor(x)));
+    int yOff = std::min(levelHeight - 1, static_cast<int>(std::floor(y)));
+    int xSize = std::max(1, std::min(levelWidth - xOff, static_cast<int>(std::ceil(x + w)) - xOff));
+    int ySize = std::max(1, std::min(levelHeight - yOff, static_cast<int>(std::ceil(y + h)) - yOff));
+
+    GDALRasterIOExtraArg extraArg;
+    INIT_RASTERIO_EXTRA_ARG(extraArg);
+    extraArg.eResampleAlg = rioAlgorithm(mode);
+    extraArg.bFloatingPointWindowValidity = TRUE;
+    extraArg.dfXOff = x;
+    extraArg.dfYOff = y;
+    extraArg.dfXSize = w;
+    extraArg.dfYSize = h;
+
+    return source->RasterIO(GF_Read, xOff, yOff, xSize, ySize, buffer, bufWidth, bufHeight,
+                            bufType, pixelSpace, lineSpace, &extraArg);
+}
+
+CPLErr readBand(GDALRasterBand *band, void *buffer, int bufWidth, int bufHeight,
+                GDALDataType bufType, ResampleMode mode)
+{
+    if (!band) {
+        return CE_Failure;
+    }
+    return readWindow(band, 0.0, 0.0, band->GetXSize(), band->GetYSize(),
+                      buffer, bufWidth, bufHeight, bufType, mode);
+}
+
+CPLErr readParallel(const QString &path, int bandIndex, int xOff, int yOff, int xSize, int ySize,
+                    void *buffer, GDALDataType bufType, int threads)
+{
+    if (xSize <= 0 || ySize <= 0) {
+        return CE_Failure;
+    }
+    auto open = [&path]() {
+        return std::unique_ptr<GDALDataset, void (*)(GDALDataset*)>(
+            (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly),
+            [](GDALDataset *d) { if (d) GDALClose(d); });
+    };
+    auto first = open();
+    GDALRasterBand *band = first ? first->GetRasterBand(bandIndex) : nullptr;
+    if (!band) {
+        return CE_Failure;
+    }
+
+    // Chunk allineati ai blocchi: colonne di blocchi, righe raggruppate finché
+    // il chunk non arriva a MinChunkPixels (le strip sono alte poche righe)
+    int blockWidth = 0, blockHeight = 0;
+    band->GetBlockSize(&blockWidth, &blockHeight);
+    blockWidth = std::max(1, blockWidth);
+    blockHeight = std::max(1, blockHeight);
+    const int groupRows = std::max(1, MinChunkPixels / std::max(1, blockWidth * blockHeight));
+    const int chunkHeight = blockHeight * groupRows;
+    // Bordi del chunk sulla griglia del file, non della finestra
+    const int firstColumn = xOff / blockWidth;
+    const int lastColumn = (xOff + xSize - 1) / blockWidth;
+    const int firstRow = yOff / chunkHeight;
+    const int lastRow = (yOff + ySize - 1) / chunkHeight;
+    const int columns = lastColumn - firstColumn + 1;
+    const int total = columns * (lastRow - firstRow + 1);
+
+    const int pixelBytes = GDALGetDataTypeSizeBytes(bufType);
+    const GSpacing lineSpace = (GSpacing)xSize * pixelBytes;
+    int workers = threads > 0 ? threads : DecodePool::maxThreads();
+    workers = std::max(1, std::min(workers, total));
+    if (workers == 1) {
+        return band->RasterIO(GF_Read, xOff, yOff, xSize, ySize, buffer, xSize, ySize, bufType, 0, 0);
+    }
+    QAtomicInt next(0);
+    QAtomicInt failed(0);
+    QMutex mutex;
+    QString firstError;
+
+    // Ogni chunk scrive nella propria porzione del buffer di destinazione
+    auto readChunks = [&](GDALRasterBand *workerBand) {
+        while (!failed.loadAcquire()) {
+            const int index = next.fetchAndAddRelaxed(1);
+            if (index >= total) {
+                break;
+            }
+            const int column = firstColumn + index % columns;
+            const int row = firstRow + index / columns;
+            const int x0 = std::max(xOff, column * blockWidth);
+            const int x1 = std::min(xOff + xSize, (column + 1) * blockWidth);
+            const int y0 = std::max(yOff, row * chunkHeight);
+            const int y1 = std::min(yOff + ySize, (row + 1) * chunkHeight);
+            char *target = static_cast<char*>(buffer) + (y0 - yOff) * lineSpace + (GSpacing)(x0 - xOff) * pixelBytes;
+            if (workerBand->RasterIO(GF_Read, x0, y0, x1 - x0, y1 - y0, target, x1 - x0, y1 - y0,
+                                     bufType, pixelBytes, lineSpace) != CE_None) {
+                QMutexLocker locker(&mutex);
+                if (firstError.isEmpty()) firstError = QString::fromUtf8(CPLGetLastErrorMsg());
+                failed.storeRelease(1);
+            }
+        }
+    };
+
+    // Il thread chiamante lavora col primo dataset, i worker aprono il proprio
+    DecodePool::parallelFor(workers, [&](int worker) {
+        if (worker == 0) {
+            readChunks(band);
+            return;
+        }
+        auto dataset = open();
+        GDALRasterBand *workerBand = dataset ? dataset->GetRasterBand(bandIndex) : nullptr;
+        if (!workerBand) {
+            // Senza dataset il worker non prende chunk: li fanno gli altri
+            return;
+        }
+        readChunks(workerBand);
+    });
+
+    if (failed.loadAcquire()) {
+        qWarning() << "Parallel read failed:" << path << firstError;
+        return CE_Failure;
+    }
+    return CE_None;
+}
+
+} // namespace RasterReader
@@ -0,0 +1,61 @@
+#ifndef RASTERREADER_H
+#define RASTERREADER_H
+
+#include <QString>
+#include <gdal.h>
+#include <gdalwarper.h>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Modalità di ricampionamento per le letture ridotte (anteprime, overlay)
+enum class ResampleMode
+{
+    Nearest,    // veloce, aliasing sui DSM: da usare durante il pan
+    Average,    // media dei pixel sorgente: qualità per DSM/NDVI
+    Bilinear,
+    Cubic,
+    Mode        // valore più frequente: per maschere e classi
+};
+
+namespace RasterReader {
+
+// Nomi accettati: nearest, average, bilinear, cubic, mode, più gli alias
+// "fast" (= nearest) e "quality" (= average)
+ResampleMode modeFromName(const QString &name, ResampleMode fallback);
+QString modeName(ResampleMode mode);
+GDALRIOResampleAlg rioAlgorithm(ResampleMode mode);
+GDALResampleAlg warpAlgorithm(ResampleMode mode);
+
+// Modalità usata quando la richiesta non ne specifica una
+void setDefaultMode(ResampleMode mode);
+ResampleMode defaultMode();
+
+// Overview col fattore di riduzione più grande che non supera `decimation`
+// (la banda stessa se nessuna overview è adatta). factorX/Y = base / overview.
+GDALRasterBand *bestOverview(GDALRasterBand *band, double decimation, double &factorX, double &factorY);
+
+// Legge la finestra sorgente (pixel a piena risoluzione, anche frazionari) in un
+// buffer bufWidth x bufHeight: instrada sull'overview migliore e ricampiona
+// tramite GDALRasterIOExtraArg
+CPLErr readWindow(GDALRasterBand *band, double srcX, double srcY, double srcWidth, double srcHeight,
+                  void *buffer, int bufWidth, int bufHeight, GDALDataType bufType, ResampleMode mode,
+                  GSpacing pixelSpace = 0, GSpacing lineSpace = 0);
+
+// Banda intera ridotta a bufWidth x bufHeight
+CPLErr readBand(GDALRasterBand *band, void *buffer, int bufWidth, int bufHeight,
+                GDALDataType bufType, ResampleMode mode);
+
+// Finestra a piena risoluzione (nessun ricampionamento) della banda bandIndex
+// di `path`, decodificata in parallelo: la finestra si divide lungo la griglia
+// dei blocchi del file (strip raggruppate fino a MinChunkPixels), i worker si
+// prendono il chunk successivo da un contatore condiviso e ognuno legge dal
+// proprio dataset direttamente nella sua porzione di `buffer` (compatto,
+// xSize * ySize). threads 0 = DecodePool::maxThreads(), 1 = RasterIO singola
+const int MinChunkPixels = 256 * 256;
+CPLErr readParallel(const QString &path, int bandIndex, int xOff, int yOff, int xSize, int ySize,
+                    void *buffer, GDALDataType bufType, int threads = 0);
+
+} // namespace RasterReader
+
+#endif // RASTERREADER_H
@@ -0,0 +1,735 @@
+#include "rastertilecache.h"
+#include "memorygovernor.h"
+#include "disktilecache.h"
+#include "decodepool.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <gdal_priv.h>
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 4, 0)
+#include <cpl_compressor.h>
+#endif
+
+namespace {
+
+// Tile demossi per passata: la compressione avviene fuori dal lock
+const int DemoteBatch = 16;
+
+// Codec del livello compresso: LZ4 (o zstd) dai compressori di GDAL se
+// disponibili, altrimenti zlib di Qt al livello più veloce
+struct TileCodec
+{
+    QString name;
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 4, 0)
+    const CPLCompressor *compressor = nullptr;
+    const CPLCompressor *decompressor = nullptr;
+    CSLConstList options = nullptr;
+#endif
+
+    TileCodec()
+    {
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 4, 0)
+        for (const char *id : {"lz4", "zstd"}) {
+            compressor = CPLGetCompressor(id);
+            decompressor = CPLGetDecompressor(id);
+            if (compressor && decompressor) {
+                name = id;
+                // Il livello di default di zstd (13) è troppo lento per una cache
+                static const char *const zstdOptions[] = {"LEVEL=1", nullptr};
+                if (name == "zstd") options = zstdOptions;
+                return;
+            }
+        }
+        compressor = nullptr;
+        decompressor = nullptr;
+#endif
+        name = "zlib";
+    }
+
+    static const TileCodec &instance()
+    {
+        static TileCodec codec;
+        return codec;
+    }
+};
+
+// Byte shuffle: i byte di pari peso dei campioni contigui (esponenti, byte
+// alti dei codici e nodata ripetuti diventano sequenze lunghe, come in Blosc)
+void shuffle(const uchar *bytes, size_t count, size_t elementBytes, uchar *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < elementBytes; ++b) {
+            out[b * count + i] = bytes[i * elementBytes + b];
+        }
+    }
+}
+
+void unshuffle(const uchar *in, size_t count, size_t elementBytes, uchar *bytes)
+{
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < elementBytes; ++b) {
+            bytes[i * elementBytes + b] = in[b * count + i];
+        }
+    }
+}
+
+QByteArray compressTile(const RasterTile &tile)
+{
+    const size_t rawBytes = tile.payloadBytes();
+    const size_t elementBytes = Quantize::sampleBytes(tile.format);
+    std::vector<uchar> shuffled(rawBytes);
+    shuffle(tile.payload(), rawBytes / elementBytes, elementBytes, shuffled.data());
+
+    const TileCodec &codec = TileCodec::instance();
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 4, 0)
+    if (codec.compressor) {
+        size_t bound = 0;
+        if (!codec.compressor->pfnFunc(shuffled.data(), rawBytes, nullptr, &bound, codec.options,
+                                       codec.compressor->user_data) || bound == 0) {
+            return QByteArray();
+        }
+        QByteArray out(static_cast<int>(bound), Qt::Uninitialized);
+        void *outData = out.data();
+        size_t outSize = bound;
+        if (!codec.compressor->pfnFunc(shuffled.data(), rawBytes, &outData, &outSize, codec.options,
+                                       codec.compressor->user_data)) {
+            return QByteArray();
+        }
+        out.truncate(static_cast<int>(outSize));
+        return out;
+    }
+#endif
+    return qCompress(shuffled.data(), static_cast<int>(rawBytes), 1);
+}
+
+// tile arriva con dimensioni e formato (ColdEntry::header), qui si ripristinano i valori
+bool decompressTile(const QByteArray &data, RasterTile &tile)
+{
+    const size_t count = (size_t)tile.width * tile.height;
+    const size_t elementBytes = Quantize::sampleBytes(tile.format);
+    const size_t rawBytes = count * elementBytes;
+    std::vector<uchar> shuffled;
+
+    const TileCodec &codec = TileCodec::instance();
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 4, 0)
+    if (codec.decompressor) {
+        shuffled.resize(rawBytes);
+        void *outData = shuffled.data();
+        size_t outSize = rawBytes;
+        if (!codec.decompressor->pfnFunc(data.constData(), data.size(), &outData, &outSize, nullptr,
+                                         codec.decompressor->user_data) || outSize != rawBytes) {
+            return false;
+        }
+    } else
+#endif
+    {
+        QByteArray raw = qUncompress(data);
+        if ((size_t)raw.size() != rawBytes) {
+            return false;
+        }
+        shuffled.assign(raw.constData(), raw.constData() + raw.size());
+    }
+    uchar *bytes;
+    if (tile.format == Quantize::Format::Float32) {
+        tile.data.resize(count);
+        bytes = reinterpret_cast<uchar*>(tile.data.data());
+    } else {
+        tile.packed.resize(rawBytes);
+        bytes = tile.packed.data();
+    }
+    unshuffle(shuffled.data(), count, elementBytes, bytes);
+    return true;
+}
+
+// Nodata dei tile: quello della banda, altrimenti il -9999 usato dagli export
+float tileNoData(GDALRasterBand *band)
+{
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+    return hasNoData ? static_cast<float>(noData) : -9999.0f;
+}
+
+} // namespace
+
+RasterGrid RasterGrid::create(const QString &path, GDALRasterBand *band, int bandIndex,
+                              int width, int height, ResampleMode mode)
+{
+    RasterGrid grid;
+    grid.band = bandIndex;
+    grid.path = path;
+    grid.sourceWidth = band->GetXSize();
+    grid.sourceHeight = band->GetYSize();
+    grid.width = width;
+    grid.height = height;
+    grid.mode = mode;
+
+    // mtime nella chiave: un raster riscritto dall'analisi non riusa tile vecchi
+    qint64 mtime = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    grid.key = path + '|' + QString::number(mtime) + '|' + QString::number(bandIndex) + '|'
+               + QString::number(width) + 'x' + QString::number(height) + '|'
+               + RasterReader::modeName(mode);
+    return grid;
+}
+
+int RasterGrid::tilesX() const
+{
+    return (width + RasterTileCache::TileSize - 1) / RasterTileCache::TileSize;
+}
+
+int RasterGrid::tilesY() const
+{
+    return (height + RasterTileCache::TileSize - 1) / RasterTileCache::TileSize;
+}
+
+const uchar *RasterTile::payload() const
+{
+    return format == Quantize::Format::Float32 ? reinterpret_cast<const uchar*>(data.data()) : packed.data();
+}
+
+void RasterTile::expandRow(int row, float *out) const
+{
+    const size_t start = (size_t)row * width;
+    switch (format) {
+    case Quantize::Format::Float32:
+        std::memcpy(out, data.data() + start, width * sizeof(float));
+        break;
+    case Quantize::Format::Float16:
+        Quantize::fromHalf(reinterpret_cast<const quint16*>(packed.data()) + start, width, noData, out);
+        break;
+    case Quantize::Format::UInt16:
+        Quantize::fromUInt16(reinterpret_cast<const quint16*>(packed.data()) + start, width, offset, scale, noData, out);
+        break;
+    case Quantize::Format::UInt8:
+        Quantize::fromUInt8(packed.data() + start, width, offset, scale, noData, out);
+        break;
+    }
+}
+
+void RasterTile::expand(float *out, size_t stride) const
+{
+    for (int row = 0; row < height; ++row) {
+        expandRow(row, out + (size_t)row * stride);
+    }
+}
+
+void RasterTile::quantize(Quantize::Format target, float bandNoData)
+{
+    if (format != Quantize::Format::Float32 || target == Quantize::Format::Float32) {
+        return;
+    }
+    noData = bandNoData;
+    float minValue = 0.0f;
+    float maxValue = 0.0f;
+    const bool hasValues = Quantize::validRange(data.data(), data.size(), noData, minValue, maxValue);
+    if (target == Quantize::Format::Float16
+        && std::max(std::abs(minValue), std::abs(maxValue)) > Quantize::HalfMax) {
+        target = Quantize::Format::UInt16;
+    }
+
+    const size_t count = data.size();
+    packed.resize(count * Quantize::sampleBytes(target));
+    offset = hasValues ? minValue : 0.0f;
+    switch (target) {
+    case Quantize::Format::Float16:
+        Quantize::toHalf(data.data(), count, noData, reinterpret_cast<quint16*>(packed.data()));
+        break;
+    case Quantize::Format::UInt16:
+        scale = (maxValue - minValue) / Quantize::UInt16MaxCode;
+        Quantize::toUInt16(data.data(), count, offset, scale, noData, reinterpret_cast<quint16*>(packed.data()));
+        break;
+    case Quantize::Format::UInt8:
+        scale = (maxValue - minValue) / Quantize::UInt8MaxCode;
+        Quantize::toUInt8(data.data(), count, offset, scale, noData, packed.data());
+        break;
+    case Quantize::Format::Float32:
+        break;
+    }
+    format = target;
+    std::vector<float>().swap(data);
+}
+
+RasterTileCache &RasterTileCache::instance()
+{
+    static RasterTileCache cache;
+    return cache;
+}
+
+RasterTileCache::RasterTileCache()
+    : m_usedBytes(0)
+    , m_coldBytes(0)
+    , m_coldRawBytes(0)
+    , m_decompressions(0)
+    , m_decompressNs(0)
+    , m_decompressMaxNs(0)
+    , m_format(static_cast<int>(Quantize::Format::UInt16))
+{
+}
+
+Quantize::Format RasterTileCache::format() const
+{
+    return static_cast<Quantize::Format>(m_format.loadRelaxed());
+}
+
+void RasterTileCache::setFormat(Quantize::Format format)
+{
+    if (m_format.fetchAndStoreRelaxed(static_cast<int>(format)) == static_cast<int>(format)) {
+        return;
+    }
+    // I tile in memoria hanno il formato precedente: si ridecodificano (dal disco, in float)
+    clear();
+    qDebug() << "Raster tile cache format:" << Quantize::formatName(format);
+}
+
+std::shared_ptr<const RasterTile> RasterTileCache::tile(const RasterGrid &grid, GDALRasterBand *band, int tx, int ty)
+{
+    QString key = grid.key + '|' + QString::number(tx) + ',' + QString::number(ty);
+    std::shared_ptr<const RasterTile> cached = lookup(key);
+    if (cached) {
+        return cached;
+    }
+
+    auto decoded = std::make_shared<RasterTile>();
+    int x0 = tx * TileSize;
+    int y0 = ty * TileSize;
+    const int width = std::min(TileSize, grid.width - x0);
+    const int height = std::min(TileSize, grid.height - y0);
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    // Tile persistito in una sessione precedente: niente decodifica GDAL
+    if (DiskTileCache::instance().load(key, *decoded) && decoded->width == width && decoded->height == height) {
+        decoded->quantize(format(), tileNoData(band));
+        insert(key, decoded);
+        return decoded;
+    }
+    decoded->width = width;
+    decoded->height = height;
+    decoded->data.resize((size_t)decoded->width * decoded->height);
+
+    // Finestra sorgente frazionaria del tile: la lettura a tile coincide con
+    // quella dell'intera banda alla stessa dimensione di output
+    double scaleX = (double)grid.sourceWidth / grid.width;
+    double scaleY = (double)grid.sourceHeight / grid.height;
+    CPLErr err = RasterReader::readWindow(band, x0 * scaleX, y0 * scaleY,
+                                          decoded->width * scaleX, decoded->height * scaleY,
+                                          decoded->data.data(), decoded->width, decoded->height,
+                                          GDT_Float32, grid.mode);
+    if (err != CE_None) {
+        qWarning() << "Tile read failed:" << tx << ty << CPLGetLastErrorMsg();
+        return nullptr;
+    }
+
+    // Su disco in float: il formato in memoria si può cambiare senza invalidarlo
+    DiskTileCache::instance().store(key, *decoded);
+    decoded->quantize(format(), tileNoData(band));
+    insert(key, decoded);
+    return decoded;
+}
+
+bool RasterTileCache::forEachTile(const RasterGrid &grid, GDALRasterBand *band,
+                                  const std::function<void(const RasterTile &, int, int)> &visit)
+{
+    qint64 before = usedBytes();
+
+    // Prima i tile caldi; restano i compressi da decomprimere e quelli da
+    // decodificare (o dal disco), tutti nei worker
+    std::vector<int> missing;
+    const int tilesX = grid.tilesX();
+    const int total = tilesX * grid.tilesY();
+    for (int index = 0; index < total; ++index) {
+        const int tx = index % tilesX;
+        const int ty = index / tilesX;
+        std::shared_ptr<const RasterTile> t = lookupHot(grid.key + '|' + QString::number(tx) + ',' + QString::number(ty));
+        if (t) {
+            visit(*t, tx, ty);
+        } else {
+            missing.push_back(index);
+        }
+    }
+
+    const int workers = std::min<int>(DecodePool::maxThreads(), (int)missing.size());
+    QAtomicInt next(0);
+    QAtomicInt failed(0);
+    auto decodeMissing = [&](const std::function<GDALRasterBand*()> &workerBand) {
+        while (!failed.loadAcquire()) {
+            const int i = next.fetchAndAddRelaxed(1);
+            if (i >= (int)missing.size()) {
+                break;
+            }
+            const int tx = missing[i] % tilesX;
+            const int ty = missing[i] / tilesX;
+            // Un tile compresso si decomprime qui senza toccare GDAL
+            std::shared_ptr<const RasterTile> t = lookup(grid.key + '|' + QString::number(tx) + ',' + QString::number(ty));
+            GDALRasterBand *decodeBand = t ? nullptr : workerBand();
+            if (!t && decodeBand) {
+                t = tile(grid, decodeBand, tx, ty);
+            }
+            if (!t) {
+                failed.storeRelease(1);
+                break;
+            }
+            visit(*t, tx, ty);
+        }
+    };
+
+    if (workers > 1 && !grid.path.isEmpty()) {
+        // Un GDALDataset per thread: il chiamante usa `band`, i worker aprono il proprio
+        DecodePool::parallelFor(workers, [&](int worker) {
+            if (worker == 0) {
+                decodeMissing([band]() { return band; });
+                return;
+            }
+            // Dataset aperto solo al primo tile da decodificare: se mancano
+            // solo tile compressi il worker non apre il file
+            GDALDataset *dataset = nullptr;
+            bool opened = false;
+            decodeMissing([&]() -> GDALRasterBand* {
+                if (!opened) {
+                    opened = true;
+                    dataset = (GDALDataset*)GDALOpen(grid.path.toUtf8().constData(), GA_ReadOnly);
+                }
+                return dataset ? dataset->GetRasterBand(grid.band) : nullptr;
+            });
+            if (dataset) GDALClose(dataset);
+        });
+    } else {
+        decodeMissing([band]() { return band; });
+    }
+    if (failed.loadAcquire()) {
+        return false;
+    }
+
+    qint64 after = usedBytes();
+    if (after > before) {
+        // Solo dopo aver rilasciato il lock: il governor può richiamare trim()
+        MemoryGovernor::instance()->notifyAllocated();
+    }
+    qDebug() << "Decoded raster" << grid.width << "x" << grid.height << "from" << total << "tiles,"
+             << missing.size() << "missing on" << std::max(1, workers) << "threads,"
+             << (after - before) / 1024 << "KB newly decoded as" << Quantize::formatName(format())
+             << ", cache" << after / (1024 * 1024) << "MB";
+    return true;
+}
+
+bool RasterTileCache::readRaster(const RasterGrid &grid, GDALRasterBand *band, float *out)
+{
+    return forEachTile(grid, band, [&grid, out](const RasterTile &t, int tx, int ty) {
+        t.expand(out + (size_t)ty * TileSize * grid.width + tx * TileSize, grid.width);
+    });
+}
+
+bool RasterTileCache::colorize(const RasterGrid &grid, GDALRasterBand *band, const std::vector<QRgb> &lut,
+                               double minValue, double maxValue, QImage &image)
+{
+    image = QImage(grid.width, grid.height, QImage::Format_RGB32);
+    if (image.isNull() || lut.empty()) {
+        return false;
+    }
+    double range = maxValue - minValue;
+    if (range < 1e-10) range = 1.0;
+    const float lutScale = static_cast<float>((lut.size() - 1) / range);
+    const float lutMin = static_cast<float>(minValue);
+    // Puntatori presi prima dei worker: scanLine() non const farebbe il detach da più thread
+    uchar *bits = image.bits();
+    const size_t bytesPerLine = image.bytesPerLine();
+
+    return forEachTile(grid, band, [&](const RasterTile &t, int tx, int ty) {
+        auto line = [&](int row) {
+            return reinterpret_cast<QRgb*>(bits + (size_t)(ty * TileSize + row) * bytesPerLine) + tx * TileSize;
+        };
+        if (t.format == Quantize::Format::UInt8) {
+            // 256 codici: si colorano una volta, poi ogni pixel è un accesso alla palette
+            uchar codes[256];
+            float values[256];
+            QRgb palette[256];
+            for (int code = 0; code < 256; ++code) codes[code] = static_cast<uchar>(code);
+            Quantize::fromUInt8(codes, 256, t.offset, t.scale, t.noData, values);
+            Quantize::colorize(values, 256, lutMin, lutScale, lut.data(), (int)lut.size(), palette);
+            for (int row = 0; row < t.height; ++row) {
+                const uchar *src = t.packed.data() + (size_t)row * t.width;
+                QRgb *dst = line(row);
+                for (int x = 0; x < t.width; ++x) {
+                    dst[x] = palette[src[x]];
+                }
+            }
+            return;
+        }
+        std::vector<float> values(t.width);
+        for (int row = 0; row < t.height; ++row) {
+            t.expandRow(row, values.data());
+            Quantize::colorize(values.data(), t.width, lutMin, lutScale, lut.data(), (int)lut.size(), line(row));
+        }
+    });
+}
+
+bool RasterTileCache::quantize(const RasterGrid &grid, GDALRasterBand *band, double minValue, double maxValue,
+                               QImage &image)
+{
+    image = QImage(grid.width, grid.height, QImage::Format_Grayscale8);
+    if (image.isNull()) {
+        return false;
+    }
+    double range = maxValue - minValue;
+    if (range < 1e-10) range = 1.0;
+    const float offset = static_cast<float>(minValue);
+    const float scale = static_cast<float>(range / Quantize::UInt8MaxCode);
+    // Stesso nodata del percorso a buffer: quello della banda, altrimenti nessuno
+    int hasNoData = 0;
+    const double bandNoData = band->GetNoDataValue(&hasNoData);
+    const float noData = hasNoData ? static_cast<float>(bandNoData) : std::numeric_limits<float>::quiet_NaN();
+    uchar *bits = image.bits();
+    const size_t bytesPerLine = image.bytesPerLine();
+
+    return forEachTile(grid, band, [&](const RasterTile &t, int tx, int ty) {
+        auto line = [&](int row) { return bits + (size_t)(ty * TileSize + row) * bytesPerLine + tx * TileSize; };
+        if (t.format == Quantize::Format::UInt8) {
+            // Codici del tile rimappati una volta sulla scala della griglia
+            uchar codes[256];
+            float values[256];
+            uchar remap[256];
+            for (int code = 0; code < 256; ++code) codes[code] = static_cast<uchar>(code);
+            Quantize::fromUInt8(codes, 256, t.offset, t.scale, t.noData, values);
+            Quantize::toUInt8(values, 256, offset, scale, noData, remap);
+            for (int row = 0; row < t.height; ++row) {
+                const uchar *src = t.packed.data() + (size_t)row * t.width;
+                uchar *dst = line(row);
+                for (int x = 0; x < t.width; ++x) {
+                    dst[x] = remap[src[x]];
+                }
+            }
+            return;
+        }
+        std::vector<float> values(t.width);
+        for (int row = 0; row < t.height; ++row) {
+            t.expandRow(row, values.data());
+            Quantize::toUInt8(values.data(), t.width, offset, scale, noData, line(row));
+        }
+    });
+}
+
+bool RasterTileCache::prefetch(const RasterGrid &grid, GDALRasterBand *band)
+{
+    return forEachTile(grid, band, [](const RasterTile &, int, int) {});
+}
+
+bool RasterTileCache::valueRange(const RasterGrid &grid, GDALRasterBand *band, double &minValue, double &maxValue)
+{
+    QMutex mutex;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    bool ok = forEachTile(grid, band, [&](const RasterTile &t, int, int) {
+        std::vector<float> values((size_t)t.width * t.height);
+        t.expand(values.data(), t.width);
+        float tileMin = 0.0f;
+        float tileMax = 0.0f;
+        if (Quantize::validRange(values.data(), values.size(), t.noData, tileMin, tileMax)) {
+            QMutexLocker locker(&mutex);
+            lo = std::min(lo, tileMin);
+            hi = std::max(hi, tileMax);
+        }
+    });
+    if (!ok || lo > hi) {
+        return false;
+    }
+    minValue = lo;
+    maxValue = hi;
+    return true;
+}
+
+qint64 RasterTileCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes + m_coldBytes;
+}
+
+qint64 RasterTileCache::trim(qint64 targetBytes)
+{
+    // Sotto un quarto dell'obiettivo i caldi non si comprimono più: si
+    // scartano prima i compressi, così la viewport corrente resta in chiaro
+    const qint64 hotFloor = targetBytes / 4;
+    while (true) {
+        std::vector<std::pair<QString, std::shared_ptr<const RasterTile>>> batch;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_usedBytes + m_coldBytes <= targetBytes) {
+                return m_usedBytes + m_coldBytes;
+            }
+            if (m_usedBytes > hotFloor && !m_lru.empty()) {
+                // Coda LRU fuori dalla cache calda; torna nel livello compresso più sotto
+                while ((int)batch.size() < DemoteBatch && !m_lru.empty() && m_usedBytes > hotFloor) {
+                    auto it = m_tiles.find(m_lru.back());
+                    m_lru.pop_back();
+                    if (it == m_tiles.end()) continue;
+                    m_usedBytes -= it->tile->byteSize();
+                    batch.emplace_back(it.key(), it->tile);
+                    m_tiles.erase(it);
+                }
+            } else if (!m_coldLru.empty()) {
+                dropColdLocked();
+                continue;
+            } else if (!m_lru.empty()) {
+                dropHotLocked();
+                continue;
+            } else {
+                return m_usedBytes + m_coldBytes;
+            }
+        }
+
+        std::vector<std::pair<QString, ColdEntry>> compressed;
+        qint64 rawBytes = 0;
+        for (const auto &victim : batch) {
+            const RasterTile &tile = *victim.second;
+            ColdEntry entry;
+            entry.header.width = tile.width;
+            entry.header.height = tile.height;
+            entry.header.format = tile.format;
+            entry.header.offset = tile.offset;
+            entry.header.scale = tile.scale;
+            entry.header.noData = tile.noData;
+            entry.rawBytes = (qint64)tile.payloadBytes();
+            entry.data = compressTile(tile);
+            // Tile incomprimibili (rumore pieno): non vale la pena tenerli
+            qint64 tileRaw = entry.rawBytes;
+            if (entry.data.isEmpty() || entry.data.size() > tileRaw / 16 * 15) {
+                continue;
+            }
+            rawBytes += tileRaw;
+            compressed.emplace_back(victim.first, std::move(entry));
+        }
+
+        QMutexLocker locker(&m_mutex);
+        for (auto &item : compressed) {
+            // Nel frattempo un altro thread può averlo ridecodificato
+            if (m_tiles.contains(item.first) || m_cold.contains(item.first)) {
+                rawBytes -= item.second.rawBytes;
+                continue;
+            }
+            m_coldLru.push_front(item.first);
+            item.second.position = m_coldLru.begin();
+            m_coldBytes += item.second.byteSize();
+            m_cold.insert(item.first, std::move(item.second));
+        }
+        m_coldRawBytes += rawBytes;
+    }
+}
+
+void RasterTileCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_tiles.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+    m_cold.clear();
+    m_coldLru.clear();
+    m_coldBytes = 0;
+    m_coldRawBytes = 0;
+}
+
+RasterTileCache::Stats RasterTileCache::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats;
+    stats.hotTiles = m_tiles.size();
+    stats.coldTiles = m_cold.size();
+    stats.hotBytes = m_usedBytes;
+    stats.coldBytes = m_coldBytes;
+    stats.coldRawBytes = m_coldRawBytes;
+    stats.decompressions = m_decompressions;
+    stats.decompressMeanUs = m_decompressions > 0 ? m_decompressNs / 1e3 / m_decompressions : 0.0;
+    stats.decompressMaxUs = m_decompressMaxNs / 1e3;
+    stats.codec = TileCodec::instance().name;
+    stats.format = Quantize::formatName(format());
+    return stats;
+}
+
+std::shared_ptr<const RasterTile> RasterTileCache::lookupHot(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_tiles.find(key);
+    if (it == m_tiles.end()) {
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->position);
+    return it->tile;
+}
+
+std::shared_ptr<const RasterTile> RasterTileCache::lookup(const QString &key)
+{
+    ColdEntry cold;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_tiles.find(key);
+        if (it != m_tiles.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->position);
+            return it->tile;
+        }
+        auto coldIt = m_cold.find(key);
+        if (coldIt == m_cold.end()) {
+            return nullptr;
+        }
+        // Fuori dal livello compresso: torna caldo una volta decompresso
+        cold = coldIt.value();
+        m_coldLru.erase(coldIt->position);
+        m_coldBytes -= cold.byteSize();
+        m_coldRawBytes -= cold.rawBytes;
+        m_cold.erase(coldIt);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto tile = std::make_shared<RasterTile>(cold.header);
+    if (!decompressTile(cold.data, *tile)) {
+        qWarning() << "Compressed tile corrupted, decoding again:" << key;
+        return nullptr;
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_decompressions++;
+        m_decompressNs += elapsed;
+        m_decompressMaxNs = std::max(m_decompressMaxNs, elapsed);
+    }
+    insert(key, tile);
+    return tile;
+}
+
+void RasterTileCache::insert(const QString &key, std::shared_ptr<const RasterTile> tile)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_tiles.contains(key)) {
+        return;
+    }
+    m_lru.push_front(key);
+    m_usedBytes += tile->byteSize();
+    m_tiles.insert(key, Entry{std::move(tile), m_lru.begin()});
+}
+
+void RasterTileCache::dropColdLocked()
+{
+    auto it = m_cold.find(m_coldLru.back());
+    if (it != m_cold.end()) {
+        m_coldBytes -= it->byteSize();
+        m_coldRawBytes -= it->rawBytes;
+        m_cold.erase(it);
+    }
+    m_coldLru.pop_back();
+}
+
+void RasterTileCache::dropHotLocked()
+{
+    auto it = m_tiles.find(m_lru.back());
+    if (it != m_tiles.end()) {
+        m_usedBytes -= it->tile->byteSize();
+        m_tiles.erase(it);
+    }
+    m_lru.pop_back();
+}
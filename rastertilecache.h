@@ -0,0 +1,175 @@
+#ifndef RASTERTILECACHE_H
+#define RASTERTILECACHE_H
+
+#include "rasterreader.h"
+#include "quantize.h"
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QHash>
+#include <QImage>
+#include <QAtomicInt>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Tile di valori decodificati (nodata/NaN inclusi così come letti). In Float32
+// i valori sono in `data`, negli altri formati in `packed` come codici di
+// Quantize: chi legge il tile passa da expandRow/expand.
+struct RasterTile
+{
+    int width = 0;
+    int height = 0;
+    Quantize::Format format = Quantize::Format::Float32;
+    float offset = 0.0f;        // UInt16/UInt8: valore = offset + codice * scale
+    float scale = 0.0f;
+    float noData = 0.0f;        // valore esatto del codice riservato al nodata
+    std::vector<float> data;
+    std::vector<uchar> packed;
+
+    size_t payloadBytes() const { return data.size() * sizeof(float) + packed.size(); }
+    size_t byteSize() const { return payloadBytes() + sizeof(RasterTile); }
+    const uchar *payload() const;
+
+    // Riga `row` in float (width valori)
+    void expandRow(int row, float *out) const;
+    // Tile intero in out, righe di `stride` float
+    void expand(float *out, size_t stride) const;
+    // Da Float32 a `target` sul range dei valori validi del tile; Float16 ripiega
+    // su UInt16 se i valori escono dal range dell'half
+    void quantize(Quantize::Format target, float bandNoData);
+};
+
+// Griglia di output su cui un raster viene decodificato: stessa banda, stessa
+// dimensione e stessa modalità di ricampionamento condividono i tile.
+struct RasterGrid
+{
+    QString key;             // percorso|mtime|banda|WxH|modalità
+    QString path;            // per i dataset dei worker che decodificano in parallelo
+    int band = 1;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    int width = 0;
+    int height = 0;
+    ResampleMode mode = ResampleMode::Average;
+
+    static RasterGrid create(const QString &path, GDALRasterBand *band, int bandIndex,
+                             int width, int height, ResampleMode mode);
+    int tilesX() const;
+    int tilesY() const;
+};
+
+// Cache LRU dei raster decodificati, a tile di TileSize x TileSize sulla griglia
+// di output. Non ha una capacità propria: è un consumer del MemoryGovernor, che
+// la riduce quando il budget globale è superato.
+// I tile caldi sono quantizzati nel formato scelto (default UInt16 per tile:
+// metà della memoria dei float, errore sotto il mezzo passo del range del tile,
+// che per un DSM è di pochi millimetri); la cache su disco resta in float.
+// Due livelli: i tile caldi restano in chiaro; quando il governor chiede
+// spazio la coda LRU viene compressa (byte shuffle + LZ4/zstd di GDAL, zlib se
+// mancano) invece di essere scartata, e si scartano i compressi solo quando i
+// caldi sono scesi a un quarto dell'obiettivo. Un hit su un tile compresso lo
+// decomprime e lo riporta tra i caldi; nelle letture a griglia la
+// decompressione avviene nei worker insieme ai tile da decodificare.
+class RasterTileCache
+{
+public:
+    static const int TileSize = 256;
+
+    struct Stats
+    {
+        int hotTiles = 0;
+        int coldTiles = 0;
+        qint64 hotBytes = 0;
+        qint64 coldBytes = 0;
+        qint64 coldRawBytes = 0;        // dimensione in chiaro dei tile compressi
+        qint64 decompressions = 0;
+        double decompressMeanUs = 0.0;
+        double decompressMaxUs = 0.0;
+        QString codec;
+        QString format;                 // formato dei tile caldi
+    };
+
+    static RasterTileCache &instance();
+
+    // Tile (tx, ty) della griglia: dalla cache, oppure decodificato da `band`
+    std::shared_ptr<const RasterTile> tile(const RasterGrid &grid, GDALRasterBand *band, int tx, int ty);
+
+    // Raster intero della griglia in `out` (width * height float), decodificando solo
+    // i tile mancanti: se sono più d'uno li decodificano in parallelo worker con il
+    // proprio dataset, ognuno copiando i suoi tile nella porzione di `out`
+    bool readRaster(const RasterGrid &grid, GDALRasterBand *band, float *out);
+
+    // Griglia colorata con la colormap tabulata `lut` (RasterExport::buildLut) tra
+    // minValue e maxValue, direttamente dai tile quantizzati: per UInt8 con una
+    // palette di 256 colori per tile, senza passare da un buffer float intero
+    bool colorize(const RasterGrid &grid, GDALRasterBand *band, const std::vector<QRgb> &lut,
+                  double minValue, double maxValue, QImage &image);
+    // Come colorize ma in Grayscale8 con i codici Quantize::toUInt8 tra minValue
+    // e maxValue (channel=1: la colormap la applica lo shader)
+    bool quantize(const RasterGrid &grid, GDALRasterBand *band, double minValue, double maxValue, QImage &image);
+    // Porta in cache tutti i tile della griglia (i mancanti decodificati in
+    // parallelo) senza copiarli altrove: per chi poi li legge uno alla volta
+    bool prefetch(const RasterGrid &grid, GDALRasterBand *band);
+    // Min/max dei valori validi della griglia (statistiche GDAL non disponibili)
+    bool valueRange(const RasterGrid &grid, GDALRasterBand *band, double &minValue, double &maxValue);
+
+    // Formato dei tile caldi; cambiarlo svuota la cache
+    Quantize::Format format() const;
+    void setFormat(Quantize::Format format);
+
+    qint64 usedBytes() const;
+    // Comprime i tile caldi meno recenti, poi scarta i compressi, fino a targetBytes
+    qint64 trim(qint64 targetBytes);
+    void clear();
+    Stats stats() const;
+
+private:
+    RasterTileCache();
+
+    // Visita tutti i tile della griglia: quelli caldi nel thread chiamante, i
+    // compressi e i mancanti in parallelo (visit può essere chiamata da più thread)
+    bool forEachTile(const RasterGrid &grid, GDALRasterBand *band,
+                     const std::function<void(const RasterTile &, int, int)> &visit);
+    // Solo tile caldi: non decomprime
+    std::shared_ptr<const RasterTile> lookupHot(const QString &key);
+    std::shared_ptr<const RasterTile> lookup(const QString &key);
+    void insert(const QString &key, std::shared_ptr<const RasterTile> tile);
+    void dropColdLocked();
+    void dropHotLocked();
+
+    struct Entry
+    {
+        std::shared_ptr<const RasterTile> tile;
+        std::list<QString>::iterator position;
+    };
+
+    struct ColdEntry
+    {
+        RasterTile header;      // senza valori: dimensioni, formato e scala
+        qint64 rawBytes = 0;
+        QByteArray data;
+        std::list<QString>::iterator position;
+
+        qint64 byteSize() const { return data.size() + static_cast<qint64>(sizeof(ColdEntry)); }
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_tiles;
+    std::list<QString> m_lru;    // front = usato più di recente
+    qint64 m_usedBytes;          // solo tile caldi
+    QHash<QString, ColdEntry> m_cold;
+    std::list<QString> m_coldLru;
+    qint64 m_coldBytes;
+    qint64 m_coldRawBytes;
+    qint64 m_decompressions;
+    qint64 m_decompressNs;
+    qint64 m_decompressMaxNs;
+    QAtomicInt m_format;
+};
+
+#endif // RASTERTILECACHE_H
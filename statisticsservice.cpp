@@ -0,0 +1,188 @@
+#include "statisticsservice.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <gdal_priv.h>
+
+namespace {
+
+// Callback di avanzamento di GDAL: FALSE interrompe ComputeStatistics
+int CPL_STDCALL statisticsProgress(double, const char *, void *data)
+{
+    const QAtomicInt *cancelled = static_cast<const QAtomicInt *>(data);
+    return cancelled && cancelled->loadAcquire() ? FALSE : TRUE;
+}
+
+} // namespace
+
+StatisticsService::StatisticsService(QObject *parent)
+    : QObject(parent)
+    , m_nextHandle(0)
+    , m_nextJob(0)
+{
+    // Due letture complete in parallelo bastano: oltre, il disco è il collo di bottiglia
+    m_pool.setMaxThreadCount(2);
+    qRegisterMetaType<RasterStatistics>();
+}
+
+StatisticsService::~StatisticsService()
+{
+    for (const Job &job : std::as_const(m_jobs)) {
+        job.cancelled->storeRelease(1);
+    }
+    m_pool.waitForDone();
+}
+
+QString StatisticsService::cacheKey(const QString &imagePath)
+{
+    return imagePath + '|' + QString::number(QFileInfo(imagePath).lastModified().toMSecsSinceEpoch());
+}
+
+int StatisticsService::requestStatistics(const QString &imagePath, const QString &channel)
+{
+    int handle = ++m_nextHandle;
+    if (!channel.isEmpty()) {
+        cancel(channel);
+        m_channelHandles.insert(channel, handle);
+    }
+
+    QString key = cacheKey(imagePath);
+
+    // Anche dalla cache il risultato arriva in modo asincrono, dopo che il
+    // chiamante ha salvato l'handle
+    auto cached = m_cache.constFind(key);
+    if (cached != m_cache.constEnd()) {
+        RasterStatistics statistics = cached.value();
+        QMetaObject::invokeMethod(this, [this, handle, imagePath, channel, statistics]() {
+            if (!channel.isEmpty()) {
+                if (m_channelHandles.value(channel) != handle) return;
+                m_channelHandles.remove(channel);
+            }
+            emit statisticsReady(handle, imagePath, statistics);
+        }, Qt::QueuedConnection);
+        return handle;
+    }
+
+    m_handleJobs.insert(handle, key);
+    // Un calcolo già annullato non si riusa: ne parte uno nuovo che lo sostituisce
+    auto running = m_jobs.find(key);
+    if (running != m_jobs.end() && !running->cancelled->loadAcquire()) {
+        running->waiters.append(handle);
+        qDebug() << "Statistics request" << handle << "joins running job for:" << imagePath;
+        return handle;
+    }
+
+    Job job;
+    job.id = ++m_nextJob;
+    job.path = imagePath;
+    job.waiters.append(handle);
+    job.cancelled = std::make_shared<QAtomicInt>(0);
+    m_jobs.insert(key, job);
+
+    std::shared_ptr<QAtomicInt> cancelled = job.cancelled;
+    int jobId = job.id;
+    m_pool.start([this, key, jobId, imagePath, cancelled]() {
+        RasterStatistics statistics = compute(imagePath, cancelled.get());
+        QMetaObject::invokeMethod(this, [this, key, jobId, statistics]() {
+            finishJob(key, jobId, statistics);
+        }, Qt::QueuedConnection);
+    });
+    qDebug() << "Statistics request" << handle << "queued for:" << imagePath;
+    return handle;
+}
+
+void StatisticsService::cancel(const QString &channel)
+{
+    auto it = m_channelHandles.find(channel);
+    if (it == m_channelHandles.end()) {
+        return;
+    }
+    int handle = it.value();
+    m_channelHandles.erase(it);
+    detachWaiter(handle);
+}
+
+void StatisticsService::detachWaiter(int handle)
+{
+    QString key = m_handleJobs.take(handle);
+    auto job = m_jobs.find(key);
+    if (job == m_jobs.end()) {
+        return;
+    }
+    job->waiters.removeAll(handle);
+    // Nessun altro pannello aspetta questo raster: interrompi la lettura
+    if (job->waiters.isEmpty()) {
+        job->cancelled->storeRelease(1);
+        qDebug() << "Statistics cancelled for:" << job->path;
+    }
+}
+
+void StatisticsService::finishJob(const QString &key, int jobId, const RasterStatistics &statistics)
+{
+    // Calcolo sostituito da uno più recente sullo stesso raster
+    auto it = m_jobs.find(key);
+    if (it == m_jobs.end() || it->id != jobId) {
+        return;
+    }
+    Job job = m_jobs.take(key);
+    if (!job.cancelled->loadAcquire() && statistics.valid) {
+        m_cache.insert(key, statistics);
+    }
+
+    for (int handle : std::as_const(job.waiters)) {
+        m_handleJobs.remove(handle);
+        for (auto it = m_channelHandles.begin(); it != m_channelHandles.end(); ++it) {
+            if (it.value() == handle) {
+                m_channelHandles.erase(it);
+                break;
+            }
+        }
+        emit statisticsReady(handle, job.path, statistics);
+    }
+}
+
+void StatisticsService::clear()
+{
+    m_cache.clear();
+}
+
+RasterStatistics StatisticsService::compute(const QString &imagePath, const QAtomicInt *cancelled)
+{
+    RasterStatistics statistics;
+    QElapsedTimer timer;
+    timer.start();
+
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(imagePath.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        qWarning() << "Failed to open GeoTIFF for statistics:" << imagePath;
+        return statistics;
+    }
+
+    GDALRasterBand *band = dataset->GetRasterBand(1);
+    if (band == nullptr) {
+        qWarning() << "No raster band found for statistics";
+        GDALClose(dataset);
+        return statistics;
+    }
+
+    double minVal, maxVal, meanVal, stdDev;
+    CPLErr err = band->ComputeStatistics(false, &minVal, &maxVal, &meanVal, &stdDev,
+                                         statisticsProgress, const_cast<QAtomicInt *>(cancelled));
+    if (err == CE_None) {
+        statistics.valid = true;
+        statistics.min = minVal;
+        statistics.max = maxVal;
+        statistics.mean = meanVal;
+        statistics.stdDev = stdDev;
+        qDebug() << "Image statistics:" << imagePath << "in" << timer.elapsed() << "ms";
+        qDebug() << "  Min:" << minVal << "Max:" << maxVal << "Mean:" << meanVal;
+    } else if (cancelled && cancelled->loadAcquire()) {
+        qDebug() << "Statistics interrupted:" << imagePath;
+    } else {
+        qWarning() << "Failed to compute statistics:" << CPLGetLastErrorMsg();
+    }
+
+    GDALClose(dataset);
+    return statistics;
+}
@@ -0,0 +1,70 @@
+#ifndef STATISTICSSERVICE_H
+#define STATISTICSSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <memory>
+
+// Statistiche di banda calcolate una volta per raster
+struct RasterStatistics
+{
+    bool valid = false;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double stdDev = 0.0;
+};
+
+// Calcolo asincrono delle statistiche fuori dal thread GUI.
+// Ogni richiesta restituisce un handle; il risultato arriva con statisticsReady.
+// Le richieste sullo stesso raster condividono un solo calcolo e il risultato
+// resta in cache (chiave percorso + mtime) per tutti i pannelli. Un canale
+// (es. la legenda di un pannello) ha al più una richiesta attiva: una nuova
+// richiesta sul canale annulla la precedente.
+class StatisticsService : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StatisticsService(QObject *parent = nullptr);
+    ~StatisticsService();
+
+    int requestStatistics(const QString &imagePath, const QString &channel);
+    void cancel(const QString &channel);
+    void clear();
+
+    // Calcolo sincrono (ComputeStatistics esatto); cancelled interrompe la lettura
+    static RasterStatistics compute(const QString &imagePath, const QAtomicInt *cancelled);
+
+signals:
+    void statisticsReady(int handle, const QString &imagePath, const RasterStatistics &statistics);
+
+private:
+    struct Job
+    {
+        int id = 0;
+        QString path;
+        QList<int> waiters;
+        std::shared_ptr<QAtomicInt> cancelled;
+    };
+
+    static QString cacheKey(const QString &imagePath);
+    void detachWaiter(int handle);
+    void finishJob(const QString &key, int jobId, const RasterStatistics &statistics);
+
+    QThreadPool m_pool;
+    QHash<QString, RasterStatistics> m_cache;
+    QHash<QString, Job> m_jobs;             // chiave cache -> calcolo in corso
+    QHash<int, QString> m_handleJobs;       // handle -> chiave del calcolo atteso
+    QHash<QString, int> m_channelHandles;   // canale -> handle attivo
+    int m_nextHandle;
+    int m_nextJob;
+};
+
+Q_DECLARE_METATYPE(RasterStatistics)
+
+#endif // STATISTICSSERVICE_H
@@ -0,0 +1,313 @@
+#include "summarypyramid.h"
+#include "rasterreader.h"
+#include "memorygovernor.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <gdal_priv.h>
+
+std::shared_ptr<SummaryPyramid> SummaryPyramid::build(GDALRasterBand *band)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int width = band->GetXSize();
+    int height = band->GetYSize();
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    auto isValid = [&](float value) {
+        return !std::isnan(value) && !std::isinf(value) && value != -9999.0f && !(hasNoData && value == noData);
+    };
+
+    // Intervallo delle classi tra percentili globali robusti, stimati su un
+    // campione nearest: con il min/max globale pochi outlier schiaccerebbero
+    // tutto il terreno in due o tre classi
+    double sampleScale = std::min(1.0, (double)RobustSampleSize / std::max(width, height));
+    int sampleWidth = std::max(1, static_cast<int>(width * sampleScale));
+    int sampleHeight = std::max(1, static_cast<int>(height * sampleScale));
+    std::vector<float> sample((size_t)sampleWidth * sampleHeight);
+    if (RasterReader::readBand(band, sample.data(), sampleWidth, sampleHeight, GDT_Float32,
+                               ResampleMode::Nearest) != CE_None) {
+        qWarning() << "Summary pyramid sample read failed:" << CPLGetLastErrorMsg();
+        return nullptr;
+    }
+    sample.erase(std::remove_if(sample.begin(), sample.end(), [&](float value) { return !isValid(value); }),
+                 sample.end());
+    if (sample.empty()) {
+        qWarning() << "Summary pyramid: no valid samples";
+        return nullptr;
+    }
+    auto sampleQuantile = [&](double fraction) {
+        auto nth = sample.begin() + static_cast<size_t>(fraction * (sample.size() - 1));
+        std::nth_element(sample.begin(), nth, sample.end());
+        return (double)*nth;
+    };
+    double minVal = sampleQuantile(RobustTail);
+    double maxVal = sampleQuantile(1.0 - RobustTail);
+
+    auto pyramid = std::make_shared<SummaryPyramid>();
+    double scale = std::min(1.0, (double)MaxAnalysisSize / std::max(width, height));
+    pyramid->m_width = std::max(1, static_cast<int>(width * scale));
+    pyramid->m_height = std::max(1, static_cast<int>(height * scale));
+    pyramid->m_binMin = minVal;
+    pyramid->m_binMax = maxVal > minVal ? maxVal : minVal + 1.0;
+    // Classi interne 1..Bins-2 sull'intervallo robusto, code nelle classi estreme
+    const double binScale = (Bins - 2) / (pyramid->m_binMax - pyramid->m_binMin);
+
+    Level base;
+    base.tilesX = (pyramid->m_width + TileSize - 1) / TileSize;
+    base.tilesY = (pyramid->m_height + TileSize - 1) / TileSize;
+    size_t tileCount = (size_t)base.tilesX * base.tilesY;
+    base.min.assign(tileCount, std::numeric_limits<float>::max());
+    base.max.assign(tileCount, std::numeric_limits<float>::lowest());
+    base.valid.assign(tileCount, 0);
+    base.hist.assign(tileCount * Bins, 0);
+
+    // Una riga di tile per volta: nearest conserva la distribuzione dei valori
+    const double rowsToSource = (double)height / pyramid->m_height;
+    std::vector<float> strip((size_t)pyramid->m_width * TileSize);
+    for (int ty = 0; ty < base.tilesY; ++ty) {
+        int y0 = ty * TileSize;
+        int rows = std::min(TileSize, pyramid->m_height - y0);
+        if (RasterReader::readWindow(band, 0.0, y0 * rowsToSource, width, rows * rowsToSource,
+                                     strip.data(), pyramid->m_width, rows, GDT_Float32,
+                                     ResampleMode::Nearest) != CE_None) {
+            qWarning() << "Summary pyramid read failed:" << CPLGetLastErrorMsg();
+            return nullptr;
+        }
+        for (int r = 0; r < rows; ++r) {
+            const float *line = strip.data() + (size_t)r * pyramid->m_width;
+            for (int x = 0; x < pyramid->m_width; ++x) {
+                float value = line[x];
+                if (!isValid(value)) {
+                    continue;
+                }
+                size_t tile = (size_t)ty * base.tilesX + x / TileSize;
+                base.min[tile] = std::min(base.min[tile], value);
+                base.max[tile] = std::max(base.max[tile], value);
+                base.valid[tile]++;
+                int bin = 0;
+                if (value >= pyramid->m_binMax) {
+                    bin = Bins - 1;
+                } else if (value >= pyramid->m_binMin) {
+                    bin = std::min(Bins - 2, 1 + static_cast<int>((value - pyramid->m_binMin) * binScale));
+                }
+                base.hist[tile * Bins + bin]++;
+            }
+        }
+    }
+    pyramid->m_levels.push_back(std::move(base));
+
+    // Livelli superiori: fusione 2x2
+    while (pyramid->m_levels.back().tilesX > 1 || pyramid->m_levels.back().tilesY > 1) {
+        const Level &below = pyramid->m_levels.back();
+        Level level;
+        level.tilesX = (below.tilesX + 1) / 2;
+        level.tilesY = (below.tilesY + 1) / 2;
+        size_t count = (size_t)level.tilesX * level.tilesY;
+        level.min.assign(count, std::numeric_limits<float>::max());
+        level.max.assign(count, std::numeric_limits<float>::lowest());
+        level.valid.assign(count, 0);
+        level.hist.assign(count * Bins, 0);
+        for (int ty = 0; ty < below.tilesY; ++ty) {
+            for (int tx = 0; tx < below.tilesX; ++tx) {
+                size_t src = (size_t)ty * below.tilesX + tx;
+                size_t dst = (size_t)(ty / 2) * level.tilesX + tx / 2;
+                level.min[dst] = std::min(level.min[dst], below.min[src]);
+                level.max[dst] = std::max(level.max[dst], below.max[src]);
+                level.valid[dst] += below.valid[src];
+                for (int b = 0; b < Bins; ++b) {
+                    level.hist[dst * Bins + b] += below.hist[src * Bins + b];
+                }
+            }
+        }
+        pyramid->m_levels.push_back(std::move(level));
+    }
+
+    qDebug() << "Summary pyramid built:" << pyramid->m_width << "x" << pyramid->m_height << "analysis grid,"
+             << pyramid->m_levels.size() << "levels," << pyramid->byteSize() / 1024 << "KB in" << timer.elapsed() << "ms";
+    return pyramid;
+}
+
+SummaryPyramid::Stretch SummaryPyramid::percentileStretch(const QRectF &viewport, double lowPercent,
+                                                          double highPercent) const
+{
+    Stretch stretch;
+    if (m_levels.empty()) {
+        return stretch;
+    }
+
+    QRectF view = viewport.normalized().intersected(QRectF(0.0, 0.0, 1.0, 1.0));
+    if (view.isEmpty()) {
+        view = QRectF(0.0, 0.0, 1.0, 1.0);
+    }
+
+    // Livello più fine con al più MaxQueryTiles tile nella viewport
+    size_t levelIndex = 0;
+    int tx0 = 0, ty0 = 0, tx1 = 0, ty1 = 0;
+    for (; levelIndex < m_levels.size(); ++levelIndex) {
+        const Level &level = m_levels[levelIndex];
+        double tileSize = (double)(TileSize << levelIndex);
+        tx0 = std::max(0, static_cast<int>(std::floor(view.left() * m_width / tileSize)));
+        ty0 = std::max(0, static_cast<int>(std::floor(view.top() * m_height / tileSize)));
+        tx1 = std::min(level.tilesX - 1, static_cast<int>(std::ceil(view.right() * m_width / tileSize)) - 1);
+        ty1 = std::min(level.tilesY - 1, static_cast<int>(std::ceil(view.bottom() * m_height / tileSize)) - 1);
+        tx1 = std::max(tx0, tx1);
+        ty1 = std::max(ty0, ty1);
+        if ((tx1 - tx0 + 1) * (ty1 - ty0 + 1) <= MaxQueryTiles) {
+            break;
+        }
+    }
+    levelIndex = std::min(levelIndex, m_levels.size() - 1);
+    const Level &level = m_levels[levelIndex];
+
+    quint64 hist[Bins] = {0};
+    quint64 total = 0;
+    float viewMin = std::numeric_limits<float>::max();
+    float viewMax = std::numeric_limits<float>::lowest();
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            size_t tile = (size_t)ty * level.tilesX + tx;
+            if (level.valid[tile] == 0) continue;
+            viewMin = std::min(viewMin, level.min[tile]);
+            viewMax = std::max(viewMax, level.max[tile]);
+            total += level.valid[tile];
+            const quint32 *tileHist = level.hist.data() + tile * Bins;
+            for (int b = 0; b < Bins; ++b) {
+                hist[b] += tileHist[b];
+            }
+        }
+    }
+    if (total == 0) {
+        return stretch;
+    }
+
+    // Percentile per interpolazione lineare dentro la classe. Le code vanno
+    // dal min/max della viewport al bordo dell'intervallo robusto
+    const double binWidth = (m_binMax - m_binMin) / (Bins - 2);
+    auto binLow = [&](int b) {
+        return b == 0 ? std::min((double)viewMin, m_binMin)
+                      : b == Bins - 1 ? m_binMax : m_binMin + (b - 1) * binWidth;
+    };
+    auto binHigh = [&](int b) {
+        return b == 0 ? m_binMin : b == Bins - 1 ? std::max((double)viewMax, m_binMax) : m_binMin + b * binWidth;
+    };
+    auto percentile = [&](double percent) {
+        double target = qBound(0.0, percent, 100.0) / 100.0 * total;
+        quint64 cumulative = 0;
+        for (int b = 0; b < Bins; ++b) {
+            if (hist[b] > 0 && cumulative + hist[b] >= target) {
+                double fraction = (target - cumulative) / hist[b];
+                return binLow(b) + fraction * (binHigh(b) - binLow(b));
+            }
+            cumulative += hist[b];
+        }
+        return (double)viewMax;
+    };
+
+    stretch.low = qBound((double)viewMin, percentile(lowPercent), (double)viewMax);
+    stretch.high = qBound((double)viewMin, percentile(highPercent), (double)viewMax);
+    if (stretch.high <= stretch.low) {
+        stretch.low = viewMin;
+        stretch.high = viewMax > viewMin ? viewMax : viewMin + 1e-6;
+    }
+    stretch.samples = total;
+    stretch.valid = true;
+    return stretch;
+}
+
+size_t SummaryPyramid::byteSize() const
+{
+    size_t bytes = sizeof(SummaryPyramid);
+    for (const Level &level : m_levels) {
+        bytes += level.min.size() * sizeof(float) * 2 + level.valid.size() * sizeof(quint32)
+                 + level.hist.size() * sizeof(quint32);
+    }
+    return bytes;
+}
+
+SummaryPyramidCache &SummaryPyramidCache::instance()
+{
+    static SummaryPyramidCache cache;
+    return cache;
+}
+
+SummaryPyramidCache::SummaryPyramidCache()
+    : m_usedBytes(0)
+{
+}
+
+QString SummaryPyramidCache::keyFor(const QString &path)
+{
+    return path + '|' + QString::number(QFileInfo(path).lastModified().toMSecsSinceEpoch());
+}
+
+std::shared_ptr<const SummaryPyramid> SummaryPyramidCache::cached(const QString &path) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pyramids.value(keyFor(path));
+}
+
+std::shared_ptr<const SummaryPyramid> SummaryPyramidCache::pyramidFor(const QString &path, GDALRasterBand *band)
+{
+    QString key = keyFor(path);
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_pyramids.constFind(key);
+        if (it != m_pyramids.constEnd()) {
+            m_lru.removeOne(key);
+            m_lru.prepend(key);
+            return it.value();
+        }
+    }
+
+    // Costruzione fuori dal lock: una lettura ridotta del raster
+    std::shared_ptr<const SummaryPyramid> pyramid = SummaryPyramid::build(band);
+    if (!pyramid) {
+        return nullptr;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_pyramids.contains(key)) {
+            m_pyramids.insert(key, pyramid);
+            m_lru.prepend(key);
+            m_usedBytes += pyramid->byteSize();
+        }
+    }
+    MemoryGovernor::instance()->notifyAllocated();
+    return pyramid;
+}
+
+qint64 SummaryPyramidCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+qint64 SummaryPyramidCache::trim(qint64 targetBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_usedBytes > targetBytes && !m_lru.isEmpty()) {
+        auto it = m_pyramids.find(m_lru.takeLast());
+        if (it != m_pyramids.end()) {
+            m_usedBytes -= it.value()->byteSize();
+            m_pyramids.erase(it);
+        }
+    }
+    return m_usedBytes;
+}
+
+void SummaryPyramidCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pyramids.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
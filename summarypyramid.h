@@ -0,0 +1,92 @@
+#ifndef SUMMARYPYRAMID_H
+#define SUMMARYPYRAMID_H
+
+#include <QString>
+#include <QRectF>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <memory>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Piramide di riepilogo per tile: min, max, conteggio valido e istogramma
+// grossolano. Le Bins-2 classi interne coprono l'intervallo tra i percentili
+// globali RobustTail e 1-RobustTail; le due classi estreme raccolgono le code,
+// interpolate nella query fino al min/max dei tile. Il livello 0 è costruito
+// con una sola lettura del raster (ridotto a MaxAnalysisSize), quelli superiori
+// fondendo 2x2 tile. Gli stretch a percentile di una viewport sommano gli
+// istogrammi dei tile coperti: costo indipendente dalla dimensione del raster.
+class SummaryPyramid
+{
+public:
+    static const int Bins = 128;
+    static const int TileSize = 64;            // pixel di analisi per tile al livello 0
+    static const int MaxAnalysisSize = 8192;   // lato massimo della griglia di analisi
+    static const int MaxQueryTiles = 256;      // tile sommati al più per query
+    static const int RobustSampleSize = 1024;  // lato massimo del campione per i percentili globali
+    static constexpr double RobustTail = 0.001; // frazione esclusa per coda dall'intervallo delle classi
+
+    struct Stretch
+    {
+        bool valid = false;
+        double low = 0.0;
+        double high = 0.0;
+        quint64 samples = 0;
+    };
+
+    static std::shared_ptr<SummaryPyramid> build(GDALRasterBand *band);
+
+    // viewport normalizzata (0..1 sulla larghezza/altezza del raster)
+    Stretch percentileStretch(const QRectF &viewport, double lowPercent, double highPercent) const;
+
+    double minValue() const { return m_binMin; }
+    double maxValue() const { return m_binMax; }
+    size_t byteSize() const;
+
+private:
+    struct Level
+    {
+        int tilesX = 0;
+        int tilesY = 0;
+        std::vector<float> min;
+        std::vector<float> max;
+        std::vector<quint32> valid;
+        std::vector<quint32> hist;    // tilesX * tilesY * Bins
+    };
+
+    std::vector<Level> m_levels;
+    int m_width = 0;      // griglia di analisi
+    int m_height = 0;
+    double m_binMin = 0.0;
+    double m_binMax = 1.0;
+};
+
+// Piramidi per raster (chiave percorso + mtime), consumer del MemoryGovernor
+class SummaryPyramidCache
+{
+public:
+    static SummaryPyramidCache &instance();
+
+    // Costruisce la piramide se manca (una lettura ridotta del raster)
+    std::shared_ptr<const SummaryPyramid> pyramidFor(const QString &path, GDALRasterBand *band);
+    // Solo se già costruita: per le query dal thread GUI
+    std::shared_ptr<const SummaryPyramid> cached(const QString &path) const;
+
+    qint64 usedBytes() const;
+    qint64 trim(qint64 targetBytes);
+    void clear();
+
+private:
+    SummaryPyramidCache();
+    static QString keyFor(const QString &path);
+
+    mutable QMutex m_mutex;
+    QHash<QString, std::shared_ptr<const SummaryPyramid>> m_pyramids;
+    QList<QString> m_lru;    // front = usata più di recente
+    qint64 m_usedBytes;
+};
+
+#endif // SUMMARYPYRAMID_H
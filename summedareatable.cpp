@@ -0,0 +1,331 @@
+#include "summedareatable.h"
+#include "memorygovernor.h"
+#include "datasetcatalog.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <gdal_priv.h>
+
+std::shared_ptr<SummedAreaTable> SummedAreaTable::build(GDALRasterBand *band, int level)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int width = band->GetXSize();
+    int height = band->GetYSize();
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    auto table = std::make_shared<SummedAreaTable>();
+    table->m_level = level;
+    table->m_width = std::max(1, (width + (1 << level) - 1) >> level);
+    table->m_height = std::max(1, (height + (1 << level) - 1) >> level);
+
+    double minVal = 0.0, maxVal = 0.0, meanVal = 0.0, stdDev = 0.0;
+    if (band->GetStatistics(TRUE, TRUE, &minVal, &maxVal, &meanVal, &stdDev) == CE_None && !std::isnan(meanVal)) {
+        table->m_offset = meanVal;
+    }
+
+    const int w = table->m_width;
+    const int h = table->m_height;
+    size_t cells = (size_t)(w + 1) * (h + 1);
+    table->m_sum.assign(cells, 0.0);
+    table->m_sumSq.assign(cells, 0.0);
+    table->m_count.assign(cells, 0);
+
+    // Strisce a piena risoluzione di righe di celle intere (2^level righe
+    // sorgente ciascuna): le somme per cella sono quelle dei pixel, senza la
+    // media delle overview che perderebbe varianza e conteggio
+    const int cellRows = 1 << level;
+    const int stripCells = std::max(1, static_cast<int>((16u * 1024u * 1024u) / (sizeof(float) * width * cellRows)));
+    std::vector<float> strip((size_t)width * std::min(height, stripCells * cellRows));
+    std::vector<double> cellSum(w);
+    std::vector<double> cellSumSq(w);
+    std::vector<quint64> cellCount(w);
+
+    for (int cy0 = 0; cy0 < h; cy0 += stripCells) {
+        const int sourceY = cy0 * cellRows;
+        const int sourceRows = std::min(stripCells * cellRows, height - sourceY);
+        if (band->RasterIO(GF_Read, 0, sourceY, width, sourceRows, strip.data(), width, sourceRows, GDT_Float32,
+                           0, 0) != CE_None) {
+            qWarning() << "Summed-area table read failed:" << CPLGetLastErrorMsg();
+            return nullptr;
+        }
+        for (int cy = cy0; cy < std::min(h, cy0 + stripCells); ++cy) {
+            std::fill(cellSum.begin(), cellSum.end(), 0.0);
+            std::fill(cellSumSq.begin(), cellSumSq.end(), 0.0);
+            std::fill(cellCount.begin(), cellCount.end(), 0);
+            const int rowStart = (cy - cy0) * cellRows;
+            const int rowEnd = std::min(sourceRows, rowStart + cellRows);
+            for (int r = rowStart; r < rowEnd; ++r) {
+                const float *line = strip.data() + (size_t)r * width;
+                for (int x = 0; x < width; ++x) {
+                    float value = line[x];
+                    if (!std::isnan(value) && !std::isinf(value) && value != -9999.0f
+                        && !(hasNoData && value == noData)) {
+                        double v = value - table->m_offset;
+                        const int cx = x >> level;
+                        cellSum[cx] += v;
+                        cellSumSq[cx] += v * v;
+                        cellCount[cx]++;
+                    }
+                }
+            }
+            double rowSum = 0.0;
+            double rowSumSq = 0.0;
+            quint64 rowCount = 0;
+            for (int x = 0; x < w; ++x) {
+                rowSum += cellSum[x];
+                rowSumSq += cellSumSq[x];
+                rowCount += cellCount[x];
+                size_t above = table->index(x + 1, cy);
+                size_t here = table->index(x + 1, cy + 1);
+                table->m_sum[here] = table->m_sum[above] + rowSum;
+                table->m_sumSq[here] = table->m_sumSq[above] + rowSumSq;
+                table->m_count[here] = table->m_count[above] + rowCount;
+            }
+        }
+    }
+
+    qDebug() << "Summed-area table level" << level << ":" << w << "x" << h << "cells,"
+             << table->byteSize() / (1024 * 1024) << "MB in" << timer.elapsed() << "ms";
+    return table;
+}
+
+std::shared_ptr<SummedAreaTable> SummedAreaTable::build(const SummedAreaTable &finer, int level)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int shift = level - finer.m_level;
+    if (shift < 0) {
+        return nullptr;
+    }
+    auto table = std::make_shared<SummedAreaTable>();
+    table->m_level = level;
+    table->m_width = std::max(1, (finer.m_width + (1 << shift) - 1) >> shift);
+    table->m_height = std::max(1, (finer.m_height + (1 << shift) - 1) >> shift);
+    table->m_offset = finer.m_offset;
+
+    const int w = table->m_width;
+    const int h = table->m_height;
+    size_t cells = (size_t)(w + 1) * (h + 1);
+    table->m_sum.assign(cells, 0.0);
+    table->m_sumSq.assign(cells, 0.0);
+    table->m_count.assign(cells, 0);
+
+    // La tabella cumulata del livello fine, campionata ai bordi delle celle
+    // grossolane, è già quella del livello richiesto
+    for (int y = 1; y <= h; ++y) {
+        const int fy = std::min(finer.m_height, y << shift);
+        for (int x = 1; x <= w; ++x) {
+            const size_t source = finer.index(std::min(finer.m_width, x << shift), fy);
+            const size_t here = table->index(x, y);
+            table->m_sum[here] = finer.m_sum[source];
+            table->m_sumSq[here] = finer.m_sumSq[source];
+            table->m_count[here] = finer.m_count[source];
+        }
+    }
+
+    qDebug() << "Summed-area table level" << level << "from level" << finer.m_level << ":" << w << "x" << h
+             << "cells in" << timer.elapsed() << "ms";
+    return table;
+}
+
+SummedAreaTable::Sums SummedAreaTable::rect(int x0, int y0, int x1, int y1) const
+{
+    Sums sums;
+    x0 = std::max(0, std::min(m_width, x0));
+    x1 = std::max(0, std::min(m_width, x1));
+    y0 = std::max(0, std::min(m_height, y0));
+    y1 = std::max(0, std::min(m_height, y1));
+    if (x1 <= x0 || y1 <= y0) {
+        return sums;
+    }
+    size_t a = index(x0, y0), b = index(x1, y0), c = index(x0, y1), d = index(x1, y1);
+    sums.sum = m_sum[d] - m_sum[b] - m_sum[c] + m_sum[a];
+    sums.sumSq = m_sumSq[d] - m_sumSq[b] - m_sumSq[c] + m_sumSq[a];
+    sums.count = (quint64)m_count[d] - m_count[b] - m_count[c] + m_count[a];
+    return sums;
+}
+
+SummedAreaTable::Sums SummedAreaTable::polygon(const QPolygonF &points) const
+{
+    Sums sums;
+    if (points.size() < 3) {
+        return sums;
+    }
+
+    QRectF bounds = points.boundingRect();
+    int yStart = std::max(0, static_cast<int>(std::floor(bounds.top())));
+    int yEnd = std::min(m_height, static_cast<int>(std::ceil(bounds.bottom())));
+    std::vector<double> crossings;
+
+    // Scansione per riga al centro delle celle: intervalli interni a coppie
+    for (int y = yStart; y < yEnd; ++y) {
+        double scanY = y + 0.5;
+        crossings.clear();
+        for (int i = 0; i < points.size(); ++i) {
+            const QPointF &p1 = points[i];
+            const QPointF &p2 = points[(i + 1) % points.size()];
+            if ((p1.y() <= scanY) == (p2.y() <= scanY)) {
+                continue;
+            }
+            crossings.push_back(p1.x() + (scanY - p1.y()) * (p2.x() - p1.x()) / (p2.y() - p1.y()));
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            // Celle col centro in [xa, xb)
+            int x0 = static_cast<int>(std::ceil(crossings[i] - 0.5));
+            int x1 = static_cast<int>(std::ceil(crossings[i + 1] - 0.5));
+            Sums span = rect(x0, y, x1, y + 1);
+            sums.sum += span.sum;
+            sums.sumSq += span.sumSq;
+            sums.count += span.count;
+        }
+    }
+    return sums;
+}
+
+size_t SummedAreaTable::byteSize() const
+{
+    return m_sum.size() * sizeof(double) + m_sumSq.size() * sizeof(double) + m_count.size() * sizeof(quint64);
+}
+
+SummedAreaTableCache &SummedAreaTableCache::instance()
+{
+    static SummedAreaTableCache cache;
+    return cache;
+}
+
+SummedAreaTableCache::SummedAreaTableCache()
+    : m_usedBytes(0)
+{
+}
+
+QString SummedAreaTableCache::keyFor(const QString &path, int level)
+{
+    return path + '|' + QString::number(QFileInfo(path).lastModified().toMSecsSinceEpoch()) + '|'
+           + QString::number(level);
+}
+
+QSize SummedAreaTableCache::rasterSize(const QString &path)
+{
+    // Dall'header nel catalogo condiviso, che lo rilegge se il file cambia
+    std::shared_ptr<const DatasetInfo> info = DatasetCatalog::instance().probe(path);
+    return info->valid ? QSize(info->width, info->height) : QSize();
+}
+
+int SummedAreaTableCache::finestLevel(const QSize &rasterSize)
+{
+    int level = 0;
+    while ((qint64)((rasterSize.width() + (1 << level) - 1) >> level)
+               * ((rasterSize.height() + (1 << level) - 1) >> level) > MaxLevelPixels) {
+        ++level;
+    }
+    return level;
+}
+
+int SummedAreaTableCache::levelFor(const QSize &rasterSize, double roiWidth, double roiHeight)
+{
+    // Il livello più grossolano in cui la ROI copre ancora MinRoiCells celle:
+    // ROI grandi usano tabelle piccole (veloci da costruire), ROI piccole quelle fini
+    double side = std::max(1.0, std::min(roiWidth, roiHeight));
+    int level = std::max(0, static_cast<int>(std::floor(std::log2(side / MinRoiCells))));
+    return std::max(finestLevel(rasterSize), level);
+}
+
+std::shared_ptr<const SummedAreaTable> SummedAreaTableCache::table(const QString &path, int level)
+{
+    QString key = keyFor(path, level);
+    QMutexLocker locker(&m_mutex);
+    auto it = m_tables.constFind(key);
+    if (it == m_tables.constEnd()) {
+        return nullptr;
+    }
+    m_lru.removeOne(key);
+    m_lru.prepend(key);
+    return it.value();
+}
+
+bool SummedAreaTableCache::beginBuild(const QString &path, int level)
+{
+    QString key = keyFor(path, level);
+    QMutexLocker locker(&m_mutex);
+    if (m_tables.contains(key) || m_building.contains(key)) {
+        return false;
+    }
+    m_building.insert(key);
+    return true;
+}
+
+std::shared_ptr<const SummedAreaTable> SummedAreaTableCache::build(const QString &path, int level)
+{
+    QString key = keyFor(path, level);
+    std::shared_ptr<const SummedAreaTable> table;
+
+    // Un livello più fine già in cache basta: le somme si aggregano senza rileggere il raster
+    std::shared_ptr<const SummedAreaTable> finer;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int candidate = level - 1; candidate >= 0 && !finer; --candidate) {
+            finer = m_tables.value(keyFor(path, candidate));
+        }
+    }
+    if (finer) {
+        table = SummedAreaTable::build(*finer, level);
+    } else {
+        GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+        if (dataset == nullptr) {
+            qWarning() << "Failed to open GeoTIFF for ROI statistics:" << path;
+        } else {
+            table = SummedAreaTable::build(dataset->GetRasterBand(1), level);
+            GDALClose(dataset);
+        }
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_building.remove(key);
+        if (table && !m_tables.contains(key)) {
+            m_tables.insert(key, table);
+            m_lru.prepend(key);
+            m_usedBytes += table->byteSize();
+        }
+    }
+    if (table) {
+        MemoryGovernor::instance()->notifyAllocated();
+    }
+    return table;
+}
+
+qint64 SummedAreaTableCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+qint64 SummedAreaTableCache::trim(qint64 targetBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_usedBytes > targetBytes && !m_lru.isEmpty()) {
+        auto it = m_tables.find(m_lru.takeLast());
+        if (it != m_tables.end()) {
+            m_usedBytes -= it.value()->byteSize();
+            m_tables.erase(it);
+        }
+    }
+    return m_usedBytes;
+}
+
+void SummedAreaTableCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_tables.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
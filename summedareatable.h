@@ -0,0 +1,100 @@
+#ifndef SUMMEDAREATABLE_H
+#define SUMMEDAREATABLE_H
+
+#include <QString>
+#include <QPolygonF>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QSize>
+#include <memory>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Tabelle a somme cumulate (somma, somma dei quadrati, conteggio validi) di un
+// livello della piramide: una cella del livello L copre 2^L x 2^L pixel
+// sorgente e ne tiene le somme esatte (non la media di un'overview), quindi
+// media, deviazione standard e conteggio sono quelli dei pixel; ai livelli
+// grossolani è approssimato solo il bordo della ROI, alle celle.
+// Un rettangolo costa quattro letture, un poligono quattro per riga di scansione.
+class SummedAreaTable
+{
+public:
+    struct Sums
+    {
+        double sum = 0.0;
+        double sumSq = 0.0;
+        quint64 count = 0;
+    };
+
+    // Dai pixel a piena risoluzione della banda, a strisce di 2^level righe
+    static std::shared_ptr<SummedAreaTable> build(GDALRasterBand *band, int level);
+    // Da un livello più fine già costruito: ogni cella somma le sue 2^(level - finer) x 2^(level - finer)
+    static std::shared_ptr<SummedAreaTable> build(const SummedAreaTable &finer, int level);
+
+    int level() const { return m_level; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    // Valori accumulati come (v - offset) per limitare la cancellazione numerica
+    double offset() const { return m_offset; }
+
+    // Celle [x0, x1) x [y0, y1) del livello
+    Sums rect(int x0, int y0, int x1, int y1) const;
+    // Poligono in coordinate del livello: celle col centro interno (pari-dispari)
+    Sums polygon(const QPolygonF &points) const;
+
+    size_t byteSize() const;
+
+private:
+    size_t index(int x, int y) const { return (size_t)y * (m_width + 1) + x; }
+
+    int m_level = 0;
+    int m_width = 0;
+    int m_height = 0;
+    double m_offset = 0.0;
+    std::vector<double> m_sum;       // (width + 1) x (height + 1), riga e colonna 0 a zero
+    std::vector<double> m_sumSq;
+    std::vector<quint64> m_count;    // pixel validi: ai livelli grossolani oltre 2^32
+};
+
+// Tabelle per raster e livello, costruite su richiesta; consumer del MemoryGovernor
+class SummedAreaTableCache
+{
+public:
+    // Livello più fine ammesso: al più MaxLevelPixels celle (~100 MB di tabelle)
+    static const qint64 MaxLevelPixels = 4ll * 1024 * 1024;
+    // Il lato corto della ROI deve coprire almeno tante celle del livello scelto
+    static const int MinRoiCells = 128;
+
+    static SummedAreaTableCache &instance();
+
+    // Dimensione del raster dal DatasetCatalog (solo header, condiviso con i pannelli)
+    QSize rasterSize(const QString &path);
+    static int finestLevel(const QSize &rasterSize);
+    static int levelFor(const QSize &rasterSize, double roiWidth, double roiHeight);
+
+    // Solo se già costruita (query dal thread GUI)
+    std::shared_ptr<const SummedAreaTable> table(const QString &path, int level);
+    // Costruzione (thread di lavoro); false se già in corso altrove
+    bool beginBuild(const QString &path, int level);
+    std::shared_ptr<const SummedAreaTable> build(const QString &path, int level);
+
+    qint64 usedBytes() const;
+    qint64 trim(qint64 targetBytes);
+    void clear();
+
+private:
+    SummedAreaTableCache();
+    static QString keyFor(const QString &path, int level);
+
+    mutable QMutex m_mutex;
+    QHash<QString, std::shared_ptr<const SummedAreaTable>> m_tables;
+    QList<QString> m_lru;
+    QSet<QString> m_building;
+    qint64 m_usedBytes;
+};
+
+#endif // SUMMEDAREATABLE_H
@@ -0,0 +1,369 @@
+#include "terrain.h"
+#include <QElapsedTimer>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <gdal_priv.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace Terrain {
+
+namespace {
+
+const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+// Tile (tx, ty) con un pixel di bordo dai tile vicini (dalla cache); ai bordi
+// del raster si replica l'ultima riga/colonna. Valori non validi -> NaN.
+bool haloTile(const RasterGrid &grid, GDALRasterBand *band, int tx, int ty, std::vector<float> &halo, int &w, int &h)
+{
+    std::shared_ptr<const RasterTile> center = RasterTileCache::instance().tile(grid, band, tx, ty);
+    if (!center) {
+        return false;
+    }
+    w = center->width;
+    h = center->height;
+    const int stride = w + 2;
+    halo.assign((size_t)stride * (h + 2), NaN);
+    std::vector<float> row(RasterTileCache::TileSize);
+
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int ntx = tx + dx;
+            int nty = ty + dy;
+            if (ntx < 0 || nty < 0 || ntx >= grid.tilesX() || nty >= grid.tilesY()) {
+                continue;
+            }
+            std::shared_ptr<const RasterTile> t = (dx == 0 && dy == 0)
+                ? center : RasterTileCache::instance().tile(grid, band, ntx, nty);
+            if (!t) {
+                continue;
+            }
+            // Porzione del vicino che cade nel bordo: ultima/prima colonna o riga
+            int srcX0 = dx < 0 ? t->width - 1 : 0;
+            int srcX1 = dx > 0 ? 1 : t->width;
+            int srcY0 = dy < 0 ? t->height - 1 : 0;
+            int srcY1 = dy > 0 ? 1 : t->height;
+            int dstX = dx < 0 ? 0 : (dx == 0 ? 1 : w + 1);
+            int dstY = dy < 0 ? 0 : (dy == 0 ? 1 : h + 1);
+            for (int sy = srcY0; sy < srcY1; ++sy) {
+                // I tile in cache possono essere quantizzati: si espande la riga
+                t->expandRow(sy, row.data());
+                std::copy(row.begin() + srcX0, row.begin() + srcX1, halo.begin() + (size_t)(dstY + sy - srcY0) * stride + dstX);
+            }
+        }
+    }
+
+    // Bordi del raster: replica
+    if (tx == 0 || tx == grid.tilesX() - 1) {
+        for (int y = 0; y < h + 2; ++y) {
+            float *line = halo.data() + (size_t)y * stride;
+            if (tx == 0) line[0] = line[1];
+            if (tx == grid.tilesX() - 1) line[w + 1] = line[w];
+        }
+    }
+    if (ty == 0) {
+        std::copy(halo.begin() + stride, halo.begin() + 2 * stride, halo.begin());
+    }
+    if (ty == grid.tilesY() - 1) {
+        std::copy(halo.begin() + (size_t)h * stride, halo.begin() + (size_t)(h + 1) * stride,
+                  halo.begin() + (size_t)(h + 1) * stride);
+    }
+
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+    for (float &value : halo) {
+        if (std::isinf(value) || value == -9999.0f || (hasNoData && value == noData)) {
+            value = NaN;
+        }
+    }
+    return true;
+}
+
+// Tile (tx, ty) con bordo da un raster già in memoria (width x height), con la
+// stessa replica ai bordi e gli stessi valori non validi di haloTile
+bool haloBuffer(const float *values, int width, int height, float noData, int tx, int ty,
+                std::vector<float> &halo, int &w, int &h)
+{
+    const int x0 = tx * RasterTileCache::TileSize;
+    const int y0 = ty * RasterTileCache::TileSize;
+    w = std::min(RasterTileCache::TileSize, width - x0);
+    h = std::min(RasterTileCache::TileSize, height - y0);
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+    const int stride = w + 2;
+    halo.resize((size_t)stride * (h + 2));
+    for (int y = 0; y < h + 2; ++y) {
+        const float *line = values + (size_t)qBound(0, y0 + y - 1, height - 1) * width;
+        float *out = halo.data() + (size_t)y * stride;
+        for (int x = 0; x < w + 2; ++x) {
+            float value = line[qBound(0, x0 + x - 1, width - 1)];
+            out[x] = (std::isinf(value) || value == -9999.0f || value == noData) ? NaN : value;
+        }
+    }
+    return true;
+}
+
+using HaloFunction = std::function<bool(int tx, int ty, std::vector<float> &halo, int &w, int &h)>;
+
+// Colormap precalcolata: stessa interpolazione lineare del provider
+struct ColorLut
+{
+    static const int Size = 1024;
+    QRgb entries[Size];
+
+    explicit ColorLut(const QVector<QColor> &colors)
+    {
+        for (int i = 0; i < Size; ++i) {
+            double normalized = (double)i / (Size - 1);
+            int colorIndex = qBound(0, (int)(normalized * (colors.size() - 1)), colors.size() - 2);
+            double localPos = normalized * (colors.size() - 1) - colorIndex;
+            const QColor &c1 = colors[colorIndex];
+            const QColor &c2 = colors[colorIndex + 1];
+            entries[i] = qRgb(qBound(0, (int)(c1.red() + localPos * (c2.red() - c1.red())), 255),
+                              qBound(0, (int)(c1.green() + localPos * (c2.green() - c1.green())), 255),
+                              qBound(0, (int)(c1.blue() + localPos * (c2.blue() - c1.blue())), 255));
+        }
+    }
+
+    QRgb at(double normalized) const
+    {
+        return entries[qBound(0, (int)(normalized * (Size - 1)), Size - 1)];
+    }
+};
+
+inline QRgb scaled(QRgb color, float factor)
+{
+    return qRgb((int)(qRed(color) * factor), (int)(qGreen(color) * factor), (int)(qBlue(color) * factor));
+}
+
+} // namespace
+
+Mode modeFromName(const QString &name)
+{
+    QString key = name.trimmed().toLower();
+    if (key == "hillshade") return Mode::Hillshade;
+    if (key == "slope") return Mode::Slope;
+    if (key == "aspect") return Mode::Aspect;
+    return Mode::None;
+}
+
+void hornGradientScalar(const float *halo, int w, int h, float cellX, float cellY, float *dzdx, float *dzdy)
+{
+    const int stride = w + 2;
+    const float invX = 1.0f / (8.0f * cellX);
+    const float invY = 1.0f / (8.0f * cellY);
+    for (int y = 0; y < h; ++y) {
+        const float *r0 = halo + (size_t)y * stride;
+        const float *r1 = r0 + stride;
+        const float *r2 = r1 + stride;
+        for (int x = 0; x < w; ++x) {
+            // a b c / d e f / g h i; (e - e) rende NaN i pixel nodata al centro
+            float a = r0[x], b = r0[x + 1], c = r0[x + 2];
+            float d = r1[x], e = r1[x + 1], f = r1[x + 2];
+            float g = r2[x], hh = r2[x + 1], i = r2[x + 2];
+            float center = e - e;
+            dzdx[(size_t)y * w + x] = (((c + 2.0f * f) + i) - ((a + 2.0f * d) + g)) * invX + center;
+            dzdy[(size_t)y * w + x] = (((g + 2.0f * hh) + i) - ((a + 2.0f * b) + c)) * invY + center;
+        }
+    }
+}
+
+void hornGradient(const float *halo, int w, int h, float cellX, float cellY, float *dzdx, float *dzdy)
+{
+#ifdef TERRAIN_SSE2
+    const int stride = w + 2;
+    const __m128 invX = _mm_set1_ps(1.0f / (8.0f * cellX));
+    const __m128 invY = _mm_set1_ps(1.0f / (8.0f * cellY));
+    const __m128 two = _mm_set1_ps(2.0f);
+    for (int y = 0; y < h; ++y) {
+        const float *r0 = halo + (size_t)y * stride;
+        const float *r1 = r0 + stride;
+        const float *r2 = r1 + stride;
+        float *outX = dzdx + (size_t)y * w;
+        float *outY = dzdy + (size_t)y * w;
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            __m128 a = _mm_loadu_ps(r0 + x), b = _mm_loadu_ps(r0 + x + 1), c = _mm_loadu_ps(r0 + x + 2);
+            __m128 d = _mm_loadu_ps(r1 + x), e = _mm_loadu_ps(r1 + x + 1), f = _mm_loadu_ps(r1 + x + 2);
+            __m128 g = _mm_loadu_ps(r2 + x), hh = _mm_loadu_ps(r2 + x + 1), i = _mm_loadu_ps(r2 + x + 2);
+            __m128 center = _mm_sub_ps(e, e);
+            __m128 east = _mm_add_ps(_mm_add_ps(c, _mm_mul_ps(two, f)), i);
+            __m128 west = _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, d)), g);
+            __m128 south = _mm_add_ps(_mm_add_ps(g, _mm_mul_ps(two, hh)), i);
+            __m128 north = _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, b)), c);
+            _mm_storeu_ps(outX + x, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(east, west), invX), center));
+            _mm_storeu_ps(outY + x, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(south, north), invY), center));
+        }
+        // Coda della riga in scalare
+        for (; x < w; ++x) {
+            float a = r0[x], b = r0[x + 1], c = r0[x + 2];
+            float d = r1[x], e = r1[x + 1], f = r1[x + 2];
+            float g = r2[x], hh = r2[x + 1], i = r2[x + 2];
+            float center = e - e;
+            outX[x] = (((c + 2.0f * f) + i) - ((a + 2.0f * d) + g)) * (1.0f / (8.0f * cellX)) + center;
+            outY[x] = (((g + 2.0f * hh) + i) - ((a + 2.0f * b) + c)) * (1.0f / (8.0f * cellY)) + center;
+        }
+    }
+#else
+    hornGradientScalar(halo, w, h, cellX, cellY, dzdx, dzdy);
+#endif
+}
+
+void hillshade(const float *dzdx, const float *dzdy, float *shade, size_t count, double azimuth, double altitude)
+{
+    // Normale (-dz/dx_est, -dz/dy_nord, 1) per la direzione della luce; dzdy è
+    // verso sud, quindi dz/dy_nord = -dzdy
+    const double az = qDegreesToRadians(azimuth);
+    const double alt = qDegreesToRadians(altitude);
+    const float A = static_cast<float>(std::sin(alt));
+    const float B = static_cast<float>(-std::sin(az) * std::cos(alt));
+    const float C = static_cast<float>(std::cos(az) * std::cos(alt));
+
+    size_t i = 0;
+#ifdef TERRAIN_SSE2
+    const __m128 va = _mm_set1_ps(A), vb = _mm_set1_ps(B), vc = _mm_set1_ps(C);
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 p = _mm_loadu_ps(dzdx + i);
+        __m128 q = _mm_loadu_ps(dzdy + i);
+        __m128 dot = _mm_add_ps(_mm_add_ps(va, _mm_mul_ps(vb, p)), _mm_mul_ps(vc, q));
+        __m128 norm = _mm_sqrt_ps(_mm_add_ps(one, _mm_add_ps(_mm_mul_ps(p, p), _mm_mul_ps(q, q))));
+        // max(zero, NaN) restituisce NaN: il nodata resta riconoscibile
+        _mm_storeu_ps(shade + i, _mm_max_ps(zero, _mm_div_ps(dot, norm)));
+    }
+#endif
+    for (; i < count; ++i) {
+        float p = dzdx[i];
+        float q = dzdy[i];
+        float value = (A + B * p + C * q) / std::sqrt(1.0f + p * p + q * q);
+        shade[i] = value < 0.0f ? 0.0f : value;
+    }
+}
+
+namespace {
+
+QImage renderTiles(int width, int height, const HaloFunction &haloFor, const Params &params, double cellX,
+                   double cellY, const QVector<QColor> &colors, double minVal, double maxVal)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QImage image(width, height, QImage::Format_RGB32);
+    image.fill(qRgb(0, 0, 0));
+    if (colors.size() < 2) {
+        return image;
+    }
+
+    // zFactor scala le quote: equivale a dividere la dimensione della cella
+    const double zFactor = params.zFactor > 0.0 ? params.zFactor : 1.0;
+    const float effectiveX = static_cast<float>(std::abs(cellX) / zFactor);
+    const float effectiveY = static_cast<float>(std::abs(cellY) / zFactor);
+    const double range = maxVal - minVal > 1e-10 ? maxVal - minVal : 1.0;
+    const float blend = static_cast<float>(qBound(0.0, params.blend, 1.0));
+    const ColorLut lut(colors);
+
+    const int tileSize = RasterTileCache::TileSize;
+    std::vector<float> halo;
+    std::vector<float> dzdx((size_t)tileSize * tileSize);
+    std::vector<float> dzdy((size_t)tileSize * tileSize);
+    std::vector<float> shade((size_t)tileSize * tileSize);
+
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int w = 0;
+            int h = 0;
+            if (!haloFor(tx, ty, halo, w, h)) {
+                qWarning() << "Terrain: tile" << tx << ty << "unavailable";
+                continue;
+            }
+            hornGradient(halo.data(), w, h, effectiveX, effectiveY, dzdx.data(), dzdy.data());
+            if (params.mode == Mode::Hillshade) {
+                hillshade(dzdx.data(), dzdy.data(), shade.data(), (size_t)w * h, params.azimuth, params.altitude);
+            }
+
+            for (int y = 0; y < h; ++y) {
+                QRgb *scanLine = (QRgb*)image.scanLine(ty * tileSize + y) + tx * tileSize;
+                const float *elevation = halo.data() + (size_t)(y + 1) * (w + 2) + 1;
+                for (int x = 0; x < w; ++x) {
+                    size_t idx = (size_t)y * w + x;
+                    if (std::isnan(elevation[x])) {
+                        continue;
+                    }
+                    float p = dzdx[idx];
+                    float q = dzdy[idx];
+                    switch (params.mode) {
+                    case Mode::Hillshade: {
+                        QRgb base = lut.at((elevation[x] - minVal) / range);
+                        // Accanto al nodata il gradiente non è definito: colore pieno
+                        float s = std::isnan(shade[idx]) ? 1.0f : std::min(1.0f, shade[idx]);
+                        scanLine[x] = scaled(base, (1.0f - blend) + blend * s);
+                        break;
+                    }
+                    case Mode::Slope: {
+                        if (std::isnan(p)) continue;
+                        double degrees = qRadiansToDegrees(std::atan(std::sqrt((double)p * p + (double)q * q)));
+                        scanLine[x] = lut.at(degrees / 90.0);
+                        break;
+                    }
+                    case Mode::Aspect: {
+                        if (std::isnan(p)) continue;
+                        if (p * p + q * q < 1e-6f) {
+                            scanLine[x] = qRgb(48, 48, 48);
+                            continue;
+                        }
+                        // Direzione di discesa (est = -p, nord = q) come azimut da nord
+                        double degrees = qRadiansToDegrees(std::atan2((double)-p, (double)q));
+                        if (degrees < 0.0) degrees += 360.0;
+                        scanLine[x] = lut.at(degrees / 360.0);
+                        break;
+                    }
+                    case Mode::None:
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    qDebug() << "Terrain render" << width << "x" << height << "in" << timer.elapsed() << "ms";
+    return image;
+}
+
+} // namespace
+
+QImage render(const RasterGrid &grid, GDALRasterBand *band, const Params &params, double cellX, double cellY,
+              const QVector<QColor> &colors, double minVal, double maxVal)
+{
+    // Tile mancanti decodificati in parallelo prima della resa, senza un
+    // buffer float dell'intera griglia; la resa poi li trova in cache
+    if (!RasterTileCache::instance().prefetch(grid, band)) {
+        qWarning() << "Terrain: tile prefetch failed:" << CPLGetLastErrorMsg();
+    }
+    return renderTiles(grid.width, grid.height,
+                       [&](int tx, int ty, std::vector<float> &halo, int &w, int &h) {
+                           return haloTile(grid, band, tx, ty, halo, w, h);
+                       },
+                       params, cellX, cellY, colors, minVal, maxVal);
+}
+
+QImage render(const float *values, int width, int height, float noData, const Params &params, double cellX,
+              double cellY, const QVector<QColor> &colors, double minVal, double maxVal)
+{
+    return renderTiles(width, height,
+                       [&](int tx, int ty, std::vector<float> &halo, int &w, int &h) {
+                           return haloBuffer(values, width, height, noData, tx, ty, halo, w, h);
+                       },
+                       params, cellX, cellY, colors, minVal, maxVal);
+}
+
+} // namespace Terrain
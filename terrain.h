@@ -0,0 +1,59 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "rastertilecache.h"
+#include <QString>
+#include <QImage>
+#include <QColor>
+#include <QVector>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALRasterBand;
+
+// Modalità di resa derivate per DSM: hillshade, pendenza ed esposizione.
+// Si calcolano a tile sulla griglia della RasterTileCache, con un bordo di un
+// pixel preso dai tile vicini: cambiare azimut o altezza della luce ricalcola
+// solo la resa dai float già in cache, senza rileggere il disco.
+namespace Terrain {
+
+enum class Mode
+{
+    None,
+    Hillshade,   // colormap dell'elevazione modulata dall'ombreggiatura
+    Slope,       // colormap della pendenza, 0..90 gradi
+    Aspect       // colormap dell'esposizione, 0..360 gradi da nord (piano = nero)
+};
+
+Mode modeFromName(const QString &name);
+
+struct Params
+{
+    Mode mode = Mode::None;
+    double azimuth = 315.0;     // gradi da nord, orario
+    double altitude = 45.0;     // gradi sull'orizzonte
+    double zFactor = 1.0;       // unità z per unità orizzontale della cella
+    double blend = 0.7;         // peso dell'ombreggiatura sulla colormap (hillshade)
+};
+
+// Gradienti di Horn da un tile con bordo ((w + 2) x (h + 2), NaN = nodata):
+// dzdx verso est, dzdy verso sud (righe), in unità z per unità orizzontale
+void hornGradient(const float *halo, int w, int h, float cellX, float cellY, float *dzdx, float *dzdy);
+void hornGradientScalar(const float *halo, int w, int h, float cellX, float cellY, float *dzdx, float *dzdy);
+
+// Intensità dell'ombreggiatura 0..1 (NaN dove il gradiente non è valido)
+void hillshade(const float *dzdx, const float *dzdy, float *shade, size_t count, double azimuth, double altitude);
+
+// Resa dell'intera griglia: cellX/cellY = dimensione orizzontale di un pixel della
+// griglia nelle unità di z (prima di zFactor), min/max per la colormap
+// dell'elevazione in modalità hillshade. I tile si leggono dalla cache
+QImage render(const RasterGrid &grid, GDALRasterBand *band, const Params &params, double cellX, double cellY,
+              const QVector<QColor> &colors, double minVal, double maxVal);
+// Come sopra da un raster già in memoria (es. la griglia filtrata dal denoise);
+// noData = nodata della banda (NaN se assente)
+QImage render(const float *values, int width, int height, float noData, const Params &params, double cellX,
+              double cellY, const QVector<QColor> &colors, double minVal, double maxVal);
+
+} // namespace Terrain
+
+#endif // TERRAIN_H
@@ -0,0 +1,166 @@
+#include "textureprovider.h"
+#include "rasterexport.h"
+#include "quantize.h"
+#include <QQuickWindow>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QUrl>
+#include <QStringList>
+#include <QDebug>
+
+namespace {
+
+QString cleanPath(QString path)
+{
+    path = QUrl::fromPercentEncoding(path.toUtf8());
+    if (path.startsWith("file:///")) return path.mid(8);
+    if (path.startsWith("file://")) return path.mid(7);
+    return path;
+}
+
+QString fileStamp(const QString &path)
+{
+    QFileInfo info(path);
+    return QString("%1:%2").arg(info.lastModified().toMSecsSinceEpoch()).arg(info.size());
+}
+
+// Formati che lo scene graph carica senza conversione; il resto si converte
+// qui, una volta, invece che nel thread di rendering a ogni upload
+QImage uploadFormat(const QImage &image)
+{
+    switch (image.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_Grayscale8:
+        return image;
+    default:
+        return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                             : QImage::Format_RGB32);
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// RasterTextureFactory
+// ============================================================================
+
+RasterTextureFactory::RasterTextureFactory(std::shared_ptr<const QImage> image)
+    : m_image(std::move(image))
+{
+}
+
+QSGTexture *RasterTextureFactory::createTexture(QQuickWindow *window) const
+{
+    QQuickWindow::CreateTextureOptions options;
+    if (m_image->hasAlphaChannel()) {
+        options |= QQuickWindow::TextureHasAlphaChannel;
+    }
+    return window->createTextureFromImage(*m_image, options);
+}
+
+QSize RasterTextureFactory::textureSize() const
+{
+    return m_image->size();
+}
+
+int RasterTextureFactory::textureByteCount() const
+{
+    return static_cast<int>(m_image->sizeInBytes());
+}
+
+QImage RasterTextureFactory::image() const
+{
+    return *m_image;
+}
+
+// ============================================================================
+// GeoTiffTextureProvider
+// ============================================================================
+
+GeoTiffTextureProvider::GeoTiffTextureProvider()
+    : QQuickImageProvider(QQuickImageProvider::Texture)
+{
+}
+
+QImage GeoTiffTextureProvider::colormapStrip(int colorMap)
+{
+    const std::vector<QRgb> lut = RasterExport::buildLut(GeoTiffImageProvider::getColorMapColors(colorMap));
+    QImage strip(256, 1, QImage::Format_RGB32);
+    QRgb *line = reinterpret_cast<QRgb*>(strip.scanLine(0));
+    for (int code = 0; code <= Quantize::UInt8MaxCode; ++code) {
+        line[code] = lut[(code * (RasterExport::LutSize - 1) + Quantize::UInt8MaxCode / 2) / Quantize::UInt8MaxCode];
+    }
+    // Come nel provider: il nodata (sotto il minimo) prende il primo colore, NaN/inf neri
+    line[Quantize::UInt8NoData] = lut.front();
+    line[Quantize::UInt8Invalid] = qRgb(0, 0, 0);
+    return strip;
+}
+
+QString GeoTiffTextureProvider::cacheKey(const QString &id, const QSize &requestedSize)
+{
+    QStringList parts = id.split("?");
+    QString key = parts[0] + "?" + fileStamp(cleanPath(parts[0]));
+    const QStringList params = parts.size() > 1 ? parts[1].split("&") : QStringList();
+    for (const QString &param : params) {
+        if (param.startsWith("t=")) {
+            continue;
+        }
+        key += "&" + param;
+        if (param.startsWith("overlay=")) {
+            key += "@" + fileStamp(cleanPath(param.mid(8)));
+        } else if (param.startsWith("alignTo=")) {
+            key += "@" + fileStamp(cleanPath(param.mid(8)));
+        }
+    }
+    return key + QString("#%1x%2").arg(requestedSize.width()).arg(requestedSize.height());
+}
+
+QQuickTextureFactory *GeoTiffTextureProvider::requestTexture(const QString &id, QSize *size,
+                                                             const QSize &requestedSize)
+{
+    // Striscia della colormap per lo shader: piccola, non serve condividerla
+    if (id.startsWith("lut?")) {
+        int colorMap = 0;
+        for (const QString &param : id.mid(4).split("&")) {
+            if (param.startsWith("colormap=")) {
+                colorMap = param.mid(9).toInt();
+            }
+        }
+        auto strip = std::make_shared<const QImage>(colormapStrip(colorMap));
+        if (size) *size = strip->size();
+        return new RasterTextureFactory(strip);
+    }
+
+    const QString key = cacheKey(id, requestedSize);
+    {
+        QMutexLocker lock(&m_mutex);
+        auto it = m_shared.constFind(key);
+        if (it != m_shared.constEnd()) {
+            if (std::shared_ptr<const QImage> image = it->lock()) {
+                qDebug() << "Texture shared with another panel:" << image->size();
+                if (size) *size = image->size();
+                return new RasterTextureFactory(image);
+            }
+        }
+    }
+
+    QImage image = m_images.requestImage(id, size, requestedSize);
+    if (image.isNull()) {
+        return nullptr;
+    }
+    auto shared = std::make_shared<const QImage>(uploadFormat(image));
+    image = QImage();
+    if (size) *size = shared->size();
+
+    QMutexLocker lock(&m_mutex);
+    for (auto it = m_shared.begin(); it != m_shared.end();) {
+        if (it->expired()) {
+            it = m_shared.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_shared.insert(key, shared);
+    return new RasterTextureFactory(shared);
+}
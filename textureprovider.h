@@ -0,0 +1,57 @@
+#ifndef TEXTUREPROVIDER_H
+#define TEXTUREPROVIDER_H
+
+#include <QQuickImageProvider>
+#include <QQuickTextureFactory>
+#include <QMutex>
+#include <QHash>
+#include <memory>
+#include "geotiffprocessor.h"
+
+// Immagine pronta per l'upload, condivisa fra le factory: un solo buffer per
+// tutti i pannelli che mostrano lo stesso layer
+class RasterTextureFactory : public QQuickTextureFactory
+{
+public:
+    explicit RasterTextureFactory(std::shared_ptr<const QImage> image);
+
+    QSGTexture *createTexture(QQuickWindow *window) const override;
+    QSize textureSize() const override;
+    int textureByteCount() const override;
+    QImage image() const override;
+
+private:
+    std::shared_ptr<const QImage> m_image;
+};
+
+// Provider "geotifftex": stessi id del provider "geotiff", ma restituisce
+// texture factory invece di QImage. La conversione al formato di upload
+// (RGB32 / ARGB32 premoltiplicato, Grayscale8 per channel=1) si fa una volta
+// nel thread di caricamento; lo scene graph carica i byte così come sono.
+// Con channel=1 l'immagine è a un canale (codici Quantize::toUInt8 sul range
+// della banda) e la colormap la applica lo shader colormap.frag con la
+// striscia "lut?colormap=N" (256x1). Con il backend software lo stesso
+// percorso produce pixmap: il QML usa channel=1 solo con un backend RHI.
+class GeoTiffTextureProvider : public QQuickImageProvider
+{
+public:
+    GeoTiffTextureProvider();
+
+    QQuickTextureFactory *requestTexture(const QString &id, QSize *size, const QSize &requestedSize) override;
+
+    // Colormap del provider in 256 colori indicizzati dai codici a 8 bit:
+    // 0..UInt8MaxCode la scala, poi nodata (primo colore) e non validi (nero)
+    static QImage colormapStrip(int colorMap);
+
+private:
+    // Id senza t= (il timestamp serve solo a forzare la ricarica in QML) più
+    // la data di modifica dei file coinvolti: un file riscritto non si condivide
+    static QString cacheKey(const QString &id, const QSize &requestedSize);
+
+    GeoTiffImageProvider m_images;
+    QMutex m_mutex;
+    // Deboli: l'immagine vive finché una factory (un pannello) la usa
+    QHash<QString, std::weak_ptr<const QImage>> m_shared;
+};
+
+#endif // TEXTUREPROVIDER_H
@@ -0,0 +1,832 @@
+#include "tileserver.h"
+#include "rasterexport.h"
+#include "geotiffprocessor.h"
+#include "warpgridcache.h"
+#include "quantize.h"
+#include "compositor.h"
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QImage>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <gdal_priv.h>
+#include <gdalwarper.h>
+#include <ogr_spatialref.h>
+
+namespace {
+
+// Semi-estensione di EPSG:3857 (metri)
+const double WorldExtent = 20037508.342789244;
+const int PerimeterSamples = 32;
+const int MaxHeaderBytes = 16 * 1024;
+// Overhead stimato di una voce di cache oltre al PNG
+const qint64 CacheEntryOverhead = 128;
+
+QByteArray reasonPhrase(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 431: return "Request Header Fields Too Large";
+    default: return "Internal Server Error";
+    }
+}
+
+double tileSpan(int z)
+{
+    return 2.0 * WorldExtent / std::ldexp(1.0, z);
+}
+
+// Tile della zoom z che intersecano l'estensione (minX, minY, maxX, maxY)
+QRect tilesCovering(const double *bounds, int z)
+{
+    const double span = tileSpan(z);
+    const int last = (1 << z) - 1;
+    int x0 = qBound(0, (int)std::floor((bounds[0] + WorldExtent) / span), last);
+    int x1 = qBound(0, (int)std::ceil((bounds[2] + WorldExtent) / span) - 1, last);
+    int y0 = qBound(0, (int)std::floor((WorldExtent - bounds[3]) / span), last);
+    int y1 = qBound(0, (int)std::ceil((WorldExtent - bounds[1]) / span) - 1, last);
+    return QRect(QPoint(x0, y0), QPoint(x1, y1));
+}
+
+} // namespace
+
+TileServer::SourceHandle::~SourceHandle()
+{
+    for (GDALDataset *grid : zoomGrids) {
+        GDALClose(grid);
+    }
+    for (GDALDataset *overview : overviews) {
+        if (overview) GDALClose(overview);
+    }
+    if (dataset) {
+        GDALClose(dataset);
+    }
+}
+
+GDALDataset *TileServer::SourceHandle::overview(int level)
+{
+    if (level < 0) {
+        return dataset;
+    }
+    if ((int)overviews.size() <= level) {
+        overviews.resize(level + 1, nullptr);
+    }
+    if (!overviews[level]) {
+        overviews[level] = GDALCreateOverviewDataset(dataset, level, true);
+    }
+    return overviews[level] ? overviews[level] : dataset;
+}
+
+GDALDataset *TileServer::SourceHandle::zoomGrid(int z)
+{
+    auto it = zoomGrids.constFind(z);
+    if (it != zoomGrids.constEnd()) {
+        return it.value();
+    }
+    // Riferimento della zoom: i tile che coprono il raster, a TileSize pixel per tile
+    const QRect tiles = tilesCovering(source->mercatorBounds, z);
+    const double pixelSpan = tileSpan(z) / TileSize;
+    GDALDriver *memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *grid = memDriver ? memDriver->Create("", tiles.width() * TileSize, tiles.height() * TileSize, 0,
+                                                      GDT_Byte, nullptr)
+                                  : nullptr;
+    if (grid) {
+        double geoTransform[6] = {-WorldExtent + tiles.left() * tileSpan(z), pixelSpan, 0.0,
+                                  WorldExtent - tiles.top() * tileSpan(z), 0.0, -pixelSpan};
+        grid->SetGeoTransform(geoTransform);
+        OGRSpatialReference mercator;
+        mercator.importFromEPSG(3857);
+        grid->SetSpatialRef(&mercator);
+    }
+    zoomGrids.insert(z, grid);
+    return grid;
+}
+
+TileServer::TileServer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_server(new QTcpServer(this))
+    , m_cacheUsed(0)
+{
+    connect(m_server, &QTcpServer::newConnection, this, &TileServer::onNewConnection);
+}
+
+TileServer::~TileServer()
+{
+    // I risultati accodati dopo la distruzione sono scartati (contesto = this)
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool TileServer::start(QString *error)
+{
+    m_source = openSource(error);
+    if (!m_source) {
+        return false;
+    }
+    m_lastStat.start();
+    m_pool.setMaxThreadCount(m_options.threads > 0 ? m_options.threads : QThread::idealThreadCount());
+
+    QImage empty(TileSize, TileSize, QImage::Format_ARGB32);
+    empty.fill(Qt::transparent);
+    m_emptyTile = encodePng(empty);
+
+    if (!m_server->listen(m_options.address, m_options.port)) {
+        *error = QString("Failed to listen on port %1: %2").arg(m_options.port).arg(m_server->errorString());
+        return false;
+    }
+    qDebug() << "Tile server:" << m_options.rasterPath << "port" << port() << "native zoom" << m_source->nativeZoom
+             << "workers" << m_pool.maxThreadCount() << (m_source->rgb ? "RGB" : "colormap") << m_options.colorMap;
+    return true;
+}
+
+quint16 TileServer::port() const
+{
+    return m_server->serverPort();
+}
+
+QString TileServer::fileStamp(const QString &path)
+{
+    QFileInfo info(path);
+    return QString("%1|%2").arg(info.lastModified().toMSecsSinceEpoch()).arg(info.size());
+}
+
+std::shared_ptr<const TileServer::Source> TileServer::openSource(QString *error) const
+{
+    const QString &path = m_options.rasterPath;
+    auto source = std::make_shared<Source>();
+    // Prima dell'apertura: se il file cambia durante la lettura il controllo successivo lo ricarica
+    source->stamp = fileStamp(path);
+    GDALDataset *dataset = (GDALDataset*)GDALOpen(path.toUtf8().constData(), GA_ReadOnly);
+    if (dataset == nullptr) {
+        *error = "Failed to open " + path;
+        return nullptr;
+    }
+    source->width = dataset->GetRasterXSize();
+    source->height = dataset->GetRasterYSize();
+
+    double geoTransform[6];
+    double inverseTransform[6];
+    const OGRSpatialReference *srs = dataset->GetSpatialRef();
+    if (dataset->GetGeoTransform(geoTransform) != CE_None || srs == nullptr
+        || !GDALInvGeoTransform(geoTransform, inverseTransform)) {
+        GDALClose(dataset);
+        *error = path + " has no georeferencing";
+        return nullptr;
+    }
+
+    // Colorazione come il provider: RGB con colormap=-1 e 3+ bande, altrimenti
+    // colormap stirata sulle statistiche della prima banda
+    source->rgb = m_options.colorMap < 0 && dataset->GetRasterCount() >= 3;
+    if (!source->rgb) {
+        GDALRasterBand *band = dataset->GetRasterBand(1);
+        double minValue = 0.0, maxValue = 0.0, mean = 0.0, stdDev = 0.0;
+        if (band->ComputeStatistics(false, &minValue, &maxValue, &mean, &stdDev, nullptr, nullptr) != CE_None) {
+            GDALClose(dataset);
+            *error = QString("Failed to compute statistics of %1: %2").arg(path, CPLGetLastErrorMsg());
+            return nullptr;
+        }
+        int hasNoData = 0;
+        source->noData = band->GetNoDataValue(&hasNoData);
+        source->hasNoData = hasNoData != 0;
+        source->minValue = minValue;
+        source->range = maxValue - minValue;
+        if (source->range < 1e-10) source->range = 1.0;
+        source->lut = RasterExport::buildLut(GeoTiffImageProvider::getColorMapColors(m_options.colorMap));
+    }
+
+    // Estensione in Web Mercator e lon/lat dai campioni sul perimetro
+    OGRSpatialReference rasterSrs(*srs);
+    rasterSrs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    OGRSpatialReference mercator;
+    mercator.importFromEPSG(3857);
+    mercator.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    OGRSpatialReference lonLat;
+    lonLat.SetWellKnownGeogCS("WGS84");
+    lonLat.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+    std::vector<double> perimeterX;
+    std::vector<double> perimeterY;
+    for (int i = 0; i <= PerimeterSamples; ++i) {
+        double t = (double)i / PerimeterSamples;
+        const double pixels[4][2] = {{t * source->width, 0.0}, {t * source->width, (double)source->height},
+                                     {0.0, t * source->height}, {(double)source->width, t * source->height}};
+        for (const auto &pixel : pixels) {
+            perimeterX.push_back(geoTransform[0] + pixel[0] * geoTransform[1] + pixel[1] * geoTransform[2]);
+            perimeterY.push_back(geoTransform[3] + pixel[0] * geoTransform[4] + pixel[1] * geoTransform[5]);
+        }
+    }
+    auto transformedBounds = [&](OGRSpatialReference &target, double *bounds) {
+        OGRCoordinateTransformation *transform = OGRCreateCoordinateTransformation(&rasterSrs, &target);
+        if (transform == nullptr) {
+            return false;
+        }
+        std::vector<double> x = perimeterX;
+        std::vector<double> y = perimeterY;
+        std::vector<int> success(x.size(), 0);
+        transform->Transform((int)x.size(), x.data(), y.data(), nullptr, success.data());
+        OGRCoordinateTransformation::DestroyCT(transform);
+        bounds[0] = bounds[1] = std::numeric_limits<double>::max();
+        bounds[2] = bounds[3] = std::numeric_limits<double>::lowest();
+        bool any = false;
+        for (size_t i = 0; i < x.size(); ++i) {
+            if (!success[i]) continue;
+            bounds[0] = std::min(bounds[0], x[i]);
+            bounds[1] = std::min(bounds[1], y[i]);
+            bounds[2] = std::max(bounds[2], x[i]);
+            bounds[3] = std::max(bounds[3], y[i]);
+            any = true;
+        }
+        return any;
+    };
+    bool ok = transformedBounds(mercator, source->mercatorBounds) && transformedBounds(lonLat, source->lonLatBounds);
+    GDALClose(dataset);
+    if (!ok) {
+        *error = "Failed to transform the raster extent to Web Mercator";
+        return nullptr;
+    }
+
+    // Zoom nativa: la prima in cui un pixel del tile non supera un pixel sorgente
+    const double resolution = (source->mercatorBounds[2] - source->mercatorBounds[0]) / source->width;
+    source->resolution = resolution;
+    source->nativeZoom = resolution > 0.0
+                         ? qBound(0, (int)std::ceil(std::log2(2.0 * WorldExtent / (TileSize * resolution))), (int)MaxZoom)
+                         : 0;
+
+    source->version = (path + '|' + source->stamp + '|' + QString::number(m_options.colorMap) + '|'
+                       + RasterReader::modeName(m_options.mode)).toUtf8();
+    return source;
+}
+
+void TileServer::refreshSource()
+{
+    if (m_lastStat.isValid() && m_lastStat.elapsed() < StatInterval) {
+        return;
+    }
+    m_lastStat.start();
+    if (fileStamp(m_options.rasterPath) == m_source->stamp) {
+        return;
+    }
+
+    QString error;
+    std::shared_ptr<const Source> source = openSource(&error);
+    if (!source) {
+        // File a metà scrittura: si riprova al prossimo controllo
+        qWarning() << "Tile server: raster changed but cannot be reopened yet:" << error;
+        return;
+    }
+    m_cache.clear();
+    m_lru.clear();
+    m_cacheUsed = 0;
+    {
+        // releaseHandle confronta m_source dai worker: si sostituisce sotto lo stesso lock
+        QMutexLocker locker(&m_handleMutex);
+        m_source = source;
+        m_idleHandles.clear();
+    }
+    qDebug() << "Tile server: raster rewritten, reloaded" << m_options.rasterPath << "native zoom"
+             << source->nativeZoom;
+}
+
+std::unique_ptr<TileServer::SourceHandle> TileServer::acquireHandle(const std::shared_ptr<const Source> &source)
+{
+    {
+        QMutexLocker locker(&m_handleMutex);
+        while (!m_idleHandles.empty()) {
+            std::unique_ptr<SourceHandle> handle = std::move(m_idleHandles.back());
+            m_idleHandles.pop_back();
+            // Aperto su una versione precedente del file: si chiude
+            if (handle->source == source) {
+                return handle;
+            }
+        }
+    }
+
+    // Un dataset per worker: le letture GDAL sullo stesso handle non sono thread-safe
+    std::unique_ptr<SourceHandle> handle(new SourceHandle);
+    handle->source = source;
+    handle->dataset = (GDALDataset*)GDALOpen(m_options.rasterPath.toUtf8().constData(), GA_ReadOnly);
+    if (handle->dataset == nullptr || handle->dataset->GetSpatialRef() == nullptr) {
+        qWarning() << "Tile server: failed to open" << m_options.rasterPath;
+        return nullptr;
+    }
+    return handle;
+}
+
+void TileServer::releaseHandle(std::unique_ptr<SourceHandle> handle)
+{
+    if (!handle) {
+        return;
+    }
+    QMutexLocker locker(&m_handleMutex);
+    if (handle->source == m_source) {
+        m_idleHandles.push_back(std::move(handle));
+    }
+}
+
+bool TileServer::intersectsRaster(int z, int x, int y) const
+{
+    const double *bounds = m_source->mercatorBounds;
+    const double span = tileSpan(z);
+    const double left = -WorldExtent + x * span;
+    const double top = WorldExtent - y * span;
+    return left < bounds[2] && left + span > bounds[0] && top > bounds[1] && top - span < bounds[3];
+}
+
+QRect TileServer::tileRange(int z) const
+{
+    return tilesCovering(m_source->mercatorBounds, z);
+}
+
+QByteArray TileServer::renderTile(int z, int x, int y, SourceHandle *handle) const
+{
+    const Source &source = *handle->source;
+
+    // Oltre la zoom nativa il tile è una finestra ingrandita della griglia nativa
+    const int gridZoom = std::min(z, source.nativeZoom);
+    const double magnification = std::ldexp(1.0, z - gridZoom);
+    GDALDataset *gridDS = handle->zoomGrid(gridZoom);
+    if (!gridDS) {
+        return QByteArray();
+    }
+    const QRect gridTiles = tilesCovering(source.mercatorBounds, gridZoom);
+    const double refOffsetX = x * TileSize / magnification - gridTiles.left() * TileSize;
+    const double refOffsetY = y * TileSize / magnification - gridTiles.top() * TileSize;
+
+    // Overview come le anteprime: la più ridotta che non scende sotto la
+    // risoluzione del tile (i fattori di GDAL sono approssimati, 5% di margine)
+    GDALRasterBand *firstBand = handle->dataset->GetRasterBand(1);
+    const double factor = source.resolution > 0.0 ? tileSpan(z) / TileSize / source.resolution : 1.0;
+    int overviewLevel = -1;
+    for (int i = 0; i < firstBand->GetOverviewCount(); ++i) {
+        GDALRasterBand *overview = firstBand->GetOverview(i);
+        if (overview && (double)source.width / overview->GetXSize() <= factor * 1.05) {
+            overviewLevel = i;
+        }
+    }
+    GDALDataset *srcDS = handle->overview(overviewLevel);
+
+    // Stessa griglia di trasformazione in cache e stesso warper di warpImageToMatch
+    std::shared_ptr<const WarpGrid> warpGrid = WarpGridCache::instance().gridFor(srcDS, gridDS);
+    void *transformArg = warpGrid ? createCachedGridTransformer(warpGrid, srcDS, gridDS, refOffsetX, refOffsetY,
+                                                                1.0 / magnification, 1.0 / magnification)
+                                  : nullptr;
+    if (!transformArg) {
+        qWarning() << "Tile server: no warp grid for tile" << z << x << y;
+        return QByteArray();
+    }
+
+    const int bandCount = source.rgb ? 3 : 1;
+    GDALDriver *memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *tileDS = memDriver->Create("", TileSize, TileSize, source.rgb ? 4 : 1,
+                                            source.rgb ? GDT_Byte : GDT_Float32, nullptr);
+    if (!tileDS) {
+        destroyCachedGridTransformer(transformArg);
+        return QByteArray();
+    }
+
+    GDALWarpOptions *warpOptions = GDALCreateWarpOptions();
+    warpOptions->hSrcDS = srcDS;
+    warpOptions->hDstDS = tileDS;
+    warpOptions->pfnTransformer = cachedGridTransform;
+    warpOptions->pTransformerArg = transformArg;
+    warpOptions->eResampleAlg = RasterReader::warpAlgorithm(m_options.mode);
+    warpOptions->eWorkingDataType = source.rgb ? GDT_Byte : GDT_Float32;
+    warpOptions->nBandCount = bandCount;
+    warpOptions->panSrcBands = (int *)CPLMalloc(sizeof(int) * bandCount);
+    warpOptions->panDstBands = (int *)CPLMalloc(sizeof(int) * bandCount);
+    for (int b = 0; b < bandCount; ++b) {
+        warpOptions->panSrcBands[b] = b + 1;
+        warpOptions->panDstBands[b] = b + 1;
+    }
+    if (source.rgb) {
+        // Fuori dal raster alpha 0: sotto si vede la mappa di base
+        warpOptions->nDstAlphaBand = 4;
+        warpOptions->papszWarpOptions = CSLSetNameValue(warpOptions->papszWarpOptions, "INIT_DEST", "0");
+    } else {
+        // Nodata e fuori raster restano NaN, poi trasparenti
+        warpOptions->padfDstNoDataReal = (double *)CPLMalloc(sizeof(double));
+        warpOptions->padfDstNoDataReal[0] = std::numeric_limits<double>::quiet_NaN();
+        warpOptions->papszWarpOptions = CSLSetNameValue(warpOptions->papszWarpOptions, "INIT_DEST", "NO_DATA");
+        if (source.hasNoData) {
+            warpOptions->padfSrcNoDataReal = (double *)CPLMalloc(sizeof(double));
+            warpOptions->padfSrcNoDataReal[0] = source.noData;
+        }
+    }
+
+    CPLErr warpError = CE_Failure;
+    {
+        GDALWarpOperation warpOperation;
+        if (warpOperation.Initialize(warpOptions) == CE_None) {
+            warpError = warpOperation.ChunkAndWarpImage(0, 0, TileSize, TileSize);
+        }
+    }
+    // GDALDestroyWarpOptions libera bande, nodata e opzioni, non il transformer
+    warpOptions->pTransformerArg = nullptr;
+    GDALDestroyWarpOptions(warpOptions);
+    destroyCachedGridTransformer(transformArg);
+    if (warpError != CE_None) {
+        qWarning() << "Tile server: warp failed for tile" << z << x << y << CPLGetLastErrorMsg();
+        GDALClose(tileDS);
+        return QByteArray();
+    }
+
+    // Colorazione con gli stessi kernel del provider
+    const size_t pixels = (size_t)TileSize * TileSize;
+    QImage image(TileSize, TileSize, QImage::Format_ARGB32);
+    bool painted = false;
+    if (source.rgb) {
+        std::vector<uint8_t> channels(pixels * 4);
+        for (int b = 0; b < 4; ++b) {
+            tileDS->GetRasterBand(b + 1)->RasterIO(GF_Read, 0, 0, TileSize, TileSize, channels.data() + b * pixels,
+                                                   TileSize, TileSize, GDT_Byte, 0, 0);
+        }
+        const uint8_t *alpha = channels.data() + 3 * pixels;
+        for (int py = 0; py < TileSize; ++py) {
+            const size_t row = (size_t)py * TileSize;
+            QRgb *line = (QRgb*)image.scanLine(py);
+            Compositor::packRgb(channels.data() + row, channels.data() + pixels + row,
+                                channels.data() + 2 * pixels + row, TileSize, line);
+            for (int px = 0; px < TileSize; ++px) {
+                if (alpha[row + px] == 0) {
+                    line[px] = 0;
+                } else {
+                    painted = true;
+                }
+            }
+        }
+    } else {
+        std::vector<float> values(pixels);
+        tileDS->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, TileSize, TileSize, values.data(), TileSize, TileSize,
+                                           GDT_Float32, 0, 0);
+        const float lutScale = static_cast<float>((RasterExport::LutSize - 1) / source.range);
+        for (int py = 0; py < TileSize; ++py) {
+            const float *row = values.data() + (size_t)py * TileSize;
+            QRgb *line = (QRgb*)image.scanLine(py);
+            Quantize::colorize(row, TileSize, static_cast<float>(source.minValue), lutScale, source.lut.data(),
+                               RasterExport::LutSize, line);
+            for (int px = 0; px < TileSize; ++px) {
+                if (!std::isfinite(row[px])) {
+                    line[px] = 0;
+                } else {
+                    painted = true;
+                }
+            }
+        }
+    }
+    GDALClose(tileDS);
+    return painted ? encodePng(image) : m_emptyTile;
+}
+
+QByteArray TileServer::encodePng(const QImage &image) const
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return bytes;
+}
+
+QByteArray TileServer::tileEtag(int z, int x, int y) const
+{
+    QByteArray key = m_source->version + '/' + QByteArray::number(z) + '/' + QByteArray::number(x) + '/' + QByteArray::number(y);
+    return '"' + QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex().left(20) + '"';
+}
+
+void TileServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        m_connections.insert(socket, Connection());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            auto it = m_connections.find(socket);
+            if (it == m_connections.end()) {
+                return;
+            }
+            it->buffer += socket->readAll();
+            processBuffer(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void TileServer::processBuffer(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || it->busy) {
+        return;
+    }
+    int end = it->buffer.indexOf("\r\n\r\n");
+    if (end < 0) {
+        if (it->buffer.size() > MaxHeaderBytes) {
+            it->busy = true;
+            it->keepAlive = false;
+            respond(socket, 431, "text/plain", "Request header too large\n");
+        }
+        return;
+    }
+    QByteArray head = it->buffer.left(end);
+    it->buffer.remove(0, end + 4);
+
+    QList<QByteArray> lines = head.split('\n');
+    QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    QByteArray method = requestLine.value(0);
+    QByteArray path = requestLine.value(1);
+    QByteArray version = requestLine.value(2);
+    QByteArray host;
+    QByteArray ifNoneMatch;
+    QByteArray connection;
+    for (int i = 1; i < lines.size(); ++i) {
+        int colon = lines[i].indexOf(':');
+        if (colon <= 0) continue;
+        QByteArray name = lines[i].left(colon).trimmed().toLower();
+        QByteArray value = lines[i].mid(colon + 1).trimmed();
+        if (name == "host") host = value;
+        else if (name == "if-none-match") ifNoneMatch = value;
+        else if (name == "connection") connection = value.toLower();
+    }
+
+    it->busy = true;
+    it->head = method == "HEAD";
+    it->keepAlive = version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+    m_stats.requests++;
+    if (method != "GET" && method != "HEAD") {
+        respond(socket, 405, "text/plain", "Only GET and HEAD are supported\n");
+        return;
+    }
+    if (!path.startsWith('/')) {
+        respond(socket, 400, "text/plain", "Bad request\n");
+        return;
+    }
+    handleRequest(socket, path, host, ifNoneMatch);
+}
+
+void TileServer::handleRequest(QTcpSocket *socket, const QByteArray &requestPath, const QByteArray &host,
+                               const QByteArray &ifNoneMatch)
+{
+    int query = requestPath.indexOf('?');
+    QByteArray path = query >= 0 ? requestPath.left(query) : requestPath;
+    if (path == "/" || path == "/index.html") {
+        respond(socket, 200, "text/html; charset=utf-8", viewerPage());
+        return;
+    }
+    if (path == "/tile.json") {
+        refreshSource();
+        respond(socket, 200, "application/json", tileJson(host));
+        return;
+    }
+
+    static const QRegularExpression tilePattern("^/(\\d{1,2})/(\\d{1,8})/(\\d{1,8})\\.png$");
+    QRegularExpressionMatch match = tilePattern.match(QString::fromLatin1(path));
+    int z = match.hasMatch() ? match.captured(1).toInt() : -1;
+    int x = match.hasMatch() ? match.captured(2).toInt() : -1;
+    int y = match.hasMatch() ? match.captured(3).toInt() : -1;
+    if (z < 0 || z > MaxZoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) {
+        respond(socket, 404, "text/plain", "Not found\n");
+        return;
+    }
+
+    // L'ETag non dipende dal contenuto: la revalidazione non tocca la cache.
+    // Prima si verifica che il file non sia stato riscritto
+    refreshSource();
+    QByteArray etag = tileEtag(z, x, y);
+    if (!ifNoneMatch.isEmpty() && (ifNoneMatch == "*" || ifNoneMatch.contains(etag))) {
+        m_stats.notModified++;
+        respond(socket, 304, QByteArray(), QByteArray(), etag);
+        return;
+    }
+    if (!intersectsRaster(z, x, y)) {
+        m_stats.empty++;
+        respond(socket, 200, "image/png", m_emptyTile, etag);
+        return;
+    }
+    requestTile(socket, z, x, y);
+}
+
+void TileServer::requestTile(QTcpSocket *socket, int z, int x, int y)
+{
+    const QByteArray etag = tileEtag(z, x, y);
+    const QString key = QString::fromLatin1(etag);
+    QByteArray png = cacheLookup(key);
+    if (!png.isEmpty()) {
+        m_stats.cacheHits++;
+        respond(socket, 200, "image/png", png, etag);
+        return;
+    }
+
+    // Tile già in resa per un altro client: si attende lo stesso risultato
+    auto pending = m_pending.find(key);
+    if (pending != m_pending.end()) {
+        pending->append(QPointer<QTcpSocket>(socket));
+        return;
+    }
+    m_pending.insert(key, QList<QPointer<QTcpSocket>>() << QPointer<QTcpSocket>(socket));
+
+    std::shared_ptr<const Source> source = m_source;
+    m_pool.start([this, source, key, etag, z, x, y]() {
+        std::unique_ptr<SourceHandle> handle = acquireHandle(source);
+        QByteArray rendered = handle ? renderTile(z, x, y, handle.get()) : QByteArray();
+        releaseHandle(std::move(handle));
+        QMetaObject::invokeMethod(this, [this, source, key, etag, rendered]() {
+            finishTile(source, key, etag, rendered);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TileServer::finishTile(const std::shared_ptr<const Source> &source, const QString &key,
+                            const QByteArray &etag, const QByteArray &png)
+{
+    const QList<QPointer<QTcpSocket>> waiters = m_pending.take(key);
+    if (png.isEmpty()) {
+        for (const QPointer<QTcpSocket> &socket : waiters) {
+            if (socket) respond(socket, 500, "text/plain", "Tile rendering failed\n");
+        }
+        return;
+    }
+    m_stats.rendered++;
+    // Resa iniziata prima di una ricarica: si risponde, ma non si tiene in cache
+    if (source == m_source) {
+        cacheInsert(key, png);
+    }
+    for (const QPointer<QTcpSocket> &socket : waiters) {
+        if (socket) respond(socket, 200, "image/png", png, etag);
+    }
+}
+
+void TileServer::respond(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body,
+                         const QByteArray &etag)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end()) {
+        return;
+    }
+    const bool keepAlive = it->keepAlive;
+    const bool head = it->head;
+    const bool moreRequests = !it->buffer.isEmpty();
+    it->busy = false;
+    if (status >= 400) {
+        m_stats.errors++;
+    }
+
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reasonPhrase(status) + "\r\n";
+    if (status != 304) {
+        if (!contentType.isEmpty()) response += "Content-Type: " + contentType + "\r\n";
+        response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    }
+    if (!etag.isEmpty()) {
+        // Il browser rivalida ogni volta: riscritto il raster cambia l'ETag e arrivano i tile nuovi
+        response += "ETag: " + etag + "\r\nCache-Control: no-cache\r\n";
+    }
+    response += "Access-Control-Allow-Origin: *\r\n";
+    response += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (!head && status != 304) {
+        response += body;
+    }
+    socket->write(response);
+
+    if (!keepAlive) {
+        socket->disconnectFromHost();
+    } else if (moreRequests) {
+        // Richieste in pipeline: la prossima dal loop, non in ricorsione
+        QPointer<QTcpSocket> next(socket);
+        QMetaObject::invokeMethod(this, [this, next]() {
+            if (next) processBuffer(next);
+        }, Qt::QueuedConnection);
+    }
+}
+
+QByteArray TileServer::tileJson(const QByteArray &host) const
+{
+    QByteArray authority = host.isEmpty() ? "localhost:" + QByteArray::number(port()) : host;
+    QJsonObject json;
+    json["tilejson"] = "2.2.0";
+    json["name"] = QFileInfo(m_options.rasterPath).fileName();
+    json["scheme"] = "xyz";
+    json["tiles"] = QJsonArray{QString::fromUtf8("http://" + authority + "/{z}/{x}/{y}.png")};
+    json["minzoom"] = 0;
+    const double *bounds = m_source->lonLatBounds;
+    json["maxzoom"] = m_source->nativeZoom;
+    json["bounds"] = QJsonArray{bounds[0], bounds[1], bounds[2], bounds[3]};
+    json["center"] = QJsonArray{(bounds[0] + bounds[2]) / 2.0, (bounds[1] + bounds[3]) / 2.0,
+                                std::max(0, m_source->nativeZoom - 3)};
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+QByteArray TileServer::viewerPage() const
+{
+    // Pagina minima per il browser: Leaflet, mappa di base OSM e i tile del raster
+    return QByteArray(R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>)") + QFileInfo(m_options.rasterPath).fileName().toHtmlEscaped().toUtf8() + R"(</title>
+<link rel="stylesheet" href="https://unpkg.com/leaflet@1.9.4/dist/leaflet.css">
+<script src="https://unpkg.com/leaflet@1.9.4/dist/leaflet.js"></script>
+<style>html, body, #map { height: 100%; margin: 0; }</style>
+</head>
+<body>
+<div id="map"></div>
+<script>
+fetch('tile.json').then(r => r.json()).then(info => {
+  const map = L.map('map');
+  L.tileLayer('https://tile.openstreetmap.org/{z}/{x}/{y}.png',
+              { maxZoom: 22, maxNativeZoom: 19, attribution: '&copy; OpenStreetMap' }).addTo(map);
+  L.tileLayer('{z}/{x}/{y}.png', { maxZoom: 22, maxNativeZoom: info.maxzoom }).addTo(map);
+  const b = info.bounds;
+  map.fitBounds([[b[1], b[0]], [b[3], b[2]]]);
+});
+</script>
+</body>
+</html>
+)";
+}
+
+QByteArray TileServer::cacheLookup(const QString &key)
+{
+    auto it = m_cache.find(key);
+    if (it == m_cache.end()) {
+        return QByteArray();
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->position);
+    return it->png;
+}
+
+void TileServer::cacheInsert(const QString &key, const QByteArray &png)
+{
+    if (m_cache.contains(key)) {
+        return;
+    }
+    m_lru.push_front(key);
+    m_cache.insert(key, CacheEntry{png, m_lru.begin()});
+    m_cacheUsed += png.size() + CacheEntryOverhead;
+    while (m_cacheUsed > m_options.cacheBytes && m_lru.size() > 1) {
+        auto victim = m_cache.find(m_lru.back());
+        m_cacheUsed -= victim->png.size() + CacheEntryOverhead;
+        m_cache.erase(victim);
+        m_lru.pop_back();
+    }
+}
+
+int runTileServer(const QStringList &arguments)
+{
+    QTextStream out(stdout);
+    TileServer::Options options;
+    bool valid = true;
+    for (int i = 0; i < arguments.size(); ++i) {
+        const QString &argument = arguments[i];
+        const bool hasValue = i + 1 < arguments.size();
+        if (argument == "--port" && hasValue) {
+            options.port = arguments[++i].toUShort();
+        } else if (argument == "--bind" && hasValue) {
+            options.address = QHostAddress(arguments[++i]);
+        } else if (argument == "--colormap" && hasValue) {
+            options.colorMap = arguments[++i].toInt();
+        } else if (argument == "--threads" && hasValue) {
+            options.threads = arguments[++i].toInt();
+        } else if (argument == "--cache-mb" && hasValue) {
+            options.cacheBytes = arguments[++i].toLongLong() * 1024 * 1024;
+        } else if (argument == "--resample" && hasValue) {
+            options.mode = RasterReader::modeFromName(arguments[++i], options.mode);
+        } else if (!argument.startsWith("--") && options.rasterPath.isEmpty()) {
+            options.rasterPath = argument;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || options.rasterPath.isEmpty()) {
+        out << "Usage: --serve <raster.tif> [--port 8080] [--bind address] [--colormap N | -1 for RGB]\n"
+               "               [--threads N] [--cache-mb 256] [--resample average]\n";
+        return 1;
+    }
+
+    TileServer server(options);
+    QString error;
+    if (!server.start(&error)) {
+        out << "Tile server: " << error << "\n";
+        return 1;
+    }
+    QString address = options.address == QHostAddress::Any ? QString("localhost") : options.address.toString();
+    out << "Serving " << options.rasterPath << " on http://" << address << ":" << server.port() << "/\n";
+    out << "  XYZ tiles: /{z}/{x}/{y}.png (native zoom " << server.nativeZoom() << "), TileJSON: /tile.json\n";
+    out.flush();
+    return QCoreApplication::exec();
+}
@@ -0,0 +1,178 @@
+#ifndef TILESERVER_H
+#define TILESERVER_H
+
+#include "rasterreader.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHostAddress>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QThreadPool>
+#include <QRect>
+#include <QRgb>
+#include <QElapsedTimer>
+#include <list>
+#include <memory>
+#include <vector>
+
+class QImage;
+class QTcpServer;
+class QTcpSocket;
+class GDALDataset;
+
+// Tile server XYZ (/{z}/{x}/{y}.png, Web Mercator) sul raster elaborato, per
+// consultarlo da browser senza l'applicazione. Resa come nel provider: il warp
+// usa la WarpGridCache (una griglia per livello di zoom, ogni tile ne è una
+// finestra) e il GDALWarpOperation con il ricampionamento scelto, dall'overview
+// adatta alla zoom; la colormap è Quantize::colorize, l'RGB Compositor::packRgb.
+// I tile si rendono su un pool di worker (ognuno col proprio dataset GDAL) e i
+// PNG finiscono in una cache LRU condivisa; l'ETag dipende solo da raster
+// (percorso, mtime e dimensione), colorazione e indice del tile, quindi
+// If-None-Match risponde 304 senza rendere né leggere la cache. Il file si
+// ricontrolla ogni StatInterval ms: se una nuova analisi lo riscrive si
+// ricaricano statistiche ed estensione, cambiano gli ETag e cache e dataset
+// dei worker si scartano.
+class TileServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int TileSize = 256;
+    static const int MaxZoom = 24;
+    static const int StatInterval = 500;
+
+    struct Options
+    {
+        QString rasterPath;
+        int colorMap = 0;                           // -1 = RGB per raster a 3+ bande
+        ResampleMode mode = ResampleMode::Average;
+        QHostAddress address = QHostAddress::Any;
+        quint16 port = 8080;                        // 0 = porta libera
+        int threads = 0;                            // 0 = QThread::idealThreadCount()
+        qint64 cacheBytes = 256ll * 1024 * 1024;
+    };
+
+    struct Stats
+    {
+        qint64 requests = 0;
+        qint64 rendered = 0;
+        qint64 cacheHits = 0;
+        qint64 notModified = 0;
+        qint64 empty = 0;       // tile fuori dal raster
+        qint64 errors = 0;
+    };
+
+    explicit TileServer(const Options &options, QObject *parent = nullptr);
+    ~TileServer();
+
+    bool start(QString *error);
+    quint16 port() const;
+    int nativeZoom() const { return m_source ? m_source->nativeZoom : 0; }
+    // Tile della zoom z che intersecano il raster (x, y inclusi)
+    QRect tileRange(int z) const;
+    Stats stats() const { return m_stats; }
+    qint64 cacheBytes() const { return m_cacheUsed; }
+
+private:
+    // Stato del raster per una versione del file, immutabile: i worker tengono
+    // il puntatore della versione con cui è partita la resa
+    struct Source
+    {
+        QString stamp;                  // mtime|dimensione del file
+        int width = 0;
+        int height = 0;
+        bool rgb = false;
+        bool hasNoData = false;
+        double noData = 0.0;
+        double minValue = 0.0;
+        double range = 1.0;
+        double resolution = 0.0;        // metri Web Mercator per pixel sorgente (circa)
+        double mercatorBounds[4] = {0.0, 0.0, 0.0, 0.0};   // minX, minY, maxX, maxY
+        double lonLatBounds[4] = {0.0, 0.0, 0.0, 0.0};     // ovest, sud, est, nord
+        int nativeZoom = 0;
+        QByteArray version;             // percorso|mtime|dimensione|colorazione, base degli ETag
+        std::vector<QRgb> lut;
+    };
+
+    // Dataset di un worker, con le overview e le griglie di riferimento per zoom
+    // (dataset MEM senza bande in Web Mercator) aperte su richiesta
+    struct SourceHandle
+    {
+        std::shared_ptr<const Source> source;   // versione per cui è stato aperto
+        GDALDataset *dataset = nullptr;
+        std::vector<GDALDataset*> overviews;
+        QHash<int, GDALDataset*> zoomGrids;
+        ~SourceHandle();
+
+        GDALDataset *overview(int level);
+        GDALDataset *zoomGrid(int z);
+    };
+
+    struct Connection
+    {
+        QByteArray buffer;
+        bool busy = false;      // una richiesta alla volta, le successive restano nel buffer
+        bool keepAlive = true;
+        bool head = false;
+    };
+
+    struct CacheEntry
+    {
+        QByteArray png;
+        std::list<QString>::iterator position;
+    };
+
+    std::shared_ptr<const Source> openSource(QString *error) const;
+    // Ricarica il raster se mtime o dimensione sono cambiati (al più ogni StatInterval)
+    void refreshSource();
+    static QString fileStamp(const QString &path);
+    std::unique_ptr<SourceHandle> acquireHandle(const std::shared_ptr<const Source> &source);
+    void releaseHandle(std::unique_ptr<SourceHandle> handle);
+    bool intersectsRaster(int z, int x, int y) const;
+    QByteArray renderTile(int z, int x, int y, SourceHandle *handle) const;
+    QByteArray encodePng(const QImage &image) const;
+    QByteArray tileEtag(int z, int x, int y) const;
+
+    void onNewConnection();
+    void processBuffer(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &path, const QByteArray &host,
+                       const QByteArray &ifNoneMatch);
+    void requestTile(QTcpSocket *socket, int z, int x, int y);
+    void finishTile(const std::shared_ptr<const Source> &source, const QString &key, const QByteArray &etag,
+                    const QByteArray &png);
+    void respond(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body,
+                 const QByteArray &etag = QByteArray());
+    QByteArray tileJson(const QByteArray &host) const;
+    QByteArray viewerPage() const;
+
+    QByteArray cacheLookup(const QString &key);
+    void cacheInsert(const QString &key, const QByteArray &png);
+
+    Options m_options;
+    QTcpServer *m_server;
+    QThreadPool m_pool;
+
+    // Versione corrente del raster: sostituita solo dal thread principale
+    std::shared_ptr<const Source> m_source;
+    QElapsedTimer m_lastStat;
+    QByteArray m_emptyTile;
+
+    QMutex m_handleMutex;
+    std::vector<std::unique_ptr<SourceHandle>> m_idleHandles;
+
+    // Stato del thread principale: connessioni, richieste in corso, cache (per
+    // ETag: i tile di una versione precedente non si confondono con i nuovi)
+    QHash<QTcpSocket*, Connection> m_connections;
+    QHash<QString, QList<QPointer<QTcpSocket>>> m_pending;
+    QHash<QString, CacheEntry> m_cache;
+    std::list<QString> m_lru;       // front = usato più di recente
+    qint64 m_cacheUsed;
+    Stats m_stats;
+};
+
+// Modalità headless: OliveM_Viewer --serve <raster.tif> [opzioni]
+int runTileServer(const QStringList &arguments);
+
+#endif // TILESERVER_H
@@ -0,0 +1,368 @@
+#include "warpgridcache.h"
+#include "memorygovernor.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <gdal_priv.h>
+#include <gdal_alg.h>
+
+namespace {
+
+// Oltre questo numero di nodi si rinuncia a raffinare la griglia. 2M nodi da
+// 16 byte sono 32 MB, metà della capacità di default: una griglia massima
+// resta in cache insieme ad altre invece di scacciarle tutte e poi sé stessa
+const size_t kMaxGridNodes = 2u * 1024u * 1024u;
+
+// Nodi iniziali sul lato lungo: la griglia parte grossolana e si dimezza il passo
+// finché l'errore al centro delle celle non rientra nella tolleranza
+const int kInitialNodesPerSide = 256;
+
+const double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+QString geoTransformKey(GDALDataset *dataset)
+{
+    double gt[6] = {0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    dataset->GetGeoTransform(gt);
+    QStringList parts;
+    for (double v : gt) {
+        parts << QString::number(v, 'g', 17);
+    }
+    return parts.join(',');
+}
+
+struct CachedGridTransformArg
+{
+    std::shared_ptr<const WarpGrid> grid;
+    GDALDataset *srcDS = nullptr;
+    GDALDataset *refDS = nullptr;
+    double refOffsetX = 0.0;  // origine dell'output in pixel di riferimento
+    double refOffsetY = 0.0;
+    double outToRefX = 1.0;   // pixel di output ridotto -> pixel di riferimento
+    double outToRefY = 1.0;
+    void *exactTransform = nullptr;
+};
+
+} // namespace
+
+bool WarpGrid::lookup(double refX, double refY, double &outX, double &outY) const
+{
+    double gx = refX / step;
+    double gy = refY / step;
+
+    // Ai bordi (coordinate appena fuori griglia) si estrapola dalla cella più vicina
+    int ix = std::max(0, std::min(nodesX - 2, static_cast<int>(std::floor(gx))));
+    int iy = std::max(0, std::min(nodesY - 2, static_cast<int>(std::floor(gy))));
+    double fx = gx - ix;
+    double fy = gy - iy;
+
+    size_t i00 = (size_t)iy * nodesX + ix;
+    size_t i10 = i00 + 1;
+    size_t i01 = i00 + nodesX;
+    size_t i11 = i01 + 1;
+
+    if (std::isnan(srcX[i00]) || std::isnan(srcX[i10]) || std::isnan(srcX[i01]) || std::isnan(srcX[i11])) {
+        return false;
+    }
+
+    double top = srcX[i00] + fx * (srcX[i10] - srcX[i00]);
+    double bottom = srcX[i01] + fx * (srcX[i11] - srcX[i01]);
+    outX = top + fy * (bottom - top);
+
+    top = srcY[i00] + fx * (srcY[i10] - srcY[i00]);
+    bottom = srcY[i01] + fx * (srcY[i11] - srcY[i01]);
+    outY = top + fy * (bottom - top);
+    return true;
+}
+
+size_t WarpGrid::byteSize() const
+{
+    return (srcX.size() + srcY.size()) * sizeof(double);
+}
+
+WarpGridCache &WarpGridCache::instance()
+{
+    static WarpGridCache cache;
+    return cache;
+}
+
+WarpGridCache::WarpGridCache()
+    : m_usedBytes(0)
+    , m_capacityBytes(64u * 1024u * 1024u)
+    , m_maxError(0.125)
+{
+}
+
+void WarpGridCache::setMaxError(double pixels)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxError = std::max(0.0, pixels);
+    qDebug() << "Warp approximation error threshold set to:" << m_maxError << "px";
+}
+
+double WarpGridCache::maxError() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxError;
+}
+
+void WarpGridCache::setCapacityBytes(size_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_capacityBytes = bytes;
+    evictLocked(m_capacityBytes);
+}
+
+size_t WarpGridCache::capacityBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_capacityBytes;
+}
+
+size_t WarpGridCache::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_usedBytes;
+}
+
+size_t WarpGridCache::trim(size_t targetBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    evictLocked(targetBytes);
+    return m_usedBytes;
+}
+
+void WarpGridCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_grids.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
+
+std::shared_ptr<const WarpGrid> WarpGridCache::gridFor(GDALDataset *srcDS, GDALDataset *refDS)
+{
+    double tolerance = maxError();
+    QString key = QString::fromUtf8(srcDS->GetProjectionRef()) + '|' + geoTransformKey(srcDS) + '|'
+                  + QString::fromUtf8(refDS->GetProjectionRef()) + '|' + geoTransformKey(refDS) + '|'
+                  + QString::number(refDS->GetRasterXSize()) + 'x' + QString::number(refDS->GetRasterYSize())
+                  + '|' + QString::number(tolerance, 'g', 17);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_grids.constFind(key);
+        if (it != m_grids.constEnd()) {
+            m_lru.removeOne(key);
+            m_lru.prepend(key);
+            qDebug() << "  Reusing cached warp grid, step:" << it.value()->step;
+            return it.value();
+        }
+    }
+
+    // Calcolo fuori dal lock: può richiedere qualche centinaio di ms
+    std::shared_ptr<WarpGrid> grid = buildGrid(srcDS, refDS, tolerance);
+    if (!grid) {
+        return nullptr;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_grids.contains(key)) {
+            m_grids.insert(key, grid);
+            m_lru.prepend(key);
+            m_usedBytes += grid->byteSize();
+            evictLocked(m_capacityBytes);
+        }
+    }
+    MemoryGovernor::instance()->notifyAllocated();
+    return grid;
+}
+
+std::shared_ptr<WarpGrid> WarpGridCache::buildGrid(GDALDataset *srcDS, GDALDataset *refDS, double tolerance) const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    void *exact = GDALCreateGenImgProjTransformer(srcDS, srcDS->GetProjectionRef(),
+                                                  refDS, refDS->GetProjectionRef(), FALSE, 0, 1);
+    if (!exact) {
+        qWarning() << "Failed to create projection transformer for warp grid";
+        return nullptr;
+    }
+
+    int refWidth = refDS->GetRasterXSize();
+    int refHeight = refDS->GetRasterYSize();
+    int step = std::max(1, std::max(refWidth, refHeight) / kInitialNodesPerSide);
+
+    auto grid = std::make_shared<WarpGrid>();
+    while (true) {
+        int nodesX = (refWidth + step - 1) / step + 1;
+        int nodesY = (refHeight + step - 1) / step + 1;
+        nodesX = std::max(2, nodesX);
+        nodesY = std::max(2, nodesY);
+
+        grid->step = step;
+        grid->nodesX = nodesX;
+        grid->nodesY = nodesY;
+        grid->srcX.assign((size_t)nodesX * nodesY, kNaN);
+        grid->srcY.assign((size_t)nodesX * nodesY, kNaN);
+
+        // Trasformazione esatta dei nodi, una riga alla volta
+        std::vector<double> xs(nodesX);
+        std::vector<double> ys(nodesX);
+        std::vector<double> zs(nodesX);
+        std::vector<int> success(nodesX);
+        for (int row = 0; row < nodesY; ++row) {
+            for (int col = 0; col < nodesX; ++col) {
+                xs[col] = (double)col * step;
+                ys[col] = (double)row * step;
+                zs[col] = 0.0;
+            }
+            GDALGenImgProjTransform(exact, TRUE, nodesX, xs.data(), ys.data(), zs.data(), success.data());
+            for (int col = 0; col < nodesX; ++col) {
+                if (success[col]) {
+                    grid->srcX[(size_t)row * nodesX + col] = xs[col];
+                    grid->srcY[(size_t)row * nodesX + col] = ys[col];
+                }
+            }
+        }
+
+        // Errore al centro delle celle: punto peggiore per l'interpolazione bilineare
+        double measured = 0.0;
+        int cellsX = nodesX - 1;
+        xs.resize(cellsX);
+        ys.resize(cellsX);
+        zs.resize(cellsX);
+        success.resize(cellsX);
+        for (int row = 0; row < nodesY - 1; ++row) {
+            for (int col = 0; col < cellsX; ++col) {
+                xs[col] = (col + 0.5) * step;
+                ys[col] = (row + 0.5) * step;
+                zs[col] = 0.0;
+            }
+            GDALGenImgProjTransform(exact, TRUE, cellsX, xs.data(), ys.data(), zs.data(), success.data());
+            for (int col = 0; col < cellsX; ++col) {
+                double approxX = 0.0;
+                double approxY = 0.0;
+                if (!success[col] || !grid->lookup((col + 0.5) * step, (row + 0.5) * step, approxX, approxY)) {
+                    continue;
+                }
+                measured = std::max(measured, std::fabs(approxX - xs[col]) + std::fabs(approxY - ys[col]));
+            }
+        }
+        grid->maxError = measured;
+
+        if (measured <= tolerance || step == 1) {
+            break;
+        }
+        int half = std::max(1, step / 2);
+        size_t nextNodes = (size_t)((refWidth + half - 1) / half + 1) * (size_t)((refHeight + half - 1) / half + 1);
+        if (nextNodes > kMaxGridNodes) {
+            qWarning() << "Warp grid refinement stopped at step" << step
+                       << "- measured error" << measured << "px exceeds tolerance" << tolerance;
+            break;
+        }
+        step = half;
+    }
+
+    GDALDestroyGenImgProjTransformer(exact);
+
+    qDebug() << "  Warp grid built:" << grid->nodesX << "x" << grid->nodesY << "nodes, step" << grid->step
+             << "px, max error" << grid->maxError << "px in" << timer.elapsed() << "ms";
+    return grid;
+}
+
+void WarpGridCache::evictLocked(size_t limit)
+{
+    while (m_usedBytes > limit && !m_lru.isEmpty()) {
+        QString key = m_lru.takeLast();
+        auto it = m_grids.find(key);
+        if (it != m_grids.end()) {
+            m_usedBytes -= it.value()->byteSize();
+            m_grids.erase(it);
+        }
+    }
+}
+
+void *createCachedGridTransformer(std::shared_ptr<const WarpGrid> grid,
+                                  GDALDataset *srcDS, GDALDataset *refDS,
+                                  int outWidth, int outHeight)
+{
+    return createCachedGridTransformer(std::move(grid), srcDS, refDS, 0.0, 0.0,
+                                       (double)refDS->GetRasterXSize() / outWidth,
+                                       (double)refDS->GetRasterYSize() / outHeight);
+}
+
+void *createCachedGridTransformer(std::shared_ptr<const WarpGrid> grid,
+                                  GDALDataset *srcDS, GDALDataset *refDS,
+                                  double refOffsetX, double refOffsetY,
+                                  double outToRefX, double outToRefY)
+{
+    auto *arg = new CachedGridTransformArg;
+    arg->grid = std::move(grid);
+    arg->srcDS = srcDS;
+    arg->refDS = refDS;
+    arg->refOffsetX = refOffsetX;
+    arg->refOffsetY = refOffsetY;
+    arg->outToRefX = outToRefX;
+    arg->outToRefY = outToRefY;
+    return arg;
+}
+
+void destroyCachedGridTransformer(void *transformArg)
+{
+    auto *arg = static_cast<CachedGridTransformArg *>(transformArg);
+    if (!arg) {
+        return;
+    }
+    if (arg->exactTransform) {
+        GDALDestroyGenImgProjTransformer(arg->exactTransform);
+    }
+    delete arg;
+}
+
+int cachedGridTransform(void *transformArg, int bDstToSrc, int nPointCount,
+                        double *x, double *y, double *z, int *panSuccess)
+{
+    auto *arg = static_cast<CachedGridTransformArg *>(transformArg);
+
+    if (!bDstToSrc) {
+        // src -> dst: raro nel warper, si usa il transformer esatto
+        if (!arg->exactTransform) {
+            arg->exactTransform = GDALCreateGenImgProjTransformer(arg->srcDS, arg->srcDS->GetProjectionRef(),
+                                                                  arg->refDS, arg->refDS->GetProjectionRef(),
+                                                                  FALSE, 0, 1);
+            if (!arg->exactTransform) {
+                for (int i = 0; i < nPointCount; ++i) panSuccess[i] = FALSE;
+                return FALSE;
+            }
+        }
+        int ok = GDALGenImgProjTransform(arg->exactTransform, FALSE, nPointCount, x, y, z, panSuccess);
+        for (int i = 0; i < nPointCount; ++i) {
+            if (panSuccess[i]) {
+                x[i] = (x[i] - arg->refOffsetX) / arg->outToRefX;
+                y[i] = (y[i] - arg->refOffsetY) / arg->outToRefY;
+            }
+        }
+        return ok;
+    }
+
+    int allOk = TRUE;
+    for (int i = 0; i < nPointCount; ++i) {
+        double srcX = 0.0;
+        double srcY = 0.0;
+        if (arg->grid->lookup(arg->refOffsetX + x[i] * arg->outToRefX, arg->refOffsetY + y[i] * arg->outToRefY,
+                              srcX, srcY)) {
+            x[i] = srcX;
+            y[i] = srcY;
+            panSuccess[i] = TRUE;
+        } else {
+            panSuccess[i] = FALSE;
+            allOk = FALSE;
+        }
+    }
+    return allOk;
+}
@@ -0,0 +1,82 @@
+#ifndef WARPGRIDCACHE_H
+#define WARPGRIDCACHE_H
+
+#include <QString>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <memory>
+#include <vector>
+
+// Forward declaration for GDAL
+class GDALDataset;
+
+// Coordinate sorgente (pixel) campionate sui nodi di una griglia regolare
+// sopra il raster di riferimento a piena risoluzione. Il passo è scelto in
+// modo che l'interpolazione bilineare resti entro la tolleranza richiesta.
+struct WarpGrid
+{
+    int step = 1;            // passo tra i nodi, in pixel di riferimento
+    int nodesX = 0;
+    int nodesY = 0;
+    double maxError = 0.0;   // errore massimo misurato, in pixel sorgente
+    std::vector<double> srcX;
+    std::vector<double> srcY;
+
+    // refX/refY in pixel di riferimento; false fuori griglia o su nodi non validi
+    bool lookup(double refX, double refY, double &outX, double &outY) const;
+    size_t byteSize() const;
+};
+
+// Cache LRU delle griglie di trasformazione per (CRS/geotransform sorgente,
+// griglia di riferimento). La griglia non dipende dalla dimensione di output,
+// quindi overlay ripetuti e livelli di zoom diversi la riusano.
+class WarpGridCache
+{
+public:
+    static WarpGridCache &instance();
+
+    std::shared_ptr<const WarpGrid> gridFor(GDALDataset *srcDS, GDALDataset *refDS);
+
+    // Tolleranza (distanza Manhattan in pixel sorgente), default 0.125 come gdalwarp
+    void setMaxError(double pixels);
+    double maxError() const;
+
+    void setCapacityBytes(size_t bytes);
+    size_t capacityBytes() const;
+    size_t usedBytes() const;
+    // Scarta le griglie meno recenti fino a stare in targetBytes (usato dal MemoryGovernor)
+    size_t trim(size_t targetBytes);
+    void clear();
+
+private:
+    WarpGridCache();
+
+    std::shared_ptr<WarpGrid> buildGrid(GDALDataset *srcDS, GDALDataset *refDS, double tolerance) const;
+    void evictLocked(size_t limit);
+
+    mutable QMutex m_mutex;
+    QHash<QString, std::shared_ptr<const WarpGrid>> m_grids;
+    QList<QString> m_lru;    // front = usata più di recente
+    size_t m_usedBytes;
+    size_t m_capacityBytes;
+    double m_maxError;
+};
+
+// Transformer compatibile con GDALTransformerFunc da passare al warper.
+// dst->src interpola la griglia in cache (coordinate di output ridotte),
+// src->dst usa il transformer esatto GenImgProj creato su richiesta.
+void *createCachedGridTransformer(std::shared_ptr<const WarpGrid> grid,
+                                  GDALDataset *srcDS, GDALDataset *refDS,
+                                  int outWidth, int outHeight);
+// Output come finestra della griglia di riferimento: pixel di riferimento =
+// refOffset + pixel di output * outToRef (tile del tile server su una griglia per zoom)
+void *createCachedGridTransformer(std::shared_ptr<const WarpGrid> grid,
+                                  GDALDataset *srcDS, GDALDataset *refDS,
+                                  double refOffsetX, double refOffsetY,
+                                  double outToRefX, double outToRefY);
+void destroyCachedGridTransformer(void *transformArg);
+int cachedGridTransform(void *transformArg, int bDstToSrc, int nPointCount,
+                        double *x, double *y, double *z, int *panSuccess);
+
+#endif // WARPGRIDCACHE_H